@@ -3,33 +3,273 @@
  * @brief SQLite extension for calculating sample and population variance and standard deviation.
  *
  * This extension provides `stddev`, `variance`, and their aliases as user-defined aggregate
- * and window functions. It is optimized for window function performance by using a circular
- * buffer to efficiently manage the sliding window of data.
+ * and window functions. The accumulation itself lives in the embeddable accumulator API
+ * (stddev-accumulator.h), whose O(1) add and remove keep sliding windows cheap. The frame's
+ * values are kept in a circular buffer so that the moments can be recomputed from them.
  */
 #include <math.h>
 #include <sqlite3ext.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "stddev-accumulator.h"
 
 SQLITE_EXTENSION_INIT1
 
+// Marks the extension entry points as exported even when the library is built with
+// hidden symbol visibility (as the CMake build does to let LTO drop unused code).
+#if defined(_WIN32)
+#define STDDEV_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#define STDDEV_API __attribute__((visibility("default")))
+#else
+#define STDDEV_API
+#endif
+
 // --- Configuration Constants for Statistics Calculation ---
 
 // The initial capacity for the dynamic arrays holding values.
 #define INITIAL_CAPACITY 100
 // The factor by which the capacity of arrays is increased when they become full.
 #define CAPACITY_GROWTH_FACTOR 2
+// Sliding moments are recomputed at once when a removal leaves less than this fraction
+// of M2, because the rounding error of the removal then dominates what is left.
+#define REMOVAL_CANCELLATION_LIMIT 1e-6
+
+// The default handling of TEXT and BLOB inputs (see StatsConfig).
+#define DEFAULT_INGEST_MODE INGEST_MODE_STRICT
 
 // --- End of Configuration Constants ---
 
+// --- Threads ---
+
+/**
+ * @brief Entry point of a thread started with stats_thread_start().
+ * @param arg The argument given to stats_thread_start().
+ */
+typedef void (*stats_thread_func)(void *arg);
+
+/**
+ * @struct StatsThreadStart
+ * @brief The function and argument handed to a new thread by the trampoline.
+ */
+typedef struct {
+    stats_thread_func func; // The thread body.
+    void *arg;              // Its argument.
+} StatsThreadStart;
+
+#ifdef _WIN32
+typedef HANDLE StatsThread;
+
+static DWORD WINAPI stats_thread_trampoline(LPVOID p) {
+    StatsThreadStart start = *(StatsThreadStart *)p;
+    free(p);
+    start.func(start.arg);
+    return 0;
+}
+#else
+typedef pthread_t StatsThread;
+
+static void *stats_thread_trampoline(void *p) {
+    StatsThreadStart start = *(StatsThreadStart *)p;
+    free(p);
+    start.func(start.arg);
+    return NULL;
+}
+#endif
+
+/**
+ * @brief Starts a native thread.
+ * @param thread Receives the thread handle.
+ * @param func The thread body.
+ * @param arg The argument passed to the thread body.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int stats_thread_start(StatsThread *thread, stats_thread_func func, void *arg) {
+    StatsThreadStart *start = (StatsThreadStart *)malloc(sizeof(StatsThreadStart));
+    if (!start)
+        return SQLITE_NOMEM;
+    start->func = func;
+    start->arg = arg;
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, stats_thread_trampoline, start, 0, NULL);
+    if (*thread != NULL)
+        return SQLITE_OK;
+#else
+    if (pthread_create(thread, NULL, stats_thread_trampoline, start) == 0)
+        return SQLITE_OK;
+#endif
+    free(start);
+    return SQLITE_ERROR;
+}
+
+/**
+ * @brief Waits for a thread started with stats_thread_start() to finish.
+ * @param thread The thread handle.
+ */
+static void stats_thread_join(StatsThread thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+/**
+ * @struct StatsSignal
+ * @brief A mutex with a condition variable, for producer/consumer hand-offs between threads.
+ */
+typedef struct {
+#ifdef _WIN32
+    CRITICAL_SECTION lock;   // The mutex.
+    CONDITION_VARIABLE cond; // Signalled on every state change.
+#else
+    pthread_mutex_t lock; // The mutex.
+    pthread_cond_t cond;  // Signalled on every state change.
+#endif
+} StatsSignal;
+
+/**
+ * @brief Initializes a signal.
+ * @param signal The signal.
+ * @return SQLITE_OK on success, or SQLITE_ERROR.
+ */
+static int stats_signal_init(StatsSignal *signal) {
+#ifdef _WIN32
+    InitializeCriticalSection(&signal->lock);
+    InitializeConditionVariable(&signal->cond);
+    return SQLITE_OK;
+#else
+    if (pthread_mutex_init(&signal->lock, NULL) != 0)
+        return SQLITE_ERROR;
+    if (pthread_cond_init(&signal->cond, NULL) != 0) {
+        pthread_mutex_destroy(&signal->lock);
+        return SQLITE_ERROR;
+    }
+    return SQLITE_OK;
+#endif
+}
+
+/**
+ * @brief Releases the resources of a signal initialized with stats_signal_init().
+ * @param signal The signal.
+ */
+static void stats_signal_destroy(StatsSignal *signal) {
+#ifdef _WIN32
+    DeleteCriticalSection(&signal->lock);
+#else
+    pthread_cond_destroy(&signal->cond);
+    pthread_mutex_destroy(&signal->lock);
+#endif
+}
+
+/**
+ * @brief Locks the mutex of a signal.
+ * @param signal The signal.
+ */
+static void stats_signal_lock(StatsSignal *signal) {
+#ifdef _WIN32
+    EnterCriticalSection(&signal->lock);
+#else
+    pthread_mutex_lock(&signal->lock);
+#endif
+}
+
+/**
+ * @brief Unlocks the mutex of a signal.
+ * @param signal The signal.
+ */
+static void stats_signal_unlock(StatsSignal *signal) {
+#ifdef _WIN32
+    LeaveCriticalSection(&signal->lock);
+#else
+    pthread_mutex_unlock(&signal->lock);
+#endif
+}
+
+/**
+ * @brief Waits for the signal to be broadcast; the caller holds the mutex.
+ * @param signal The signal.
+ */
+static void stats_signal_wait(StatsSignal *signal) {
+#ifdef _WIN32
+    SleepConditionVariableCS(&signal->cond, &signal->lock, INFINITE);
+#else
+    pthread_cond_wait(&signal->cond, &signal->lock);
+#endif
+}
+
+/**
+ * @brief Wakes all threads waiting on a signal.
+ * @param signal The signal.
+ */
+static void stats_signal_broadcast(StatsSignal *signal) {
+#ifdef _WIN32
+    WakeAllConditionVariable(&signal->cond);
+#else
+    pthread_cond_broadcast(&signal->cond);
+#endif
+}
+
+// --- Connection Configuration ---
+
+// Non-numeric inputs raise an "Invalid data type" error.
+#define INGEST_MODE_STRICT 0
+// Numeric-looking TEXT and BLOB inputs are converted, other non-numeric inputs are skipped.
+#define INGEST_MODE_LENIENT 1
+
+/**
+ * @struct StatsConfig
+ * @brief Per-connection settings and ingestion counters of the statistics functions.
+ *
+ * A single instance is created for each connection and passed as user data to every
+ * registered function. It is reference counted so that it is freed together with the
+ * last registration that uses it.
+ */
+typedef struct {
+    int ingest_mode;                // INGEST_MODE_STRICT or INGEST_MODE_LENIENT.
+    sqlite3_int64 coerced_count;    // TEXT/BLOB inputs converted to numbers in lenient mode.
+    sqlite3_int64 skipped_count;    // Non-numeric inputs skipped in lenient mode.
+    int ref_count;                  // Number of function registrations referencing this config.
+    struct DeferredWorker *workers; // Background delta-log workers started on this connection.
+} StatsConfig;
+
+static void stop_deferred_workers(StatsConfig *config);
+
+/**
+ * @brief Drops one reference to a StatsConfig, freeing it with the last one.
+ *
+ * Used as the xDestroy callback of every function registration.
+ * @param p The StatsConfig to release.
+ */
+static void release_stats_config(void *p) {
+    StatsConfig *config = (StatsConfig *)p;
+    if (config && --config->ref_count == 0) {
+        stop_deferred_workers(config);
+        free(config);
+    }
+}
+
 /**
  * @struct WindowStatsData
- * @brief Holds the statistical data for a window function's state.
+ * @brief A growable circular buffer of values.
  *
- * This structure maintains the state required for calculating running
- * statistics. It uses a circular buffer and keeps track of the sum and
- * sum of squares for efficient O(1) updates.
+ * Used by the functions that need the values of their frame (or of a fixed-size ring)
+ * rather than just their moments.
  */
 typedef struct {
     double *values; // Pointer to a dynamic array of values (circular buffer).
@@ -37,18 +277,32 @@ typedef struct {
     int capacity;   // The current allocated capacity of the `values` buffer.
     int head;       // Index of the oldest element (the "front" of the circular buffer).
     int tail;       // Index where the next new element will be inserted (the "back").
-    double sum;     // Running sum of all values in the buffer.
-    double sum_sq;  // Running sum of the squares of all values.
 } WindowStatsData;
 
+/**
+ * @brief Count, mean and sum of squared deviations (M2) of a set of values.
+ *
+ * This is the public stddev_accumulator (see stddev-accumulator.h), so the SQL functions
+ * and host code that links the accumulator API compute identical results. Unlike
+ * running sums, these moments can be merged and subtracted exactly (Chan et al.), which
+ * makes them suitable for summaries that are maintained from batches of added and
+ * removed values.
+ */
+typedef stddev_accumulator MomentsState;
+
 /**
  * @struct StatsWindowContext
  * @brief Wrapper structure for the statistics window function context.
  *
- * This is the structure that SQLite's aggregate context pointer will point to.
+ * This is the structure that SQLite's aggregate context pointer will point to. The
+ * values of the frame are kept so that the moments can be recomputed from them: values
+ * leaving the frame are removed in O(1), but each removal leaves rounding error behind.
  */
 typedef struct {
-    WindowStatsData data; // The statistical data and state.
+    WindowStatsData data; // The values in the frame, oldest first.
+    MomentsState moments; // Moments of the values in the frame.
+    int removals;         // Values removed since the moments were last recomputed.
+    int ingest_mode;      // Ingestion mode captured at the first step, so inverse calls agree with it.
 } StatsWindowContext;
 
 // --- Circular Buffer and Calculation Helper Functions ---
@@ -94,49 +348,46 @@ static double remove_from_circular_buffer(WindowStatsData *data) {
  *
  * This uses Bessel's correction, which is standard for estimating population
  * variance from a sample, making it an unbiased estimator.
- * @param data The window statistics data structure.
- * @return The calculated sample variance, or NAN if count < 2.
+ * @param m The moments of the values.
+ * @return The calculated sample variance, or NAN if n < 2.
  */
-static double calculate_variance_sample(WindowStatsData *data) {
-    if (data->count < 2)
-        return NAN;
-    double mean = data->sum / data->count;
-    // This is Welford's algorithm for variance, adapted for a full dataset.
-    double variance_pop = (data->sum_sq / data->count) - (mean * mean);
-    // Apply Bessel's correction for sample variance.
-    return variance_pop * ((double)data->count / (data->count - 1));
+static double calculate_variance_sample(const MomentsState *m) {
+    stddev_accumulator_result r;
+    stddev_accumulator_finalize(m, &r);
+    return r.variance_sample;
 }
 
 /**
  * @brief Calculate the population variance (using n in the denominator).
- * @param data The window statistics data structure.
- * @return The calculated population variance, or NAN if count < 1.
+ * @param m The moments of the values.
+ * @return The calculated population variance, or NAN if n < 1.
  */
-static double calculate_variance_population(WindowStatsData *data) {
-    if (data->count < 1)
-        return NAN;
-    double mean = data->sum / data->count;
-    return (data->sum_sq / data->count) - (mean * mean);
+static double calculate_variance_population(const MomentsState *m) {
+    stddev_accumulator_result r;
+    stddev_accumulator_finalize(m, &r);
+    return r.variance_population;
 }
 
 /**
  * @brief Calculate the sample standard deviation.
- * @param data The window statistics data structure.
+ * @param m The moments of the values.
  * @return The calculated sample standard deviation.
  */
-static double calculate_stddev_sample(WindowStatsData *data) {
-    double variance = calculate_variance_sample(data);
-    return isnan(variance) ? NAN : sqrt(variance);
+static double calculate_stddev_sample(const MomentsState *m) {
+    stddev_accumulator_result r;
+    stddev_accumulator_finalize(m, &r);
+    return r.stddev_sample;
 }
 
 /**
  * @brief Calculate the population standard deviation.
- * @param data The window statistics data structure.
+ * @param m The moments of the values.
  * @return The calculated population standard deviation.
  */
-static double calculate_stddev_population(WindowStatsData *data) {
-    double variance = calculate_variance_population(data);
-    return isnan(variance) ? NAN : sqrt(variance);
+static double calculate_stddev_population(const MomentsState *m) {
+    stddev_accumulator_result r;
+    stddev_accumulator_finalize(m, &r);
+    return r.stddev_population;
 }
 
 // --- Context Management and Result Handling ---
@@ -157,8 +408,6 @@ static int init_window_stats_data(sqlite3_context *context, WindowStatsData *dat
     data->count = 0;
     data->head = 0;
     data->tail = 0;
-    data->sum = 0.0;
-    data->sum_sq = 0.0;
     return SQLITE_OK;
 }
 
@@ -200,13 +449,171 @@ static void set_result(sqlite3_context *context, double result) {
     }
 }
 
+/**
+ * @brief Sets a timestamp held as a double as the result: INTEGER when it is integral
+ * (as epoch timestamps usually are), otherwise as set_result() does.
+ * @param context The SQLite function context.
+ * @param ts The timestamp.
+ */
+static void set_timestamp_result(sqlite3_context *context, double ts) {
+    if (ts >= -9007199254740992.0 && ts <= 9007199254740992.0 && ts == floor(ts))
+        sqlite3_result_int64(context, (sqlite3_int64)ts);
+    else
+        set_result(context, ts);
+}
+
+// --- Input Value Conversion ---
+
+// Outcomes of read_numeric_value().
+#define VALUE_NUMERIC 0 // An INTEGER or REAL value.
+#define VALUE_COERCED 1 // A numeric-looking TEXT or BLOB value converted in lenient mode.
+#define VALUE_NULL 2    // A NULL value, always ignored.
+#define VALUE_SKIPPED 3 // A non-numeric value ignored in lenient mode.
+#define VALUE_INVALID 4 // A non-numeric value in strict mode.
+
+// Outcomes of parse_numeric_text().
+#define NUMERIC_TEXT_NONE 0    // The text is not a number.
+#define NUMERIC_TEXT_EXACT 1   // The text is a number and was converted exactly.
+#define NUMERIC_TEXT_INEXACT 2 // The text is a number but needs a full-precision conversion.
+
+// Powers of ten that are exactly representable as doubles.
+static const double exact_powers_of_ten[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                             1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+/**
+ * @brief Checks for the ASCII whitespace characters SQLite accepts around numbers.
+ * @param c The character to check.
+ * @return Non-zero if the character is whitespace.
+ */
+static int is_ascii_space(unsigned char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v'; }
+
+/**
+ * @brief Parses a decimal number from a (not necessarily NUL-terminated) string.
+ *
+ * Accepts the same shape as SQLite's numeric affinity: optional surrounding whitespace,
+ * an optional sign, digits with an optional decimal point and an optional exponent.
+ * Numbers with at most 19 significant digits, a mantissa below 2^53 and a decimal
+ * exponent within +/-22 are converted exactly with a single multiplication or division
+ * (Clinger's fast path); anything longer is reported as NUMERIC_TEXT_INEXACT.
+ *
+ * @param z The characters to parse.
+ * @param n The number of characters.
+ * @param out Receives the value for NUMERIC_TEXT_EXACT.
+ * @return NUMERIC_TEXT_NONE, NUMERIC_TEXT_EXACT or NUMERIC_TEXT_INEXACT.
+ */
+static int parse_numeric_text(const unsigned char *z, int n, double *out) {
+    int i = 0;
+    while (i < n && is_ascii_space(z[i]))
+        i++;
+    while (n > i && is_ascii_space(z[n - 1]))
+        n--;
+    if (i == n)
+        return NUMERIC_TEXT_NONE;
+
+    int negative = 0;
+    if (z[i] == '+' || z[i] == '-') {
+        negative = z[i] == '-';
+        i++;
+    }
+
+    unsigned long long mantissa = 0;
+    int digits = 0;      // All digits seen in the integer and fraction parts.
+    int significant = 0; // Digits accumulated into the mantissa.
+    int truncated = 0;   // Whether non-zero digits were dropped from the mantissa.
+    int exponent = 0;    // Decimal exponent applied to the mantissa.
+
+    for (; i < n && z[i] >= '0' && z[i] <= '9'; i++, digits++) {
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (z[i] - '0');
+            if (mantissa != 0)
+                significant++;
+        } else {
+            exponent++;
+            truncated |= z[i] != '0';
+        }
+    }
+    if (i < n && z[i] == '.') {
+        for (i++; i < n && z[i] >= '0' && z[i] <= '9'; i++, digits++) {
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (z[i] - '0');
+                if (mantissa != 0)
+                    significant++;
+                exponent--;
+            } else {
+                truncated |= z[i] != '0';
+            }
+        }
+    }
+    if (digits == 0)
+        return NUMERIC_TEXT_NONE;
+
+    if (i < n && (z[i] == 'e' || z[i] == 'E')) {
+        int exponent_negative = 0;
+        int exponent_value = 0;
+        int exponent_digits = 0;
+        i++;
+        if (i < n && (z[i] == '+' || z[i] == '-')) {
+            exponent_negative = z[i] == '-';
+            i++;
+        }
+        for (; i < n && z[i] >= '0' && z[i] <= '9'; i++, exponent_digits++) {
+            if (exponent_value < 100000)
+                exponent_value = exponent_value * 10 + (z[i] - '0');
+        }
+        if (exponent_digits == 0)
+            return NUMERIC_TEXT_NONE;
+        exponent += exponent_negative ? -exponent_value : exponent_value;
+    }
+    if (i != n)
+        return NUMERIC_TEXT_NONE;
+
+    if (truncated || mantissa > (1ULL << 53) || exponent < -22 || exponent > 22)
+        return NUMERIC_TEXT_INEXACT;
+    double value = (double)mantissa;
+    value = exponent >= 0 ? value * exact_powers_of_ten[exponent] : value / exact_powers_of_ten[-exponent];
+    *out = negative ? -value : value;
+    return NUMERIC_TEXT_EXACT;
+}
+
+/**
+ * @brief Reads a function argument as a double according to the ingestion mode.
+ * @param arg The argument value.
+ * @param ingest_mode INGEST_MODE_STRICT or INGEST_MODE_LENIENT.
+ * @param out Receives the value for VALUE_NUMERIC and VALUE_COERCED.
+ * @return One of the VALUE_* outcomes.
+ */
+static int read_numeric_value(sqlite3_value *arg, int ingest_mode, double *out) {
+    int value_type = sqlite3_value_type(arg);
+    if (value_type == SQLITE_INTEGER || value_type == SQLITE_FLOAT) {
+        *out = sqlite3_value_double(arg);
+        return VALUE_NUMERIC;
+    }
+    if (value_type == SQLITE_NULL)
+        return VALUE_NULL;
+    if (ingest_mode != INGEST_MODE_LENIENT)
+        return VALUE_INVALID;
+
+    const unsigned char *z = value_type == SQLITE_TEXT ? sqlite3_value_text(arg) : (const unsigned char *)sqlite3_value_blob(arg);
+    int n = sqlite3_value_bytes(arg);
+    switch (parse_numeric_text(z, n, out)) {
+    case NUMERIC_TEXT_EXACT:
+        return VALUE_COERCED;
+    case NUMERIC_TEXT_INEXACT:
+        // Long or extreme numbers are left to SQLite's own correctly rounded conversion.
+        *out = sqlite3_value_double(arg);
+        return VALUE_COERCED;
+    default:
+        return VALUE_SKIPPED;
+    }
+}
+
 // --- UNIFIED CALLBACKS FOR AGGREGATE AND WINDOW FUNCTIONS ---
 
 /**
  * @brief The "step" function, called for each row in the aggregate or window frame.
  *
  * This function adds a new value to the statistical context. It handles context
- * initialization, buffer growth, and data type validation.
+ * initialization and data type validation.
  *
  * @param context The SQLite function context.
  * @param argc The number of arguments.
@@ -224,20 +631,29 @@ static void stats_step(sqlite3_context *context, int argc, sqlite3_value **argv)
         return;
     }
 
+    StatsConfig *config = (StatsConfig *)sqlite3_user_data(context);
+
     // Initialize context on the first call.
     if (ctx->data.values == NULL) {
         if (init_window_stats_data(context, &ctx->data) != SQLITE_OK)
             return;
+        ctx->ingest_mode = config->ingest_mode;
     }
 
     // Check the type of the incoming value.
-    int value_type = sqlite3_value_type(argv[0]);
-    if (value_type == SQLITE_NULL)
+    double value;
+    switch (read_numeric_value(argv[0], ctx->ingest_mode, &value)) {
+    case VALUE_NULL:
         return; // Ignore NULLs.
-
-    if (value_type != SQLITE_INTEGER && value_type != SQLITE_FLOAT) {
+    case VALUE_INVALID:
         sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
         return;
+    case VALUE_SKIPPED:
+        config->skipped_count++;
+        return;
+    case VALUE_COERCED:
+        config->coerced_count++;
+        break;
     }
 
     // Grow buffer if it is full.
@@ -247,15 +663,13 @@ static void stats_step(sqlite3_context *context, int argc, sqlite3_value **argv)
     }
 
     // Add the new value to the context.
-    double value = sqlite3_value_double(argv[0]);
     add_to_circular_buffer(&ctx->data, value);
-    ctx->data.sum += value;
-    ctx->data.sum_sq += value * value;
+    stddev_accumulator_add(&ctx->moments, value);
 }
 
 /**
  * @brief The "inverse" function, called when a row moves out of a window frame.
- * This removes the oldest value from the statistical context.
+ * This removes the value of the leaving row from the statistical context.
  * @param context The SQLite function context.
  * @param argc The number of arguments.
  * @param argv The argument values of the row leaving the window.
@@ -265,18 +679,30 @@ static void stats_inverse(sqlite3_context *context, int argc, sqlite3_value **ar
     if (!ctx || !ctx->data.values || ctx->data.count <= 0)
         return;
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+    // Values that were not added by stats_step() must not remove anything.
+    double value;
+    int status = read_numeric_value(argv[0], ctx->ingest_mode, &value);
+    if (status != VALUE_NUMERIC && status != VALUE_COERCED)
         return;
 
-    double removed_value = remove_from_circular_buffer(&ctx->data);
-    ctx->data.sum -= removed_value;
-    ctx->data.sum_sq -= removed_value * removed_value;
+    double m2 = ctx->moments.m2;
+    stddev_accumulator_remove(&ctx->moments, remove_from_circular_buffer(&ctx->data));
+
+    // Removals accumulate rounding drift; recompute the moments from the frame each time
+    // as many values as it holds have been removed, which is O(1) amortized, and right
+    // after a removal that cancelled nearly all of M2 (such as a spike leaving the frame).
+    if (++ctx->removals >= ctx->data.count || ctx->moments.m2 < m2 * REMOVAL_CANCELLATION_LIMIT) {
+        stddev_accumulator_init(&ctx->moments);
+        for (int i = 0; i < ctx->data.count; i++)
+            stddev_accumulator_add(&ctx->moments, get_circular_value(&ctx->data, i));
+        ctx->removals = 0;
+    }
 }
 
 // --- Value/Final Callback Helpers ---
 
 // A function pointer type for the statistical calculation functions.
-typedef double (*stats_func)(WindowStatsData *);
+typedef double (*stats_func)(const MomentsState *);
 
 /**
  * @brief Generic "value" function for statistical calculations.
@@ -286,11 +712,22 @@ typedef double (*stats_func)(WindowStatsData *);
  */
 static void stats_value_helper(sqlite3_context *context, stats_func func, int min_count) {
     StatsWindowContext *ctx = (StatsWindowContext *)sqlite3_aggregate_context(context, 0);
-    if (!ctx || !ctx->data.values || ctx->data.count < min_count) {
+    if (!ctx || ctx->moments.n < min_count) {
         sqlite3_result_null(context);
         return;
     }
-    set_result(context, func(&ctx->data));
+    set_result(context, func(&ctx->moments));
+}
+
+/**
+ * @brief Frees the value buffer of a statistics context.
+ * @param ctx The context, or NULL.
+ */
+static void free_stats_window_context(StatsWindowContext *ctx) {
+    if (ctx && ctx->data.values) {
+        free(ctx->data.values);
+        ctx->data.values = NULL;
+    }
 }
 
 /**
@@ -301,17 +738,8 @@ static void stats_value_helper(sqlite3_context *context, stats_func func, int mi
  * @param min_count The minimum number of data points required.
  */
 static void stats_final_helper(sqlite3_context *context, stats_func func, int min_count) {
-    StatsWindowContext *ctx = (StatsWindowContext *)sqlite3_aggregate_context(context, 0);
-    if (ctx && ctx->data.values && ctx->data.count >= min_count) {
-        set_result(context, func(&ctx->data));
-    } else {
-        sqlite3_result_null(context);
-    }
-    // Clean up memory for the aggregate context.
-    if (ctx && ctx->data.values) {
-        free(ctx->data.values);
-        ctx->data.values = NULL;
-    }
+    stats_value_helper(context, func, min_count);
+    free_stats_window_context((StatsWindowContext *)sqlite3_aggregate_context(context, 0));
 }
 
 // --- Specific Implementations for Value/Final Callbacks ---
@@ -326,89 +754,9276 @@ static void stddev_pop_final(sqlite3_context *context) { stats_final_helper(cont
 static void variance_samp_final(sqlite3_context *context) { stats_final_helper(context, calculate_variance_sample, 2); }
 static void variance_pop_final(sqlite3_context *context) { stats_final_helper(context, calculate_variance_population, 1); }
 
-// --- Extension Initialization ---
+// --- Mergeable Moments ---
+
+// MomentsState and its operations (add, remove, merge, subtract) are the accumulator API.
 
 /**
- * @struct StatsFunctionGroup
- * @brief Defines a group of related statistical functions to be registered.
- * This structure helps to reduce code duplication during function registration.
+ * @struct CoMomentsState
+ * @brief Count, means, sums of squared deviations and co-moment of paired values (x, y).
  */
 typedef struct {
-    const char **names;                // Array of function names/aliases.
-    int name_count;                    // Number of names in the array.
-    void (*xValue)(sqlite3_context *); // Pointer to the xValue function.
-    void (*xFinal)(sqlite3_context *); // Pointer to the xFinal function.
-} StatsFunctionGroup;
+    sqlite3_int64 n; // Number of pairs.
+    double mean_x;   // Mean of x.
+    double mean_y;   // Mean of y.
+    double m2_x;     // Sum of squared deviations of x.
+    double m2_y;     // Sum of squared deviations of y.
+    double c_xy;     // Sum of the products of the deviations of x and y.
+} CoMomentsState;
 
 /**
- * @brief Helper function to register a unified statistical function (lowercase and uppercase).
- * @param db The database connection.
- * @param name The name of the function to register.
- * @param xFinal The final function for aggregate mode.
- * @param xValue The value function for window mode.
- * @return SQLITE_OK on success, or an error code on failure.
+ * @brief Adds a pair to a co-moments state (the bivariate Welford update).
+ * @param m The co-moments state.
+ * @param x The first value.
+ * @param y The second value.
  */
-static int register_unified_stats_function(sqlite3 *db, const char *name, void (*xFinal)(sqlite3_context *), void (*xValue)(sqlite3_context *)) {
-    int rc;
-    // Register the lowercase version.
-    rc = sqlite3_create_window_function(db, name, 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, 0, stats_step, xFinal, xValue, stats_inverse, NULL);
-    if (rc != SQLITE_OK)
-        return rc;
+static void co_moments_add(CoMomentsState *m, double x, double y) {
+    m->n++;
+    double dx = x - m->mean_x;
+    double dy = y - m->mean_y;
+    m->mean_x += dx / m->n;
+    m->mean_y += dy / m->n;
+    m->m2_x += dx * (x - m->mean_x);
+    m->m2_y += dy * (y - m->mean_y);
+    m->c_xy += dx * (y - m->mean_y);
+}
 
-    // Create and register the uppercase version.
-    char *upper_name = malloc(strlen(name) + 1);
-    if (!upper_name)
-        return SQLITE_NOMEM;
-    strcpy(upper_name, name);
-    for (int i = 0; upper_name[i]; i++) {
-        if (upper_name[i] >= 'a' && upper_name[i] <= 'z') {
-            upper_name[i] = upper_name[i] - 'a' + 'A';
-        }
+/**
+ * @brief Removes a previously added pair from a co-moments state (inverse of co_moments_add()).
+ * @param m The co-moments state.
+ * @param x The first value to remove.
+ * @param y The second value to remove.
+ */
+static void co_moments_remove(CoMomentsState *m, double x, double y) {
+    if (m->n <= 1) {
+        memset(m, 0, sizeof(*m));
+        return;
     }
-
-    rc = sqlite3_create_window_function(db, upper_name, 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS, 0, stats_step, xFinal, xValue, stats_inverse, NULL);
-    free(upper_name);
-    return rc;
+    double old_mean_x = m->mean_x, old_mean_y = m->mean_y;
+    m->n--;
+    m->mean_x = (old_mean_x * (m->n + 1) - x) / m->n;
+    m->mean_y = (old_mean_y * (m->n + 1) - y) / m->n;
+    m->m2_x -= (x - old_mean_x) * (x - m->mean_x);
+    m->m2_y -= (y - old_mean_y) * (y - m->mean_y);
+    m->c_xy -= (x - m->mean_x) * (y - old_mean_y);
+    // Guard against rounding below zero.
+    if (m->m2_x < 0.0)
+        m->m2_x = 0.0;
+    if (m->m2_y < 0.0)
+        m->m2_y = 0.0;
 }
 
+// --- Group Keys and Hash Map ---
+
 /**
- * @brief The main entry point for the SQLite extension.
+ * @struct StatsKey
+ * @brief A view of a single SQL value, used as a grouping key.
  *
- * This function is called by SQLite when the extension is loaded. It registers
- * all the custom statistical functions and their aliases.
+ * TEXT and BLOB keys point to memory owned by someone else until they are copied
+ * into a GroupMap.
+ */
+typedef struct {
+    int type;                // SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL.
+    sqlite3_int64 i;         // The value of an INTEGER key.
+    double r;                // The value of a FLOAT key.
+    const unsigned char *z;  // The bytes of a TEXT or BLOB key.
+    int n;                   // The number of bytes of a TEXT or BLOB key.
+} StatsKey;
+
+/**
+ * @struct GroupMapEntry
+ * @brief An entry of a GroupMap; the zero-initialized payload follows the structure.
+ */
+typedef struct GroupMapEntry {
+    struct GroupMapEntry *next;       // Next entry in the same bucket.
+    struct GroupMapEntry *next_added; // Next entry in insertion order.
+    unsigned int hash;                // Hash of the key.
+    StatsKey key;                     // The key; TEXT/BLOB bytes are stored after the payload.
+} GroupMapEntry;
+
+/**
+ * @struct GroupMap
+ * @brief A hash map from StatsKey to fixed-size payloads, iterable in insertion order.
+ */
+typedef struct {
+    GroupMapEntry **buckets; // Bucket array, NULL until the first insertion.
+    int bucket_count;        // Number of buckets (a power of two).
+    int count;               // Number of entries.
+    size_t payload_size;     // Size of the payload stored with each entry.
+    GroupMapEntry *first;    // First entry in insertion order.
+    GroupMapEntry *last;     // Last entry in insertion order.
+} GroupMap;
+
+// The initial number of buckets of a GroupMap.
+#define GROUP_MAP_INITIAL_BUCKETS 64
+
+// Rounds a payload size up so the key bytes that follow it stay aligned.
+#define GROUP_MAP_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+/**
+ * @brief Returns the payload stored with a GroupMap entry.
+ * @param entry The entry.
+ * @return Pointer to the payload.
+ */
+static void *group_map_payload(GroupMapEntry *entry) { return (void *)(entry + 1); }
+
+/**
+ * @brief Keys REAL values that hold an exact 64-bit integer as INTEGER.
  *
- * @param db The database connection.
- * @param pzErrMsg A pointer to an error message string.
- * @param pApi A pointer to the SQLite API routines.
+ * This makes `1` and `1.0` fall into the same group, as they do with GROUP BY.
+ * @param key The key to normalize.
+ */
+static void stats_key_normalize(StatsKey *key) {
+    if (key->type == SQLITE_FLOAT && key->r >= -9223372036854775808.0 && key->r < 9223372036854775808.0 && key->r == (double)(sqlite3_int64)key->r) {
+        key->type = SQLITE_INTEGER;
+        key->i = (sqlite3_int64)key->r;
+    }
+}
+
+/**
+ * @brief Reads a SQL value as a normalized StatsKey without copying it.
+ * @param value The SQL value.
+ * @param key Receives the key.
+ */
+static void stats_key_from_value(sqlite3_value *value, StatsKey *key) {
+    memset(key, 0, sizeof(*key));
+    key->type = sqlite3_value_type(value);
+    switch (key->type) {
+    case SQLITE_INTEGER:
+        key->i = sqlite3_value_int64(value);
+        break;
+    case SQLITE_FLOAT:
+        key->r = sqlite3_value_double(value);
+        break;
+    case SQLITE_TEXT:
+        key->z = sqlite3_value_text(value);
+        key->n = sqlite3_value_bytes(value);
+        break;
+    case SQLITE_BLOB:
+        key->z = (const unsigned char *)sqlite3_value_blob(value);
+        key->n = sqlite3_value_bytes(value);
+        break;
+    }
+    stats_key_normalize(key);
+}
+
+/**
+ * @brief Binds a StatsKey to a statement parameter.
+ * @param stmt The prepared statement.
+ * @param index The 1-based parameter index.
+ * @param key The key to bind.
  * @return SQLITE_OK on success, or an error code on failure.
  */
-int sqlite3_extension_init(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi) {
-    int rc = SQLITE_OK;
-    SQLITE_EXTENSION_INIT2(pApi);
+static int bind_stats_key(sqlite3_stmt *stmt, int index, const StatsKey *key) {
+    switch (key->type) {
+    case SQLITE_INTEGER:
+        return sqlite3_bind_int64(stmt, index, key->i);
+    case SQLITE_FLOAT:
+        return sqlite3_bind_double(stmt, index, key->r);
+    case SQLITE_TEXT:
+        return sqlite3_bind_text(stmt, index, (const char *)key->z, key->n, SQLITE_TRANSIENT);
+    case SQLITE_BLOB:
+        return sqlite3_bind_blob(stmt, index, key->z, key->n, SQLITE_TRANSIENT);
+    default:
+        return sqlite3_bind_null(stmt, index);
+    }
+}
 
-    // Define the names and aliases for each statistical function.
-    const char *stddev_samp_names[] = {"stddev_samp", "stddev_sample", "stdev_samp", "stdev_sample", "stddev", "stdev", "std_dev", "standard_deviation"};
-    const char *stddev_pop_names[] = {"stddev_pop", "stddev_population", "stdev_pop", "stdev_population"};
-    const char *variance_samp_names[] = {"variance_samp", "variance_sample", "var_samp", "var_sample", "variance", "var"};
-    const char *variance_pop_names[] = {"variance_pop", "variance_population", "var_pop", "var_population"};
+/**
+ * @brief Sets a StatsKey as the result of a function or virtual-table column.
+ * @param context The SQLite function context.
+ * @param key The key.
+ */
+static void result_stats_key(sqlite3_context *context, const StatsKey *key) {
+    switch (key->type) {
+    case SQLITE_INTEGER:
+        sqlite3_result_int64(context, key->i);
+        break;
+    case SQLITE_FLOAT:
+        sqlite3_result_double(context, key->r);
+        break;
+    case SQLITE_TEXT:
+        sqlite3_result_text(context, (const char *)key->z, key->n, SQLITE_TRANSIENT);
+        break;
+    case SQLITE_BLOB:
+        sqlite3_result_blob(context, key->z, key->n, SQLITE_TRANSIENT);
+        break;
+    default:
+        sqlite3_result_null(context);
+    }
+}
 
-    // Define the groups of functions to be registered.
-    StatsFunctionGroup functions_to_register[] = {
-        {stddev_samp_names, sizeof(stddev_samp_names) / sizeof(stddev_samp_names[0]), stddev_samp_value, stddev_samp_final},
-        {stddev_pop_names, sizeof(stddev_pop_names) / sizeof(stddev_pop_names[0]), stddev_pop_value, stddev_pop_final},
-        {variance_samp_names, sizeof(variance_samp_names) / sizeof(variance_samp_names[0]), variance_samp_value, variance_samp_final},
-        {variance_pop_names, sizeof(variance_pop_names) / sizeof(variance_pop_names[0]), variance_pop_value, variance_pop_final}};
+/**
+ * @brief Hashes a StatsKey (FNV-1a over the type and the value bytes).
+ * @param key The key.
+ * @return The hash.
+ */
+static unsigned int stats_key_hash(const StatsKey *key) {
+    unsigned int hash = 2166136261u ^ (unsigned int)key->type;
+    const unsigned char *bytes = NULL;
+    size_t size = 0;
+    if (key->type == SQLITE_INTEGER) {
+        bytes = (const unsigned char *)&key->i;
+        size = sizeof(key->i);
+    } else if (key->type == SQLITE_FLOAT) {
+        bytes = (const unsigned char *)&key->r;
+        size = sizeof(key->r);
+    } else if (key->type == SQLITE_TEXT || key->type == SQLITE_BLOB) {
+        bytes = key->z;
+        size = (size_t)key->n;
+    }
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
 
-    // Iterate through the groups and register each function and its aliases.
-    int num_groups = sizeof(functions_to_register) / sizeof(functions_to_register[0]);
-    for (int i = 0; i < num_groups; i++) {
-        StatsFunctionGroup *group = &functions_to_register[i];
-        for (int j = 0; j < group->name_count; j++) {
-            rc = register_unified_stats_function(db, group->names[j], group->xFinal, group->xValue);
-            if (rc != SQLITE_OK)
-                return rc;
-        }
+/**
+ * @brief Checks two StatsKeys for equality.
+ * @param a The first key.
+ * @param b The second key.
+ * @return Non-zero if the keys are equal.
+ */
+static int stats_key_equal(const StatsKey *a, const StatsKey *b) {
+    if (a->type != b->type)
+        return 0;
+    switch (a->type) {
+    case SQLITE_INTEGER:
+        return a->i == b->i;
+    case SQLITE_FLOAT:
+        return a->r == b->r;
+    case SQLITE_TEXT:
+    case SQLITE_BLOB:
+        return a->n == b->n && (a->n == 0 || memcmp(a->z, b->z, a->n) == 0);
+    default:
+        return 1;
     }
+}
 
-    return rc;
+/**
+ * @brief Compares two StatsKeys in SQLite's sort order with the BINARY collation.
+ *
+ * NULL sorts first, then numbers (INTEGER and REAL compared by value), then TEXT,
+ * then BLOB.
+ * @param a The first key.
+ * @param b The second key.
+ * @return A negative, zero or positive value as `a` sorts before, equal to or after `b`.
+ */
+static int stats_key_compare(const StatsKey *a, const StatsKey *b) {
+    int class_a = a->type == SQLITE_NULL ? 0 : a->type == SQLITE_TEXT ? 2 : a->type == SQLITE_BLOB ? 3 : 1;
+    int class_b = b->type == SQLITE_NULL ? 0 : b->type == SQLITE_TEXT ? 2 : b->type == SQLITE_BLOB ? 3 : 1;
+    if (class_a != class_b)
+        return class_a - class_b;
+    if (class_a == 0)
+        return 0;
+    if (class_a == 1) {
+        if (a->type == SQLITE_INTEGER && b->type == SQLITE_INTEGER)
+            return a->i < b->i ? -1 : a->i > b->i;
+        double x = a->type == SQLITE_INTEGER ? (double)a->i : a->r;
+        double y = b->type == SQLITE_INTEGER ? (double)b->i : b->r;
+        return x < y ? -1 : x > y;
+    }
+    int common = a->n < b->n ? a->n : b->n;
+    int rc = common > 0 ? memcmp(a->z, b->z, common) : 0;
+    return rc != 0 ? rc : a->n - b->n;
+}
+
+/**
+ * @brief Initializes an empty GroupMap.
+ * @param map The map to initialize.
+ * @param payload_size The size of the payload stored with each key.
+ */
+static void group_map_init(GroupMap *map, size_t payload_size) {
+    memset(map, 0, sizeof(*map));
+    map->payload_size = GROUP_MAP_ALIGN(payload_size);
+}
+
+/**
+ * @brief Frees all entries of a GroupMap, leaving it empty.
+ * @param map The map to free.
+ */
+static void group_map_free(GroupMap *map) {
+    GroupMapEntry *entry = map->first;
+    while (entry) {
+        GroupMapEntry *next = entry->next_added;
+        free(entry);
+        entry = next;
+    }
+    free(map->buckets);
+    group_map_init(map, map->payload_size);
+}
+
+/**
+ * @brief Doubles the number of buckets of a GroupMap.
+ * @param map The map to grow.
+ * @return SQLITE_OK on success, SQLITE_NOMEM on memory allocation failure.
+ */
+static int grow_group_map(GroupMap *map) {
+    int new_count = map->bucket_count ? map->bucket_count * 2 : GROUP_MAP_INITIAL_BUCKETS;
+    GroupMapEntry **new_buckets = (GroupMapEntry **)calloc(new_count, sizeof(GroupMapEntry *));
+    if (!new_buckets)
+        return SQLITE_NOMEM;
+    for (GroupMapEntry *entry = map->first; entry; entry = entry->next_added) {
+        unsigned int slot = entry->hash & (new_count - 1);
+        entry->next = new_buckets[slot];
+        new_buckets[slot] = entry;
+    }
+    free(map->buckets);
+    map->buckets = new_buckets;
+    map->bucket_count = new_count;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Finds the payload of a key, optionally inserting the key.
+ * @param map The map.
+ * @param key The key to look up. TEXT/BLOB bytes are copied on insertion.
+ * @param create Whether to insert the key (with a zeroed payload) if it is missing.
+ * @return The payload, or NULL if the key is missing (or on allocation failure when creating).
+ */
+static void *group_map_lookup(GroupMap *map, const StatsKey *key, int create) {
+    unsigned int hash = stats_key_hash(key);
+    if (map->buckets) {
+        for (GroupMapEntry *entry = map->buckets[hash & (map->bucket_count - 1)]; entry; entry = entry->next) {
+            if (entry->hash == hash && stats_key_equal(&entry->key, key))
+                return group_map_payload(entry);
+        }
+    }
+    if (!create)
+        return NULL;
+    if (map->count >= map->bucket_count && grow_group_map(map) != SQLITE_OK)
+        return NULL;
+
+    int key_bytes = (key->type == SQLITE_TEXT || key->type == SQLITE_BLOB) ? key->n : 0;
+    GroupMapEntry *entry = (GroupMapEntry *)malloc(sizeof(GroupMapEntry) + map->payload_size + key_bytes + 1);
+    if (!entry)
+        return NULL;
+    memset(entry, 0, sizeof(GroupMapEntry) + map->payload_size);
+    entry->hash = hash;
+    entry->key = *key;
+    if (key->type == SQLITE_TEXT || key->type == SQLITE_BLOB) {
+        unsigned char *copy = (unsigned char *)group_map_payload(entry) + map->payload_size;
+        if (key_bytes > 0)
+            memcpy(copy, key->z, key_bytes);
+        copy[key_bytes] = 0;
+        entry->key.z = copy;
+    }
+
+    unsigned int slot = hash & (map->bucket_count - 1);
+    entry->next = map->buckets[slot];
+    map->buckets[slot] = entry;
+    if (map->last)
+        map->last->next_added = entry;
+    else
+        map->first = entry;
+    map->last = entry;
+    map->count++;
+    return group_map_payload(entry);
+}
+
+// --- Probability Distributions ---
+
+// Convergence limits of the continued fraction in regularized_incomplete_beta().
+#define BETA_CF_MAX_ITERATIONS 300
+#define BETA_CF_EPSILON 1e-15
+
+/**
+ * @brief Evaluates the continued fraction of the incomplete beta function (modified Lentz method).
+ * @param a The first shape parameter.
+ * @param b The second shape parameter.
+ * @param x The point, in [0, 1].
+ * @return The value of the continued fraction.
+ */
+static double incomplete_beta_fraction(double a, double b, double x) {
+    const double tiny = 1e-300;
+    double c = 1.0;
+    double d = 1.0 - (a + b) * x / (a + 1.0);
+    d = 1.0 / (fabs(d) < tiny ? tiny : d);
+    double h = d;
+    for (int m = 1; m <= BETA_CF_MAX_ITERATIONS; m++) {
+        double m2 = 2.0 * m;
+        double numerator = m * (b - m) * x / ((a + m2 - 1.0) * (a + m2));
+        d = 1.0 + numerator * d;
+        c = 1.0 + numerator / c;
+        d = 1.0 / (fabs(d) < tiny ? tiny : d);
+        c = fabs(c) < tiny ? tiny : c;
+        h *= d * c;
+        numerator = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1.0));
+        d = 1.0 + numerator * d;
+        c = 1.0 + numerator / c;
+        d = 1.0 / (fabs(d) < tiny ? tiny : d);
+        c = fabs(c) < tiny ? tiny : c;
+        double delta = d * c;
+        h *= delta;
+        if (fabs(delta - 1.0) < BETA_CF_EPSILON)
+            break;
+    }
+    return h;
+}
+
+/**
+ * @brief The regularized incomplete beta function I_x(a, b).
+ * @param a The first shape parameter (> 0).
+ * @param b The second shape parameter (> 0).
+ * @param x The point.
+ * @return I_x(a, b), or NAN for invalid parameters.
+ */
+static double regularized_incomplete_beta(double a, double b, double x) {
+    if (!(a > 0.0) || !(b > 0.0) || isnan(x))
+        return NAN;
+    if (x <= 0.0)
+        return 0.0;
+    if (x >= 1.0)
+        return 1.0;
+    double log_front = lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log1p(-x);
+    // The continued fraction converges quickly on this side of the mean; use symmetry otherwise.
+    if (x < (a + 1.0) / (a + b + 2.0))
+        return exp(log_front) * incomplete_beta_fraction(a, b, x) / a;
+    return 1.0 - exp(log_front) * incomplete_beta_fraction(b, a, 1.0 - x) / b;
+}
+
+/**
+ * @brief Two-sided p-value of a Student t statistic.
+ * @param t The t statistic.
+ * @param df The degrees of freedom (may be fractional).
+ * @return P(|T| >= |t|), or NAN for invalid input.
+ */
+static double student_t_two_sided_p(double t, double df) {
+    if (isnan(t) || !(df > 0.0))
+        return NAN;
+    if (isinf(t))
+        return 0.0;
+    return regularized_incomplete_beta(df / 2.0, 0.5, df / (df + t * t));
+}
+
+/**
+ * @brief The standard normal cumulative distribution function.
+ * @param z The point.
+ * @return P(Z <= z).
+ */
+static double normal_cdf(double z) { return 0.5 * erfc(-z / sqrt(2.0)); }
+
+/**
+ * @brief The standard normal quantile function (inverse of normal_cdf()).
+ *
+ * Acklam's rational approximation refined by one Halley step, which gives nearly full
+ * double precision.
+ * @param p The probability, in (0, 1).
+ * @return z with P(Z <= z) = p, or NAN outside (0, 1).
+ */
+static double normal_quantile(double p) {
+    static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                               1.383577518672690e+02,  -3.066479806614716e+01, 2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02, 6.680131188771972e+01,
+                               -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                               -2.549732539343734e+00, 4.374664141464968e+00,  2.938163982698783e+00};
+    static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00, 3.754408661907416e+00};
+    if (!(p > 0.0 && p < 1.0))
+        return NAN;
+    double z;
+    if (p < 0.02425 || p > 1.0 - 0.02425) {
+        double q = sqrt(-2.0 * log(p < 0.5 ? p : 1.0 - p));
+        z = (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1.0);
+        if (p > 0.5)
+            z = -z;
+    } else {
+        double q = p - 0.5, r = q * q;
+        z = (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+            (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1.0);
+    }
+    double e = normal_cdf(z) - p;
+    double u = e * sqrt(2.0 * 3.14159265358979323846) * exp(0.5 * z * z);
+    return z - u / (1.0 + 0.5 * z * u);
+}
+
+/**
+ * @brief The digamma function psi(x), the derivative of lgamma.
+ * @param x The point (> 0).
+ * @return psi(x).
+ */
+static double digamma(double x) {
+    double result = 0.0;
+    // Shift into the range of the asymptotic series with psi(x) = psi(x + 1) - 1 / x.
+    while (x < 6.0) {
+        result -= 1.0 / x;
+        x += 1.0;
+    }
+    double inv2 = 1.0 / (x * x);
+    return result + log(x) - 0.5 / x -
+           inv2 * (1.0 / 12.0 - inv2 * (1.0 / 120.0 - inv2 * (1.0 / 252.0 - inv2 * (1.0 / 240.0 - inv2 * (1.0 / 132.0)))));
+}
+
+/**
+ * @brief The trigamma function psi'(x), the derivative of digamma.
+ * @param x The point (> 0).
+ * @return psi'(x).
+ */
+static double trigamma(double x) {
+    double result = 0.0;
+    // Shift into the range of the asymptotic series with psi'(x) = psi'(x + 1) + 1 / x^2.
+    while (x < 6.0) {
+        result += 1.0 / (x * x);
+        x += 1.0;
+    }
+    double inv = 1.0 / x, inv2 = inv * inv;
+    return result + inv + 0.5 * inv2 + inv * inv2 * (1.0 / 6.0 - inv2 * (1.0 / 30.0 - inv2 * (1.0 / 42.0 - inv2 * (1.0 / 30.0))));
+}
+
+// --- JSON Results ---
+
+/**
+ * @brief Appends the separator needed before the next member of a JSON object or array.
+ * @param json The JSON text under construction.
+ */
+static void json_append_separator(sqlite3_str *json) {
+    int length = sqlite3_str_length(json);
+    char last = length > 0 ? sqlite3_str_value(json)[length - 1] : '{';
+    if (last != '{' && last != '[' && last != ':')
+        sqlite3_str_appendchar(json, 1, ',');
+}
+
+/**
+ * @brief Appends a number to a JSON object or array; NAN and INF become `null`.
+ * @param json The JSON text under construction.
+ * @param key The member name, or NULL inside an array.
+ * @param value The number.
+ */
+static void json_append_double(sqlite3_str *json, const char *key, double value) {
+    json_append_separator(json);
+    if (key)
+        sqlite3_str_appendf(json, "\"%s\":", key);
+    if (isnan(value) || isinf(value))
+        sqlite3_str_appendall(json, "null");
+    else
+        sqlite3_str_appendf(json, "%!.15g", value);
+}
+
+/**
+ * @brief Appends an integer to a JSON object or array.
+ * @param json The JSON text under construction.
+ * @param key The member name, or NULL inside an array.
+ * @param value The integer.
+ */
+static void json_append_int(sqlite3_str *json, const char *key, sqlite3_int64 value) {
+    json_append_separator(json);
+    if (key)
+        sqlite3_str_appendf(json, "\"%s\":", key);
+    sqlite3_str_appendf(json, "%lld", value);
+}
+
+/**
+ * @brief Sets a JSON text under construction as the function result and frees it.
+ * @param context The SQLite function context.
+ * @param json The JSON text.
+ */
+static void json_result(sqlite3_context *context, sqlite3_str *json) {
+    int rc = sqlite3_str_errcode(json);
+    char *text = sqlite3_str_finish(json);
+    if (rc != SQLITE_OK || !text) {
+        sqlite3_free(text);
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    sqlite3_result_text(context, text, -1, sqlite3_free);
+}
+
+// --- Configuration Functions ---
+
+/**
+ * @brief Implements `stats_config(key [, value])`, which reads or changes a connection setting.
+ *
+ * The only key is `ingest_mode`, with the values `strict` (the default: non-numeric
+ * inputs raise an error) and `lenient` (numeric-looking TEXT/BLOB inputs are converted,
+ * other non-numeric inputs are skipped and counted). The mode is captured by each
+ * aggregate or window context when it receives its first row. Returns the setting's
+ * current value.
+ *
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (1 or 2).
+ * @param argv The argument values.
+ */
+static void stats_config_func(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    StatsConfig *config = (StatsConfig *)sqlite3_user_data(context);
+    const char *key = (const char *)sqlite3_value_text(argv[0]);
+    if (!key || sqlite3_stricmp(key, "ingest_mode") != 0) {
+        sqlite3_result_error(context, "Unknown stats_config key, expected 'ingest_mode'.", -1);
+        return;
+    }
+
+    if (argc == 2) {
+        const char *mode = (const char *)sqlite3_value_text(argv[1]);
+        if (mode && sqlite3_stricmp(mode, "strict") == 0) {
+            config->ingest_mode = INGEST_MODE_STRICT;
+        } else if (mode && sqlite3_stricmp(mode, "lenient") == 0) {
+            config->ingest_mode = INGEST_MODE_LENIENT;
+        } else {
+            sqlite3_result_error(context, "Invalid ingest_mode, expected 'strict' or 'lenient'.", -1);
+            return;
+        }
+    }
+    sqlite3_result_text(context, config->ingest_mode == INGEST_MODE_LENIENT ? "lenient" : "strict", -1, SQLITE_STATIC);
+}
+
+/**
+ * @brief Implements `stats_ingest_counts([reset])`.
+ *
+ * Returns the number of coerced and skipped inputs seen in lenient mode on this
+ * connection as a JSON object, e.g. `{"coerced":12,"skipped":3}`. A true `reset`
+ * argument clears the counters after reading them.
+ *
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (0 or 1).
+ * @param argv The argument values.
+ */
+static void stats_ingest_counts_func(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    StatsConfig *config = (StatsConfig *)sqlite3_user_data(context);
+    char *json = sqlite3_mprintf("{\"coerced\":%lld,\"skipped\":%lld}", config->coerced_count, config->skipped_count);
+    if (!json) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    sqlite3_result_text(context, json, -1, sqlite3_free);
+    if (argc == 1 && sqlite3_value_int(argv[0])) {
+        config->coerced_count = 0;
+        config->skipped_count = 0;
+    }
+}
+
+// --- Changeset-Driven Summary Refresh ---
+
+// Value type of a column that is not part of a change (the other types match SQLITE_INTEGER etc.).
+#define CHANGESET_UNDEFINED 0
+// First byte of a table header in a changeset and in a patchset.
+#define CHANGESET_TABLE_HEADER 'T'
+#define PATCHSET_TABLE_HEADER 'P'
+
+/**
+ * @struct MomentsDelta
+ * @brief The values added to and removed from one group, coalesced into moments.
+ */
+typedef struct {
+    MomentsState added;   // Moments of the values added to the group.
+    MomentsState removed; // Moments of the values removed from the group.
+} MomentsDelta;
+
+/**
+ * @struct ChangesetReader
+ * @brief A cursor over the binary changeset format produced by the session extension.
+ */
+typedef struct {
+    const unsigned char *data; // The changeset bytes.
+    int size;                  // The number of bytes.
+    int offset;                // The read position.
+} ChangesetReader;
+
+/**
+ * @brief Reads an SQLite varint from a changeset.
+ * @param reader The changeset reader.
+ * @param out Receives the value.
+ * @return SQLITE_OK on success, SQLITE_CORRUPT if the changeset ends early.
+ */
+static int changeset_read_varint(ChangesetReader *reader, sqlite3_int64 *out) {
+    unsigned long long value = 0;
+    for (int i = 0; i < 9; i++) {
+        if (reader->offset >= reader->size)
+            return SQLITE_CORRUPT;
+        unsigned char byte = reader->data[reader->offset++];
+        if (i == 8) {
+            value = (value << 8) | byte;
+            break;
+        }
+        value = (value << 7) | (byte & 0x7f);
+        if (!(byte & 0x80))
+            break;
+    }
+    *out = (sqlite3_int64)value;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Reads one serialized value of a changeset record.
+ * @param reader The changeset reader.
+ * @param value Receives the value; TEXT/BLOB values point into the changeset.
+ * @return SQLITE_OK on success, SQLITE_CORRUPT on malformed input.
+ */
+static int changeset_read_value(ChangesetReader *reader, StatsKey *value) {
+    if (reader->offset >= reader->size)
+        return SQLITE_CORRUPT;
+    memset(value, 0, sizeof(*value));
+    value->type = reader->data[reader->offset++];
+    switch (value->type) {
+    case CHANGESET_UNDEFINED:
+    case SQLITE_NULL:
+        return SQLITE_OK;
+    case SQLITE_INTEGER:
+    case SQLITE_FLOAT: {
+        if (reader->size - reader->offset < 8)
+            return SQLITE_CORRUPT;
+        unsigned long long bits = 0;
+        for (int i = 0; i < 8; i++)
+            bits = (bits << 8) | reader->data[reader->offset++];
+        if (value->type == SQLITE_INTEGER)
+            value->i = (sqlite3_int64)bits;
+        else
+            memcpy(&value->r, &bits, sizeof(value->r));
+        return SQLITE_OK;
+    }
+    case SQLITE_TEXT:
+    case SQLITE_BLOB: {
+        sqlite3_int64 length;
+        if (changeset_read_varint(reader, &length) != SQLITE_OK || length < 0 || length > reader->size - reader->offset)
+            return SQLITE_CORRUPT;
+        value->z = reader->data + reader->offset;
+        value->n = (int)length;
+        reader->offset += (int)length;
+        return SQLITE_OK;
+    }
+    default:
+        return SQLITE_CORRUPT;
+    }
+}
+
+/**
+ * @brief Reads the values of all columns of a changeset record.
+ * @param reader The changeset reader.
+ * @param values Receives the values.
+ * @param column_count The number of columns of the table.
+ * @return SQLITE_OK on success, SQLITE_CORRUPT on malformed input.
+ */
+static int changeset_read_record(ChangesetReader *reader, StatsKey *values, int column_count) {
+    for (int i = 0; i < column_count; i++) {
+        int rc = changeset_read_value(reader, &values[i]);
+        if (rc != SQLITE_OK)
+            return rc;
+    }
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Converts a changeset value of the tracked column to a double.
+ *
+ * Applies the same ingestion rules as the aggregate functions and updates the
+ * connection's ingestion counters.
+ * @param config The connection configuration.
+ * @param value The value to convert.
+ * @param out Receives the number.
+ * @return One of the VALUE_* outcomes.
+ */
+static int changeset_numeric_value(StatsConfig *config, const StatsKey *value, double *out) {
+    switch (value->type) {
+    case SQLITE_INTEGER:
+        *out = (double)value->i;
+        return VALUE_NUMERIC;
+    case SQLITE_FLOAT:
+        *out = value->r;
+        return VALUE_NUMERIC;
+    case SQLITE_TEXT:
+    case SQLITE_BLOB:
+        break;
+    default:
+        return VALUE_NULL;
+    }
+    if (config->ingest_mode != INGEST_MODE_LENIENT)
+        return VALUE_INVALID;
+
+    int parsed = parse_numeric_text(value->z, value->n, out);
+    if (parsed == NUMERIC_TEXT_INEXACT) {
+        char buffer[512];
+        int length = value->n < (int)sizeof(buffer) - 1 ? value->n : (int)sizeof(buffer) - 1;
+        memcpy(buffer, value->z, length);
+        buffer[length] = 0;
+        *out = strtod(buffer, NULL);
+    }
+    if (parsed == NUMERIC_TEXT_NONE) {
+        config->skipped_count++;
+        return VALUE_SKIPPED;
+    }
+    config->coerced_count++;
+    return VALUE_COERCED;
+}
+
+/**
+ * @brief Loads the column names of a table in column order.
+ * @param db The database connection.
+ * @param table The table name.
+ * @param names Receives a malloc'ed array of malloc'ed names.
+ * @param count Receives the number of columns (0 if the table does not exist).
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int load_table_columns(sqlite3 *db, const char *table, char ***names, int *count) {
+    sqlite3_stmt *stmt = NULL;
+    *names = NULL;
+    *count = 0;
+    int rc = sqlite3_prepare_v2(db, "SELECT name FROM pragma_table_info(?1) ORDER BY cid", -1, &stmt, NULL);
+    if (rc != SQLITE_OK)
+        return rc;
+    sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+    int capacity = 0;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (*count >= capacity) {
+            capacity = capacity ? capacity * CAPACITY_GROWTH_FACTOR : 16;
+            char **grown = (char **)realloc(*names, capacity * sizeof(char *));
+            if (!grown) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            *names = grown;
+        }
+        const char *name = (const char *)sqlite3_column_text(stmt, 0);
+        (*names)[*count] = name ? strdup(name) : NULL;
+        if (!(*names)[*count]) {
+            rc = SQLITE_NOMEM;
+            break;
+        }
+        (*count)++;
+    }
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+/**
+ * @brief Frees a column name array returned by load_table_columns().
+ * @param names The names.
+ * @param count The number of names.
+ */
+static void free_table_columns(char **names, int count) {
+    for (int i = 0; i < count; i++)
+        free(names[i]);
+    free(names);
+}
+
+/**
+ * @brief Finds a column by name (case-insensitively).
+ * @param names The column names.
+ * @param count The number of columns.
+ * @param name The name to find.
+ * @return The column index, or -1 if there is no such column.
+ */
+static int find_table_column(char **names, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (sqlite3_stricmp(names[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Applies coalesced per-group moment deltas to a summary table.
+ *
+ * The summary table must have the columns `group_key`, `n`, `mean` and `m2`. Groups
+ * are matched with `IS`, so a NULL key denotes the ungrouped summary row. Rows whose
+ * count drops to zero are deleted. All writes happen inside one savepoint.
+ *
+ * @param db The database connection.
+ * @param summary_table The summary table name.
+ * @param deltas Map from group key to MomentsDelta.
+ * @param error_message Receives an sqlite3_malloc'ed error message on failure.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int apply_moment_deltas(sqlite3 *db, const char *summary_table, GroupMap *deltas, char **error_message) {
+    sqlite3_stmt *select_stmt = NULL, *update_stmt = NULL, *insert_stmt = NULL, *delete_stmt = NULL;
+    char *sql = NULL;
+    int rc = sqlite3_exec(db, "SAVEPOINT stats_apply_moments", NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        *error_message = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+        return rc;
+    }
+
+#define PREPARE_SUMMARY_STMT(stmt, format)                                                                                                           \
+    if (rc == SQLITE_OK) {                                                                                                                           \
+        sql = sqlite3_mprintf(format, summary_table);                                                                                                \
+        rc = sql ? sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) : SQLITE_NOMEM;                                                                       \
+        sqlite3_free(sql);                                                                                                                           \
+    }
+    PREPARE_SUMMARY_STMT(select_stmt, "SELECT n, mean, m2 FROM \"%w\" WHERE group_key IS ?1")
+    PREPARE_SUMMARY_STMT(update_stmt, "UPDATE \"%w\" SET n = ?2, mean = ?3, m2 = ?4 WHERE group_key IS ?1")
+    PREPARE_SUMMARY_STMT(insert_stmt, "INSERT INTO \"%w\"(group_key, n, mean, m2) VALUES (?1, ?2, ?3, ?4)")
+    PREPARE_SUMMARY_STMT(delete_stmt, "DELETE FROM \"%w\" WHERE group_key IS ?1")
+#undef PREPARE_SUMMARY_STMT
+
+    for (GroupMapEntry *entry = deltas->first; rc == SQLITE_OK && entry; entry = entry->next_added) {
+        MomentsDelta *delta = (MomentsDelta *)group_map_payload(entry);
+        MomentsState state = {0, 0.0, 0.0};
+        int exists = 0;
+
+        bind_stats_key(select_stmt, 1, &entry->key);
+        if ((rc = sqlite3_step(select_stmt)) == SQLITE_ROW) {
+            exists = 1;
+            state.n = sqlite3_column_int64(select_stmt, 0);
+            state.mean = sqlite3_column_double(select_stmt, 1);
+            state.m2 = sqlite3_column_double(select_stmt, 2);
+            rc = SQLITE_OK;
+        } else if (rc == SQLITE_DONE) {
+            rc = SQLITE_OK;
+        }
+        sqlite3_reset(select_stmt);
+        if (rc != SQLITE_OK)
+            break;
+
+        stddev_accumulator_merge(&state, &delta->added);
+        stddev_accumulator_subtract(&state, &delta->removed);
+
+        sqlite3_stmt *write_stmt = state.n > 0 ? (exists ? update_stmt : insert_stmt) : (exists ? delete_stmt : NULL);
+        if (!write_stmt)
+            continue;
+        bind_stats_key(write_stmt, 1, &entry->key);
+        if (write_stmt != delete_stmt) {
+            sqlite3_bind_int64(write_stmt, 2, state.n);
+            sqlite3_bind_double(write_stmt, 3, state.mean);
+            sqlite3_bind_double(write_stmt, 4, state.m2);
+        }
+        rc = sqlite3_step(write_stmt) == SQLITE_DONE ? SQLITE_OK : sqlite3_errcode(db);
+        sqlite3_reset(write_stmt);
+    }
+
+    sqlite3_finalize(select_stmt);
+    sqlite3_finalize(update_stmt);
+    sqlite3_finalize(insert_stmt);
+    sqlite3_finalize(delete_stmt);
+    if (rc != SQLITE_OK) {
+        // Capture the message before the rollback replaces it.
+        *error_message = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK TO stats_apply_moments; RELEASE stats_apply_moments", NULL, NULL, NULL);
+        return rc;
+    }
+    rc = sqlite3_exec(db, "RELEASE stats_apply_moments", NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        *error_message = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+    return rc;
+}
+
+/**
+ * @brief Adds or removes one value of a group in a map of moment deltas.
+ * @param deltas Map from group key to MomentsDelta.
+ * @param group The group key.
+ * @param value The value.
+ * @param remove Whether the value is removed rather than added.
+ * @return SQLITE_OK on success, SQLITE_NOMEM on memory allocation failure.
+ */
+static int record_moment_delta(GroupMap *deltas, const StatsKey *group, double value, int remove) {
+    MomentsDelta *delta = (MomentsDelta *)group_map_lookup(deltas, group, 1);
+    if (!delta)
+        return SQLITE_NOMEM;
+    stddev_accumulator_add(remove ? &delta->removed : &delta->added, value);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Implements `stats_apply_changeset(changeset, summary_table, source_table, value_column [, group_column])`.
+ *
+ * Walks a changeset produced by the session extension and refreshes the moment
+ * summaries of `source_table.value_column` (optionally grouped by `group_column`) stored
+ * in `summary_table(group_key, n, mean, m2)`. INSERTs add the new value, DELETEs remove
+ * the old value and UPDATEs do both. Deltas are coalesced per group in memory and each
+ * affected summary row is read and written once, so the cost is O(1) per change plus
+ * O(1) per group. When an UPDATE leaves the value or group column unchanged, the
+ * missing column is read from `source_table` by primary key.
+ *
+ * The changeset is parsed directly because the `sqlite3changeset_*` routines are not
+ * available to loadable extensions.
+ *
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (4 or 5).
+ * @param argv The argument values.
+ */
+static void stats_apply_changeset_func(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    StatsConfig *config = (StatsConfig *)sqlite3_user_data(context);
+    sqlite3 *db = sqlite3_context_db_handle(context);
+    const char *summary_table = (const char *)sqlite3_value_text(argv[1]);
+    const char *source_table = (const char *)sqlite3_value_text(argv[2]);
+    const char *value_column = (const char *)sqlite3_value_text(argv[3]);
+    const char *group_column = argc > 4 ? (const char *)sqlite3_value_text(argv[4]) : NULL;
+    if (!summary_table || !source_table || !value_column) {
+        sqlite3_result_error(context, "stats_apply_changeset requires summary table, source table and value column names.", -1);
+        return;
+    }
+
+    ChangesetReader reader = {(const unsigned char *)sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]), 0};
+    char **columns = NULL;
+    int column_count = 0;
+    StatsKey *old_values = NULL, *new_values = NULL; // Records of the current change.
+    int record_capacity = 0;                          // Allocated length of the record arrays.
+    sqlite3_stmt *lookup_stmt = NULL;
+    GroupMap deltas;
+    group_map_init(&deltas, sizeof(MomentsDelta));
+    sqlite3_int64 applied = 0;
+    const char *error = NULL;
+    char *write_error = NULL;
+
+    int rc = load_table_columns(db, source_table, &columns, &column_count);
+    if (rc != SQLITE_OK)
+        goto done;
+    int value_index = find_table_column(columns, column_count, value_column);
+    int group_index = group_column ? find_table_column(columns, column_count, group_column) : -1;
+    if (column_count == 0 || value_index < 0 || (group_column && group_index < 0)) {
+        error = "stats_apply_changeset: unknown source table or column.";
+        goto done;
+    }
+
+    int table_columns = 0; // Column count of the current changeset table.
+    int tracked = 0;       // Whether the current changeset table is the source table.
+    const unsigned char *primary_key = NULL;
+    while (rc == SQLITE_OK && !error && reader.offset < reader.size) {
+        int op = reader.data[reader.offset++];
+        if (op == CHANGESET_TABLE_HEADER) {
+            sqlite3_int64 count;
+            if (changeset_read_varint(&reader, &count) != SQLITE_OK || count <= 0 || count > reader.size - reader.offset) {
+                rc = SQLITE_CORRUPT;
+                break;
+            }
+            table_columns = (int)count;
+            primary_key = reader.data + reader.offset;
+            reader.offset += table_columns;
+            const unsigned char *name_end = memchr(reader.data + reader.offset, 0, reader.size - reader.offset);
+            if (!name_end) {
+                rc = SQLITE_CORRUPT;
+                break;
+            }
+            tracked = sqlite3_stricmp((const char *)reader.data + reader.offset, source_table) == 0;
+            reader.offset = (int)(name_end - reader.data) + 1;
+            if (tracked && table_columns != column_count) {
+                error = "stats_apply_changeset: changeset columns do not match the source table.";
+                break;
+            }
+            if (table_columns > record_capacity) {
+                StatsKey *grown_old = (StatsKey *)realloc(old_values, table_columns * sizeof(StatsKey));
+                if (grown_old)
+                    old_values = grown_old;
+                StatsKey *grown_new = (StatsKey *)realloc(new_values, table_columns * sizeof(StatsKey));
+                if (grown_new)
+                    new_values = grown_new;
+                if (!grown_old || !grown_new) {
+                    rc = SQLITE_NOMEM;
+                    break;
+                }
+                record_capacity = table_columns;
+            }
+            sqlite3_finalize(lookup_stmt);
+            lookup_stmt = NULL;
+            continue;
+        }
+        if (op == PATCHSET_TABLE_HEADER) {
+            error = "stats_apply_changeset: patchsets are not supported, a changeset is required.";
+            break;
+        }
+        if ((op != SQLITE_INSERT && op != SQLITE_DELETE && op != SQLITE_UPDATE) || table_columns == 0 || reader.offset >= reader.size) {
+            rc = SQLITE_CORRUPT;
+            break;
+        }
+        reader.offset++; // Skip the "indirect" flag.
+
+        if (op != SQLITE_INSERT && (rc = changeset_read_record(&reader, old_values, table_columns)) != SQLITE_OK)
+            break;
+        if (op != SQLITE_DELETE && (rc = changeset_read_record(&reader, new_values, table_columns)) != SQLITE_OK)
+            break;
+        if (!tracked)
+            continue;
+
+        StatsKey null_key = {SQLITE_NULL, 0, 0.0, NULL, 0};
+        StatsKey old_value = null_key, new_value = null_key, old_group = null_key, new_group = null_key;
+        if (op == SQLITE_INSERT) {
+            new_value = new_values[value_index];
+            if (group_index >= 0)
+                new_group = new_values[group_index];
+        } else if (op == SQLITE_DELETE) {
+            old_value = old_values[value_index];
+            if (group_index >= 0)
+                old_group = old_values[group_index];
+        } else {
+            int value_changed = old_values[value_index].type != CHANGESET_UNDEFINED;
+            int group_changed = group_index >= 0 && old_values[group_index].type != CHANGESET_UNDEFINED;
+            if (!value_changed && !group_changed)
+                continue;
+
+            if (!value_changed || (group_index >= 0 && !group_changed)) {
+                // Read the unchanged column from the source table by primary key.
+                if (!lookup_stmt) {
+                    sqlite3_str *sql = sqlite3_str_new(db);
+                    sqlite3_str_appendf(sql, "SELECT \"%w\", %s%w%s FROM \"%w\" WHERE ", columns[value_index], group_index >= 0 ? "\"" : "",
+                                        group_index >= 0 ? columns[group_index] : "NULL", group_index >= 0 ? "\"" : "", source_table);
+                    int terms = 0;
+                    for (int i = 0; i < table_columns; i++) {
+                        if (primary_key[i])
+                            sqlite3_str_appendf(sql, "%s\"%w\" IS ?%d", terms++ ? " AND " : "", columns[i], i + 1);
+                    }
+                    char *lookup_sql = sqlite3_str_finish(sql);
+                    rc = lookup_sql ? sqlite3_prepare_v2(db, lookup_sql, -1, &lookup_stmt, NULL) : SQLITE_NOMEM;
+                    sqlite3_free(lookup_sql);
+                    if (rc != SQLITE_OK)
+                        break;
+                }
+                for (int i = 0; i < table_columns; i++) {
+                    if (primary_key[i])
+                        bind_stats_key(lookup_stmt, i + 1, &old_values[i]);
+                }
+                rc = sqlite3_step(lookup_stmt);
+                if (rc != SQLITE_ROW) {
+                    if (rc == SQLITE_DONE) {
+                        rc = SQLITE_OK;
+                        error = "stats_apply_changeset: updated row not found in the source table.";
+                    }
+                    sqlite3_reset(lookup_stmt);
+                    break;
+                }
+                rc = SQLITE_OK;
+                StatsKey current_value, current_group;
+                stats_key_from_value(sqlite3_column_value(lookup_stmt, 0), &current_value);
+                stats_key_from_value(sqlite3_column_value(lookup_stmt, 1), &current_group);
+                // Values are consumed below before the statement is reset.
+                old_value = value_changed ? old_values[value_index] : current_value;
+                new_value = value_changed ? new_values[value_index] : current_value;
+                old_group = group_changed ? old_values[group_index] : current_group;
+                new_group = group_changed ? new_values[group_index] : current_group;
+            } else {
+                old_value = old_values[value_index];
+                new_value = new_values[value_index];
+                if (group_index >= 0) {
+                    old_group = old_values[group_index];
+                    new_group = new_values[group_index];
+                }
+            }
+        }
+
+        stats_key_normalize(&old_group);
+        stats_key_normalize(&new_group);
+        double number;
+        int status;
+        if (op != SQLITE_INSERT) {
+            status = changeset_numeric_value(config, &old_value, &number);
+            if (status == VALUE_NUMERIC || status == VALUE_COERCED)
+                rc = record_moment_delta(&deltas, &old_group, number, 1);
+            else if (status == VALUE_INVALID)
+                error = "Invalid data type, expected numeric value.";
+        }
+        if (rc == SQLITE_OK && !error && op != SQLITE_DELETE) {
+            status = changeset_numeric_value(config, &new_value, &number);
+            if (status == VALUE_NUMERIC || status == VALUE_COERCED)
+                rc = record_moment_delta(&deltas, &new_group, number, 0);
+            else if (status == VALUE_INVALID)
+                error = "Invalid data type, expected numeric value.";
+        }
+        if (lookup_stmt)
+            sqlite3_reset(lookup_stmt);
+        applied++;
+    }
+
+    if (rc == SQLITE_OK && !error)
+        rc = apply_moment_deltas(db, summary_table, &deltas, &write_error);
+
+done:
+    if (write_error)
+        sqlite3_result_error(context, write_error, -1);
+    else if (error)
+        sqlite3_result_error(context, error, -1);
+    else if (rc == SQLITE_CORRUPT)
+        sqlite3_result_error(context, "stats_apply_changeset: malformed changeset.", -1);
+    else if (rc == SQLITE_NOMEM)
+        sqlite3_result_error_nomem(context);
+    else if (rc != SQLITE_OK)
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+    else
+        sqlite3_result_int64(context, applied);
+    sqlite3_finalize(lookup_stmt);
+    group_map_free(&deltas);
+    free(old_values);
+    free(new_values);
+    free_table_columns(columns, column_count);
+    sqlite3_free(write_error);
+}
+
+// --- Deferred Delta-Log Maintenance ---
+
+// Suffix of the delta log table created next to a summary table.
+#define DELTA_LOG_SUFFIX "_log"
+// Default pause between two flushes of a background worker, in milliseconds.
+#define DEFAULT_FLUSH_INTERVAL_MS 1000
+// Longest accepted flush interval (one day), so the worker's sleep counter cannot overflow.
+#define MAX_FLUSH_INTERVAL_MS 86400000
+// Default maximum number of log rows folded into the summary per flush.
+#define DEFAULT_FLUSH_BATCH_ROWS 10000
+// How long a background worker waits for the write lock, in milliseconds.
+#define WORKER_BUSY_TIMEOUT_MS 5000
+// Granularity at which a sleeping worker checks for a stop request, in milliseconds.
+#define WORKER_SLEEP_SLICE_MS 50
+
+/**
+ * @struct DeferredWorker
+ * @brief A background thread that folds a delta log into its summary table.
+ *
+ * The worker uses its own connection to the database file. Fields below `mutex` are
+ * shared with the owning connection and only accessed while holding it.
+ */
+typedef struct DeferredWorker {
+    struct DeferredWorker *next; // Next worker of the same connection.
+    char *summary_table;         // The summary table maintained by this worker.
+    char *filename;              // The database file.
+    int interval_ms;             // Pause between flushes when the log is drained.
+    int batch_rows;              // Maximum log rows per flush.
+    int ingest_mode;             // Ingestion mode for TEXT/BLOB log values.
+    StatsThread thread;          // The worker thread.
+    sqlite3_mutex *mutex;        // Protects the fields below.
+    int stop_requested;          // Set by the owner to end the thread.
+    sqlite3_int64 flushed_rows;  // Log rows folded into the summary so far.
+    char *last_error;            // Message of the last failed flush, or NULL.
+} DeferredWorker;
+
+/**
+ * @brief Folds pending rows of a delta log into its summary table.
+ *
+ * Reads up to `max_rows` log rows in insertion order, coalesces their added and
+ * removed values per group into MomentsDelta entries, applies them with
+ * apply_moment_deltas() and deletes the processed log rows, all in one savepoint.
+ *
+ * @param db The database connection.
+ * @param summary_table The summary table; its log is `summary_table || '_log'`.
+ * @param max_rows Maximum number of log rows to process, or a negative value for all.
+ * @param ingest_mode The ingestion mode for TEXT/BLOB values.
+ * @param flushed Receives the number of log rows processed.
+ * @param error_message Receives an sqlite3_malloc'ed error message on failure.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int flush_delta_log(sqlite3 *db, const char *summary_table, int max_rows, int ingest_mode, sqlite3_int64 *flushed, char **error_message) {
+    sqlite3_stmt *stmt = NULL;
+    GroupMap deltas;
+    group_map_init(&deltas, sizeof(MomentsDelta));
+    sqlite3_int64 last_id = 0;
+    *flushed = 0;
+
+    int rc = sqlite3_exec(db, "SAVEPOINT stats_flush_delta_log", NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        *error_message = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+        return rc;
+    }
+
+    char *sql = sqlite3_mprintf("SELECT id, group_key, old_value, new_value FROM \"%w" DELTA_LOG_SUFFIX "\" ORDER BY id LIMIT %d", summary_table,
+                                max_rows < 0 ? -1 : max_rows);
+    rc = sql ? sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) : SQLITE_NOMEM;
+    sqlite3_free(sql);
+    while (rc == SQLITE_OK && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        rc = SQLITE_OK;
+        last_id = sqlite3_column_int64(stmt, 0);
+        (*flushed)++;
+
+        StatsKey group;
+        stats_key_from_value(sqlite3_column_value(stmt, 1), &group);
+        for (int column = 2; rc == SQLITE_OK && column <= 3; column++) {
+            double value;
+            int status = read_numeric_value(sqlite3_column_value(stmt, column), ingest_mode, &value);
+            if (status == VALUE_NUMERIC || status == VALUE_COERCED)
+                rc = record_moment_delta(&deltas, &group, value, column == 2);
+        }
+    }
+    if (rc == SQLITE_DONE)
+        rc = SQLITE_OK;
+    if (rc != SQLITE_OK && !*error_message)
+        *error_message = sqlite3_mprintf("%s", rc == SQLITE_NOMEM ? "out of memory" : sqlite3_errmsg(db));
+    sqlite3_finalize(stmt);
+
+    if (rc == SQLITE_OK && *flushed > 0)
+        rc = apply_moment_deltas(db, summary_table, &deltas, error_message);
+    if (rc == SQLITE_OK && *flushed > 0) {
+        sql = sqlite3_mprintf("DELETE FROM \"%w" DELTA_LOG_SUFFIX "\" WHERE id <= %lld", summary_table, last_id);
+        rc = sql ? sqlite3_exec(db, sql, NULL, NULL, NULL) : SQLITE_NOMEM;
+        sqlite3_free(sql);
+        if (rc != SQLITE_OK)
+            *error_message = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+    }
+    group_map_free(&deltas);
+
+    if (rc != SQLITE_OK) {
+        sqlite3_exec(db, "ROLLBACK TO stats_flush_delta_log; RELEASE stats_flush_delta_log", NULL, NULL, NULL);
+        *flushed = 0;
+        return rc;
+    }
+    rc = sqlite3_exec(db, "RELEASE stats_flush_delta_log", NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        *error_message = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+    return rc;
+}
+
+/**
+ * @brief Body of a background worker thread.
+ *
+ * Repeatedly flushes the delta log in IMMEDIATE transactions on a private connection.
+ * While full batches are found it continues without pausing; otherwise it sleeps for
+ * the configured interval, checking for stop requests in short slices.
+ *
+ * @param arg The DeferredWorker.
+ */
+static void deferred_worker_main(void *arg) {
+    DeferredWorker *worker = (DeferredWorker *)arg;
+    sqlite3 *db = NULL;
+    int rc = sqlite3_open_v2(worker->filename, &db, SQLITE_OPEN_READWRITE, NULL);
+    if (rc == SQLITE_OK)
+        sqlite3_busy_timeout(db, WORKER_BUSY_TIMEOUT_MS);
+
+    for (;;) {
+        sqlite3_mutex_enter(worker->mutex);
+        int stop = worker->stop_requested;
+        sqlite3_mutex_leave(worker->mutex);
+        if (stop)
+            break;
+
+        sqlite3_int64 flushed = 0;
+        char *error_message = NULL;
+        if (rc == SQLITE_OK) {
+            int step_rc = sqlite3_exec(db, "BEGIN IMMEDIATE", NULL, NULL, NULL);
+            if (step_rc == SQLITE_OK) {
+                step_rc = flush_delta_log(db, worker->summary_table, worker->batch_rows, worker->ingest_mode, &flushed, &error_message);
+                step_rc = sqlite3_exec(db, step_rc == SQLITE_OK ? "COMMIT" : "ROLLBACK", NULL, NULL, NULL) == SQLITE_OK ? step_rc : sqlite3_errcode(db);
+                if (step_rc != SQLITE_OK && !error_message)
+                    error_message = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+            } else if (step_rc != SQLITE_BUSY) {
+                // A busy database is retried on the next round; anything else is reported.
+                error_message = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+            }
+        } else {
+            error_message = sqlite3_mprintf("cannot open %s: %s", worker->filename, db ? sqlite3_errmsg(db) : "out of memory");
+        }
+
+        sqlite3_mutex_enter(worker->mutex);
+        worker->flushed_rows += flushed;
+        if (error_message) {
+            sqlite3_free(worker->last_error);
+            worker->last_error = error_message;
+        }
+        sqlite3_mutex_leave(worker->mutex);
+
+        // Keep going while the log still holds full batches.
+        if (rc == SQLITE_OK && !error_message && flushed == worker->batch_rows)
+            continue;
+        for (int slept = 0; slept < worker->interval_ms; slept += WORKER_SLEEP_SLICE_MS) {
+            sqlite3_mutex_enter(worker->mutex);
+            stop = worker->stop_requested;
+            sqlite3_mutex_leave(worker->mutex);
+            if (stop)
+                break;
+            sqlite3_sleep(WORKER_SLEEP_SLICE_MS);
+        }
+    }
+    sqlite3_close(db);
+}
+
+/**
+ * @brief Asks a worker thread to stop and waits for it to finish.
+ * @param worker The worker to stop.
+ */
+static void join_deferred_worker(DeferredWorker *worker) {
+    sqlite3_mutex_enter(worker->mutex);
+    worker->stop_requested = 1;
+    sqlite3_mutex_leave(worker->mutex);
+    stats_thread_join(worker->thread);
+}
+
+/**
+ * @brief Frees a worker whose thread is not running.
+ * @param worker The worker to free.
+ */
+static void free_deferred_worker(DeferredWorker *worker) {
+    if (worker->mutex)
+        sqlite3_mutex_free(worker->mutex);
+    sqlite3_free(worker->last_error);
+    free(worker->summary_table);
+    free(worker->filename);
+    free(worker);
+}
+
+/**
+ * @brief Stops all background workers of a connection.
+ * @param config The connection configuration.
+ */
+static void stop_deferred_workers(StatsConfig *config) {
+    while (config->workers) {
+        DeferredWorker *worker = config->workers;
+        config->workers = worker->next;
+        join_deferred_worker(worker);
+        free_deferred_worker(worker);
+    }
+}
+
+/**
+ * @brief Finds the worker of a summary table and optionally unlinks it.
+ * @param config The connection configuration.
+ * @param summary_table The summary table name.
+ * @param unlink Whether to remove the worker from the connection's list.
+ * @return The worker, or NULL if none is running.
+ */
+static DeferredWorker *find_deferred_worker(StatsConfig *config, const char *summary_table, int unlink) {
+    for (DeferredWorker **link = &config->workers; *link; link = &(*link)->next) {
+        DeferredWorker *worker = *link;
+        if (sqlite3_stricmp(worker->summary_table, summary_table) == 0) {
+            if (unlink)
+                *link = worker->next;
+            return worker;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Implements `stats_deferred_create(summary_table, source_table, value_column [, group_column])`.
+ *
+ * Sets up deferred maintenance of `summary_table(group_key, n, mean, m2)`: creates the
+ * summary table if needed, a compact `<summary_table>_log(id, group_key, old_value, new_value)`
+ * table and triggers on `source_table` that only append a log row per change. An empty
+ * summary table is seeded from the current contents of `source_table`. Returns the
+ * number of rows seeded.
+ *
+ * An empty summary table with pending log rows is not seeded: the source already holds
+ * the changes of those rows, so they are applied as deltas instead.
+ *
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (3 or 4).
+ * @param argv The argument values.
+ */
+static void stats_deferred_create_func(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    StatsConfig *config = (StatsConfig *)sqlite3_user_data(context);
+    sqlite3 *db = sqlite3_context_db_handle(context);
+    const char *summary = (const char *)sqlite3_value_text(argv[0]);
+    const char *source = (const char *)sqlite3_value_text(argv[1]);
+    const char *value = (const char *)sqlite3_value_text(argv[2]);
+    const char *group = argc > 3 ? (const char *)sqlite3_value_text(argv[3]) : NULL;
+    if (!summary || !source || !value) {
+        sqlite3_result_error(context, "stats_deferred_create requires summary table, source table and value column names.", -1);
+        return;
+    }
+
+    char *new_group = group ? sqlite3_mprintf("NEW.\"%w\"", group) : sqlite3_mprintf("NULL");
+    char *old_group = group ? sqlite3_mprintf("OLD.\"%w\"", group) : sqlite3_mprintf("NULL");
+    char *update_columns = group ? sqlite3_mprintf("\"%w\", \"%w\"", value, group) : sqlite3_mprintf("\"%w\"", value);
+    char *sql = NULL;
+    if (new_group && old_group && update_columns) {
+        sql = sqlite3_mprintf(
+            "CREATE TABLE IF NOT EXISTS \"%w\"(group_key PRIMARY KEY, n INTEGER NOT NULL, mean REAL, m2 REAL);"
+            "CREATE TABLE IF NOT EXISTS \"%w" DELTA_LOG_SUFFIX "\"(id INTEGER PRIMARY KEY, group_key, old_value, new_value);"
+            "CREATE TRIGGER IF NOT EXISTS \"%w_log_insert\" AFTER INSERT ON \"%w\" WHEN NEW.\"%w\" IS NOT NULL BEGIN "
+            "INSERT INTO \"%w" DELTA_LOG_SUFFIX "\"(group_key, new_value) VALUES (%s, NEW.\"%w\"); END;"
+            "CREATE TRIGGER IF NOT EXISTS \"%w_log_delete\" AFTER DELETE ON \"%w\" WHEN OLD.\"%w\" IS NOT NULL BEGIN "
+            "INSERT INTO \"%w" DELTA_LOG_SUFFIX "\"(group_key, old_value) VALUES (%s, OLD.\"%w\"); END;"
+            "CREATE TRIGGER IF NOT EXISTS \"%w_log_update\" AFTER UPDATE OF %s ON \"%w\" "
+            "WHEN OLD.\"%w\" IS NOT NEW.\"%w\" OR %s IS NOT %s BEGIN "
+            "INSERT INTO \"%w" DELTA_LOG_SUFFIX "\"(group_key, old_value, new_value) SELECT %s, OLD.\"%w\", NEW.\"%w\" WHERE %s IS %s; "
+            "INSERT INTO \"%w" DELTA_LOG_SUFFIX "\"(group_key, old_value) SELECT %s, OLD.\"%w\" WHERE %s IS NOT %s AND OLD.\"%w\" IS NOT NULL; "
+            "INSERT INTO \"%w" DELTA_LOG_SUFFIX "\"(group_key, new_value) SELECT %s, NEW.\"%w\" WHERE %s IS NOT %s AND NEW.\"%w\" IS NOT NULL; "
+            "END;",
+            summary, summary, summary, source, value, summary, new_group, value, summary, source, value, summary, old_group, value, summary,
+            update_columns, source, value, value, old_group, new_group, summary, new_group, value, value, old_group, new_group, summary, old_group,
+            value, old_group, new_group, value, summary, new_group, value, old_group, new_group, value);
+    }
+    sqlite3_free(new_group);
+    sqlite3_free(old_group);
+    sqlite3_free(update_columns);
+    if (!sql) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    sqlite3_stmt *stmt = NULL;
+    char *error_message = NULL;
+    GroupMap deltas;
+    group_map_init(&deltas, sizeof(MomentsDelta));
+    sqlite3_int64 seeded = 0;
+
+    int rc = sqlite3_exec(db, "SAVEPOINT stats_deferred_create", NULL, NULL, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(db, sql, NULL, NULL, &error_message);
+    sqlite3_free(sql);
+
+    // Seed an empty summary table from the source table.
+    int empty = 0, pending = 0;
+    if (rc == SQLITE_OK) {
+        sql = sqlite3_mprintf("SELECT NOT EXISTS (SELECT 1 FROM \"%w\"), EXISTS (SELECT 1 FROM \"%w" DELTA_LOG_SUFFIX "\")", summary, summary);
+        rc = sql ? sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) : SQLITE_NOMEM;
+        sqlite3_free(sql);
+        if (rc == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+            empty = sqlite3_column_int(stmt, 0);
+            pending = sqlite3_column_int(stmt, 1);
+        }
+        sqlite3_finalize(stmt);
+        stmt = NULL;
+    }
+    if (rc == SQLITE_OK && empty && pending) {
+        sqlite3_int64 flushed;
+        rc = flush_delta_log(db, summary, -1, config->ingest_mode, &flushed, &error_message);
+    } else if (rc == SQLITE_OK && empty) {
+        sql = group ? sqlite3_mprintf("SELECT \"%w\", \"%w\" FROM \"%w\"", group, value, source) : sqlite3_mprintf("SELECT NULL, \"%w\" FROM \"%w\"", value, source);
+        rc = sql ? sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) : SQLITE_NOMEM;
+        sqlite3_free(sql);
+        while (rc == SQLITE_OK && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            rc = SQLITE_OK;
+            StatsKey key;
+            double number;
+            int status = read_numeric_value(sqlite3_column_value(stmt, 1), config->ingest_mode, &number);
+            if (status == VALUE_INVALID) {
+                error_message = sqlite3_mprintf("Invalid data type, expected numeric value.");
+                rc = SQLITE_MISMATCH;
+            } else if (status == VALUE_NUMERIC || status == VALUE_COERCED) {
+                stats_key_from_value(sqlite3_column_value(stmt, 0), &key);
+                rc = record_moment_delta(&deltas, &key, number, 0);
+                seeded++;
+            }
+        }
+        if (rc == SQLITE_DONE)
+            rc = SQLITE_OK;
+        sqlite3_finalize(stmt);
+        if (rc == SQLITE_OK)
+            rc = apply_moment_deltas(db, summary, &deltas, &error_message);
+    }
+    group_map_free(&deltas);
+
+    if (rc != SQLITE_OK) {
+        if (!error_message)
+            error_message = sqlite3_mprintf("%s", rc == SQLITE_NOMEM ? "out of memory" : sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK TO stats_deferred_create; RELEASE stats_deferred_create", NULL, NULL, NULL);
+        sqlite3_result_error(context, error_message, -1);
+    } else if (sqlite3_exec(db, "RELEASE stats_deferred_create", NULL, NULL, NULL) != SQLITE_OK) {
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+    } else {
+        sqlite3_result_int64(context, seeded);
+    }
+    sqlite3_free(error_message);
+}
+
+/**
+ * @brief Implements `stats_deferred_flush(summary_table [, max_rows])`.
+ *
+ * Synchronously folds pending delta-log rows into the summary table on the calling
+ * connection and returns the number of log rows processed.
+ *
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (1 or 2).
+ * @param argv The argument values.
+ */
+static void stats_deferred_flush_func(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    StatsConfig *config = (StatsConfig *)sqlite3_user_data(context);
+    const char *summary = (const char *)sqlite3_value_text(argv[0]);
+    int max_rows = argc > 1 && sqlite3_value_type(argv[1]) != SQLITE_NULL ? sqlite3_value_int(argv[1]) : -1;
+    if (!summary) {
+        sqlite3_result_error(context, "stats_deferred_flush requires a summary table name.", -1);
+        return;
+    }
+    sqlite3_int64 flushed = 0;
+    char *error_message = NULL;
+    if (flush_delta_log(sqlite3_context_db_handle(context), summary, max_rows, config->ingest_mode, &flushed, &error_message) != SQLITE_OK)
+        sqlite3_result_error(context, error_message ? error_message : "out of memory", -1);
+    else
+        sqlite3_result_int64(context, flushed);
+    sqlite3_free(error_message);
+}
+
+/**
+ * @brief Implements `stats_deferred_start(summary_table [, interval_ms [, batch_rows]])`.
+ *
+ * Starts a background thread that keeps folding the delta log into the summary table
+ * using its own connection to the same database file. Requires a file database and a
+ * thread-safe SQLite build. The worker stops with stats_deferred_stop() or when the
+ * connection closes.
+ *
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (1 to 3).
+ * @param argv The argument values.
+ */
+static void stats_deferred_start_func(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    StatsConfig *config = (StatsConfig *)sqlite3_user_data(context);
+    const char *summary = (const char *)sqlite3_value_text(argv[0]);
+    const char *filename = sqlite3_db_filename(sqlite3_context_db_handle(context), "main");
+    if (!summary) {
+        sqlite3_result_error(context, "stats_deferred_start requires a summary table name.", -1);
+        return;
+    }
+    sqlite3_int64 interval_ms = argc > 1 && sqlite3_value_type(argv[1]) != SQLITE_NULL ? sqlite3_value_int64(argv[1]) : DEFAULT_FLUSH_INTERVAL_MS;
+    if (interval_ms < 1 || interval_ms > MAX_FLUSH_INTERVAL_MS) {
+        sqlite3_result_error(context, "stats_deferred_start requires 1 <= interval_ms <= 86400000.", -1);
+        return;
+    }
+    if (!filename || !filename[0]) {
+        sqlite3_result_error(context, "stats_deferred_start requires a file database.", -1);
+        return;
+    }
+    if (!sqlite3_threadsafe()) {
+        sqlite3_result_error(context, "stats_deferred_start requires a thread-safe SQLite build.", -1);
+        return;
+    }
+    if (find_deferred_worker(config, summary, 0)) {
+        sqlite3_result_error(context, "A deferred worker is already running for this summary table.", -1);
+        return;
+    }
+
+    DeferredWorker *worker = (DeferredWorker *)calloc(1, sizeof(DeferredWorker));
+    if (!worker || !(worker->summary_table = strdup(summary)) || !(worker->filename = strdup(filename)) ||
+        !(worker->mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST))) {
+        if (worker)
+            free_deferred_worker(worker);
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    worker->interval_ms = (int)interval_ms;
+    worker->batch_rows = argc > 2 && sqlite3_value_type(argv[2]) != SQLITE_NULL ? sqlite3_value_int(argv[2]) : DEFAULT_FLUSH_BATCH_ROWS;
+    if (worker->batch_rows <= 0)
+        worker->batch_rows = DEFAULT_FLUSH_BATCH_ROWS;
+    worker->ingest_mode = config->ingest_mode;
+
+    if (stats_thread_start(&worker->thread, deferred_worker_main, worker) != SQLITE_OK) {
+        free_deferred_worker(worker);
+        sqlite3_result_error(context, "Cannot start the deferred worker thread.", -1);
+        return;
+    }
+    worker->next = config->workers;
+    config->workers = worker;
+    sqlite3_result_int(context, 1);
+}
+
+/**
+ * @brief Implements `stats_deferred_stop(summary_table)`.
+ *
+ * Stops the background worker of a summary table and returns the number of log rows
+ * it processed, or raises the error of its last failed flush.
+ *
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (1).
+ * @param argv The argument values.
+ */
+static void stats_deferred_stop_func(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    StatsConfig *config = (StatsConfig *)sqlite3_user_data(context);
+    const char *summary = (const char *)sqlite3_value_text(argv[0]);
+    DeferredWorker *worker = summary ? find_deferred_worker(config, summary, 1) : NULL;
+    if (!worker) {
+        sqlite3_result_null(context);
+        return;
+    }
+    join_deferred_worker(worker);
+    if (worker->last_error)
+        sqlite3_result_error(context, worker->last_error, -1);
+    else
+        sqlite3_result_int64(context, worker->flushed_rows);
+    free_deferred_worker(worker);
+}
+
+/**
+ * @brief Implements `stats_deferred_value(summary_table, group_key, statistic)`.
+ *
+ * Returns a statistic of one group with read-your-writes freshness: the stored summary
+ * row is combined with the group's rows still pending in the delta log. `statistic` is
+ * one of `n`, `mean`, `m2`, `variance_samp`, `variance_pop`, `stddev_samp` or `stddev_pop`.
+ *
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (3).
+ * @param argv The argument values.
+ */
+static void stats_deferred_value_func(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    StatsConfig *config = (StatsConfig *)sqlite3_user_data(context);
+    sqlite3 *db = sqlite3_context_db_handle(context);
+    const char *summary = (const char *)sqlite3_value_text(argv[0]);
+    const char *statistic = (const char *)sqlite3_value_text(argv[2]);
+    if (!summary || !statistic) {
+        sqlite3_result_error(context, "stats_deferred_value requires a summary table name and a statistic.", -1);
+        return;
+    }
+
+    MomentsState state = {0, 0.0, 0.0};
+    MomentsDelta pending;
+    memset(&pending, 0, sizeof(pending));
+    sqlite3_stmt *stmt = NULL;
+    char *sql = sqlite3_mprintf("SELECT n, mean, m2, 0, NULL, NULL FROM \"%w\" WHERE group_key IS ?1 "
+                                "UNION ALL SELECT NULL, NULL, NULL, 1, old_value, new_value FROM \"%w" DELTA_LOG_SUFFIX "\" WHERE group_key IS ?1",
+                                summary, summary);
+    int rc = sql ? sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) : SQLITE_NOMEM;
+    sqlite3_free(sql);
+    if (rc == SQLITE_OK)
+        sqlite3_bind_value(stmt, 1, argv[1]);
+    while (rc == SQLITE_OK && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        rc = SQLITE_OK;
+        if (sqlite3_column_int(stmt, 3) == 0) {
+            state.n = sqlite3_column_int64(stmt, 0);
+            state.mean = sqlite3_column_double(stmt, 1);
+            state.m2 = sqlite3_column_double(stmt, 2);
+            continue;
+        }
+        double value;
+        int status = read_numeric_value(sqlite3_column_value(stmt, 4), config->ingest_mode, &value);
+        if (status == VALUE_NUMERIC || status == VALUE_COERCED)
+            stddev_accumulator_add(&pending.removed, value);
+        status = read_numeric_value(sqlite3_column_value(stmt, 5), config->ingest_mode, &value);
+        if (status == VALUE_NUMERIC || status == VALUE_COERCED)
+            stddev_accumulator_add(&pending.added, value);
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+        return;
+    }
+    stddev_accumulator_merge(&state, &pending.added);
+    stddev_accumulator_subtract(&state, &pending.removed);
+
+    double result;
+    sqlite3_int64 min_count = 1;
+    if (sqlite3_stricmp(statistic, "n") == 0) {
+        sqlite3_result_int64(context, state.n);
+        return;
+    } else if (sqlite3_stricmp(statistic, "mean") == 0) {
+        result = state.mean;
+    } else if (sqlite3_stricmp(statistic, "m2") == 0) {
+        result = state.m2;
+    } else if (sqlite3_stricmp(statistic, "variance_samp") == 0) {
+        result = state.m2 / (state.n - 1);
+        min_count = 2;
+    } else if (sqlite3_stricmp(statistic, "variance_pop") == 0) {
+        result = state.m2 / state.n;
+    } else if (sqlite3_stricmp(statistic, "stddev_samp") == 0) {
+        result = sqrt(state.m2 / (state.n - 1));
+        min_count = 2;
+    } else if (sqlite3_stricmp(statistic, "stddev_pop") == 0) {
+        result = sqrt(state.m2 / state.n);
+    } else {
+        sqlite3_result_error(context, "Unknown statistic, expected n, mean, m2, variance_samp, variance_pop, stddev_samp or stddev_pop.", -1);
+        return;
+    }
+    if (state.n >= min_count)
+        set_result(context, result);
+    else
+        sqlite3_result_null(context);
+}
+
+// --- Ratio Metrics (Delta Method) ---
+
+/**
+ * @struct RatioMetricContext
+ * @brief Aggregate context of `ratio_metric_stats()`.
+ */
+typedef struct {
+    CoMomentsState moments; // Co-moments of (numerator, denominator).
+    int initialized;        // Whether the ingestion mode has been captured.
+    int ingest_mode;        // Ingestion mode captured at the first step.
+} RatioMetricContext;
+
+/**
+ * @brief Reads the (numerator, denominator) pair of a `ratio_metric_stats()` row.
+ * @param context The SQLite function context.
+ * @param ctx The aggregate context.
+ * @param argv The argument values.
+ * @param numerator Receives the numerator.
+ * @param denominator Receives the denominator.
+ * @return VALUE_NUMERIC if the pair is used, VALUE_INVALID if an error was reported, or
+ *         VALUE_NULL if the row is ignored.
+ */
+static int read_ratio_pair(sqlite3_context *context, RatioMetricContext *ctx, sqlite3_value **argv, double *numerator, double *denominator) {
+    int status = read_numeric_value(argv[0], ctx->ingest_mode, numerator);
+    int denominator_status = read_numeric_value(argv[1], ctx->ingest_mode, denominator);
+    if (status == VALUE_INVALID || denominator_status == VALUE_INVALID) {
+        sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+        return VALUE_INVALID;
+    }
+    if ((status != VALUE_NUMERIC && status != VALUE_COERCED) || (denominator_status != VALUE_NUMERIC && denominator_status != VALUE_COERCED))
+        return VALUE_NULL;
+    return VALUE_NUMERIC;
+}
+
+/**
+ * @brief The "step" function of `ratio_metric_stats(numerator, denominator)`.
+ *
+ * Rows where either value is NULL (or skipped in lenient mode) are ignored.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (2).
+ * @param argv The argument values.
+ */
+static void ratio_metric_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    RatioMetricContext *ctx = (RatioMetricContext *)sqlite3_aggregate_context(context, sizeof(RatioMetricContext));
+    if (!ctx) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    if (!ctx->initialized) {
+        ctx->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+        ctx->initialized = 1;
+    }
+    double numerator, denominator;
+    if (read_ratio_pair(context, ctx, argv, &numerator, &denominator) == VALUE_NUMERIC)
+        co_moments_add(&ctx->moments, numerator, denominator);
+}
+
+/**
+ * @brief The "inverse" function of `ratio_metric_stats()`.
+ *
+ * The pair leaving the frame is passed in `argv`, so no values are buffered.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments.
+ * @param argv The argument values of the row leaving the window.
+ */
+static void ratio_metric_inverse(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    RatioMetricContext *ctx = (RatioMetricContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || ctx->moments.n <= 0)
+        return;
+    double numerator, denominator;
+    if (read_ratio_pair(context, ctx, argv, &numerator, &denominator) == VALUE_NUMERIC)
+        co_moments_remove(&ctx->moments, numerator, denominator);
+}
+
+/**
+ * @brief The "value" function of `ratio_metric_stats()`.
+ *
+ * Returns a JSON object with `n`, the `ratio` of the numerator and denominator sums,
+ * and the delta-method `variance` and `stderr` of the ratio:
+ * `(var(num) - 2 R cov(num, den) + R^2 var(den)) / (n * mean(den)^2)`.
+ * Returns NULL for fewer than two rows.
+ *
+ * @param context The SQLite function context.
+ */
+static void ratio_metric_value(sqlite3_context *context) {
+    RatioMetricContext *ctx = (RatioMetricContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || ctx->moments.n < 2) {
+        sqlite3_result_null(context);
+        return;
+    }
+    const CoMomentsState *m = &ctx->moments;
+    double ratio = m->mean_x / m->mean_y;
+    double variance = (m->m2_x - 2.0 * ratio * m->c_xy + ratio * ratio * m->m2_y) / (m->n - 1) / (m->n * m->mean_y * m->mean_y);
+
+    sqlite3_str *json = sqlite3_str_new(sqlite3_context_db_handle(context));
+    sqlite3_str_appendchar(json, 1, '{');
+    json_append_int(json, "n", m->n);
+    json_append_double(json, "ratio", ratio);
+    json_append_double(json, "variance", variance);
+    json_append_double(json, "stderr", sqrt(variance));
+    sqlite3_str_appendchar(json, 1, '}');
+    json_result(context, json);
+}
+
+/**
+ * @brief The "final" function of `ratio_metric_stats()`.
+ * @param context The SQLite function context.
+ */
+static void ratio_metric_final(sqlite3_context *context) { ratio_metric_value(context); }
+
+// --- Variance Change-Point Detection ---
+
+/**
+ * @struct ChangepointContext
+ * @brief Aggregate context of `variance_changepoint()`.
+ *
+ * The ring holds at most 2 * min_segment values: the reference window followed by the
+ * recent window. Both windows keep their moments so the variance ratio is O(1) per row.
+ */
+typedef struct {
+    WindowStatsData ring;        // The reference window followed by the recent window.
+    MomentsState reference;      // Moments of the reference window.
+    MomentsState recent;         // Moments of the recent window (the last min_segment values).
+    int min_segment;             // The window size, and the minimum length of a segment.
+    double threshold;            // The variance ratio (in either direction) that flags a change.
+    int ingest_mode;             // Ingestion mode captured at the first step.
+    int flagged;                 // Whether a row added since the last value call was flagged as a change point.
+    int evaluated;               // Whether the value function has run since the last row was added.
+    sqlite3_int64 change_points; // Number of change points detected so far.
+} ChangepointContext;
+
+/**
+ * @brief The "step" function of `variance_changepoint(x, min_segment, threshold)`.
+ *
+ * Compares the sample variance of the last `min_segment` values with that of the
+ * `min_segment` values before them (an adjacent-window F statistic). A ratio above
+ * `threshold` or below `1 / threshold` flags the current row. Both windows are then
+ * cleared, so the next change can be flagged no earlier than 2 * `min_segment` rows later.
+ *
+ * Under a RANGE frame SQLite adds all peer rows before it asks for their values, so the
+ * flag collects every row added since the last value call and covers the whole peer group.
+ *
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (3).
+ * @param argv The argument values.
+ */
+static void changepoint_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    ChangepointContext *ctx = (ChangepointContext *)sqlite3_aggregate_context(context, sizeof(ChangepointContext));
+    if (!ctx) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    // Initialize context on the first call.
+    if (ctx->ring.values == NULL) {
+        ctx->min_segment = sqlite3_value_int(argv[1]);
+        ctx->threshold = sqlite3_value_double(argv[2]);
+        if (ctx->min_segment < 2 || !(ctx->threshold > 1.0)) {
+            sqlite3_result_error(context, "variance_changepoint requires min_segment >= 2 and threshold > 1.", -1);
+            return;
+        }
+        ctx->ring.capacity = 2 * ctx->min_segment;
+        ctx->ring.values = (double *)malloc(ctx->ring.capacity * sizeof(double));
+        if (!ctx->ring.values) {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        ctx->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+    }
+    if (ctx->evaluated) {
+        ctx->flagged = 0;
+        ctx->evaluated = 0;
+    }
+
+    double value;
+    int status = read_numeric_value(argv[0], ctx->ingest_mode, &value);
+    if (status == VALUE_INVALID) {
+        sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+        return;
+    }
+    if (status != VALUE_NUMERIC && status != VALUE_COERCED)
+        return;
+
+    // The oldest value always belongs to the reference window.
+    if (ctx->ring.count == ctx->ring.capacity)
+        stddev_accumulator_remove(&ctx->reference, remove_from_circular_buffer(&ctx->ring));
+    add_to_circular_buffer(&ctx->ring, value);
+    stddev_accumulator_add(&ctx->recent, value);
+    if (ctx->recent.n > ctx->min_segment) {
+        double moving = get_circular_value(&ctx->ring, ctx->ring.count - (int)ctx->recent.n);
+        stddev_accumulator_remove(&ctx->recent, moving);
+        stddev_accumulator_add(&ctx->reference, moving);
+    }
+
+    if (ctx->reference.n < ctx->min_segment || ctx->recent.n < ctx->min_segment)
+        return;
+    double reference_variance = ctx->reference.m2 / (ctx->reference.n - 1);
+    double recent_variance = ctx->recent.m2 / (ctx->recent.n - 1);
+    int changed;
+    if (reference_variance <= 0.0)
+        changed = recent_variance > 0.0;
+    else
+        changed = recent_variance > ctx->threshold * reference_variance || recent_variance * ctx->threshold < reference_variance;
+    if (!changed)
+        return;
+
+    // Start a new segment. The recent window still mixes both regimes, so both windows
+    // are rebuilt from the rows that follow.
+    ctx->flagged = 1;
+    ctx->change_points++;
+    ctx->ring.count = ctx->ring.head = ctx->ring.tail = 0;
+    memset(&ctx->reference, 0, sizeof(ctx->reference));
+    memset(&ctx->recent, 0, sizeof(ctx->recent));
+}
+
+/**
+ * @brief The "inverse" function of `variance_changepoint()`.
+ *
+ * Detection depends on the whole history of the partition, so frames that drop rows
+ * are rejected.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments.
+ * @param argv The argument values of the row leaving the window.
+ */
+static void changepoint_inverse(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    sqlite3_result_error(context, "variance_changepoint requires a frame starting at UNBOUNDED PRECEDING.", -1);
+}
+
+/**
+ * @brief The "value" function of `variance_changepoint()`: 1 if the current row (or, under
+ * a RANGE frame, any of its peers) is a change point, else 0.
+ * @param context The SQLite function context.
+ */
+static void changepoint_value(sqlite3_context *context) {
+    ChangepointContext *ctx = (ChangepointContext *)sqlite3_aggregate_context(context, 0);
+    sqlite3_result_int(context, ctx ? ctx->flagged : 0);
+    if (ctx)
+        ctx->evaluated = 1;
+}
+
+/**
+ * @brief The "final" function of `variance_changepoint()`.
+ *
+ * As an aggregate, returns the number of change points in the group.
+ * @param context The SQLite function context.
+ */
+static void changepoint_final(sqlite3_context *context) {
+    ChangepointContext *ctx = (ChangepointContext *)sqlite3_aggregate_context(context, 0);
+    sqlite3_result_int64(context, ctx ? ctx->change_points : 0);
+    if (ctx && ctx->ring.values) {
+        free(ctx->ring.values);
+        ctx->ring.values = NULL;
+    }
+}
+
+// --- Variance Components (Gauge R&R) ---
+
+/**
+ * @struct PartCell
+ * @brief Per-part state of `variance_components()`: the moments of each (part, operator) cell.
+ */
+typedef struct {
+    GroupMap cells; // Map from operator key to the MomentsState of the cell.
+} PartCell;
+
+/**
+ * @struct VarianceComponentsContext
+ * @brief Aggregate context of `variance_components()`.
+ */
+typedef struct {
+    GroupMap parts;     // Map from part key to PartCell.
+    GroupMap operators; // Map from operator key to the operator's MomentsState.
+    int initialized;    // Whether the maps have been initialized.
+    int ingest_mode;    // Ingestion mode captured at the first step.
+} VarianceComponentsContext;
+
+/**
+ * @brief The "step" function of `variance_components(value, part_key, operator_key)`.
+ *
+ * Adds the measurement to the (n, mean, M2) state of its (part, operator) cell, kept in a
+ * per-part hash of operator cells, and to the operator's marginal moments.
+ *
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (3).
+ * @param argv The argument values.
+ */
+static void variance_components_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    VarianceComponentsContext *ctx = (VarianceComponentsContext *)sqlite3_aggregate_context(context, sizeof(VarianceComponentsContext));
+    if (!ctx) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    if (!ctx->initialized) {
+        group_map_init(&ctx->parts, sizeof(PartCell));
+        group_map_init(&ctx->operators, sizeof(MomentsState));
+        ctx->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+        ctx->initialized = 1;
+    }
+
+    double value;
+    int status = read_numeric_value(argv[0], ctx->ingest_mode, &value);
+    if (status == VALUE_INVALID) {
+        sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+        return;
+    }
+    if (status != VALUE_NUMERIC && status != VALUE_COERCED)
+        return;
+    // Measurements without both keys cannot be attributed to a cell.
+    if (sqlite3_value_type(argv[1]) == SQLITE_NULL || sqlite3_value_type(argv[2]) == SQLITE_NULL)
+        return;
+
+    StatsKey part_key, operator_key;
+    stats_key_from_value(argv[1], &part_key);
+    stats_key_from_value(argv[2], &operator_key);
+    PartCell *part = (PartCell *)group_map_lookup(&ctx->parts, &part_key, 1);
+    MomentsState *operator_moments = (MomentsState *)group_map_lookup(&ctx->operators, &operator_key, 1);
+    if (!part || !operator_moments) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    if (part->cells.payload_size == 0)
+        group_map_init(&part->cells, sizeof(MomentsState));
+    MomentsState *cell = (MomentsState *)group_map_lookup(&part->cells, &operator_key, 1);
+    if (!cell) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    stddev_accumulator_add(cell, value);
+    stddev_accumulator_add(operator_moments, value);
+}
+
+/**
+ * @brief The "final" function of `variance_components()`.
+ *
+ * Computes the two-way crossed ANOVA with interaction used for Gauge R&R studies and
+ * returns the variance components as a JSON object. The expected mean squares assume
+ * a balanced study (every part measured by every operator the same number of times).
+ * With unbalanced data, the average number of replicates per cell is used.
+ *
+ * @param context The SQLite function context.
+ */
+static void variance_components_final(sqlite3_context *context) {
+    VarianceComponentsContext *ctx = (VarianceComponentsContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || !ctx->initialized || ctx->parts.count == 0) {
+        sqlite3_result_null(context);
+        if (ctx && ctx->initialized)
+            group_map_free(&ctx->operators);
+        return;
+    }
+
+    // Grand moments, part sums of squares and cell sums of squares.
+    MomentsState grand = {0, 0.0, 0.0};
+    sqlite3_int64 cell_count = 0;
+    double ss_error = 0.0;
+    for (GroupMapEntry *p = ctx->parts.first; p; p = p->next_added) {
+        PartCell *part = (PartCell *)group_map_payload(p);
+        for (GroupMapEntry *c = part->cells.first; c; c = c->next_added) {
+            MomentsState *cell = (MomentsState *)group_map_payload(c);
+            stddev_accumulator_merge(&grand, cell);
+            ss_error += cell->m2;
+            cell_count++;
+        }
+    }
+    double ss_part = 0.0, ss_cells = 0.0, ss_operator = 0.0;
+    for (GroupMapEntry *p = ctx->parts.first; p; p = p->next_added) {
+        PartCell *part = (PartCell *)group_map_payload(p);
+        MomentsState part_moments = {0, 0.0, 0.0};
+        for (GroupMapEntry *c = part->cells.first; c; c = c->next_added) {
+            MomentsState *cell = (MomentsState *)group_map_payload(c);
+            stddev_accumulator_merge(&part_moments, cell);
+            ss_cells += cell->n * (cell->mean - grand.mean) * (cell->mean - grand.mean);
+        }
+        ss_part += part_moments.n * (part_moments.mean - grand.mean) * (part_moments.mean - grand.mean);
+    }
+    for (GroupMapEntry *o = ctx->operators.first; o; o = o->next_added) {
+        MomentsState *op = (MomentsState *)group_map_payload(o);
+        ss_operator += op->n * (op->mean - grand.mean) * (op->mean - grand.mean);
+    }
+    double ss_interaction = ss_cells - ss_part - ss_operator;
+    if (ss_interaction < 0.0)
+        ss_interaction = 0.0;
+
+    double parts = ctx->parts.count, operators = ctx->operators.count;
+    double df_part = parts - 1, df_operator = operators - 1, df_interaction = df_part * df_operator;
+    double df_error = (double)(grand.n - cell_count);
+    double replicates = (double)grand.n / (parts * operators);
+
+    double ms_part = ss_part / df_part, ms_operator = ss_operator / df_operator;
+    double ms_interaction = df_interaction > 0 ? ss_interaction / df_interaction : 0.0;
+    double ms_error = ss_error / df_error;
+
+    // Expected mean squares of the random-effects model; negative estimates are set to zero.
+    double repeatability = ms_error;
+    double interaction = fmax(0.0, (ms_interaction - ms_error) / replicates);
+    double operator_variance = fmax(0.0, (ms_operator - ms_interaction) / (parts * replicates));
+    double part_variance = fmax(0.0, (ms_part - ms_interaction) / (operators * replicates));
+    double reproducibility = operator_variance + interaction;
+    double gauge_rr = repeatability + reproducibility;
+    double total = gauge_rr + part_variance;
+
+    sqlite3_str *json = sqlite3_str_new(sqlite3_context_db_handle(context));
+    sqlite3_str_appendchar(json, 1, '{');
+    json_append_int(json, "n", grand.n);
+    json_append_int(json, "parts", ctx->parts.count);
+    json_append_int(json, "operators", ctx->operators.count);
+    json_append_double(json, "repeatability", repeatability);
+    json_append_double(json, "reproducibility", reproducibility);
+    json_append_double(json, "operator", operator_variance);
+    json_append_double(json, "interaction", interaction);
+    json_append_double(json, "gauge_rr", gauge_rr);
+    json_append_double(json, "part_to_part", part_variance);
+    json_append_double(json, "total", total);
+    json_append_double(json, "pct_gauge_rr", 100.0 * sqrt(gauge_rr / total));
+    json_append_double(json, "ndc", 1.41 * sqrt(part_variance / gauge_rr));
+    sqlite3_str_appendchar(json, 1, '}');
+    json_result(context, json);
+
+    for (GroupMapEntry *p = ctx->parts.first; p; p = p->next_added)
+        group_map_free(&((PartCell *)group_map_payload(p))->cells);
+    group_map_free(&ctx->parts);
+    group_map_free(&ctx->operators);
+}
+
+// --- Experiment Aggregates (Welch t-test, CUPED) ---
+
+/**
+ * @struct ExperimentContext
+ * @brief Aggregate context of `welch_ttest()` and `cuped_stats()`.
+ */
+typedef struct {
+    GroupMap arms;   // Map from arm key to CoMomentsState (x = pre-period covariate, y = metric).
+    int initialized; // Whether the map has been initialized.
+    int ingest_mode; // Ingestion mode captured at the first step.
+} ExperimentContext;
+
+/**
+ * @brief Shared "step" logic of the experiment aggregates.
+ * @param context The SQLite function context.
+ * @param metric The metric argument.
+ * @param covariate The pre-period covariate argument, or NULL for `welch_ttest()`.
+ * @param arm The arm argument.
+ */
+static void experiment_step(sqlite3_context *context, sqlite3_value *metric, sqlite3_value *covariate, sqlite3_value *arm) {
+    ExperimentContext *ctx = (ExperimentContext *)sqlite3_aggregate_context(context, sizeof(ExperimentContext));
+    if (!ctx) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    if (!ctx->initialized) {
+        group_map_init(&ctx->arms, sizeof(CoMomentsState));
+        ctx->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+        ctx->initialized = 1;
+    }
+
+    double y, x = 0.0;
+    int status = read_numeric_value(metric, ctx->ingest_mode, &y);
+    int covariate_status = covariate ? read_numeric_value(covariate, ctx->ingest_mode, &x) : VALUE_NUMERIC;
+    if (status == VALUE_INVALID || covariate_status == VALUE_INVALID) {
+        sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+        return;
+    }
+    if ((status != VALUE_NUMERIC && status != VALUE_COERCED) || (covariate_status != VALUE_NUMERIC && covariate_status != VALUE_COERCED) ||
+        sqlite3_value_type(arm) == SQLITE_NULL)
+        return;
+
+    StatsKey key;
+    stats_key_from_value(arm, &key);
+    CoMomentsState *state = (CoMomentsState *)group_map_lookup(&ctx->arms, &key, 1);
+    if (!state) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    co_moments_add(state, x, y);
+}
+
+/**
+ * @brief The "step" function of `welch_ttest(metric, arm)`.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (2).
+ * @param argv The argument values.
+ */
+static void welch_ttest_step(sqlite3_context *context, int argc, sqlite3_value **argv) { experiment_step(context, argv[0], NULL, argv[1]); }
+
+/**
+ * @brief The "step" function of `cuped_stats(metric, pre_metric, arm)`.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (3).
+ * @param argv The argument values.
+ */
+static void cuped_stats_step(sqlite3_context *context, int argc, sqlite3_value **argv) { experiment_step(context, argv[0], argv[1], argv[2]); }
+
+/**
+ * @brief Finds the control and treatment arms of an experiment context.
+ *
+ * The arm that sorts first is the control. Reports an error unless there are exactly
+ * two arms; returns 0 without a result when there are fewer.
+ *
+ * @param context The SQLite function context.
+ * @param ctx The experiment context.
+ * @param control Receives the control arm state.
+ * @param treatment Receives the treatment arm state.
+ * @return Non-zero if both arms were found and each has at least two observations.
+ */
+static int experiment_arms(sqlite3_context *context, ExperimentContext *ctx, CoMomentsState **control, CoMomentsState **treatment) {
+    if (ctx->arms.count > 2) {
+        sqlite3_result_error(context, "Experiment aggregates require exactly two arms.", -1);
+        return 0;
+    }
+    if (ctx->arms.count < 2) {
+        sqlite3_result_null(context);
+        return 0;
+    }
+    GroupMapEntry *first = ctx->arms.first, *second = first->next_added;
+    if (stats_key_compare(&first->key, &second->key) > 0) {
+        GroupMapEntry *swap = first;
+        first = second;
+        second = swap;
+    }
+    *control = (CoMomentsState *)group_map_payload(first);
+    *treatment = (CoMomentsState *)group_map_payload(second);
+    if ((*control)->n < 2 || (*treatment)->n < 2) {
+        sqlite3_result_null(context);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Welch-Satterthwaite degrees of freedom of two variances of means.
+ * @param v1 Variance of the first mean (s1^2 / n1).
+ * @param n1 Size of the first sample.
+ * @param v2 Variance of the second mean (s2^2 / n2).
+ * @param n2 Size of the second sample.
+ * @return The degrees of freedom.
+ */
+static double welch_degrees_of_freedom(double v1, sqlite3_int64 n1, double v2, sqlite3_int64 n2) {
+    return (v1 + v2) * (v1 + v2) / (v1 * v1 / (n1 - 1) + v2 * v2 / (n2 - 1));
+}
+
+/**
+ * @brief The "final" function of `welch_ttest()`.
+ *
+ * Returns a JSON object with the arm sizes and means, the effect (treatment minus
+ * control mean), Cohen's d, the Welch (unpooled) and pooled standard errors, the t
+ * statistic, the Welch-Satterthwaite degrees of freedom and the two-sided p-value.
+ *
+ * @param context The SQLite function context.
+ */
+static void welch_ttest_final(sqlite3_context *context) {
+    ExperimentContext *ctx = (ExperimentContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || !ctx->initialized) {
+        sqlite3_result_null(context);
+        return;
+    }
+    CoMomentsState *control, *treatment;
+    if (experiment_arms(context, ctx, &control, &treatment)) {
+        double var_c = control->m2_y / (control->n - 1), var_t = treatment->m2_y / (treatment->n - 1);
+        double effect = treatment->mean_y - control->mean_y;
+        double se = sqrt(var_c / control->n + var_t / treatment->n);
+        double pooled_var = (control->m2_y + treatment->m2_y) / (control->n + treatment->n - 2);
+        double pooled_se = sqrt(pooled_var * (1.0 / control->n + 1.0 / treatment->n));
+        double df = welch_degrees_of_freedom(var_c / control->n, control->n, var_t / treatment->n, treatment->n);
+
+        sqlite3_str *json = sqlite3_str_new(sqlite3_context_db_handle(context));
+        sqlite3_str_appendchar(json, 1, '{');
+        json_append_int(json, "control_n", control->n);
+        json_append_int(json, "treatment_n", treatment->n);
+        json_append_double(json, "control_mean", control->mean_y);
+        json_append_double(json, "treatment_mean", treatment->mean_y);
+        json_append_double(json, "effect", effect);
+        json_append_double(json, "cohens_d", effect / sqrt(pooled_var));
+        json_append_double(json, "se", se);
+        json_append_double(json, "pooled_se", pooled_se);
+        json_append_double(json, "t", effect / se);
+        json_append_double(json, "df", df);
+        json_append_double(json, "p_value", student_t_two_sided_p(effect / se, df));
+        sqlite3_str_appendchar(json, 1, '}');
+        json_result(context, json);
+    }
+    group_map_free(&ctx->arms);
+}
+
+/**
+ * @brief The "final" function of `cuped_stats()`.
+ *
+ * Applies CUPED variance reduction: theta is the within-arm pooled regression slope of
+ * the metric on the pre-period covariate, and each arm's metric is adjusted by
+ * `-theta * (x - mean_x)`. Returns a JSON object with theta, the raw and adjusted
+ * effects, the raw, pooled and adjusted standard errors, the variance reduction and the
+ * Welch t statistic, degrees of freedom and two-sided p-value of the adjusted effect.
+ *
+ * @param context The SQLite function context.
+ */
+static void cuped_stats_final(sqlite3_context *context) {
+    ExperimentContext *ctx = (ExperimentContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || !ctx->initialized) {
+        sqlite3_result_null(context);
+        return;
+    }
+    CoMomentsState *control, *treatment;
+    if (experiment_arms(context, ctx, &control, &treatment)) {
+        double theta = (control->c_xy + treatment->c_xy) / (control->m2_x + treatment->m2_x);
+        if (isnan(theta) || isinf(theta))
+            theta = 0.0; // A constant covariate carries no information.
+
+        double var_c = control->m2_y / (control->n - 1), var_t = treatment->m2_y / (treatment->n - 1);
+        double adj_var_c = (control->m2_y - 2.0 * theta * control->c_xy + theta * theta * control->m2_x) / (control->n - 1);
+        double adj_var_t = (treatment->m2_y - 2.0 * theta * treatment->c_xy + theta * theta * treatment->m2_x) / (treatment->n - 1);
+        double effect = treatment->mean_y - control->mean_y;
+        double adjusted_effect = effect - theta * (treatment->mean_x - control->mean_x);
+        double se = sqrt(var_c / control->n + var_t / treatment->n);
+        double adjusted_se = sqrt(adj_var_c / control->n + adj_var_t / treatment->n);
+        double pooled_se =
+            sqrt((control->m2_y + treatment->m2_y) / (control->n + treatment->n - 2) * (1.0 / control->n + 1.0 / treatment->n));
+        double df = welch_degrees_of_freedom(adj_var_c / control->n, control->n, adj_var_t / treatment->n, treatment->n);
+
+        sqlite3_str *json = sqlite3_str_new(sqlite3_context_db_handle(context));
+        sqlite3_str_appendchar(json, 1, '{');
+        json_append_int(json, "control_n", control->n);
+        json_append_int(json, "treatment_n", treatment->n);
+        json_append_double(json, "theta", theta);
+        json_append_double(json, "effect", effect);
+        json_append_double(json, "adjusted_effect", adjusted_effect);
+        json_append_double(json, "se", se);
+        json_append_double(json, "pooled_se", pooled_se);
+        json_append_double(json, "adjusted_se", adjusted_se);
+        json_append_double(json, "variance_reduction", 1.0 - (adjusted_se * adjusted_se) / (se * se));
+        json_append_double(json, "t", adjusted_effect / adjusted_se);
+        json_append_double(json, "df", df);
+        json_append_double(json, "p_value", student_t_two_sided_p(adjusted_effect / adjusted_se, df));
+        sqlite3_str_appendchar(json, 1, '}');
+        json_result(context, json);
+    }
+    group_map_free(&ctx->arms);
+}
+
+// --- Sigma-Clipped Statistics ---
+
+/**
+ * @struct SigmaClipContext
+ * @brief Aggregate context of `sigma_clipped_stats()`.
+ */
+typedef struct {
+    WindowStatsData data; // Buffered values (appended only, so values[0..count) is contiguous).
+    double k;             // Clipping threshold in standard deviations.
+    int max_iters;        // Maximum number of clipping passes, or -1 for no limit.
+    int ingest_mode;      // Ingestion mode captured at the first step.
+} SigmaClipContext;
+
+/**
+ * @brief qsort() comparison function for doubles in ascending order.
+ * @param a Pointer to the first double.
+ * @param b Pointer to the second double.
+ * @return A negative, zero or positive value.
+ */
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief The "step" function of `sigma_clipped_stats(x, k, max_iters)`.
+ *
+ * `k` and `max_iters` are read from the first row. A NULL `max_iters` iterates until
+ * no more points are rejected.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (3).
+ * @param argv The argument values.
+ */
+static void sigma_clip_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    SigmaClipContext *ctx = (SigmaClipContext *)sqlite3_aggregate_context(context, sizeof(SigmaClipContext));
+    if (!ctx) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    // Initialize context on the first call.
+    if (ctx->data.values == NULL) {
+        ctx->k = sqlite3_value_double(argv[1]);
+        ctx->max_iters = sqlite3_value_type(argv[2]) == SQLITE_NULL ? -1 : sqlite3_value_int(argv[2]);
+        if (!(ctx->k > 0.0) || ctx->max_iters < -1 || (ctx->max_iters == -1 && sqlite3_value_type(argv[2]) != SQLITE_NULL)) {
+            sqlite3_result_error(context, "sigma_clipped_stats requires k > 0 and max_iters >= 0 or NULL.", -1);
+            return;
+        }
+        if (init_window_stats_data(context, &ctx->data) != SQLITE_OK)
+            return;
+        ctx->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+    }
+
+    double value;
+    int status = read_numeric_value(argv[0], ctx->ingest_mode, &value);
+    if (status == VALUE_INVALID) {
+        sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+        return;
+    }
+    if (status != VALUE_NUMERIC && status != VALUE_COERCED)
+        return;
+    if (ctx->data.count >= ctx->data.capacity) {
+        if (grow_stats_buffer(context, &ctx->data) != SQLITE_OK)
+            return;
+    }
+    add_to_circular_buffer(&ctx->data, value);
+}
+
+/**
+ * @brief Computes the moments of a contiguous range with a shifted two-pass sum.
+ * @param values The values.
+ * @param lo The first index of the range.
+ * @param hi One past the last index of the range.
+ * @param m Receives the moments of values[lo..hi).
+ */
+static void range_moments(const double *values, int lo, int hi, MomentsState *m) {
+    m->n = hi - lo;
+    if (m->n == 0) {
+        m->mean = m->m2 = 0.0;
+        return;
+    }
+    double sum = 0.0;
+    for (int i = lo; i < hi; i++)
+        sum += values[i];
+    m->mean = sum / m->n;
+    double m2 = 0.0;
+    for (int i = lo; i < hi; i++) {
+        double d = values[i] - m->mean;
+        m2 += d * d;
+    }
+    m->m2 = m2;
+}
+
+/**
+ * @brief The "final" function of `sigma_clipped_stats()`.
+ *
+ * Sorts the buffered values once. The kept points are then always a contiguous range
+ * [lo, hi) of the sorted array, so each pass only visits the points at the two ends
+ * of the range and removes the rejected ones from the running moments. Each pass
+ * rejects points farther than `k` standard deviations (population) from the median
+ * of the kept points.
+ *
+ * Returns a JSON object with the kept count `n`, the clipped `mean`, `median` and
+ * `stddev` (population), the `rejected` count and the number of `iterations` that
+ * rejected points.
+ *
+ * @param context The SQLite function context.
+ */
+static void sigma_clip_final(sqlite3_context *context) {
+    SigmaClipContext *ctx = (SigmaClipContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || !ctx->data.values || ctx->data.count == 0) {
+        sqlite3_result_null(context);
+        if (ctx && ctx->data.values) {
+            free(ctx->data.values);
+            ctx->data.values = NULL;
+        }
+        return;
+    }
+
+    double *values = ctx->data.values;
+    qsort(values, ctx->data.count, sizeof(double), compare_doubles);
+    int lo = 0, hi = ctx->data.count, iterations = 0;
+    MomentsState kept;
+    range_moments(values, lo, hi, &kept);
+    while (ctx->max_iters < 0 || iterations < ctx->max_iters) {
+        int mid = lo + (hi - lo) / 2;
+        double median = (hi - lo) % 2 ? values[mid] : 0.5 * (values[mid - 1] + values[mid]);
+        double bound = ctx->k * sqrt(kept.m2 / kept.n);
+        int old_lo = lo, old_hi = hi;
+        while (lo < hi && values[lo] < median - bound)
+            stddev_accumulator_remove(&kept, values[lo++]);
+        while (hi > lo && values[hi - 1] > median + bound)
+            stddev_accumulator_remove(&kept, values[--hi]);
+        if (lo == old_lo && hi == old_hi)
+            break;
+        iterations++;
+        if (lo == hi)
+            break;
+    }
+
+    // Recompute the kept moments from scratch so the removals leave no rounding drift.
+    range_moments(values, lo, hi, &kept);
+    int mid = lo + (hi - lo) / 2;
+    sqlite3_str *json = sqlite3_str_new(sqlite3_context_db_handle(context));
+    sqlite3_str_appendchar(json, 1, '{');
+    json_append_int(json, "n", kept.n);
+    json_append_double(json, "mean", kept.n > 0 ? kept.mean : NAN);
+    json_append_double(json, "median", kept.n == 0 ? NAN : (hi - lo) % 2 ? values[mid] : 0.5 * (values[mid - 1] + values[mid]));
+    json_append_double(json, "stddev", kept.n > 0 ? sqrt(kept.m2 / kept.n) : NAN);
+    json_append_int(json, "rejected", ctx->data.count - kept.n);
+    json_append_int(json, "iterations", iterations);
+    sqlite3_str_appendchar(json, 1, '}');
+    json_result(context, json);
+
+    free(ctx->data.values);
+    ctx->data.values = NULL;
+}
+
+// --- Table-Valued Function Arguments ---
+
+// Largest number of arguments (hidden columns) of a table-valued function.
+#define TABLE_FUNCTION_MAX_ARGUMENTS 8
+
+/**
+ * @brief Plans a table-valued function whose arguments are hidden columns.
+ *
+ * The equality constraints on the argument columns are passed to xFilter in column
+ * order, and `idxNum` is set to the bitmask of the arguments present.
+ * @param vtab The virtual table.
+ * @param info The index information.
+ * @param first_column The column index of the first argument.
+ * @param argument_count The number of arguments (at most TABLE_FUNCTION_MAX_ARGUMENTS).
+ * @param required Bitmask of the arguments that must be given.
+ * @param usage Error message for a call that lacks a required argument.
+ * @param cost The estimated cost of a scan.
+ * @return SQLITE_OK, SQLITE_CONSTRAINT for an unusable plan, or SQLITE_ERROR if a required argument is missing.
+ */
+static int plan_table_function(sqlite3_vtab *vtab, sqlite3_index_info *info, int first_column, int argument_count, int required, const char *usage,
+                               double cost) {
+    int constraint_of[TABLE_FUNCTION_MAX_ARGUMENTS];
+    int present = 0, usable = 0;
+    for (int i = 0; i < argument_count; i++)
+        constraint_of[i] = -1;
+    for (int i = 0; i < info->nConstraint; i++) {
+        const struct sqlite3_index_constraint *constraint = &info->aConstraint[i];
+        int argument = constraint->iColumn - first_column;
+        if (argument < 0 || argument >= argument_count || constraint->op != SQLITE_INDEX_CONSTRAINT_EQ)
+            continue;
+        present |= 1 << argument;
+        if (constraint->usable) {
+            usable |= 1 << argument;
+            constraint_of[argument] = i;
+        }
+    }
+    if ((present & required) != required) {
+        vtab->zErrMsg = sqlite3_mprintf("%s", usage);
+        return SQLITE_ERROR;
+    }
+    if ((usable & present) != present)
+        return SQLITE_CONSTRAINT;
+
+    int next_argument = 1;
+    for (int i = 0; i < argument_count; i++) {
+        if (constraint_of[i] < 0)
+            continue;
+        info->aConstraintUsage[constraint_of[i]].argvIndex = next_argument++;
+        info->aConstraintUsage[constraint_of[i]].omit = 1;
+    }
+    info->idxNum = usable;
+    info->estimatedCost = cost;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Copies the arguments passed to xFilter into per-argument slots.
+ * @param arguments Receives a copy of each argument present; missing ones are NULL pointers.
+ * @param argument_count The number of argument slots.
+ * @param idx_num The bitmask set by plan_table_function().
+ * @param argv The xFilter arguments.
+ * @return SQLITE_OK or SQLITE_NOMEM.
+ */
+static int copy_table_function_arguments(sqlite3_value **arguments, int argument_count, int idx_num, sqlite3_value **argv) {
+    for (int i = 0, next = 0; i < argument_count; i++) {
+        if (!(idx_num & (1 << i)))
+            continue;
+        arguments[i] = sqlite3_value_dup(argv[next++]);
+        if (!arguments[i])
+            return SQLITE_NOMEM;
+    }
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Frees the argument copies made by copy_table_function_arguments().
+ * @param arguments The argument slots.
+ * @param argument_count The number of argument slots.
+ */
+static void free_table_function_arguments(sqlite3_value **arguments, int argument_count) {
+    for (int i = 0; i < argument_count; i++) {
+        sqlite3_value_free(arguments[i]);
+        arguments[i] = NULL;
+    }
+}
+
+// --- Stream Ingestion (FIFO / Unix Socket) ---
+#ifndef _WIN32
+
+// Size of the read buffer; each read() asks for as much of it as is free.
+#define STREAM_READ_BUFFER_SIZE 65536
+// Largest supported record, so a record always fits in the read buffer.
+#define STREAM_MAX_RECORD_SIZE 4096
+// Records folded between snapshots when emit_every is not given.
+#define DEFAULT_STREAM_EMIT_EVERY 1000
+// Longest wait for data, in milliseconds, before checking for sqlite3_interrupt() again.
+#define STREAM_POLL_TIMEOUT_MS 100
+
+// Kinds of record fields.
+#define STREAM_FIELD_SIGNED 0   // Two's complement integer.
+#define STREAM_FIELD_UNSIGNED 1 // Unsigned integer.
+#define STREAM_FIELD_FLOAT 2    // IEEE 754 binary32 or binary64.
+#define STREAM_FIELD_PAD 3      // Ignored bytes.
+
+/**
+ * @struct StreamField
+ * @brief A field of a fixed-size binary record.
+ */
+typedef struct {
+    int offset; // Byte offset within the record.
+    int size;   // Size in bytes.
+    int kind;   // One of the STREAM_FIELD_* kinds.
+} StreamField;
+
+/**
+ * @struct StreamLayout
+ * @brief The parsed record layout of a `stream_stats()` scan.
+ */
+typedef struct {
+    int record_size;   // Size of one record in bytes.
+    int big_endian;    // Whether multi-byte fields are big-endian.
+    int has_key;       // Whether records are grouped by a key field.
+    StreamField key;   // The key field (if has_key).
+    StreamField value; // The value field.
+} StreamLayout;
+
+// Columns of the stream_stats table-valued function.
+#define STREAM_COLUMN_SNAPSHOT 0
+#define STREAM_COLUMN_KEY 1
+#define STREAM_COLUMN_N 2
+#define STREAM_COLUMN_MEAN 3
+#define STREAM_COLUMN_VARIANCE 4
+#define STREAM_COLUMN_STDDEV 5
+#define STREAM_COLUMN_PATH 6
+#define STREAM_COLUMN_LAYOUT 7
+#define STREAM_COLUMN_KEY_FIELD 8
+#define STREAM_COLUMN_VALUE_FIELD 9
+#define STREAM_COLUMN_EMIT_EVERY 10
+// Number of hidden argument columns, starting at STREAM_COLUMN_PATH.
+#define STREAM_ARGUMENT_COUNT 5
+// Arguments that must be given (path, layout, key_field, value_field).
+#define STREAM_REQUIRED_ARGUMENTS 0x0F
+
+/**
+ * @struct StreamStatsTable
+ * @brief The eponymous `stream_stats` virtual table.
+ */
+typedef struct {
+    sqlite3_vtab base; // Base class.
+    sqlite3 *db;       // The connection, checked for interruption while waiting.
+} StreamStatsTable;
+
+/**
+ * @struct StreamStatsCursor
+ * @brief A scan of `stream_stats()`.
+ */
+typedef struct {
+    sqlite3_vtab_cursor base;       // Base class.
+    int fd;                         // The stream, or -1.
+    StreamLayout layout;            // Record layout.
+    sqlite3_int64 emit_every;       // Records folded between snapshots.
+    unsigned char *buffer;          // Read buffer.
+    int buffered;                   // Bytes in the read buffer.
+    int stream_done;                // Whether the writer has closed the stream.
+    int awaiting_writer;            // Whether a FIFO has not seen a writer yet, so end of file means "wait".
+    GroupMap groups;                // Map from key to MomentsState.
+    sqlite3_int64 pending;          // Records folded since the last snapshot.
+    sqlite3_int64 snapshot;         // Number of the current snapshot (1-based).
+    GroupMapEntry *row;             // The current output row, or NULL at the end.
+    sqlite3_int64 rowid;            // Row counter.
+    sqlite3_value *arguments[STREAM_ARGUMENT_COUNT]; // Argument values of the scan, for the hidden columns.
+} StreamStatsCursor;
+
+/**
+ * @brief Parses a record layout such as `'<key:u32,value:f64,ts:i64'`.
+ *
+ * Fields are `name:type` pairs separated by commas, where type is one of i8, i16, i32,
+ * i64, u8, u16, u32, u64, f32, f64 or padN (N ignored bytes). A leading `<` or `>`
+ * selects little-endian (the default) or big-endian fields.
+ *
+ * @param spec The layout string.
+ * @param key_field The name of the key field, or NULL for a single group.
+ * @param value_field The name of the value field.
+ * @param layout Receives the layout.
+ * @return NULL on success, or an error message to be freed with sqlite3_free().
+ */
+static char *parse_stream_layout(const char *spec, const char *key_field, const char *value_field, StreamLayout *layout) {
+    memset(layout, 0, sizeof(*layout));
+    int found_value = 0;
+    const char *p = spec;
+    while (is_ascii_space((unsigned char)*p))
+        p++;
+    if (*p == '<' || *p == '>')
+        layout->big_endian = *p++ == '>';
+
+    while (*p) {
+        while (is_ascii_space((unsigned char)*p) || *p == ',')
+            p++;
+        if (!*p)
+            break;
+        const char *name = p;
+        while (*p && *p != ':' && *p != ',' && !is_ascii_space((unsigned char)*p))
+            p++;
+        int name_length = (int)(p - name);
+        while (is_ascii_space((unsigned char)*p))
+            p++;
+        if (*p != ':' || name_length == 0)
+            return sqlite3_mprintf("stream_stats: expected 'name:type' in layout near '%s'", name);
+        p++;
+        while (is_ascii_space((unsigned char)*p))
+            p++;
+
+        StreamField field = {layout->record_size, 0, 0};
+        char kind = *p;
+        char *end;
+        long bits = strtol(p + (strncmp(p, "pad", 3) == 0 ? 3 : 1), &end, 10);
+        if (strncmp(p, "pad", 3) == 0 && bits > 0 && bits <= STREAM_MAX_RECORD_SIZE) {
+            field.kind = STREAM_FIELD_PAD;
+            field.size = (int)bits;
+        } else if ((kind == 'i' || kind == 'u') && (bits == 8 || bits == 16 || bits == 32 || bits == 64)) {
+            field.kind = kind == 'i' ? STREAM_FIELD_SIGNED : STREAM_FIELD_UNSIGNED;
+            field.size = (int)bits / 8;
+        } else if (kind == 'f' && (bits == 32 || bits == 64)) {
+            field.kind = STREAM_FIELD_FLOAT;
+            field.size = (int)bits / 8;
+        } else {
+            return sqlite3_mprintf("stream_stats: unknown field type in layout near '%s'", p);
+        }
+        p = end;
+        layout->record_size += field.size;
+        if (layout->record_size > STREAM_MAX_RECORD_SIZE)
+            return sqlite3_mprintf("stream_stats: records are limited to %d bytes", STREAM_MAX_RECORD_SIZE);
+
+        if (field.kind != STREAM_FIELD_PAD && key_field && (int)strlen(key_field) == name_length && memcmp(name, key_field, name_length) == 0) {
+            layout->key = field;
+            layout->has_key = 1;
+        }
+        if (field.kind != STREAM_FIELD_PAD && (int)strlen(value_field) == name_length && memcmp(name, value_field, name_length) == 0) {
+            layout->value = field;
+            found_value = 1;
+        }
+    }
+    if (key_field && !layout->has_key)
+        return sqlite3_mprintf("stream_stats: key field '%s' is not in the layout", key_field);
+    if (!found_value)
+        return sqlite3_mprintf("stream_stats: value field '%s' is not in the layout", value_field);
+    return NULL;
+}
+
+/**
+ * @brief Reads a field of a record as raw bits.
+ * @param record The record.
+ * @param field The field.
+ * @param big_endian Whether the field is big-endian.
+ * @return The field bits in the low bytes of the result.
+ */
+static sqlite3_uint64 read_stream_bits(const unsigned char *record, const StreamField *field, int big_endian) {
+    sqlite3_uint64 bits = 0;
+    for (int i = 0; i < field->size; i++) {
+        int byte = big_endian ? i : field->size - 1 - i;
+        bits = (bits << 8) | record[field->offset + byte];
+    }
+    return bits;
+}
+
+/**
+ * @brief Decodes a numeric field of a record.
+ * @param record The record.
+ * @param field The field.
+ * @param big_endian Whether the field is big-endian.
+ * @param key Receives the field as a normalized INTEGER or REAL key.
+ */
+static void read_stream_field(const unsigned char *record, const StreamField *field, int big_endian, StatsKey *key) {
+    sqlite3_uint64 bits = read_stream_bits(record, field, big_endian);
+    memset(key, 0, sizeof(*key));
+    if (field->kind == STREAM_FIELD_FLOAT) {
+        key->type = SQLITE_FLOAT;
+        if (field->size == 4) {
+            unsigned int narrow = (unsigned int)bits;
+            float f;
+            memcpy(&f, &narrow, sizeof(f));
+            key->r = f;
+        } else {
+            memcpy(&key->r, &bits, sizeof(key->r));
+        }
+        stats_key_normalize(key);
+        return;
+    }
+    int shift = 64 - 8 * field->size;
+    if (field->kind == STREAM_FIELD_SIGNED) {
+        key->type = SQLITE_INTEGER;
+        key->i = shift ? ((sqlite3_int64)(bits << shift)) >> shift : (sqlite3_int64)bits;
+    } else if (bits <= (sqlite3_uint64)0x7FFFFFFFFFFFFFFFULL) {
+        key->type = SQLITE_INTEGER;
+        key->i = (sqlite3_int64)bits;
+    } else {
+        key->type = SQLITE_FLOAT; // Beyond the range of SQLite integers.
+        key->r = (double)bits;
+    }
+}
+
+/**
+ * @brief Opens a FIFO or connects to a Unix stream socket for non-blocking reads.
+ *
+ * A FIFO is opened without waiting for a writer, so that the scan can wait in poll()
+ * and stay interruptible. Until a writer shows up, read() returns 0 as if the stream
+ * had ended; `awaiting_writer` tells the caller to wait instead.
+ * @param path The path of the FIFO or socket.
+ * @param awaiting_writer Receives 1 for a FIFO, 0 otherwise.
+ * @return The file descriptor, or -1 with errno set.
+ */
+static int open_stream(const char *path, int *awaiting_writer) {
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return -1;
+    int fd;
+    if (S_ISSOCK(st.st_mode)) {
+        struct sockaddr_un address;
+        if (strlen(path) >= sizeof(address.sun_path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+    } else {
+        do
+            fd = open(path, O_RDONLY | O_NONBLOCK);
+        while (fd < 0 && errno == EINTR);
+        if (fd < 0)
+            return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    *awaiting_writer = S_ISFIFO(st.st_mode);
+    return fd;
+}
+
+/**
+ * @brief Folds the complete records in the read buffer until a snapshot is due.
+ * @param cursor The cursor.
+ * @return SQLITE_OK, or SQLITE_NOMEM.
+ */
+static int fold_stream_records(StreamStatsCursor *cursor) {
+    const StreamLayout *layout = &cursor->layout;
+    int offset = 0;
+    while (offset + layout->record_size <= cursor->buffered && cursor->pending < cursor->emit_every) {
+        const unsigned char *record = cursor->buffer + offset;
+        offset += layout->record_size;
+        StatsKey key, value;
+        read_stream_field(record, &layout->value, layout->big_endian, &value);
+        double x = value.type == SQLITE_INTEGER ? (double)value.i : value.r;
+        if (isnan(x))
+            continue;
+        if (layout->has_key)
+            read_stream_field(record, &layout->key, layout->big_endian, &key);
+        else
+            memset(&key, 0, sizeof(key));
+        MomentsState *state = (MomentsState *)group_map_lookup(&cursor->groups, &key, 1);
+        if (!state)
+            return SQLITE_NOMEM;
+        stddev_accumulator_add(state, x);
+        cursor->pending++;
+    }
+    memmove(cursor->buffer, cursor->buffer + offset, cursor->buffered - offset);
+    cursor->buffered -= offset;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Reports whether sqlite3_interrupt() was called on a connection.
+ *
+ * sqlite3_is_interrupted() needs SQLite 3.41 at build and run time. With older versions
+ * a waiting scan cannot be cancelled and ends only when the writer closes the stream.
+ * @param db The connection.
+ * @return 1 if the running statement was interrupted, else 0.
+ */
+static int stream_interrupted(sqlite3 *db) {
+#if SQLITE_VERSION_NUMBER >= 3041000
+    return sqlite3_libversion_number() >= 3041000 && sqlite3_is_interrupted(db);
+#else
+    (void)db;
+    return 0;
+#endif
+}
+
+/**
+ * @brief Reads and folds records until the next snapshot is due or the stream ends.
+ *
+ * Positions the cursor on the first row of the new snapshot, or at the end when the
+ * stream ended with nothing new to report.
+ * @param cursor The cursor.
+ * @return SQLITE_OK, or an error code with the error message set on the table.
+ */
+static int next_stream_snapshot(StreamStatsCursor *cursor) {
+    cursor->row = NULL;
+    cursor->pending = 0;
+    while (!cursor->stream_done) {
+        if (fold_stream_records(cursor) != SQLITE_OK)
+            return SQLITE_NOMEM;
+        if (cursor->pending >= cursor->emit_every)
+            break;
+
+        ssize_t got = read(cursor->fd, cursor->buffer + cursor->buffered, STREAM_READ_BUFFER_SIZE - cursor->buffered);
+        if (got > 0) {
+            cursor->buffered += (int)got;
+            cursor->awaiting_writer = 0;
+        } else if (got == 0 && !cursor->awaiting_writer) {
+            cursor->stream_done = 1;
+        } else if (got == 0 || errno == EAGAIN || errno == EWOULDBLOCK) {
+            struct pollfd pfd = {cursor->fd, POLLIN, 0};
+            int ready = poll(&pfd, 1, STREAM_POLL_TIMEOUT_MS);
+            if (ready < 0 && errno != EINTR) {
+                cursor->base.pVtab->zErrMsg = sqlite3_mprintf("stream_stats: poll failed: %s", strerror(errno));
+                return SQLITE_IOERR;
+            }
+            // A hang-up means a writer has come (and gone), so end of file is real from now on.
+            if (ready > 0 && (pfd.revents & POLLHUP))
+                cursor->awaiting_writer = 0;
+            if (stream_interrupted(((StreamStatsTable *)cursor->base.pVtab)->db))
+                return SQLITE_INTERRUPT;
+        } else if (errno != EINTR) {
+            cursor->base.pVtab->zErrMsg = sqlite3_mprintf("stream_stats: read failed: %s", strerror(errno));
+            return SQLITE_IOERR;
+        }
+    }
+    // A trailing partial record left by the writer is dropped.
+    if (cursor->pending > 0) {
+        cursor->snapshot++;
+        cursor->row = cursor->groups.first;
+    }
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Connects the eponymous `stream_stats` virtual table.
+ * @param db The database connection.
+ * @param aux Module user data (unused).
+ * @param argc The number of module arguments.
+ * @param argv The module arguments.
+ * @param vtab Receives the virtual table.
+ * @param error_message Receives an error message.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int stream_stats_connect(sqlite3 *db, void *aux, int argc, const char *const *argv, sqlite3_vtab **vtab, char **error_message) {
+    int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(snapshot INTEGER, key, n INTEGER, mean REAL, variance REAL, stddev REAL, "
+                                      "path HIDDEN, layout HIDDEN, key_field HIDDEN, value_field HIDDEN, emit_every HIDDEN)");
+    if (rc != SQLITE_OK)
+        return rc;
+    // Reading files must not be reachable from schema objects such as views and triggers.
+    sqlite3_vtab_config(db, SQLITE_VTAB_DIRECTONLY);
+    StreamStatsTable *table = (StreamStatsTable *)sqlite3_malloc(sizeof(StreamStatsTable));
+    if (!table)
+        return SQLITE_NOMEM;
+    memset(table, 0, sizeof(StreamStatsTable));
+    table->db = db;
+    *vtab = &table->base;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Disconnects the `stream_stats` virtual table.
+ * @param vtab The virtual table.
+ * @return SQLITE_OK.
+ */
+static int stream_stats_disconnect(sqlite3_vtab *vtab) {
+    sqlite3_free(vtab);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Plans a `stream_stats` scan: the function arguments are passed to xFilter in column order.
+ * @param vtab The virtual table.
+ * @param info The index information.
+ * @return SQLITE_OK, SQLITE_CONSTRAINT for an unusable plan, or SQLITE_ERROR if a required argument is missing.
+ */
+static int stream_stats_best_index(sqlite3_vtab *vtab, sqlite3_index_info *info) {
+    // A stream is read at most once, so the cost only needs to be the same for every plan.
+    return plan_table_function(vtab, info, STREAM_COLUMN_PATH, STREAM_ARGUMENT_COUNT, STREAM_REQUIRED_ARGUMENTS,
+                               "stream_stats requires path, layout, key_field and value_field arguments", 1e9);
+}
+
+/**
+ * @brief Opens a `stream_stats` cursor.
+ * @param vtab The virtual table.
+ * @param cursor Receives the cursor.
+ * @return SQLITE_OK on success, or SQLITE_NOMEM.
+ */
+static int stream_stats_open(sqlite3_vtab *vtab, sqlite3_vtab_cursor **cursor) {
+    StreamStatsCursor *c = (StreamStatsCursor *)calloc(1, sizeof(StreamStatsCursor));
+    if (!c)
+        return SQLITE_NOMEM;
+    c->fd = -1;
+    *cursor = &c->base;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Releases the stream, buffer, states and argument copies of a cursor.
+ * @param c The cursor.
+ */
+static void reset_stream_cursor(StreamStatsCursor *c) {
+    if (c->fd >= 0)
+        close(c->fd);
+    c->fd = -1;
+    free(c->buffer);
+    c->buffer = NULL;
+    group_map_free(&c->groups);
+    free_table_function_arguments(c->arguments, STREAM_ARGUMENT_COUNT);
+    c->buffered = c->stream_done = c->awaiting_writer = 0;
+    c->snapshot = c->rowid = 0;
+    c->row = NULL;
+}
+
+/**
+ * @brief Closes a `stream_stats` cursor.
+ * @param cursor The cursor.
+ * @return SQLITE_OK.
+ */
+static int stream_stats_close(sqlite3_vtab_cursor *cursor) {
+    reset_stream_cursor((StreamStatsCursor *)cursor);
+    free(cursor);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Starts a `stream_stats` scan: opens the stream and reads up to the first snapshot.
+ * @param cursor The cursor.
+ * @param idx_num Bitmask of the arguments passed in argv.
+ * @param idx_str Unused.
+ * @param argc The number of arguments.
+ * @param argv The arguments, in column order.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int stream_stats_filter(sqlite3_vtab_cursor *cursor, int idx_num, const char *idx_str, int argc, sqlite3_value **argv) {
+    StreamStatsCursor *c = (StreamStatsCursor *)cursor;
+    reset_stream_cursor(c);
+    if (copy_table_function_arguments(c->arguments, STREAM_ARGUMENT_COUNT, idx_num, argv) != SQLITE_OK)
+        return SQLITE_NOMEM;
+
+    const char *path = (const char *)sqlite3_value_text(c->arguments[0]);
+    const char *layout = (const char *)sqlite3_value_text(c->arguments[1]);
+    const char *key_field = (const char *)sqlite3_value_text(c->arguments[2]);
+    const char *value_field = (const char *)sqlite3_value_text(c->arguments[3]);
+    c->emit_every = c->arguments[4] ? sqlite3_value_int64(c->arguments[4]) : DEFAULT_STREAM_EMIT_EVERY;
+    if (!path || !layout || !value_field || c->emit_every <= 0) {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("stream_stats requires a path, a layout, a value field and emit_every > 0");
+        return SQLITE_ERROR;
+    }
+    char *error_message = parse_stream_layout(layout, key_field, value_field, &c->layout);
+    if (error_message) {
+        cursor->pVtab->zErrMsg = error_message;
+        return SQLITE_ERROR;
+    }
+
+    group_map_init(&c->groups, sizeof(MomentsState));
+    c->buffer = (unsigned char *)malloc(STREAM_READ_BUFFER_SIZE);
+    if (!c->buffer)
+        return SQLITE_NOMEM;
+    c->fd = open_stream(path, &c->awaiting_writer);
+    if (c->fd < 0) {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("stream_stats: cannot open %s: %s", path, strerror(errno));
+        return SQLITE_CANTOPEN;
+    }
+    return next_stream_snapshot(c);
+}
+
+/**
+ * @brief Advances a `stream_stats` cursor, reading the next snapshot when the current one is exhausted.
+ * @param cursor The cursor.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int stream_stats_next(sqlite3_vtab_cursor *cursor) {
+    StreamStatsCursor *c = (StreamStatsCursor *)cursor;
+    c->rowid++;
+    c->row = c->row->next_added;
+    return c->row ? SQLITE_OK : next_stream_snapshot(c);
+}
+
+/**
+ * @brief Reports whether a `stream_stats` cursor is past the last row.
+ * @param cursor The cursor.
+ * @return Non-zero at the end of the scan.
+ */
+static int stream_stats_eof(sqlite3_vtab_cursor *cursor) { return ((StreamStatsCursor *)cursor)->row == NULL; }
+
+/**
+ * @brief Returns a column of the current `stream_stats` row.
+ * @param cursor The cursor.
+ * @param context The result context.
+ * @param column The column index.
+ * @return SQLITE_OK.
+ */
+static int stream_stats_column(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column) {
+    StreamStatsCursor *c = (StreamStatsCursor *)cursor;
+    const MomentsState *state = (const MomentsState *)group_map_payload(c->row);
+    switch (column) {
+    case STREAM_COLUMN_SNAPSHOT:
+        sqlite3_result_int64(context, c->snapshot);
+        break;
+    case STREAM_COLUMN_KEY:
+        result_stats_key(context, &c->row->key);
+        break;
+    case STREAM_COLUMN_N:
+        sqlite3_result_int64(context, state->n);
+        break;
+    case STREAM_COLUMN_MEAN:
+        set_result(context, state->mean);
+        break;
+    case STREAM_COLUMN_VARIANCE:
+        set_result(context, state->n > 1 ? state->m2 / (state->n - 1) : NAN);
+        break;
+    case STREAM_COLUMN_STDDEV:
+        set_result(context, state->n > 1 ? sqrt(state->m2 / (state->n - 1)) : NAN);
+        break;
+    default:
+        if (c->arguments[column - STREAM_COLUMN_PATH])
+            sqlite3_result_value(context, c->arguments[column - STREAM_COLUMN_PATH]);
+        else if (column == STREAM_COLUMN_EMIT_EVERY)
+            sqlite3_result_int64(context, c->emit_every);
+    }
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Returns the rowid of the current `stream_stats` row.
+ * @param cursor The cursor.
+ * @param rowid Receives the rowid.
+ * @return SQLITE_OK.
+ */
+static int stream_stats_rowid(sqlite3_vtab_cursor *cursor, sqlite3_int64 *rowid) {
+    *rowid = ((StreamStatsCursor *)cursor)->rowid;
+    return SQLITE_OK;
+}
+
+// The eponymous-only `stream_stats` table-valued function.
+static const sqlite3_module stream_stats_module = {
+    0,                        // iVersion
+    NULL,                     // xCreate (eponymous only)
+    stream_stats_connect,     // xConnect
+    stream_stats_best_index,  // xBestIndex
+    stream_stats_disconnect,  // xDisconnect
+    NULL,                     // xDestroy
+    stream_stats_open,        // xOpen
+    stream_stats_close,       // xClose
+    stream_stats_filter,      // xFilter
+    stream_stats_next,        // xNext
+    stream_stats_eof,         // xEof
+    stream_stats_column,      // xColumn
+    stream_stats_rowid,       // xRowid
+};
+
+#endif // !_WIN32
+
+// --- Ring-Buffer Time Series Table ---
+
+// Values kept per key when the table is created without a capacity argument.
+#define DEFAULT_RING_CAPACITY 1000
+
+// Columns of a ring_series table.
+#define RING_COLUMN_KEY 0
+#define RING_COLUMN_TS 1
+#define RING_COLUMN_VALUE 2
+#define RING_COLUMN_N 3
+#define RING_COLUMN_MEAN 4
+#define RING_COLUMN_VARIANCE 5
+#define RING_COLUMN_STDDEV 6
+
+/**
+ * @struct RingSeries
+ * @brief The recent values of one key of a ring_series table.
+ *
+ * `values` and `timestamps` are rings of the same capacity that are always added to
+ * and removed from together, so a logical index addresses the same sample in both.
+ */
+typedef struct {
+    WindowStatsData values;     // Ring of values.
+    WindowStatsData timestamps; // Ring of timestamps (NaN when NULL).
+    MomentsState moments;       // Moments of the values in the ring.
+    int evictions;              // Samples dropped since the moments were last recomputed.
+} RingSeries;
+
+/**
+ * @struct RingJournalEntry
+ * @brief The undo record of one insert into a ring_series table.
+ */
+typedef struct {
+    RingSeries *series;   // The key's ring (GroupMap payloads never move).
+    MomentsState moments; // Moments of the ring before the insert.
+    int evictions;        // Eviction counter of the ring before the insert.
+    int evicted;          // Number of samples the insert dropped from the ring.
+} RingJournalEntry;
+
+/**
+ * @struct RingSeriesTable
+ * @brief A ring_series virtual table.
+ */
+typedef struct {
+    sqlite3_vtab base;         // Base class.
+    StatsConfig *config;       // The connection's configuration (ingestion mode).
+    int capacity;              // Values kept per key.
+    double max_age;            // Values older than the newest timestamp minus this are dropped (0 for no limit).
+    GroupMap series;           // Map from key to RingSeries.
+    sqlite3_int64 inserted;    // Number of rows inserted, used as the rowid of new rows.
+    const char *names[3];      // Column names given as bare arguments (only valid while connecting).
+    int name_lengths[3];       // Lengths of `names`.
+    int name_count;            // Number of column names given.
+    RingJournalEntry *journal; // Undo records of the inserts of the open transaction.
+    int journal_count;         // Number of undo records.
+    int journal_capacity;      // Allocated capacity of `journal`.
+    double *evicted;           // (ts, value) pairs dropped by the journaled inserts, in order.
+    int evicted_count;         // Number of doubles in `evicted`.
+    int evicted_capacity;      // Allocated capacity of `evicted`, in doubles.
+    int *savepoints;           // Journal length when each open savepoint began.
+    int savepoint_count;       // Number of open savepoints.
+    int savepoint_capacity;    // Allocated capacity of `savepoints`.
+} RingSeriesTable;
+
+/**
+ * @struct RingSeriesCursor
+ * @brief A scan of a ring_series table. Rows are read in place from the rings.
+ */
+typedef struct {
+    sqlite3_vtab_cursor base; // Base class.
+    GroupMapEntry *entry;     // The key of the current row, or NULL at the end.
+    int index;                // Logical index of the current row within the key's ring.
+    int single_key;           // Whether the scan is restricted to one key.
+    sqlite3_int64 rowid;      // Row counter.
+} RingSeriesCursor;
+
+/**
+ * @brief Parses an argument of `CREATE VIRTUAL TABLE ... USING ring_series(...)`.
+ *
+ * Up to three bare identifiers name the key, ts and value columns, in that order;
+ * the other arguments are `name=value` (or `name=>value`) options.
+ * @param table The table being created.
+ * @param argument The module argument.
+ * @return NULL on success, or an error message to be freed with sqlite3_free().
+ */
+static char *parse_ring_series_argument(RingSeriesTable *table, const char *argument) {
+    const char *equals = strchr(argument, '=');
+    if (!equals) {
+        int start = 0, end = (int)strlen(argument);
+        while (start < end && is_ascii_space((unsigned char)argument[start]))
+            start++;
+        while (end > start && is_ascii_space((unsigned char)argument[end - 1]))
+            end--;
+        int valid = end > start && !(argument[start] >= '0' && argument[start] <= '9');
+        for (int i = start; i < end && valid; i++) {
+            char c = argument[i];
+            valid = c == '_' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        }
+        if (!valid)
+            return sqlite3_mprintf("ring_series: expected a column name or name=value, got '%s'", argument);
+        if (table->name_count == 3)
+            return sqlite3_mprintf("ring_series: at most three column names (key, ts, value), got '%s'", argument);
+        table->names[table->name_count] = argument + start;
+        table->name_lengths[table->name_count++] = end - start;
+        return NULL;
+    }
+    int name_length = (int)(equals - argument);
+    while (name_length > 0 && is_ascii_space((unsigned char)argument[name_length - 1]))
+        name_length--;
+    const char *value = equals + (equals[1] == '>' ? 2 : 1);
+    char *end;
+    double number = strtod(value, &end);
+    while (is_ascii_space((unsigned char)*end))
+        end++;
+    if (end == value || *end)
+        return sqlite3_mprintf("ring_series: '%s' is not a number", value);
+
+    if (name_length == 8 && sqlite3_strnicmp(argument, "capacity", 8) == 0) {
+        if (number < 1 || number > 1e8 || number != floor(number))
+            return sqlite3_mprintf("ring_series: capacity must be an integer between 1 and 100000000");
+        table->capacity = (int)number;
+    } else if (name_length == 7 && sqlite3_strnicmp(argument, "max_age", 7) == 0) {
+        if (!(number >= 0.0))
+            return sqlite3_mprintf("ring_series: max_age must not be negative");
+        table->max_age = number;
+    } else {
+        return sqlite3_mprintf("ring_series: unknown argument '%.*s'", name_length, argument);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Connects a ring_series table.
+ *
+ * The data lives in memory only, so a table reconnected by a new connection starts empty.
+ * @param db The database connection.
+ * @param aux The StatsConfig of the connection.
+ * @param argc The number of module arguments.
+ * @param argv The module arguments; argv[3] onwards are the table arguments.
+ * @param vtab Receives the virtual table.
+ * @param error_message Receives an error message.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int ring_series_connect(sqlite3 *db, void *aux, int argc, const char *const *argv, sqlite3_vtab **vtab, char **error_message) {
+    RingSeriesTable *table = (RingSeriesTable *)calloc(1, sizeof(RingSeriesTable));
+    if (!table)
+        return SQLITE_NOMEM;
+    table->config = (StatsConfig *)aux;
+    table->capacity = DEFAULT_RING_CAPACITY;
+    group_map_init(&table->series, sizeof(RingSeries));
+    for (int i = 3; i < argc; i++) {
+        *error_message = parse_ring_series_argument(table, argv[i]);
+        if (*error_message) {
+            free(table);
+            return SQLITE_ERROR;
+        }
+    }
+    static const char *const default_names[3] = {"key", "ts", "value"};
+    const char *names[3];
+    int lengths[3];
+    for (int i = 0; i < 3; i++) {
+        names[i] = i < table->name_count ? table->names[i] : default_names[i];
+        lengths[i] = i < table->name_count ? table->name_lengths[i] : (int)strlen(default_names[i]);
+    }
+    char *schema = sqlite3_mprintf("CREATE TABLE x(\"%.*w\", \"%.*w\", \"%.*w\" REAL, n INTEGER HIDDEN, mean REAL HIDDEN, "
+                                   "variance REAL HIDDEN, stddev REAL HIDDEN)",
+                                   lengths[0], names[0], lengths[1], names[1], lengths[2], names[2]);
+    int rc = schema ? sqlite3_declare_vtab(db, schema) : SQLITE_NOMEM;
+    sqlite3_free(schema);
+    if (rc != SQLITE_OK) {
+        if (rc != SQLITE_NOMEM)
+            *error_message = sqlite3_mprintf("ring_series: %s", sqlite3_errmsg(db));
+        free(table);
+        return rc;
+    }
+    *vtab = &table->base;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Disconnects a ring_series table, releasing all of its data.
+ * @param vtab The virtual table.
+ * @return SQLITE_OK.
+ */
+static int ring_series_disconnect(sqlite3_vtab *vtab) {
+    RingSeriesTable *table = (RingSeriesTable *)vtab;
+    for (GroupMapEntry *e = table->series.first; e; e = e->next_added) {
+        RingSeries *series = (RingSeries *)group_map_payload(e);
+        free(series->values.values);
+        free(series->timestamps.values);
+    }
+    group_map_free(&table->series);
+    free(table->journal);
+    free(table->evicted);
+    free(table->savepoints);
+    free(table);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Plans a ring_series scan: an equality constraint on `key` reads a single ring.
+ * @param vtab The virtual table.
+ * @param info The index information.
+ * @return SQLITE_OK.
+ */
+static int ring_series_best_index(sqlite3_vtab *vtab, sqlite3_index_info *info) {
+    RingSeriesTable *table = (RingSeriesTable *)vtab;
+    for (int i = 0; i < info->nConstraint; i++) {
+        const struct sqlite3_index_constraint *constraint = &info->aConstraint[i];
+        if (constraint->usable && constraint->iColumn == RING_COLUMN_KEY && constraint->op == SQLITE_INDEX_CONSTRAINT_EQ) {
+            info->aConstraintUsage[i].argvIndex = 1;
+            info->aConstraintUsage[i].omit = 1;
+            info->idxNum = 1;
+            info->estimatedCost = 1.0 + table->capacity;
+            info->estimatedRows = table->capacity;
+            return SQLITE_OK;
+        }
+    }
+    info->estimatedCost = 1.0 + (double)table->capacity * (table->series.count + 1);
+    info->estimatedRows = (sqlite3_int64)table->capacity * (table->series.count + 1);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Opens a ring_series cursor.
+ * @param vtab The virtual table.
+ * @param cursor Receives the cursor.
+ * @return SQLITE_OK on success, or SQLITE_NOMEM.
+ */
+static int ring_series_open(sqlite3_vtab *vtab, sqlite3_vtab_cursor **cursor) {
+    RingSeriesCursor *c = (RingSeriesCursor *)calloc(1, sizeof(RingSeriesCursor));
+    if (!c)
+        return SQLITE_NOMEM;
+    *cursor = &c->base;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Closes a ring_series cursor.
+ * @param cursor The cursor.
+ * @return SQLITE_OK.
+ */
+static int ring_series_close(sqlite3_vtab_cursor *cursor) {
+    free(cursor);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Skips keys whose ring is empty, starting at the cursor's current key.
+ * @param c The cursor.
+ */
+static void skip_empty_ring_series(RingSeriesCursor *c) {
+    while (c->entry && ((RingSeries *)group_map_payload(c->entry))->values.count == 0)
+        c->entry = c->single_key ? NULL : c->entry->next_added;
+}
+
+/**
+ * @brief Starts a ring_series scan over all keys or, with idx_num 1, over the key in argv[0].
+ * @param cursor The cursor.
+ * @param idx_num 1 if the scan is restricted to one key.
+ * @param idx_str Unused.
+ * @param argc The number of arguments.
+ * @param argv The key, when idx_num is 1.
+ * @return SQLITE_OK.
+ */
+static int ring_series_filter(sqlite3_vtab_cursor *cursor, int idx_num, const char *idx_str, int argc, sqlite3_value **argv) {
+    RingSeriesCursor *c = (RingSeriesCursor *)cursor;
+    RingSeriesTable *table = (RingSeriesTable *)cursor->pVtab;
+    c->index = 0;
+    c->rowid = 0;
+    c->single_key = idx_num == 1;
+    if (c->single_key) {
+        StatsKey key;
+        stats_key_from_value(argv[0], &key);
+        void *payload = group_map_lookup(&table->series, &key, 0);
+        // The payload directly follows its entry.
+        c->entry = payload ? (GroupMapEntry *)payload - 1 : NULL;
+    } else {
+        c->entry = table->series.first;
+    }
+    skip_empty_ring_series(c);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Advances a ring_series cursor to the next value of the ring, or the next key.
+ * @param cursor The cursor.
+ * @return SQLITE_OK.
+ */
+static int ring_series_next(sqlite3_vtab_cursor *cursor) {
+    RingSeriesCursor *c = (RingSeriesCursor *)cursor;
+    c->rowid++;
+    if (++c->index < ((RingSeries *)group_map_payload(c->entry))->values.count)
+        return SQLITE_OK;
+    c->index = 0;
+    c->entry = c->single_key ? NULL : c->entry->next_added;
+    skip_empty_ring_series(c);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Reports whether a ring_series cursor is past the last row.
+ * @param cursor The cursor.
+ * @return Non-zero at the end of the scan.
+ */
+static int ring_series_eof(sqlite3_vtab_cursor *cursor) { return ((RingSeriesCursor *)cursor)->entry == NULL; }
+
+/**
+ * @brief Returns a column of the current ring_series row.
+ *
+ * The hidden statistics columns report the live moments of the row's key, so
+ * `SELECT stddev FROM t WHERE key = ? LIMIT 1` is O(1).
+ * @param cursor The cursor.
+ * @param context The result context.
+ * @param column The column index.
+ * @return SQLITE_OK.
+ */
+static int ring_series_column(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column) {
+    RingSeriesCursor *c = (RingSeriesCursor *)cursor;
+    RingSeries *series = (RingSeries *)group_map_payload(c->entry);
+    const MomentsState *m = &series->moments;
+    switch (column) {
+    case RING_COLUMN_KEY:
+        result_stats_key(context, &c->entry->key);
+        break;
+    case RING_COLUMN_TS:
+        set_timestamp_result(context, get_circular_value(&series->timestamps, c->index));
+        break;
+    case RING_COLUMN_VALUE:
+        sqlite3_result_double(context, get_circular_value(&series->values, c->index));
+        break;
+    case RING_COLUMN_N:
+        sqlite3_result_int64(context, m->n);
+        break;
+    case RING_COLUMN_MEAN:
+        sqlite3_result_double(context, m->mean);
+        break;
+    case RING_COLUMN_VARIANCE:
+        set_result(context, m->n > 1 ? m->m2 / (m->n - 1) : NAN);
+        break;
+    case RING_COLUMN_STDDEV:
+        set_result(context, m->n > 1 ? sqrt(m->m2 / (m->n - 1)) : NAN);
+        break;
+    }
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Returns the rowid of the current ring_series row (its position in the scan).
+ * @param cursor The cursor.
+ * @param rowid Receives the rowid.
+ * @return SQLITE_OK.
+ */
+static int ring_series_rowid(sqlite3_vtab_cursor *cursor, sqlite3_int64 *rowid) {
+    *rowid = ((RingSeriesCursor *)cursor)->rowid;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Grows an array so that it can hold `needed` elements.
+ * @param array The array (updated).
+ * @param capacity The allocated capacity in elements (updated).
+ * @param needed The number of elements required.
+ * @param size The size of an element.
+ * @return SQLITE_OK on success, or SQLITE_NOMEM.
+ */
+static int reserve_ring_array(void **array, int *capacity, sqlite3_int64 needed, size_t size) {
+    if (needed <= *capacity)
+        return SQLITE_OK;
+    sqlite3_int64 new_capacity = *capacity > 0 ? *capacity : 16;
+    while (new_capacity < needed)
+        new_capacity *= CAPACITY_GROWTH_FACTOR;
+    if (new_capacity > 0x7FFFFFFF)
+        return SQLITE_NOMEM;
+    void *grown = realloc(*array, (size_t)new_capacity * size);
+    if (!grown)
+        return SQLITE_NOMEM;
+    *array = grown;
+    *capacity = (int)new_capacity;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Drops the oldest sample of a key's ring, keeping it in the journal.
+ * @param table The table.
+ * @param series The key's ring.
+ * @param entry The journal entry of the current insert.
+ */
+static void evict_ring_sample(RingSeriesTable *table, RingSeries *series, RingJournalEntry *entry) {
+    double ts = remove_from_circular_buffer(&series->timestamps);
+    double value = remove_from_circular_buffer(&series->values);
+    stddev_accumulator_remove(&series->moments, value);
+    table->evicted[table->evicted_count++] = ts;
+    table->evicted[table->evicted_count++] = value;
+    entry->evicted++;
+    series->evictions++;
+}
+
+/**
+ * @brief Appends a sample to a key's ring, dropping the oldest samples that no longer fit.
+ *
+ * The insert is journaled first, so that it can be undone by a rollback.
+ * @param table The table.
+ * @param series The key's ring.
+ * @param ts The timestamp (NaN if NULL).
+ * @param value The value.
+ * @return SQLITE_OK on success, or SQLITE_NOMEM.
+ */
+static int append_ring_sample(RingSeriesTable *table, RingSeries *series, double ts, double value) {
+    // Reserve room for the worst case, in which the insert drops the whole ring.
+    if (reserve_ring_array((void **)&table->journal, &table->journal_capacity, table->journal_count + 1, sizeof(RingJournalEntry)) != SQLITE_OK ||
+        reserve_ring_array((void **)&table->evicted, &table->evicted_capacity,
+                           table->evicted_count + 2 * (sqlite3_int64)series->values.count, sizeof(double)) != SQLITE_OK)
+        return SQLITE_NOMEM;
+    RingJournalEntry *entry = &table->journal[table->journal_count++];
+    entry->series = series;
+    entry->moments = series->moments;
+    entry->evictions = series->evictions;
+    entry->evicted = 0;
+
+    if (table->max_age > 0.0 && !isnan(ts)) {
+        while (series->values.count > 0 && get_circular_value(&series->timestamps, 0) < ts - table->max_age)
+            evict_ring_sample(table, series, entry);
+    }
+    if (series->values.count == series->values.capacity)
+        evict_ring_sample(table, series, entry);
+    add_to_circular_buffer(&series->timestamps, ts);
+    add_to_circular_buffer(&series->values, value);
+    stddev_accumulator_add(&series->moments, value);
+
+    // Removals accumulate rounding drift; recompute the moments from the ring each time
+    // as many samples as it holds have been dropped, which is O(1) amortized.
+    if (series->evictions >= series->values.capacity) {
+        stddev_accumulator_init(&series->moments);
+        for (int i = 0; i < series->values.count; i++)
+            stddev_accumulator_add(&series->moments, get_circular_value(&series->values, i));
+        series->evictions = 0;
+    }
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Undoes journaled inserts, newest first, until `length` journal entries remain.
+ * @param table The table.
+ * @param length The journal length to return to.
+ */
+static void undo_ring_journal(RingSeriesTable *table, int length) {
+    while (table->journal_count > length) {
+        RingJournalEntry *entry = &table->journal[--table->journal_count];
+        RingSeries *series = entry->series;
+        int capacity = series->values.capacity;
+
+        // Drop the inserted sample from the back of the rings.
+        series->values.tail = series->timestamps.tail = (series->values.tail + capacity - 1) % capacity;
+        series->values.count--;
+        series->timestamps.count--;
+
+        // Put the dropped samples back at the front, the most recently dropped first.
+        for (int i = 0; i < entry->evicted; i++) {
+            series->values.head = series->timestamps.head = (series->values.head + capacity - 1) % capacity;
+            series->values.values[series->values.head] = table->evicted[--table->evicted_count];
+            series->timestamps.values[series->timestamps.head] = table->evicted[--table->evicted_count];
+            series->values.count++;
+            series->timestamps.count++;
+        }
+        series->moments = entry->moments;
+        series->evictions = entry->evictions;
+        table->inserted--;
+    }
+}
+
+/**
+ * @brief Inserts a row into a ring_series table. UPDATE and DELETE are not supported.
+ *
+ * Rows with a NULL value (or a value skipped in lenient mode) are ignored.
+ * @param vtab The virtual table.
+ * @param argc The number of arguments.
+ * @param argv argv[0] is the old rowid (NULL for INSERT); argv[2..] are the column values.
+ * @param rowid Receives the rowid of the inserted row.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int ring_series_update(sqlite3_vtab *vtab, int argc, sqlite3_value **argv, sqlite3_int64 *rowid) {
+    RingSeriesTable *table = (RingSeriesTable *)vtab;
+    if (argc == 1 || sqlite3_value_type(argv[0]) != SQLITE_NULL) {
+        vtab->zErrMsg = sqlite3_mprintf("ring_series tables are append-only");
+        return SQLITE_CONSTRAINT;
+    }
+
+    double value, ts = NAN;
+    int status = read_numeric_value(argv[2 + RING_COLUMN_VALUE], table->config->ingest_mode, &value);
+    int ts_status = read_numeric_value(argv[2 + RING_COLUMN_TS], table->config->ingest_mode, &ts);
+    if (status == VALUE_INVALID || ts_status == VALUE_INVALID) {
+        vtab->zErrMsg = sqlite3_mprintf("Invalid data type, expected numeric value.");
+        return SQLITE_MISMATCH;
+    }
+    if (status != VALUE_NUMERIC && status != VALUE_COERCED)
+        return SQLITE_OK;
+    if (ts_status != VALUE_NUMERIC && ts_status != VALUE_COERCED)
+        ts = NAN;
+
+    StatsKey key;
+    stats_key_from_value(argv[2 + RING_COLUMN_KEY], &key);
+    RingSeries *series = (RingSeries *)group_map_lookup(&table->series, &key, 1);
+    if (!series)
+        return SQLITE_NOMEM;
+    if (!series->values.values) {
+        series->values.values = (double *)malloc(table->capacity * sizeof(double));
+        series->timestamps.values = (double *)malloc(table->capacity * sizeof(double));
+        if (!series->values.values || !series->timestamps.values) {
+            free(series->values.values);
+            free(series->timestamps.values);
+            series->values.values = series->timestamps.values = NULL;
+            return SQLITE_NOMEM;
+        }
+        series->values.capacity = series->timestamps.capacity = table->capacity;
+    }
+    if (append_ring_sample(table, series, ts, value) != SQLITE_OK)
+        return SQLITE_NOMEM;
+    *rowid = ++table->inserted;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Starts a transaction on a ring_series table with an empty journal.
+ * @param vtab The virtual table.
+ * @return SQLITE_OK.
+ */
+static int ring_series_begin(sqlite3_vtab *vtab) {
+    RingSeriesTable *table = (RingSeriesTable *)vtab;
+    table->journal_count = table->evicted_count = table->savepoint_count = 0;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Commits a transaction on a ring_series table: the journal is discarded.
+ * @param vtab The virtual table.
+ * @return SQLITE_OK.
+ */
+static int ring_series_commit(sqlite3_vtab *vtab) { return ring_series_begin(vtab); }
+
+/**
+ * @brief Rolls back a transaction on a ring_series table, undoing all of its inserts.
+ * @param vtab The virtual table.
+ * @return SQLITE_OK.
+ */
+static int ring_series_rollback(sqlite3_vtab *vtab) {
+    undo_ring_journal((RingSeriesTable *)vtab, 0);
+    return ring_series_begin(vtab);
+}
+
+/**
+ * @brief Opens savepoint `level` (and any lower levels not seen yet) at the current journal length.
+ * @param vtab The virtual table.
+ * @param level The savepoint level.
+ * @return SQLITE_OK on success, or SQLITE_NOMEM.
+ */
+static int ring_series_savepoint(sqlite3_vtab *vtab, int level) {
+    RingSeriesTable *table = (RingSeriesTable *)vtab;
+    if (reserve_ring_array((void **)&table->savepoints, &table->savepoint_capacity, (sqlite3_int64)level + 1, sizeof(int)) != SQLITE_OK)
+        return SQLITE_NOMEM;
+    while (table->savepoint_count <= level)
+        table->savepoints[table->savepoint_count++] = table->journal_count;
+    table->savepoints[level] = table->journal_count;
+    table->savepoint_count = level + 1;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Releases savepoint `level` and the savepoints above it; their inserts stay journaled.
+ * @param vtab The virtual table.
+ * @param level The savepoint level.
+ * @return SQLITE_OK.
+ */
+static int ring_series_release(sqlite3_vtab *vtab, int level) {
+    RingSeriesTable *table = (RingSeriesTable *)vtab;
+    if (level < table->savepoint_count)
+        table->savepoint_count = level;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Rolls back to savepoint `level`, which stays open.
+ * @param vtab The virtual table.
+ * @param level The savepoint level.
+ * @return SQLITE_OK.
+ */
+static int ring_series_rollback_to(sqlite3_vtab *vtab, int level) {
+    RingSeriesTable *table = (RingSeriesTable *)vtab;
+    if (level < table->savepoint_count) {
+        undo_ring_journal(table, table->savepoints[level]);
+        table->savepoint_count = level + 1;
+    }
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Creates a ring_series table; the same as connecting, as nothing is stored in the database.
+ *
+ * A separate function from ring_series_connect() keeps the module from also being
+ * eponymous.
+ * @param db The database connection.
+ * @param aux The StatsConfig of the connection.
+ * @param argc The number of module arguments.
+ * @param argv The module arguments.
+ * @param vtab Receives the virtual table.
+ * @param error_message Receives an error message.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int ring_series_create(sqlite3 *db, void *aux, int argc, const char *const *argv, sqlite3_vtab **vtab, char **error_message) {
+    return ring_series_connect(db, aux, argc, argv, vtab, error_message);
+}
+
+// The ring_series virtual table module.
+static const sqlite3_module ring_series_module = {
+    2,                       // iVersion
+    ring_series_create,      // xCreate
+    ring_series_connect,     // xConnect
+    ring_series_best_index,  // xBestIndex
+    ring_series_disconnect,  // xDisconnect
+    ring_series_disconnect,  // xDestroy
+    ring_series_open,        // xOpen
+    ring_series_close,       // xClose
+    ring_series_filter,      // xFilter
+    ring_series_next,        // xNext
+    ring_series_eof,         // xEof
+    ring_series_column,      // xColumn
+    ring_series_rowid,       // xRowid
+    ring_series_update,      // xUpdate
+    ring_series_begin,       // xBegin
+    NULL,                    // xSync
+    ring_series_commit,      // xCommit
+    ring_series_rollback,    // xRollback
+    NULL,                    // xFindFunction
+    NULL,                    // xRename
+    ring_series_savepoint,   // xSavepoint
+    ring_series_release,     // xRelease
+    ring_series_rollback_to, // xRollbackTo
+};
+
+// --- Compressed Series Chunks ---
+
+/*
+ * Chunk format (all header fields little-endian):
+ *
+ *   offset  size  field
+ *        0     4  magic "SPK1"
+ *        4     8  n (int64)
+ *       12     8  mean (float64)
+ *       20     8  M2, the sum of squared deviations (float64)
+ *       28     8  min (float64)
+ *       36     8  max (float64)
+ *       44     8  smallest timestamp (int64)
+ *       52     8  largest timestamp (int64)
+ *       60        bit stream of n (ts, value) pairs, most significant bit first
+ *
+ * The first pair is stored as two raw 64-bit words. Later timestamps are stored as the
+ * delta of their delta to the previous one and values as the XOR with the previous
+ * value, as in Facebook's Gorilla time-series format.
+ */
+
+// Size of the chunk header.
+#define CHUNK_HEADER_SIZE 60
+// The magic bytes at the start of a chunk.
+#define CHUNK_MAGIC "SPK1"
+// The bounds used for NULL (unbounded) arguments of chunk_range_stats().
+#define CHUNK_TS_MIN ((sqlite3_int64)(-0x7FFFFFFFFFFFFFFFLL - 1))
+#define CHUNK_TS_MAX ((sqlite3_int64)0x7FFFFFFFFFFFFFFFLL)
+
+/**
+ * @struct BitWriter
+ * @brief A growable bit stream, written most significant bit first.
+ */
+typedef struct {
+    unsigned char *data;       // Completed bytes.
+    size_t size;               // Number of completed bytes.
+    size_t capacity;           // Allocated bytes.
+    sqlite3_uint64 pending;    // Bits not yet written to `data` (the low `pending_bits` bits).
+    int pending_bits;          // Number of pending bits (always < 8 between calls).
+    int failed;                // Whether an allocation failed.
+} BitWriter;
+
+/**
+ * @struct BitReader
+ * @brief A bit stream reader over a byte range.
+ */
+typedef struct {
+    const unsigned char *data; // The bytes.
+    size_t size;               // Number of bytes.
+    size_t position;           // Position in bits.
+    int overrun;               // Whether a read went past the end.
+} BitReader;
+
+/**
+ * @brief Appends up to 32 bits to a bit stream.
+ * @param w The writer.
+ * @param value The bits to write (the low `count` bits).
+ * @param count Number of bits (0-32).
+ */
+static void bit_writer_put32(BitWriter *w, sqlite3_uint64 value, int count) {
+    w->pending = (w->pending << count) | (value & ((1ULL << count) - 1));
+    w->pending_bits += count;
+    while (w->pending_bits >= 8) {
+        if (w->size == w->capacity) {
+            size_t capacity = w->capacity ? w->capacity * CAPACITY_GROWTH_FACTOR : 256;
+            unsigned char *data = (unsigned char *)realloc(w->data, capacity);
+            if (!data) {
+                w->failed = 1;
+                return;
+            }
+            w->data = data;
+            w->capacity = capacity;
+        }
+        w->pending_bits -= 8;
+        w->data[w->size++] = (unsigned char)(w->pending >> w->pending_bits);
+    }
+}
+
+/**
+ * @brief Appends up to 64 bits to a bit stream.
+ * @param w The writer.
+ * @param value The bits to write (the low `count` bits).
+ * @param count Number of bits (0-64).
+ */
+static void bit_writer_put(BitWriter *w, sqlite3_uint64 value, int count) {
+    if (count > 32) {
+        bit_writer_put32(w, value >> 32, count - 32);
+        count = 32;
+    }
+    bit_writer_put32(w, value, count);
+}
+
+/**
+ * @brief Reads up to 64 bits from a bit stream.
+ * @param r The reader.
+ * @param count Number of bits (0-64).
+ * @return The bits, or 0 (with `overrun` set) past the end of the stream.
+ */
+static sqlite3_uint64 bit_reader_get(BitReader *r, int count) {
+    if (r->position + count > r->size * 8) {
+        r->overrun = 1;
+        return 0;
+    }
+    sqlite3_uint64 value = 0;
+    while (count > 0) {
+        int available = 8 - (int)(r->position & 7);
+        int take = available < count ? available : count;
+        unsigned int bits = (r->data[r->position >> 3] >> (available - take)) & ((1u << take) - 1);
+        value = (value << take) | bits;
+        r->position += take;
+        count -= take;
+    }
+    return value;
+}
+
+/**
+ * @brief Counts the leading zero bits of a non-zero 64-bit word.
+ * @param x The word.
+ * @return The number of leading zeros.
+ */
+static int leading_zeros64(sqlite3_uint64 x) {
+#if defined(__GNUC__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    while (!(x & 0x8000000000000000ULL)) {
+        x <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/**
+ * @brief Counts the trailing zero bits of a non-zero 64-bit word.
+ * @param x The word.
+ * @return The number of trailing zeros.
+ */
+static int trailing_zeros64(sqlite3_uint64 x) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/**
+ * @struct SeriesCodec
+ * @brief State shared by the chunk encoder and decoder: the previous pair and XOR block.
+ */
+typedef struct {
+    sqlite3_int64 count;         // Number of pairs coded so far.
+    sqlite3_uint64 ts;           // The previous timestamp.
+    sqlite3_uint64 delta;        // The previous timestamp delta.
+    sqlite3_uint64 value_bits;   // Bits of the previous value.
+    int leading;                 // Leading zeros of the current XOR block.
+    int trailing;                // Trailing zeros of the current XOR block (64 if no block yet).
+} SeriesCodec;
+
+/**
+ * @brief Encodes a (ts, value) pair.
+ * @param codec The codec state.
+ * @param w The bit stream.
+ * @param ts The timestamp.
+ * @param value The value.
+ */
+static void series_encode(SeriesCodec *codec, BitWriter *w, sqlite3_int64 ts, double value) {
+    sqlite3_uint64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if (codec->count++ == 0) {
+        bit_writer_put(w, (sqlite3_uint64)ts, 64);
+        bit_writer_put(w, bits, 64);
+        codec->ts = (sqlite3_uint64)ts;
+        codec->value_bits = bits;
+        codec->trailing = 64;
+        return;
+    }
+
+    // Timestamp: delta of delta, in the smallest of five bucket sizes.
+    sqlite3_uint64 delta = (sqlite3_uint64)ts - codec->ts;
+    sqlite3_int64 dod = (sqlite3_int64)(delta - codec->delta);
+    if (dod == 0)
+        bit_writer_put(w, 0x0, 1);
+    else if (dod >= -63 && dod <= 64)
+        bit_writer_put(w, (0x2ULL << 7) | (sqlite3_uint64)(dod + 63), 9);
+    else if (dod >= -255 && dod <= 256)
+        bit_writer_put(w, (0x6ULL << 9) | (sqlite3_uint64)(dod + 255), 12);
+    else if (dod >= -2047 && dod <= 2048)
+        bit_writer_put(w, (0xEULL << 12) | (sqlite3_uint64)(dod + 2047), 16);
+    else {
+        bit_writer_put(w, 0xF, 4);
+        bit_writer_put(w, (sqlite3_uint64)dod, 64);
+    }
+    codec->ts = (sqlite3_uint64)ts;
+    codec->delta = delta;
+
+    // Value: XOR with the previous value, reusing the previous block when it fits.
+    sqlite3_uint64 x = bits ^ codec->value_bits;
+    codec->value_bits = bits;
+    if (x == 0) {
+        bit_writer_put(w, 0x0, 1);
+        return;
+    }
+    int leading = leading_zeros64(x), trailing = trailing_zeros64(x);
+    if (leading > 31)
+        leading = 31; // Stored in 5 bits.
+    if (codec->trailing < 64 && leading >= codec->leading && trailing >= codec->trailing) {
+        bit_writer_put(w, 0x2, 2);
+        bit_writer_put(w, x >> codec->trailing, 64 - codec->leading - codec->trailing);
+        return;
+    }
+    int length = 64 - leading - trailing;
+    bit_writer_put(w, 0x3, 2);
+    bit_writer_put(w, (sqlite3_uint64)leading, 5);
+    bit_writer_put(w, (sqlite3_uint64)(length & 63), 6); // A length of 64 is stored as 0.
+    bit_writer_put(w, x >> trailing, length);
+    codec->leading = leading;
+    codec->trailing = trailing;
+}
+
+/**
+ * @brief Decodes the next (ts, value) pair.
+ * @param codec The codec state.
+ * @param r The bit stream.
+ * @param ts Receives the timestamp.
+ * @param value Receives the value.
+ */
+static void series_decode(SeriesCodec *codec, BitReader *r, sqlite3_int64 *ts, double *value) {
+    if (codec->count++ == 0) {
+        codec->ts = bit_reader_get(r, 64);
+        codec->value_bits = bit_reader_get(r, 64);
+        codec->trailing = 64;
+    } else {
+        sqlite3_int64 dod;
+        if (bit_reader_get(r, 1) == 0)
+            dod = 0;
+        else if (bit_reader_get(r, 1) == 0)
+            dod = (sqlite3_int64)bit_reader_get(r, 7) - 63;
+        else if (bit_reader_get(r, 1) == 0)
+            dod = (sqlite3_int64)bit_reader_get(r, 9) - 255;
+        else if (bit_reader_get(r, 1) == 0)
+            dod = (sqlite3_int64)bit_reader_get(r, 12) - 2047;
+        else
+            dod = (sqlite3_int64)bit_reader_get(r, 64);
+        codec->delta += (sqlite3_uint64)dod;
+        codec->ts += codec->delta;
+
+        if (bit_reader_get(r, 1) == 1) {
+            if (bit_reader_get(r, 1) == 1) {
+                codec->leading = (int)bit_reader_get(r, 5);
+                int length = (int)bit_reader_get(r, 6);
+                if (length == 0)
+                    length = 64;
+                codec->trailing = 64 - codec->leading - length;
+            }
+            if (codec->trailing < 0 || codec->trailing >= 64) {
+                r->overrun = 1; // Corrupt block header.
+                return;
+            }
+            int length = 64 - codec->leading - codec->trailing;
+            codec->value_bits ^= bit_reader_get(r, length) << codec->trailing;
+        }
+    }
+    *ts = (sqlite3_int64)codec->ts;
+    memcpy(value, &codec->value_bits, sizeof(*value));
+}
+
+/**
+ * @brief Writes a 64-bit word in little-endian byte order.
+ * @param out The destination.
+ * @param bits The word.
+ */
+static void put_le64(unsigned char *out, sqlite3_uint64 bits) {
+    for (int i = 0; i < 8; i++)
+        out[i] = (unsigned char)(bits >> (8 * i));
+}
+
+/**
+ * @brief Reads a 64-bit little-endian word.
+ * @param in The source.
+ * @return The word.
+ */
+static sqlite3_uint64 get_le64(const unsigned char *in) {
+    sqlite3_uint64 bits = 0;
+    for (int i = 7; i >= 0; i--)
+        bits = (bits << 8) | in[i];
+    return bits;
+}
+
+/**
+ * @brief Writes a double in little-endian byte order.
+ * @param out The destination.
+ * @param value The value.
+ */
+static void put_le_double(unsigned char *out, double value) {
+    sqlite3_uint64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_le64(out, bits);
+}
+
+/**
+ * @brief Reads a little-endian double.
+ * @param in The source.
+ * @return The value.
+ */
+static double get_le_double(const unsigned char *in) {
+    sqlite3_uint64 bits = get_le64(in);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * @struct ChunkHeader
+ * @brief The decoded header of a series chunk.
+ */
+typedef struct {
+    MomentsState moments; // Count, mean and M2 of the values.
+    double min;           // Smallest value.
+    double max;           // Largest value.
+    sqlite3_int64 min_ts; // Smallest timestamp.
+    sqlite3_int64 max_ts; // Largest timestamp.
+} ChunkHeader;
+
+/**
+ * @brief Reads the header of a chunk BLOB, reporting an error for anything else.
+ * @param context The SQLite function context.
+ * @param value The argument holding the chunk.
+ * @param header Receives the header.
+ * @return SQLITE_OK, SQLITE_EMPTY for a NULL argument (the result is set to NULL),
+ *         or SQLITE_ERROR (the error is reported).
+ */
+static int read_chunk_header(sqlite3_context *context, sqlite3_value *value, ChunkHeader *header) {
+    if (sqlite3_value_type(value) == SQLITE_NULL) {
+        sqlite3_result_null(context);
+        return SQLITE_EMPTY;
+    }
+    const unsigned char *blob = (const unsigned char *)sqlite3_value_blob(value);
+    if (sqlite3_value_type(value) != SQLITE_BLOB || sqlite3_value_bytes(value) < CHUNK_HEADER_SIZE || memcmp(blob, CHUNK_MAGIC, 4) != 0) {
+        sqlite3_result_error(context, "Expected a chunk created by series_pack().", -1);
+        return SQLITE_ERROR;
+    }
+    header->moments.n = (sqlite3_int64)get_le64(blob + 4);
+    header->moments.mean = get_le_double(blob + 12);
+    header->moments.m2 = get_le_double(blob + 20);
+    header->min = get_le_double(blob + 28);
+    header->max = get_le_double(blob + 36);
+    header->min_ts = (sqlite3_int64)get_le64(blob + 44);
+    header->max_ts = (sqlite3_int64)get_le64(blob + 52);
+    if (header->moments.n < 0) {
+        sqlite3_result_error(context, "Corrupt series chunk.", -1);
+        return SQLITE_ERROR;
+    }
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Sets a JSON object with the n, mean, variance, stddev, min and max of a chunk (range) as the result.
+ * @param context The SQLite function context.
+ * @param header The statistics; the timestamps are included when `with_time_range` is set.
+ * @param with_time_range Whether to add the min_ts and max_ts members.
+ */
+static void chunk_stats_result(sqlite3_context *context, const ChunkHeader *header, int with_time_range) {
+    const MomentsState *m = &header->moments;
+    sqlite3_str *json = sqlite3_str_new(sqlite3_context_db_handle(context));
+    sqlite3_str_appendchar(json, 1, '{');
+    json_append_int(json, "n", m->n);
+    json_append_double(json, "mean", m->n > 0 ? m->mean : NAN);
+    json_append_double(json, "variance", m->n > 1 ? m->m2 / (m->n - 1) : NAN);
+    json_append_double(json, "stddev", m->n > 1 ? sqrt(m->m2 / (m->n - 1)) : NAN);
+    json_append_double(json, "min", m->n > 0 ? header->min : NAN);
+    json_append_double(json, "max", m->n > 0 ? header->max : NAN);
+    if (with_time_range) {
+        json_append_int(json, "min_ts", header->min_ts);
+        json_append_int(json, "max_ts", header->max_ts);
+    }
+    sqlite3_str_appendchar(json, 1, '}');
+    json_result(context, json);
+}
+
+/**
+ * @struct SeriesPackContext
+ * @brief Aggregate context of `series_pack()`.
+ */
+typedef struct {
+    BitWriter stream;   // The compressed pairs.
+    SeriesCodec codec;  // Encoder state.
+    ChunkHeader header; // Statistics for the header.
+    int initialized;    // Whether the ingestion mode has been captured.
+    int ingest_mode;    // Ingestion mode captured at the first step.
+} SeriesPackContext;
+
+/**
+ * @brief The "step" function of `series_pack(ts, value)`.
+ *
+ * Timestamps must be integers (for example Unix epoch seconds or milliseconds); rows
+ * compress best when fed in timestamp order. Rows with a NULL timestamp or value are
+ * ignored.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (2).
+ * @param argv The argument values.
+ */
+static void series_pack_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    SeriesPackContext *ctx = (SeriesPackContext *)sqlite3_aggregate_context(context, sizeof(SeriesPackContext));
+    if (!ctx) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    if (!ctx->initialized) {
+        ctx->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+        ctx->initialized = 1;
+    }
+
+    double value;
+    int status = read_numeric_value(argv[1], ctx->ingest_mode, &value);
+    if (status == VALUE_INVALID) {
+        sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+        return;
+    }
+    if ((status != VALUE_NUMERIC && status != VALUE_COERCED) || sqlite3_value_type(argv[0]) == SQLITE_NULL)
+        return;
+    StatsKey ts;
+    stats_key_from_value(argv[0], &ts);
+    if (ts.type != SQLITE_INTEGER) {
+        sqlite3_result_error(context, "series_pack requires integer timestamps.", -1);
+        return;
+    }
+
+    series_encode(&ctx->codec, &ctx->stream, ts.i, value);
+    if (ctx->stream.failed) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    ChunkHeader *h = &ctx->header;
+    if (h->moments.n == 0) {
+        h->min = h->max = value;
+        h->min_ts = h->max_ts = ts.i;
+    }
+    h->min = value < h->min ? value : h->min;
+    h->max = value > h->max ? value : h->max;
+    h->min_ts = ts.i < h->min_ts ? ts.i : h->min_ts;
+    h->max_ts = ts.i > h->max_ts ? ts.i : h->max_ts;
+    stddev_accumulator_add(&h->moments, value);
+}
+
+/**
+ * @brief The "final" function of `series_pack()`: returns the chunk BLOB, or NULL for no rows.
+ * @param context The SQLite function context.
+ */
+static void series_pack_final(sqlite3_context *context) {
+    SeriesPackContext *ctx = (SeriesPackContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || ctx->header.moments.n == 0) {
+        sqlite3_result_null(context);
+        if (ctx)
+            free(ctx->stream.data);
+        return;
+    }
+
+    // Pad the last byte with zero bits.
+    BitWriter *w = &ctx->stream;
+    if (w->pending_bits > 0)
+        bit_writer_put(w, 0, 8 - w->pending_bits);
+    unsigned char *blob = w->failed ? NULL : (unsigned char *)sqlite3_malloc64(CHUNK_HEADER_SIZE + w->size);
+    if (!blob) {
+        sqlite3_result_error_nomem(context);
+        free(w->data);
+        return;
+    }
+    const ChunkHeader *h = &ctx->header;
+    memcpy(blob, CHUNK_MAGIC, 4);
+    put_le64(blob + 4, (sqlite3_uint64)h->moments.n);
+    put_le_double(blob + 12, h->moments.mean);
+    put_le_double(blob + 20, h->moments.m2);
+    put_le_double(blob + 28, h->min);
+    put_le_double(blob + 36, h->max);
+    put_le64(blob + 44, (sqlite3_uint64)h->min_ts);
+    put_le64(blob + 52, (sqlite3_uint64)h->max_ts);
+    if (w->size > 0)
+        memcpy(blob + CHUNK_HEADER_SIZE, w->data, w->size);
+    sqlite3_result_blob64(context, blob, CHUNK_HEADER_SIZE + w->size, sqlite3_free);
+    free(w->data);
+}
+
+/**
+ * @brief `chunk_stats(chunk)`: the statistics of a chunk, read from its header only.
+ *
+ * Returns a JSON object with n, mean, variance, stddev, min, max, min_ts and max_ts.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (1).
+ * @param argv The argument values.
+ */
+static void chunk_stats_func(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    ChunkHeader header;
+    if (read_chunk_header(context, argv[0], &header) == SQLITE_OK)
+        chunk_stats_result(context, &header, 1);
+}
+
+/**
+ * @brief `chunk_range_stats(chunk, from_ts, to_ts)`: the statistics of the values with
+ * from_ts <= ts <= to_ts.
+ *
+ * A NULL bound is unbounded. A range that covers the whole chunk is answered from the
+ * header, and one that misses it entirely without decoding; otherwise the pairs are
+ * decoded and accumulated in a single pass without materializing them.
+ * Returns a JSON object with n, mean, variance, stddev, min and max.
+ *
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (3).
+ * @param argv The argument values.
+ */
+static void chunk_range_stats_func(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    ChunkHeader header;
+    if (read_chunk_header(context, argv[0], &header) != SQLITE_OK)
+        return;
+    sqlite3_int64 from = sqlite3_value_type(argv[1]) == SQLITE_NULL ? CHUNK_TS_MIN : sqlite3_value_int64(argv[1]);
+    sqlite3_int64 to = sqlite3_value_type(argv[2]) == SQLITE_NULL ? CHUNK_TS_MAX : sqlite3_value_int64(argv[2]);
+    if (from <= header.min_ts && to >= header.max_ts) {
+        chunk_stats_result(context, &header, 0);
+        return;
+    }
+
+    ChunkHeader range;
+    memset(&range, 0, sizeof(range));
+    if (from <= header.max_ts && to >= header.min_ts && from <= to) {
+        BitReader reader = {(const unsigned char *)sqlite3_value_blob(argv[0]) + CHUNK_HEADER_SIZE,
+                            (size_t)sqlite3_value_bytes(argv[0]) - CHUNK_HEADER_SIZE, 0, 0};
+        SeriesCodec codec;
+        memset(&codec, 0, sizeof(codec));
+        for (sqlite3_int64 i = 0; i < header.moments.n; i++) {
+            sqlite3_int64 ts = 0;
+            double value = 0.0;
+            series_decode(&codec, &reader, &ts, &value);
+            if (reader.overrun)
+                break;
+            if (ts < from || ts > to)
+                continue;
+            if (range.moments.n == 0)
+                range.min = range.max = value;
+            range.min = value < range.min ? value : range.min;
+            range.max = value > range.max ? value : range.max;
+            stddev_accumulator_add(&range.moments, value);
+        }
+        if (reader.overrun) {
+            sqlite3_result_error(context, "Corrupt series chunk.", -1);
+            return;
+        }
+    }
+    chunk_stats_result(context, &range, 0);
+}
+
+/**
+ * @brief The "step" function of `chunk_merge_stats(chunk)`: merges chunk headers without decoding.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (1).
+ * @param argv The argument values.
+ */
+static void chunk_merge_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    ChunkHeader *merged = (ChunkHeader *)sqlite3_aggregate_context(context, sizeof(ChunkHeader));
+    if (!merged) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    ChunkHeader header;
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL || read_chunk_header(context, argv[0], &header) != SQLITE_OK || header.moments.n == 0)
+        return;
+    if (merged->moments.n == 0) {
+        *merged = header;
+        return;
+    }
+    stddev_accumulator_merge(&merged->moments, &header.moments);
+    merged->min = header.min < merged->min ? header.min : merged->min;
+    merged->max = header.max > merged->max ? header.max : merged->max;
+    merged->min_ts = header.min_ts < merged->min_ts ? header.min_ts : merged->min_ts;
+    merged->max_ts = header.max_ts > merged->max_ts ? header.max_ts : merged->max_ts;
+}
+
+/**
+ * @brief The "final" function of `chunk_merge_stats()`: the same JSON object as `chunk_stats()` over all chunks.
+ * @param context The SQLite function context.
+ */
+static void chunk_merge_final(sqlite3_context *context) {
+    ChunkHeader *merged = (ChunkHeader *)sqlite3_aggregate_context(context, 0);
+    if (!merged || merged->moments.n == 0)
+        sqlite3_result_null(context);
+    else
+        chunk_stats_result(context, merged, 1);
+}
+
+// --- Empirical Semivariogram ---
+
+// Upper bound on the number of distance bins.
+#define SEMIVARIOGRAM_MAX_BINS 100000
+// Upper bound on the number of worker threads.
+#define SEMIVARIOGRAM_MAX_THREADS 64
+// Upper bound on the number of grid cells.
+#define SEMIVARIOGRAM_MAX_CELLS (1 << 26)
+
+/**
+ * @struct SemivariogramContext
+ * @brief Aggregate context of `semivariogram()`: the points as structure-of-arrays.
+ */
+typedef struct {
+    double *x;        // X coordinates.
+    double *y;        // Y coordinates.
+    double *v;        // Values.
+    int count;        // Number of points.
+    int capacity;     // Allocated points.
+    double bin_width; // Width of a distance bin.
+    double max_dist;  // Largest pair distance considered.
+    int threads;      // Number of threads for the pair enumeration.
+    int ingest_mode;  // Ingestion mode captured at the first step.
+} SemivariogramContext;
+
+/**
+ * @struct SemivariogramGrid
+ * @brief Points bucketed into square cells at least max_dist wide, sorted by cell.
+ *
+ * Every pair within max_dist lies in the same cell or in two adjacent cells.
+ */
+typedef struct {
+    double *x;        // X coordinates, sorted by cell.
+    double *y;        // Y coordinates, sorted by cell.
+    double *v;        // Values, sorted by cell.
+    int *cell_start;  // Index of the first point of each cell; cell_start[cells] is the point count.
+    int columns;      // Number of cell columns.
+    int rows;         // Number of cell rows.
+    int largest_cell; // Number of points in the fullest cell.
+    int bins;         // Number of distance bins.
+    double bin_width; // Width of a distance bin.
+    double max_dist;  // Largest pair distance considered.
+} SemivariogramGrid;
+
+/**
+ * @struct SemivariogramWorker
+ * @brief Per-thread share of the cells and private bin accumulators.
+ */
+typedef struct {
+    const SemivariogramGrid *grid; // The grid.
+    int first_cell;                // First cell processed by this worker.
+    int cell_stride;               // Distance between the cells processed by this worker.
+    sqlite3_int64 *pairs;          // Pair count of each bin.
+    double *sum_sq;                // Sum of squared value differences of each bin.
+    double *sum_dist;              // Sum of pair distances of each bin.
+    double *d2;                    // Scratch: squared distances of one point to a cell.
+    double *sq;                    // Scratch: squared value differences of one point to a cell.
+} SemivariogramWorker;
+
+/**
+ * @brief The "step" function of `semivariogram(x, y, value, bin_width, max_dist [, threads])`.
+ *
+ * The bin width, maximum distance and thread count are read from the first row.
+ * Rows with a NULL coordinate or value are ignored.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (5 or 6).
+ * @param argv The argument values.
+ */
+static void semivariogram_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    SemivariogramContext *ctx = (SemivariogramContext *)sqlite3_aggregate_context(context, sizeof(SemivariogramContext));
+    if (!ctx) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    // Initialize context on the first call.
+    if (ctx->capacity == 0) {
+        ctx->bin_width = sqlite3_value_double(argv[3]);
+        ctx->max_dist = sqlite3_value_double(argv[4]);
+        ctx->threads = argc > 5 ? sqlite3_value_int(argv[5]) : 1;
+        if (!(ctx->bin_width > 0.0) || !(ctx->max_dist > 0.0) || isinf(ctx->max_dist) || ctx->max_dist / ctx->bin_width > SEMIVARIOGRAM_MAX_BINS) {
+            sqlite3_result_error(context, "semivariogram requires bin_width > 0 and 0 < max_dist <= 100000 * bin_width.", -1);
+            return;
+        }
+        if (ctx->threads < 1 || ctx->threads > SEMIVARIOGRAM_MAX_THREADS) {
+            sqlite3_result_error(context, "semivariogram requires between 1 and 64 threads.", -1);
+            return;
+        }
+        ctx->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+        ctx->capacity = INITIAL_CAPACITY;
+        ctx->x = (double *)malloc(3 * ctx->capacity * sizeof(double));
+        if (!ctx->x) {
+            ctx->capacity = 0;
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        ctx->y = ctx->x + ctx->capacity;
+        ctx->v = ctx->y + ctx->capacity;
+    }
+
+    double point[3];
+    for (int i = 0; i < 3; i++) {
+        int status = read_numeric_value(argv[i], ctx->ingest_mode, &point[i]);
+        if (status == VALUE_INVALID) {
+            sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+            return;
+        }
+        if (status != VALUE_NUMERIC && status != VALUE_COERCED)
+            return;
+    }
+    if (isinf(point[0]) || isinf(point[1]))
+        return; // Such a point has no finite distance to anything.
+
+    // The three arrays share one allocation.
+    if (ctx->count == ctx->capacity) {
+        int capacity = ctx->capacity * CAPACITY_GROWTH_FACTOR;
+        double *x = (double *)malloc(3 * (size_t)capacity * sizeof(double));
+        if (!x) {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        memcpy(x, ctx->x, ctx->count * sizeof(double));
+        memcpy(x + capacity, ctx->y, ctx->count * sizeof(double));
+        memcpy(x + 2 * capacity, ctx->v, ctx->count * sizeof(double));
+        free(ctx->x);
+        ctx->x = x;
+        ctx->y = x + capacity;
+        ctx->v = x + 2 * capacity;
+        ctx->capacity = capacity;
+    }
+    ctx->x[ctx->count] = point[0];
+    ctx->y[ctx->count] = point[1];
+    ctx->v[ctx->count] = point[2];
+    ctx->count++;
+}
+
+/**
+ * @brief Buckets the points of a context into a grid.
+ * @param ctx The aggregate context.
+ * @param grid Receives the grid; free with free_semivariogram_grid().
+ * @return SQLITE_OK, SQLITE_RANGE if the coordinates span more than the largest double, or SQLITE_NOMEM.
+ */
+static int build_semivariogram_grid(const SemivariogramContext *ctx, SemivariogramGrid *grid) {
+    memset(grid, 0, sizeof(*grid));
+    grid->bin_width = ctx->bin_width;
+    grid->max_dist = ctx->max_dist;
+    grid->bins = (int)ceil(ctx->max_dist / ctx->bin_width);
+
+    double min_x = ctx->x[0], max_x = ctx->x[0], min_y = ctx->y[0], max_y = ctx->y[0];
+    for (int i = 1; i < ctx->count; i++) {
+        min_x = ctx->x[i] < min_x ? ctx->x[i] : min_x;
+        max_x = ctx->x[i] > max_x ? ctx->x[i] : max_x;
+        min_y = ctx->y[i] < min_y ? ctx->y[i] : min_y;
+        max_y = ctx->y[i] > max_y ? ctx->y[i] : max_y;
+    }
+    double span_x = max_x - min_x, span_y = max_y - min_y;
+    if (!isfinite(span_x) || !isfinite(span_y))
+        return SQLITE_RANGE;
+    // Cells may be wider than max_dist; widen them until the grid is not much larger
+    // than the number of points, so sparse, spread-out data does not allocate a huge grid.
+    double cell = ctx->max_dist;
+    double limit = 4.0 * ctx->count + 1024.0;
+    limit = limit < SEMIVARIOGRAM_MAX_CELLS ? limit : SEMIVARIOGRAM_MAX_CELLS;
+    while ((floor(span_x / cell) + 1.0) * (floor(span_y / cell) + 1.0) > limit)
+        cell *= 2.0;
+    double columns = floor(span_x / cell) + 1.0, rows = floor(span_y / cell) + 1.0;
+    grid->columns = (int)(columns < limit ? columns : limit);
+    grid->rows = (int)(rows < limit ? rows : limit);
+    int cells = grid->columns * grid->rows;
+
+    int *cell_of = (int *)malloc(ctx->count * sizeof(int));
+    grid->cell_start = (int *)calloc(cells + 1, sizeof(int));
+    grid->x = (double *)malloc(3 * (size_t)ctx->count * sizeof(double));
+    if (!cell_of || !grid->cell_start || !grid->x) {
+        free(cell_of);
+        free(grid->cell_start);
+        free(grid->x);
+        return SQLITE_NOMEM;
+    }
+    grid->y = grid->x + ctx->count;
+    grid->v = grid->y + ctx->count;
+
+    // Counting sort by cell.
+    for (int i = 0; i < ctx->count; i++) {
+        int column = (int)((ctx->x[i] - min_x) / cell), row = (int)((ctx->y[i] - min_y) / cell);
+        column = column < grid->columns ? column : grid->columns - 1;
+        row = row < grid->rows ? row : grid->rows - 1;
+        cell_of[i] = row * grid->columns + column;
+        grid->cell_start[cell_of[i] + 1]++;
+    }
+    for (int c = 0; c < cells; c++) {
+        int size = grid->cell_start[c + 1];
+        grid->largest_cell = size > grid->largest_cell ? size : grid->largest_cell;
+        grid->cell_start[c + 1] += grid->cell_start[c];
+    }
+    for (int i = 0; i < ctx->count; i++) {
+        int slot = grid->cell_start[cell_of[i]]++;
+        grid->x[slot] = ctx->x[i];
+        grid->y[slot] = ctx->y[i];
+        grid->v[slot] = ctx->v[i];
+    }
+    // The fill loop advanced each start to the next cell's start; shift them back.
+    for (int c = cells; c > 0; c--)
+        grid->cell_start[c] = grid->cell_start[c - 1];
+    grid->cell_start[0] = 0;
+    free(cell_of);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Frees the arrays of a grid.
+ * @param grid The grid.
+ */
+static void free_semivariogram_grid(SemivariogramGrid *grid) {
+    free(grid->x);
+    free(grid->cell_start);
+}
+
+/**
+ * @brief Accumulates the pairs between the points [a_begin, a_end) and [b_begin, b_end).
+ *
+ * For each point of the first range, a branch-free loop over the second range computes
+ * the squared distances and squared value differences into contiguous scratch arrays
+ * (which the compiler vectorizes), and a second loop bins the pairs within max_dist.
+ *
+ * @param w The worker.
+ * @param a_begin First point of the first range.
+ * @param a_end One past the last point of the first range.
+ * @param b_begin First point of the second range.
+ * @param b_end One past the last point of the second range.
+ * @param same_cell Whether both ranges are the same cell (each pair is then counted once).
+ */
+static void semivariogram_cell_pairs(SemivariogramWorker *w, int a_begin, int a_end, int b_begin, int b_end, int same_cell) {
+    const SemivariogramGrid *g = w->grid;
+    const double *restrict xs = g->x, *restrict ys = g->y, *restrict vs = g->v;
+    double *restrict d2 = w->d2, *restrict sq = w->sq;
+    double max_d2 = g->max_dist * g->max_dist;
+    for (int i = a_begin; i < a_end; i++) {
+        double xi = xs[i], yi = ys[i], vi = vs[i];
+        int first = same_cell ? i + 1 : b_begin;
+        int n = b_end - first;
+        for (int k = 0; k < n; k++) {
+            double dx = xs[first + k] - xi, dy = ys[first + k] - yi, dv = vs[first + k] - vi;
+            d2[k] = dx * dx + dy * dy;
+            sq[k] = dv * dv;
+        }
+        for (int k = 0; k < n; k++) {
+            if (d2[k] > max_d2)
+                continue;
+            double d = sqrt(d2[k]);
+            int bin = (int)(d / g->bin_width);
+            bin = bin < g->bins ? bin : g->bins - 1;
+            w->pairs[bin]++;
+            w->sum_sq[bin] += sq[k];
+            w->sum_dist[bin] += d;
+        }
+    }
+}
+
+/**
+ * @brief Thread body: processes every cell_stride-th cell with its forward neighbours.
+ * @param arg The SemivariogramWorker.
+ */
+static void semivariogram_worker_main(void *arg) {
+    SemivariogramWorker *w = (SemivariogramWorker *)arg;
+    const SemivariogramGrid *g = w->grid;
+    // Half of the neighbourhood, so each pair of cells is visited once.
+    static const int neighbours[4][2] = {{1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+    int cells = g->columns * g->rows;
+    for (int c = w->first_cell; c < cells; c += w->cell_stride) {
+        int a_begin = g->cell_start[c], a_end = g->cell_start[c + 1];
+        if (a_begin == a_end)
+            continue;
+        semivariogram_cell_pairs(w, a_begin, a_end, a_begin, a_end, 1);
+        int column = c % g->columns, row = c / g->columns;
+        for (int k = 0; k < 4; k++) {
+            int nc = column + neighbours[k][0], nr = row + neighbours[k][1];
+            if (nc < 0 || nc >= g->columns || nr >= g->rows)
+                continue;
+            int other = nr * g->columns + nc;
+            semivariogram_cell_pairs(w, a_begin, a_end, g->cell_start[other], g->cell_start[other + 1], 0);
+        }
+    }
+}
+
+/**
+ * @brief The "final" function of `semivariogram()`.
+ *
+ * Buckets the points into a uniform grid so only pairs in the same or adjacent cells
+ * are compared, splits the cells across the worker threads (each with private bins) and
+ * merges the bins. Returns a JSON array with one object per distance bin: `bin` (the
+ * index, covering [bin * bin_width, (bin + 1) * bin_width)), `lag` (the mean pair
+ * distance), `pairs` and `gamma` (half the mean squared value difference).
+ *
+ * @param context The SQLite function context.
+ */
+static void semivariogram_final(sqlite3_context *context) {
+    SemivariogramContext *ctx = (SemivariogramContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || ctx->count == 0) {
+        sqlite3_result_null(context);
+        if (ctx)
+            free(ctx->x);
+        return;
+    }
+
+    SemivariogramGrid grid;
+    SemivariogramWorker *workers = NULL;
+    StatsThread threads[SEMIVARIOGRAM_MAX_THREADS];
+    int started[SEMIVARIOGRAM_MAX_THREADS] = {0};
+    int rc = build_semivariogram_grid(ctx, &grid);
+    free(ctx->x);
+    ctx->x = NULL;
+    if (rc == SQLITE_RANGE) {
+        sqlite3_result_error(context, "semivariogram coordinates must span less than the largest finite distance.", -1);
+        return;
+    }
+    if (rc != SQLITE_OK) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    int cells = grid.columns * grid.rows;
+    int worker_count = ctx->threads < cells ? ctx->threads : cells;
+    workers = (SemivariogramWorker *)calloc(worker_count, sizeof(SemivariogramWorker));
+    for (int t = 0; workers && t < worker_count; t++) {
+        SemivariogramWorker *w = &workers[t];
+        w->grid = &grid;
+        w->first_cell = t;
+        w->cell_stride = worker_count;
+        w->pairs = (sqlite3_int64 *)calloc(grid.bins, sizeof(sqlite3_int64));
+        w->sum_sq = (double *)calloc(2 * (size_t)grid.bins, sizeof(double));
+        w->d2 = (double *)malloc(2 * ((size_t)grid.largest_cell + 1) * sizeof(double));
+        if (!w->pairs || !w->sum_sq || !w->d2) {
+            rc = SQLITE_NOMEM;
+            break;
+        }
+        w->sum_dist = w->sum_sq + grid.bins;
+        w->sq = w->d2 + grid.largest_cell + 1;
+    }
+    if (!workers)
+        rc = SQLITE_NOMEM;
+
+    if (rc == SQLITE_OK) {
+        // Worker 0 runs on the calling thread, as does any worker whose thread fails to start.
+        for (int t = 1; t < worker_count; t++)
+            started[t] = stats_thread_start(&threads[t], semivariogram_worker_main, &workers[t]) == SQLITE_OK;
+        semivariogram_worker_main(&workers[0]);
+        for (int t = 1; t < worker_count; t++) {
+            if (started[t])
+                stats_thread_join(threads[t]);
+            else
+                semivariogram_worker_main(&workers[t]);
+        }
+
+        sqlite3_str *json = sqlite3_str_new(sqlite3_context_db_handle(context));
+        sqlite3_str_appendchar(json, 1, '[');
+        for (int b = 0; b < grid.bins; b++) {
+            sqlite3_int64 pairs = 0;
+            double sum_sq = 0.0, sum_dist = 0.0;
+            for (int t = 0; t < worker_count; t++) {
+                pairs += workers[t].pairs[b];
+                sum_sq += workers[t].sum_sq[b];
+                sum_dist += workers[t].sum_dist[b];
+            }
+            json_append_separator(json);
+            sqlite3_str_appendchar(json, 1, '{');
+            json_append_int(json, "bin", b);
+            json_append_double(json, "lag", pairs > 0 ? sum_dist / pairs : NAN);
+            json_append_int(json, "pairs", pairs);
+            json_append_double(json, "gamma", pairs > 0 ? sum_sq / (2.0 * pairs) : NAN);
+            sqlite3_str_appendchar(json, 1, '}');
+        }
+        sqlite3_str_appendchar(json, 1, ']');
+        json_result(context, json);
+    } else {
+        sqlite3_result_error_nomem(context);
+    }
+
+    for (int t = 0; workers && t < worker_count; t++) {
+        free(workers[t].pairs);
+        free(workers[t].sum_sq);
+        free(workers[t].d2);
+    }
+    free(workers);
+    free_semivariogram_grid(&grid);
+}
+
+// --- Kernel-Weighted Rolling Variance ---
+
+// Number of cascaded boxes per kernel.
+#define KERNEL_BOXES_TRIANGULAR 2
+#define KERNEL_BOXES_GAUSSIAN 3
+// Largest supported kernel width in rows.
+#define KERNEL_MAX_WIDTH 10000000
+
+/**
+ * @struct KernelSums
+ * @brief Weight, weighted sum and weighted sum of squares of (shifted) values.
+ */
+typedef struct {
+    double w; // Sum of weights.
+    double s; // Sum of weight * value.
+    double q; // Sum of weight * value^2.
+} KernelSums;
+
+/**
+ * @struct BoxStage
+ * @brief One box filter of a cascade: a running sum over its last `length` inputs.
+ */
+typedef struct {
+    KernelSums *ring; // The last `length` inputs (zero before they are filled).
+    int length;       // Box length in rows.
+    int next;         // Ring slot of the oldest input, overwritten next.
+    KernelSums sum;   // Sum of the inputs in the ring.
+} BoxStage;
+
+/**
+ * @struct KernelVarianceContext
+ * @brief Aggregate context of `kernel_rolling_variance()`.
+ */
+typedef struct {
+    BoxStage stages[KERNEL_BOXES_GAUSSIAN]; // The cascade.
+    int stage_count;                        // Number of boxes in the cascade.
+    double shift;                           // First value, subtracted from all values for precision.
+    int has_shift;                          // Whether `shift` has been set.
+    int ingest_mode;                        // Ingestion mode captured at the first step.
+    KernelSums output;                      // Output of the last box after the current row.
+} KernelVarianceContext;
+
+/**
+ * @brief Pushes an input through a box filter.
+ *
+ * The running sum is updated in O(1). It is recomputed from the ring each time the
+ * ring wraps around, which bounds rounding drift at O(1) amortized cost.
+ * @param stage The box filter.
+ * @param in The input.
+ * @return The sum of the last `length` inputs.
+ */
+static KernelSums box_stage_push(BoxStage *stage, KernelSums in) {
+    KernelSums *out = &stage->ring[stage->next];
+    stage->sum.w += in.w - out->w;
+    stage->sum.s += in.s - out->s;
+    stage->sum.q += in.q - out->q;
+    *out = in;
+    if (++stage->next == stage->length) {
+        stage->next = 0;
+        KernelSums exact = {0.0, 0.0, 0.0};
+        for (int i = 0; i < stage->length; i++) {
+            exact.w += stage->ring[i].w;
+            exact.s += stage->ring[i].s;
+            exact.q += stage->ring[i].q;
+        }
+        stage->sum = exact;
+    }
+    return stage->sum;
+}
+
+/**
+ * @brief The "step" function of `kernel_rolling_variance(x, kernel, width)`.
+ *
+ * Pushes the row through a cascade of box filters: two boxes of (width + 1) / 2 rows
+ * give a triangular kernel, three boxes of (width + 2) / 3 rows approximate a Gaussian.
+ * A NULL value enters with zero weight, so the kernel still advances by one row.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (3).
+ * @param argv The argument values.
+ */
+static void kernel_variance_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    KernelVarianceContext *ctx = (KernelVarianceContext *)sqlite3_aggregate_context(context, sizeof(KernelVarianceContext));
+    if (!ctx) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    // Initialize context on the first call.
+    if (ctx->stage_count == 0) {
+        const char *kernel = (const char *)sqlite3_value_text(argv[1]);
+        sqlite3_int64 width = sqlite3_value_int64(argv[2]);
+        int boxes;
+        if (kernel && sqlite3_stricmp(kernel, "triangular") == 0)
+            boxes = KERNEL_BOXES_TRIANGULAR;
+        else if (kernel && sqlite3_stricmp(kernel, "gaussian") == 0)
+            boxes = KERNEL_BOXES_GAUSSIAN;
+        else {
+            sqlite3_result_error(context, "kernel_rolling_variance kernel must be 'triangular' or 'gaussian'.", -1);
+            return;
+        }
+        if (width < 1 || width > KERNEL_MAX_WIDTH) {
+            sqlite3_result_error(context, "kernel_rolling_variance requires 1 <= width <= 10000000.", -1);
+            return;
+        }
+        int length = (int)((width + boxes - 1) / boxes);
+        KernelSums *rings = (KernelSums *)calloc((size_t)boxes * length, sizeof(KernelSums));
+        if (!rings) {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        for (int i = 0; i < boxes; i++) {
+            ctx->stages[i].ring = rings + (size_t)i * length;
+            ctx->stages[i].length = length;
+        }
+        ctx->stage_count = boxes;
+        ctx->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+    }
+
+    double value;
+    KernelSums sample = {0.0, 0.0, 0.0};
+    int status = read_numeric_value(argv[0], ctx->ingest_mode, &value);
+    if (status == VALUE_INVALID) {
+        sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+        return;
+    }
+    if (status == VALUE_NUMERIC || status == VALUE_COERCED) {
+        if (!ctx->has_shift) {
+            ctx->shift = value;
+            ctx->has_shift = 1;
+        }
+        double shifted = value - ctx->shift;
+        sample.w = 1.0;
+        sample.s = shifted;
+        sample.q = shifted * shifted;
+    }
+    for (int i = 0; i < ctx->stage_count; i++)
+        sample = box_stage_push(&ctx->stages[i], sample);
+    ctx->output = sample;
+}
+
+/**
+ * @brief The "inverse" function of `kernel_rolling_variance()`.
+ *
+ * The kernel keeps its own window, so frames that drop rows are rejected.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments.
+ * @param argv The argument values of the row leaving the window.
+ */
+static void kernel_variance_inverse(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    sqlite3_result_error(context, "kernel_rolling_variance requires a frame starting at UNBOUNDED PRECEDING.", -1);
+}
+
+/**
+ * @brief The "value" function of `kernel_rolling_variance()`: the kernel-weighted
+ * (population) variance of the rows ending at the current row, or NULL if none has weight.
+ * @param context The SQLite function context.
+ */
+static void kernel_variance_value(sqlite3_context *context) {
+    KernelVarianceContext *ctx = (KernelVarianceContext *)sqlite3_aggregate_context(context, 0);
+    // A tiny positive weight can remain from the running sums after all values left.
+    if (!ctx || !(ctx->output.w > 0.5)) {
+        sqlite3_result_null(context);
+        return;
+    }
+    double mean = ctx->output.s / ctx->output.w;
+    double variance = ctx->output.q / ctx->output.w - mean * mean;
+    set_result(context, variance > 0.0 ? variance : 0.0);
+}
+
+/**
+ * @brief The "final" function of `kernel_rolling_variance()`.
+ *
+ * As an aggregate, returns the kernel-weighted variance ending at the last row.
+ * @param context The SQLite function context.
+ */
+static void kernel_variance_final(sqlite3_context *context) {
+    kernel_variance_value(context);
+    KernelVarianceContext *ctx = (KernelVarianceContext *)sqlite3_aggregate_context(context, 0);
+    if (ctx && ctx->stage_count > 0) {
+        free(ctx->stages[0].ring);
+        ctx->stage_count = 0;
+    }
+}
+
+// --- Session-Window Statistics ---
+
+// Columns of the session_stats table-valued function.
+#define SESSION_COLUMN_KEY 0
+#define SESSION_COLUMN_SESSION 1
+#define SESSION_COLUMN_START_TS 2
+#define SESSION_COLUMN_END_TS 3
+#define SESSION_COLUMN_DURATION 4
+#define SESSION_COLUMN_N 5
+#define SESSION_COLUMN_MEAN 6
+#define SESSION_COLUMN_VARIANCE 7
+#define SESSION_COLUMN_STDDEV 8
+#define SESSION_COLUMN_TABLE 9
+#define SESSION_COLUMN_KEY_COL 10
+#define SESSION_COLUMN_TS_COL 11
+#define SESSION_COLUMN_VALUE_COL 12
+#define SESSION_COLUMN_MAX_GAP 13
+// Number of hidden argument columns, starting at SESSION_COLUMN_TABLE.
+#define SESSION_ARGUMENT_COUNT 5
+// Every argument must be given (key_col may be NULL).
+#define SESSION_REQUIRED_ARGUMENTS 0x1F
+
+/**
+ * @struct SessionStatsTable
+ * @brief The eponymous `session_stats` virtual table.
+ */
+typedef struct {
+    sqlite3_vtab base;   // Base class.
+    sqlite3 *db;         // The connection, used to read the source table.
+    StatsConfig *config; // The connection's configuration (ingestion mode).
+} SessionStatsTable;
+
+/**
+ * @struct SessionState
+ * @brief The statistics of one session.
+ */
+typedef struct {
+    sqlite3_value *key;     // The session's key (owned copy), or NULL pointer when unused.
+    sqlite3_int64 number;   // 1-based number of the session within its key.
+    double start_ts;        // Timestamp of the first row.
+    double end_ts;          // Timestamp of the last row.
+    MomentsState moments;   // Moments of the non-NULL values.
+} SessionState;
+
+/**
+ * @struct SessionStatsCursor
+ * @brief A scan of `session_stats()`: streams the source in (key, ts) order.
+ */
+typedef struct {
+    sqlite3_vtab_cursor base;                      // Base class.
+    sqlite3_stmt *stmt;                            // SELECT key, ts, value ... ORDER BY key, ts.
+    double max_gap;                                // Largest gap within a session.
+    int ingest_mode;                               // Ingestion mode captured at the start of the scan.
+    SessionState open;                             // The session being accumulated.
+    SessionState row;                              // The completed session of the current row.
+    int eof;                                       // Whether the scan is past the last row.
+    sqlite3_int64 rowid;                           // Row counter.
+    sqlite3_value *arguments[SESSION_ARGUMENT_COUNT]; // Argument values of the scan, for the hidden columns.
+} SessionStatsCursor;
+
+/**
+ * @brief Connects the eponymous `session_stats` virtual table.
+ * @param db The database connection.
+ * @param aux The StatsConfig of the connection.
+ * @param argc The number of module arguments.
+ * @param argv The module arguments.
+ * @param vtab Receives the virtual table.
+ * @param error_message Receives an error message.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int session_stats_connect(sqlite3 *db, void *aux, int argc, const char *const *argv, sqlite3_vtab **vtab, char **error_message) {
+    int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(key, session INTEGER, start_ts, end_ts, duration, n INTEGER, mean REAL, variance REAL, "
+                                      "stddev REAL, \"table\" HIDDEN, key_col HIDDEN, ts_col HIDDEN, value_col HIDDEN, max_gap HIDDEN)");
+    if (rc != SQLITE_OK)
+        return rc;
+    SessionStatsTable *table = (SessionStatsTable *)sqlite3_malloc(sizeof(SessionStatsTable));
+    if (!table)
+        return SQLITE_NOMEM;
+    memset(table, 0, sizeof(*table));
+    table->db = db;
+    table->config = (StatsConfig *)aux;
+    *vtab = &table->base;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Disconnects the `session_stats` virtual table.
+ * @param vtab The virtual table.
+ * @return SQLITE_OK.
+ */
+static int session_stats_disconnect(sqlite3_vtab *vtab) {
+    sqlite3_free(vtab);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Plans a `session_stats` scan.
+ * @param vtab The virtual table.
+ * @param info The index information.
+ * @return SQLITE_OK, SQLITE_CONSTRAINT for an unusable plan, or SQLITE_ERROR if an argument is missing.
+ */
+static int session_stats_best_index(sqlite3_vtab *vtab, sqlite3_index_info *info) {
+    return plan_table_function(vtab, info, SESSION_COLUMN_TABLE, SESSION_ARGUMENT_COUNT, SESSION_REQUIRED_ARGUMENTS,
+                               "session_stats requires table, key_col, ts_col, value_col and max_gap arguments", 1e6);
+}
+
+/**
+ * @brief Opens a `session_stats` cursor.
+ * @param vtab The virtual table.
+ * @param cursor Receives the cursor.
+ * @return SQLITE_OK on success, or SQLITE_NOMEM.
+ */
+static int session_stats_open(sqlite3_vtab *vtab, sqlite3_vtab_cursor **cursor) {
+    SessionStatsCursor *c = (SessionStatsCursor *)calloc(1, sizeof(SessionStatsCursor));
+    if (!c)
+        return SQLITE_NOMEM;
+    *cursor = &c->base;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Releases the statement, sessions and argument copies of a cursor.
+ * @param c The cursor.
+ */
+static void reset_session_cursor(SessionStatsCursor *c) {
+    sqlite3_finalize(c->stmt);
+    c->stmt = NULL;
+    sqlite3_value_free(c->open.key);
+    sqlite3_value_free(c->row.key);
+    memset(&c->open, 0, sizeof(c->open));
+    memset(&c->row, 0, sizeof(c->row));
+    free_table_function_arguments(c->arguments, SESSION_ARGUMENT_COUNT);
+    c->eof = 1;
+    c->rowid = 0;
+}
+
+/**
+ * @brief Closes a `session_stats` cursor.
+ * @param cursor The cursor.
+ * @return SQLITE_OK.
+ */
+static int session_stats_close(sqlite3_vtab_cursor *cursor) {
+    reset_session_cursor((SessionStatsCursor *)cursor);
+    free(cursor);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Reads source rows until a session is complete and makes it the current row.
+ *
+ * A session ends when the key changes or the gap to the previous row of the key exceeds
+ * max_gap. Only the open session is kept, so the state is O(1) regardless of the number
+ * of keys. Rows with a NULL timestamp are ignored; rows with a NULL value extend the
+ * session without contributing to its moments.
+ * @param c The cursor.
+ * @return SQLITE_OK, or an error code with the error message set on the table.
+ */
+static int next_session(SessionStatsCursor *c) {
+    sqlite3_value_free(c->row.key);
+    memset(&c->row, 0, sizeof(c->row));
+    for (;;) {
+        // The statement is finalized at the end of the source, as stepping it again would restart it.
+        int rc = c->stmt ? sqlite3_step(c->stmt) : SQLITE_DONE;
+        if (rc == SQLITE_DONE) {
+            sqlite3_finalize(c->stmt);
+            c->stmt = NULL;
+            // The open session, if any, is the last one.
+            c->row = c->open;
+            memset(&c->open, 0, sizeof(c->open));
+            c->eof = c->row.key == NULL;
+            return SQLITE_OK;
+        }
+        if (rc != SQLITE_ROW) {
+            c->base.pVtab->zErrMsg = sqlite3_mprintf("session_stats: %s", sqlite3_errmsg(sqlite3_db_handle(c->stmt)));
+            return rc;
+        }
+        if (sqlite3_column_type(c->stmt, 1) == SQLITE_NULL)
+            continue;
+        double ts = sqlite3_column_double(c->stmt, 1), value;
+        int status = read_numeric_value(sqlite3_column_value(c->stmt, 2), c->ingest_mode, &value);
+        if (status == VALUE_INVALID) {
+            c->base.pVtab->zErrMsg = sqlite3_mprintf("Invalid data type, expected numeric value.");
+            return SQLITE_MISMATCH;
+        }
+
+        int same_key = 0;
+        if (c->open.key) {
+            StatsKey open_key, key;
+            stats_key_from_value(c->open.key, &open_key);
+            stats_key_from_value(sqlite3_column_value(c->stmt, 0), &key);
+            same_key = stats_key_equal(&open_key, &key);
+        }
+        int completed = 0;
+        if (!same_key || ts - c->open.end_ts > c->max_gap) {
+            // Close the open session and start a new one with this row.
+            sqlite3_int64 number = same_key ? c->open.number + 1 : 1;
+            if (c->open.key) {
+                c->row = c->open;
+                completed = 1;
+            }
+            memset(&c->open, 0, sizeof(c->open));
+            c->open.key = sqlite3_value_dup(sqlite3_column_value(c->stmt, 0));
+            if (!c->open.key)
+                return SQLITE_NOMEM;
+            c->open.number = number;
+            c->open.start_ts = ts;
+        }
+        c->open.end_ts = ts;
+        if (status == VALUE_NUMERIC || status == VALUE_COERCED)
+            stddev_accumulator_add(&c->open.moments, value);
+        if (completed)
+            return SQLITE_OK;
+    }
+}
+
+/**
+ * @brief Starts a `session_stats` scan.
+ *
+ * Reads `SELECT key_col, ts_col, value_col FROM table ORDER BY key_col, ts_col`; with an
+ * index on (key_col, ts_col) the rows stream without a sort. A NULL key_col treats the
+ * whole table as one key.
+ * @param cursor The cursor.
+ * @param idx_num Bitmask of the arguments passed in argv.
+ * @param idx_str Unused.
+ * @param argc The number of arguments.
+ * @param argv The arguments, in column order.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int session_stats_filter(sqlite3_vtab_cursor *cursor, int idx_num, const char *idx_str, int argc, sqlite3_value **argv) {
+    SessionStatsCursor *c = (SessionStatsCursor *)cursor;
+    SessionStatsTable *table = (SessionStatsTable *)cursor->pVtab;
+    reset_session_cursor(c);
+    if (copy_table_function_arguments(c->arguments, SESSION_ARGUMENT_COUNT, idx_num, argv) != SQLITE_OK)
+        return SQLITE_NOMEM;
+
+    const char *source = (const char *)sqlite3_value_text(c->arguments[0]);
+    const char *key_col = (const char *)sqlite3_value_text(c->arguments[1]);
+    const char *ts_col = (const char *)sqlite3_value_text(c->arguments[2]);
+    const char *value_col = (const char *)sqlite3_value_text(c->arguments[3]);
+    c->max_gap = sqlite3_value_double(c->arguments[4]);
+    if (!source || !ts_col || !value_col || sqlite3_value_type(c->arguments[4]) == SQLITE_NULL || c->max_gap < 0.0) {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("session_stats requires table, ts_col and value_col names and max_gap >= 0");
+        return SQLITE_ERROR;
+    }
+    c->ingest_mode = table->config->ingest_mode;
+
+    char *sql = key_col ? sqlite3_mprintf("SELECT \"%w\", \"%w\", \"%w\" FROM \"%w\" ORDER BY 1, 2", key_col, ts_col, value_col, source)
+                        : sqlite3_mprintf("SELECT 0, \"%w\", \"%w\" FROM \"%w\" ORDER BY 2", ts_col, value_col, source);
+    if (!sql)
+        return SQLITE_NOMEM;
+    int rc = sqlite3_prepare_v2(table->db, sql, -1, &c->stmt, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK) {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("session_stats: %s", sqlite3_errmsg(table->db));
+        return rc;
+    }
+    c->eof = 0;
+    return next_session(c);
+}
+
+/**
+ * @brief Advances a `session_stats` cursor to the next session.
+ * @param cursor The cursor.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int session_stats_next(sqlite3_vtab_cursor *cursor) {
+    SessionStatsCursor *c = (SessionStatsCursor *)cursor;
+    c->rowid++;
+    return next_session(c);
+}
+
+/**
+ * @brief Reports whether a `session_stats` cursor is past the last row.
+ * @param cursor The cursor.
+ * @return Non-zero at the end of the scan.
+ */
+static int session_stats_eof(sqlite3_vtab_cursor *cursor) { return ((SessionStatsCursor *)cursor)->eof; }
+
+/**
+ * @brief Returns a column of the current `session_stats` row.
+ * @param cursor The cursor.
+ * @param context The result context.
+ * @param column The column index.
+ * @return SQLITE_OK.
+ */
+static int session_stats_column(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column) {
+    SessionStatsCursor *c = (SessionStatsCursor *)cursor;
+    const SessionState *s = &c->row;
+    const MomentsState *m = &s->moments;
+    switch (column) {
+    case SESSION_COLUMN_KEY:
+        if (c->arguments[1] && sqlite3_value_type(c->arguments[1]) != SQLITE_NULL)
+            sqlite3_result_value(context, s->key);
+        else
+            sqlite3_result_null(context);
+        break;
+    case SESSION_COLUMN_SESSION:
+        sqlite3_result_int64(context, s->number);
+        break;
+    case SESSION_COLUMN_START_TS:
+        set_timestamp_result(context, s->start_ts);
+        break;
+    case SESSION_COLUMN_END_TS:
+        set_timestamp_result(context, s->end_ts);
+        break;
+    case SESSION_COLUMN_DURATION:
+        set_timestamp_result(context, s->end_ts - s->start_ts);
+        break;
+    case SESSION_COLUMN_N:
+        sqlite3_result_int64(context, m->n);
+        break;
+    case SESSION_COLUMN_MEAN:
+        set_result(context, m->n > 0 ? m->mean : NAN);
+        break;
+    case SESSION_COLUMN_VARIANCE:
+        set_result(context, m->n > 1 ? m->m2 / (m->n - 1) : NAN);
+        break;
+    case SESSION_COLUMN_STDDEV:
+        set_result(context, m->n > 1 ? sqrt(m->m2 / (m->n - 1)) : NAN);
+        break;
+    default:
+        if (c->arguments[column - SESSION_COLUMN_TABLE])
+            sqlite3_result_value(context, c->arguments[column - SESSION_COLUMN_TABLE]);
+    }
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Returns the rowid of the current `session_stats` row.
+ * @param cursor The cursor.
+ * @param rowid Receives the rowid.
+ * @return SQLITE_OK.
+ */
+static int session_stats_rowid(sqlite3_vtab_cursor *cursor, sqlite3_int64 *rowid) {
+    *rowid = ((SessionStatsCursor *)cursor)->rowid;
+    return SQLITE_OK;
+}
+
+// The eponymous-only `session_stats` table-valued function.
+static const sqlite3_module session_stats_module = {
+    0,                        // iVersion
+    NULL,                     // xCreate (eponymous only)
+    session_stats_connect,    // xConnect
+    session_stats_best_index, // xBestIndex
+    session_stats_disconnect, // xDisconnect
+    NULL,                     // xDestroy
+    session_stats_open,       // xOpen
+    session_stats_close,      // xClose
+    session_stats_filter,     // xFilter
+    session_stats_next,       // xNext
+    session_stats_eof,        // xEof
+    session_stats_column,     // xColumn
+    session_stats_rowid,      // xRowid
+};
+
+// --- Incremental PCA (Frequent Directions) ---
+
+/*
+ * The principal components are tracked with a Frequent Directions sketch (Liberty,
+ * 2013): a matrix B of 4k rows whose Gram matrix B^T B approximates the scatter matrix
+ * of the centered vectors. Vectors are centered on the fly with the running mean: the
+ * n-th vector enters the sketch as sqrt((n - 1) / n) * (x - mean), which keeps the
+ * scatter exact (the multivariate form of Welford's update). New rows fill the free
+ * half of the sketch; once it is full, a single SVD shrinks every singular value by the
+ * median one, which frees 2k rows again. The SVD therefore runs once per block of 2k
+ * vectors, and the per-vector work is a few contiguous loops over the d dimensions.
+ *
+ * State format (all fields little-endian):
+ *
+ *   offset  size  field
+ *        0     4  magic "IPC1"
+ *        4     8  d, the vector dimension (int64)
+ *       12     8  number of sketch rows, 4k (int64)
+ *       20     8  number of occupied sketch rows (int64)
+ *       28     8  n, the number of vectors (int64)
+ *       36     8  total scatter: sum of squared distances from the mean (float64)
+ *       44  8*d   mean vector (float64)
+ *          8*r*d  occupied sketch rows (float64, row-major)
+ */
+
+// Size of the incremental PCA state header.
+#define PCA_HEADER_SIZE 44
+// The magic bytes at the start of an incremental PCA state.
+#define PCA_MAGIC "IPC1"
+// The largest supported number of components.
+#define PCA_MAX_COMPONENTS 64
+// Number of sketch rows per component. Rows beyond 2k absorb the shrinkage that the
+// Frequent Directions update applies to the leading directions.
+#define PCA_ROWS_PER_COMPONENT 4
+// The largest supported vector dimension.
+#define PCA_MAX_DIMENSIONS 65536
+// The maximum number of Jacobi sweeps for the eigen-decomposition of the Gram matrix.
+#define PCA_JACOBI_MAX_SWEEPS 60
+// Relative size below which off-diagonal Gram entries and eigenvalues count as zero.
+#define PCA_EPSILON 1e-15
+
+/**
+ * @struct PcaSketch
+ * @brief A Frequent Directions sketch of centered vectors, with its working memory.
+ */
+typedef struct {
+    int dim;            // Vector dimension d (0 until the first vector).
+    int ell;            // Number of sketch rows, PCA_ROWS_PER_COMPONENT per component.
+    int rows;           // Number of occupied sketch rows (always < ell between updates).
+    sqlite3_int64 n;    // Number of vectors.
+    double trace;       // Total scatter: the sum of squared distances from the mean.
+    double *mean;       // Mean vector (d values); owns the single allocation.
+    double *sketch;     // Sketch rows (ell x d, row-major).
+    double *basis;      // Right singular vectors of the last decomposition (ell x d).
+    double *gram;       // Gram matrix B B^T (ell x ell), diagonalized in place.
+    double *rotation;   // Eigenvectors of the Gram matrix (ell x ell).
+    double *values;     // Eigenvalues of the Gram matrix, in descending order (ell).
+} PcaSketch;
+
+/**
+ * @brief Allocates the memory of an empty sketch.
+ * @param s The sketch (zero-initialized).
+ * @param dim The vector dimension.
+ * @param ell The number of sketch rows.
+ * @return SQLITE_OK on success, or SQLITE_NOMEM.
+ */
+static int pca_sketch_init(PcaSketch *s, int dim, int ell) {
+    size_t d = (size_t)dim, l = (size_t)ell;
+    double *memory = (double *)calloc(d + 2 * l * d + 2 * l * l + l, sizeof(double));
+    if (!memory)
+        return SQLITE_NOMEM;
+    s->dim = dim;
+    s->ell = ell;
+    s->rows = 0;
+    s->n = 0;
+    s->trace = 0.0;
+    s->mean = memory;
+    s->sketch = s->mean + d;
+    s->basis = s->sketch + l * d;
+    s->gram = s->basis + l * d;
+    s->rotation = s->gram + l * l;
+    s->values = s->rotation + l * l;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Frees the memory of a sketch.
+ * @param s The sketch.
+ */
+static void pca_sketch_free(PcaSketch *s) {
+    free(s->mean);
+    s->mean = NULL;
+    s->dim = 0;
+}
+
+/**
+ * @brief The dot product of two vectors.
+ *
+ * Four independent partial sums let the compiler keep several multiply-adds in flight
+ * (and use packed instructions) without reassociating a single floating-point sum.
+ * @param a The first vector.
+ * @param b The second vector.
+ * @param count The number of elements.
+ * @return The dot product.
+ */
+static double pca_dot(const double *restrict a, const double *restrict b, int count) {
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < count; i++)
+        s0 += a[i] * b[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+/**
+ * @brief Diagonalizes a symmetric matrix with cyclic Jacobi rotations.
+ * @param a The matrix (n x n, row-major); its diagonal receives the eigenvalues.
+ * @param v Receives the eigenvectors as columns (n x n, row-major).
+ * @param n The matrix order.
+ */
+static void pca_jacobi(double *a, double *v, int n) {
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++)
+            v[i * n + j] = i == j ? 1.0 : 0.0;
+
+    for (int sweep = 0; sweep < PCA_JACOBI_MAX_SWEEPS; sweep++) {
+        double off = 0.0, diagonal = 0.0;
+        for (int p = 0; p < n; p++) {
+            diagonal += a[p * n + p] * a[p * n + p];
+            for (int q = p + 1; q < n; q++)
+                off += a[p * n + q] * a[p * n + q];
+        }
+        if (off <= PCA_EPSILON * PCA_EPSILON * diagonal)
+            break;
+
+        for (int p = 0; p < n - 1; p++) {
+            for (int q = p + 1; q < n; q++) {
+                double apq = a[p * n + q];
+                if (apq == 0.0)
+                    continue;
+                // Rotation angle that zeroes a[p][q] (the smaller root keeps it stable).
+                double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0), s = t * c;
+                for (int k = 0; k < n; k++) {
+                    double akp = a[k * n + p], akq = a[k * n + q];
+                    a[k * n + p] = c * akp - s * akq;
+                    a[k * n + q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < n; k++) {
+                    double apk = a[p * n + k], aqk = a[q * n + k];
+                    a[p * n + k] = c * apk - s * aqk;
+                    a[q * n + k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < n; k++) {
+                    double vkp = v[k * n + p], vkq = v[k * n + q];
+                    v[k * n + p] = c * vkp - s * vkq;
+                    v[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Computes the SVD of the occupied sketch rows.
+ *
+ * The squared singular values are the eigenvalues of the small Gram matrix B B^T; with
+ * its eigenvectors u_i, the right singular vectors are B^T u_i / sigma_i. On return
+ * `values` holds the squared singular values in descending order and `basis` the
+ * matching unit vectors (zero rows for vanishing singular values).
+ * @param s The sketch.
+ */
+static void pca_decompose(PcaSketch *s) {
+    int r = s->rows, d = s->dim;
+    for (int i = 0; i < r; i++)
+        for (int j = i; j < r; j++)
+            s->gram[i * r + j] = s->gram[j * r + i] = pca_dot(s->sketch + (size_t)i * d, s->sketch + (size_t)j * d, d);
+    pca_jacobi(s->gram, s->rotation, r);
+
+    // Selection sort of the eigenpairs by descending eigenvalue (r is small).
+    for (int i = 0; i < r; i++)
+        s->values[i] = s->gram[i * r + i] > 0.0 ? s->gram[i * r + i] : 0.0;
+    for (int i = 0; i < r; i++) {
+        int best = i;
+        for (int j = i + 1; j < r; j++)
+            if (s->values[j] > s->values[best])
+                best = j;
+        if (best == i)
+            continue;
+        double value = s->values[i];
+        s->values[i] = s->values[best];
+        s->values[best] = value;
+        for (int k = 0; k < r; k++) {
+            double u = s->rotation[k * r + i];
+            s->rotation[k * r + i] = s->rotation[k * r + best];
+            s->rotation[k * r + best] = u;
+        }
+    }
+
+    double threshold = r > 0 ? s->values[0] * PCA_EPSILON * r : 0.0;
+    for (int i = 0; i < r; i++) {
+        double *restrict out = s->basis + (size_t)i * d;
+        memset(out, 0, (size_t)d * sizeof(double));
+        if (s->values[i] <= threshold)
+            continue;
+        double scale = 1.0 / sqrt(s->values[i]);
+        for (int k = 0; k < r; k++) {
+            double coefficient = s->rotation[k * r + i] * scale;
+            const double *restrict row = s->sketch + (size_t)k * d;
+            for (int j = 0; j < d; j++)
+                out[j] += coefficient * row[j];
+        }
+    }
+}
+
+/**
+ * @brief Shrinks a full sketch: subtracts the median squared singular value from all of
+ * them, which zeroes the lower half of the rows.
+ * @param s The sketch (with rows == ell).
+ */
+static void pca_shrink(PcaSketch *s) {
+    pca_decompose(s);
+    int half = s->ell / 2, d = s->dim;
+    double delta = s->values[half];
+    for (int i = 0; i < half; i++) {
+        double shrunk = s->values[i] - delta;
+        double scale = shrunk > 0.0 ? sqrt(shrunk) : 0.0;
+        double *restrict row = s->sketch + (size_t)i * d;
+        const double *restrict direction = s->basis + (size_t)i * d;
+        for (int j = 0; j < d; j++)
+            row[j] = scale * direction[j];
+    }
+    s->rows = half;
+}
+
+/**
+ * @brief Commits the next free sketch row (already written) and shrinks a full sketch.
+ * @param s The sketch.
+ */
+static void pca_commit_row(PcaSketch *s) {
+    if (++s->rows == s->ell)
+        pca_shrink(s);
+}
+
+/**
+ * @brief Adds a vector stored as little-endian float32 values to a sketch.
+ *
+ * The vector is decoded straight into the next free sketch row and centered there.
+ * @param s The sketch.
+ * @param bytes The vector (4 * dim bytes).
+ * @return 1 if the vector was added, 0 if it was skipped for a non-finite element.
+ */
+static int pca_add_vector(PcaSketch *s, const unsigned char *bytes) {
+    int d = s->dim;
+    double *restrict row = s->sketch + (size_t)s->rows * d;
+    for (int j = 0; j < d; j++) {
+        const unsigned char *b = bytes + 4 * (size_t)j;
+        sqlite3_uint64 bits = (sqlite3_uint64)b[0] | (sqlite3_uint64)b[1] << 8 | (sqlite3_uint64)b[2] << 16 | (sqlite3_uint64)b[3] << 24;
+        unsigned int word = (unsigned int)bits;
+        float value;
+        memcpy(&value, &word, sizeof(value));
+        row[j] = value;
+    }
+    for (int j = 0; j < d; j++)
+        if (!isfinite(row[j]))
+            return 0;
+
+    s->n++;
+    if (s->n == 1) {
+        memcpy(s->mean, row, (size_t)d * sizeof(double));
+        return 1;
+    }
+    double weight = sqrt((double)(s->n - 1) / s->n), inv_n = 1.0 / s->n;
+    double *restrict mean = s->mean;
+    for (int j = 0; j < d; j++) {
+        double delta = row[j] - mean[j];
+        mean[j] += delta * inv_n;
+        row[j] = weight * delta;
+    }
+    s->trace += pca_dot(row, row, d);
+    pca_commit_row(s);
+    return 1;
+}
+
+/**
+ * @brief Merges another sketch with the same dimension and number of rows into a sketch.
+ *
+ * The scatter of the union is the sum of both scatters plus the between-group term
+ * n_a n_b / n (mean_b - mean_a)(mean_b - mean_a)^T, which enters as one extra row.
+ * @param into The sketch to update.
+ * @param other The sketch to merge in.
+ */
+static void pca_merge(PcaSketch *into, const PcaSketch *other) {
+    int d = into->dim;
+    if (other->n == 0)
+        return;
+    if (into->n == 0) {
+        memcpy(into->mean, other->mean, (size_t)d * sizeof(double));
+        memcpy(into->sketch, other->sketch, (size_t)other->rows * d * sizeof(double));
+        into->rows = other->rows;
+        into->n = other->n;
+        into->trace = other->trace;
+        return;
+    }
+
+    for (int i = 0; i < other->rows; i++) {
+        memcpy(into->sketch + (size_t)into->rows * d, other->sketch + (size_t)i * d, (size_t)d * sizeof(double));
+        pca_commit_row(into);
+    }
+    sqlite3_int64 n = into->n + other->n;
+    double weight = sqrt((double)into->n * other->n / n), share = (double)other->n / n;
+    double *restrict row = into->sketch + (size_t)into->rows * d;
+    double *restrict mean = into->mean;
+    const double *restrict other_mean = other->mean;
+    for (int j = 0; j < d; j++) {
+        double delta = other_mean[j] - mean[j];
+        row[j] = weight * delta;
+        mean[j] += delta * share;
+    }
+    into->trace += other->trace + pca_dot(row, row, d);
+    into->n = n;
+    pca_commit_row(into);
+}
+
+/**
+ * @brief Sets a serialized sketch as the function result.
+ * @param context The SQLite function context.
+ * @param s The sketch.
+ */
+static void pca_state_result(sqlite3_context *context, const PcaSketch *s) {
+    size_t d = (size_t)s->dim;
+    size_t size = PCA_HEADER_SIZE + 8 * d * (1 + (size_t)s->rows);
+    unsigned char *blob = (unsigned char *)sqlite3_malloc64(size);
+    if (!blob) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    memcpy(blob, PCA_MAGIC, 4);
+    put_le64(blob + 4, (sqlite3_uint64)s->dim);
+    put_le64(blob + 12, (sqlite3_uint64)s->ell);
+    put_le64(blob + 20, (sqlite3_uint64)s->rows);
+    put_le64(blob + 28, (sqlite3_uint64)s->n);
+    put_le_double(blob + 36, s->trace);
+    unsigned char *out = blob + PCA_HEADER_SIZE;
+    for (size_t j = 0; j < d; j++, out += 8)
+        put_le_double(out, s->mean[j]);
+    for (size_t j = 0; j < (size_t)s->rows * d; j++, out += 8)
+        put_le_double(out, s->sketch[j]);
+    sqlite3_result_blob64(context, blob, size, sqlite3_free);
+}
+
+/**
+ * @brief Reads a serialized sketch into a newly allocated sketch.
+ *
+ * The header must describe exactly the bytes that follow it. The sketch must also be
+ * one that pca_state_result() can produce: the first vector only sets the mean, so a
+ * sketch of n vectors holds fewer than n rows, and every stored number is finite.
+ * @param context The SQLite function context, which receives any error.
+ * @param value The state BLOB.
+ * @param s Receives the sketch; it must be freed with pca_sketch_free() on success.
+ * @return SQLITE_OK on success, or an error code (with the error result set).
+ */
+static int pca_state_read(sqlite3_context *context, sqlite3_value *value, PcaSketch *s) {
+    const unsigned char *blob = (const unsigned char *)sqlite3_value_blob(value);
+    size_t size = sqlite3_value_type(value) == SQLITE_BLOB ? (size_t)sqlite3_value_bytes(value) : 0;
+    sqlite3_int64 dim = 0, ell = 0, rows = 0, n = -1;
+    double trace = NAN;
+    if (size >= PCA_HEADER_SIZE && memcmp(blob, PCA_MAGIC, 4) == 0) {
+        dim = (sqlite3_int64)get_le64(blob + 4);
+        ell = (sqlite3_int64)get_le64(blob + 12);
+        rows = (sqlite3_int64)get_le64(blob + 20);
+        n = (sqlite3_int64)get_le64(blob + 28);
+        trace = get_le_double(blob + 36);
+    }
+    // Checked field by field before the size, so that the size cannot overflow.
+    if (dim < 1 || dim > PCA_MAX_DIMENSIONS || ell < PCA_ROWS_PER_COMPONENT || ell > PCA_ROWS_PER_COMPONENT * PCA_MAX_COMPONENTS ||
+        ell % PCA_ROWS_PER_COMPONENT != 0 || rows < 0 || rows >= ell || n < 0 || (rows > 0 && rows >= n) ||
+        !isfinite(trace) || trace < 0 || size != PCA_HEADER_SIZE + 8 * (size_t)dim * (1 + (size_t)rows)) {
+        sqlite3_result_error(context, "Invalid incremental PCA state.", -1);
+        return SQLITE_ERROR;
+    }
+    if (pca_sketch_init(s, (int)dim, (int)ell) != SQLITE_OK) {
+        sqlite3_result_error_nomem(context);
+        return SQLITE_NOMEM;
+    }
+    s->rows = (int)rows;
+    s->n = n;
+    s->trace = trace;
+    int finite = 1;
+    const unsigned char *in = blob + PCA_HEADER_SIZE;
+    for (size_t j = 0; j < (size_t)dim; j++, in += 8)
+        finite &= isfinite(s->mean[j] = get_le_double(in)) != 0;
+    for (size_t j = 0; j < (size_t)rows * dim; j++, in += 8)
+        finite &= isfinite(s->sketch[j] = get_le_double(in)) != 0;
+    if (!finite) {
+        pca_sketch_free(s);
+        sqlite3_result_error(context, "Invalid incremental PCA state.", -1);
+        return SQLITE_ERROR;
+    }
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Sets the principal components of a sketch as a JSON result.
+ *
+ * The object holds n, dim, total_variance, the explained_variance and
+ * explained_variance_ratio of each component, the mean vector and the components (unit
+ * vectors, signed so that their largest entry is positive). Returns NULL for fewer than
+ * two vectors.
+ * @param context The SQLite function context.
+ * @param s The sketch; its working memory is overwritten.
+ */
+static void pca_json_result(sqlite3_context *context, PcaSketch *s) {
+    if (s->n < 2) {
+        sqlite3_result_null(context);
+        return;
+    }
+    pca_decompose(s);
+    int k = s->ell / PCA_ROWS_PER_COMPONENT < s->rows ? s->ell / PCA_ROWS_PER_COMPONENT : s->rows, d = s->dim;
+    double denominator = (double)(s->n - 1);
+
+    sqlite3_str *json = sqlite3_str_new(NULL);
+    sqlite3_str_appendchar(json, 1, '{');
+    json_append_int(json, "n", s->n);
+    json_append_int(json, "dim", d);
+    json_append_double(json, "total_variance", s->trace / denominator);
+    sqlite3_str_appendall(json, ",\"explained_variance\":[");
+    for (int i = 0; i < k; i++)
+        json_append_double(json, NULL, s->values[i] / denominator);
+    sqlite3_str_appendall(json, "],\"explained_variance_ratio\":[");
+    for (int i = 0; i < k; i++)
+        json_append_double(json, NULL, s->trace > 0.0 ? s->values[i] / s->trace : NAN);
+    sqlite3_str_appendall(json, "],\"mean\":[");
+    for (int j = 0; j < d; j++)
+        json_append_double(json, NULL, s->mean[j]);
+    sqlite3_str_appendall(json, "],\"components\":[");
+    for (int i = 0; i < k; i++) {
+        const double *component = s->basis + (size_t)i * d;
+        int largest = 0;
+        for (int j = 1; j < d; j++)
+            if (fabs(component[j]) > fabs(component[largest]))
+                largest = j;
+        double sign = component[largest] < 0.0 ? -1.0 : 1.0;
+        json_append_separator(json);
+        sqlite3_str_appendchar(json, 1, '[');
+        for (int j = 0; j < d; j++)
+            json_append_double(json, NULL, sign * component[j]);
+        sqlite3_str_appendchar(json, 1, ']');
+    }
+    sqlite3_str_appendall(json, "]}");
+    json_result(context, json);
+}
+
+/**
+ * @brief The "step" function of `incremental_pca(vec, k)` and `incremental_pca_state(vec, k)`.
+ *
+ * Vectors are BLOBs of little-endian float32 values (the layout of sqlite-vec's
+ * `vec_f32()`); all of them must have the same length. NULL vectors and vectors with a
+ * non-finite element are ignored.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (2).
+ * @param argv The argument values.
+ */
+static void pca_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    PcaSketch *s = (PcaSketch *)sqlite3_aggregate_context(context, sizeof(PcaSketch));
+    if (!s) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    int type = sqlite3_value_type(argv[0]);
+    if (type == SQLITE_NULL)
+        return;
+    int bytes = sqlite3_value_bytes(argv[0]);
+    if (type != SQLITE_BLOB || bytes == 0 || bytes % 4 != 0) {
+        sqlite3_result_error(context, "incremental_pca expects float32 vector BLOBs.", -1);
+        return;
+    }
+    if (!s->mean) {
+        sqlite3_int64 k = sqlite3_value_int64(argv[1]);
+        if (sqlite3_value_numeric_type(argv[1]) != SQLITE_INTEGER || k < 1 || k > PCA_MAX_COMPONENTS) {
+            sqlite3_result_error(context, "incremental_pca requires 1 <= k <= 64 components.", -1);
+            return;
+        }
+        if (bytes / 4 > PCA_MAX_DIMENSIONS || k > bytes / 4) {
+            sqlite3_result_error(context, "incremental_pca requires k <= vector dimension <= 65536.", -1);
+            return;
+        }
+        if (pca_sketch_init(s, bytes / 4, PCA_ROWS_PER_COMPONENT * (int)k) != SQLITE_OK) {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+    } else if (bytes / 4 != s->dim) {
+        sqlite3_result_error(context, "incremental_pca vectors must all have the same length.", -1);
+        return;
+    }
+    pca_add_vector(s, (const unsigned char *)sqlite3_value_blob(argv[0]));
+}
+
+/**
+ * @brief The "final" function of `incremental_pca()`: returns the JSON result (see pca_json_result()).
+ * @param context The SQLite function context.
+ */
+static void pca_final(sqlite3_context *context) {
+    PcaSketch *s = (PcaSketch *)sqlite3_aggregate_context(context, 0);
+    if (!s || !s->mean) {
+        sqlite3_result_null(context);
+        return;
+    }
+    pca_json_result(context, s);
+    pca_sketch_free(s);
+}
+
+/**
+ * @brief The "final" function of `incremental_pca_state()` and `incremental_pca_merge()`:
+ * returns the sketch as a mergeable state BLOB, or NULL for no vectors.
+ * @param context The SQLite function context.
+ */
+static void pca_state_final(sqlite3_context *context) {
+    PcaSketch *s = (PcaSketch *)sqlite3_aggregate_context(context, 0);
+    if (!s || !s->mean || s->n == 0)
+        sqlite3_result_null(context);
+    else
+        pca_state_result(context, s);
+    if (s)
+        pca_sketch_free(s);
+}
+
+/**
+ * @brief The "step" function of `incremental_pca_merge(state)`: merges state BLOBs, for
+ * example the per-shard results of `incremental_pca_state()`. NULL states are ignored.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (1).
+ * @param argv The argument values.
+ */
+static void pca_merge_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    PcaSketch *s = (PcaSketch *)sqlite3_aggregate_context(context, sizeof(PcaSketch));
+    if (!s) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    PcaSketch other;
+    memset(&other, 0, sizeof(other));
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL || pca_state_read(context, argv[0], &other) != SQLITE_OK)
+        return;
+    if (!s->mean) {
+        if (pca_sketch_init(s, other.dim, other.ell) != SQLITE_OK) {
+            sqlite3_result_error_nomem(context);
+            pca_sketch_free(&other);
+            return;
+        }
+    } else if (other.dim != s->dim || other.ell != s->ell) {
+        sqlite3_result_error(context, "incremental_pca states must have the same dimension and k.", -1);
+        pca_sketch_free(&other);
+        return;
+    }
+    pca_merge(s, &other);
+    pca_sketch_free(&other);
+}
+
+/**
+ * @brief `incremental_pca_result(state)`: the JSON result of `incremental_pca()` for a state BLOB.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (1).
+ * @param argv The argument values.
+ */
+static void pca_result_func(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    PcaSketch s;
+    memset(&s, 0, sizeof(s));
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        sqlite3_result_null(context);
+        return;
+    }
+    if (pca_state_read(context, argv[0], &s) != SQLITE_OK)
+        return;
+    pca_json_result(context, &s);
+    pca_sketch_free(&s);
+}
+
+// --- Accumulator States ---
+
+/**
+ * @brief Sets a moments state as a serialized accumulator BLOB result (see stddev-accumulator.h).
+ * @param context The SQLite function context.
+ * @param m The moments.
+ */
+static void accumulator_state_result(sqlite3_context *context, const MomentsState *m) {
+    unsigned char blob[STDDEV_ACCUMULATOR_SERIALIZED_SIZE];
+    stddev_accumulator_serialize(m, blob);
+    sqlite3_result_blob(context, blob, sizeof(blob), SQLITE_TRANSIENT);
+}
+
+/**
+ * @brief Reads a serialized accumulator BLOB.
+ * @param context The SQLite function context, which receives any error.
+ * @param value The state BLOB.
+ * @param m Receives the moments.
+ * @return SQLITE_OK on success, or SQLITE_ERROR (with the error result set).
+ */
+static int read_accumulator_state(sqlite3_context *context, sqlite3_value *value, MomentsState *m) {
+    if (sqlite3_value_type(value) != SQLITE_BLOB ||
+        stddev_accumulator_deserialize(m, (const unsigned char *)sqlite3_value_blob(value), (size_t)sqlite3_value_bytes(value)) != 0) {
+        sqlite3_result_error(context, "Invalid accumulator state.", -1);
+        return SQLITE_ERROR;
+    }
+    return SQLITE_OK;
+}
+
+/**
+ * @brief The "final" function of `stddev_state(x)`: the accumulated moments as a state
+ * BLOB (the aggregate shares the step function of `stddev()`).
+ * @param context The SQLite function context.
+ */
+static void stddev_state_final(sqlite3_context *context) {
+    StatsWindowContext *ctx = (StatsWindowContext *)sqlite3_aggregate_context(context, 0);
+    MomentsState empty = {0, 0.0, 0.0};
+    accumulator_state_result(context, ctx ? &ctx->moments : &empty);
+    free_stats_window_context(ctx);
+}
+
+/**
+ * @brief The "step" function of `stddev_merge(state)`: merges state BLOBs written by
+ * `stddev_state()` or by host code through stddev_accumulator_serialize(). NULL states
+ * are ignored.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (1).
+ * @param argv The argument values.
+ */
+static void stddev_merge_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    MomentsState *merged = (MomentsState *)sqlite3_aggregate_context(context, sizeof(MomentsState));
+    if (!merged) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    MomentsState state;
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL || read_accumulator_state(context, argv[0], &state) != SQLITE_OK)
+        return;
+    stddev_accumulator_merge(merged, &state);
+}
+
+/**
+ * @brief The "final" function of `stddev_merge()`: the merged state BLOB.
+ * @param context The SQLite function context.
+ */
+static void stddev_merge_final(sqlite3_context *context) {
+    MomentsState *merged = (MomentsState *)sqlite3_aggregate_context(context, 0);
+    MomentsState empty = {0, 0.0, 0.0};
+    accumulator_state_result(context, merged ? merged : &empty);
+}
+
+/**
+ * @brief `stddev_result(state)`: the statistics of a state BLOB.
+ *
+ * Returns a JSON object with n, mean, variance_samp, variance_pop, stddev_samp and
+ * stddev_pop (null where undefined), or NULL for a NULL state.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (1).
+ * @param argv The argument values.
+ */
+static void stddev_result_func(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    MomentsState state;
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        sqlite3_result_null(context);
+        return;
+    }
+    if (read_accumulator_state(context, argv[0], &state) != SQLITE_OK)
+        return;
+    stddev_accumulator_result r;
+    stddev_accumulator_finalize(&state, &r);
+
+    sqlite3_str *json = sqlite3_str_new(NULL);
+    sqlite3_str_appendchar(json, 1, '{');
+    json_append_int(json, "n", r.n);
+    json_append_double(json, "mean", r.mean);
+    json_append_double(json, "variance_samp", r.variance_sample);
+    json_append_double(json, "variance_pop", r.variance_population);
+    json_append_double(json, "stddev_samp", r.stddev_sample);
+    json_append_double(json, "stddev_pop", r.stddev_population);
+    sqlite3_str_appendchar(json, 1, '}');
+    json_result(context, json);
+}
+
+// --- Distribution Drift Against a Baseline ---
+
+/*
+ * Baseline format (all fields little-endian):
+ *
+ *   offset  size  field
+ *        0     4  magic "DRB1"
+ *        4     8  number of histogram bins b (int64)
+ *       12    28  serialized accumulator of the baseline values (stddev-accumulator.h)
+ *       40  8*(b-1)  inner bin edges in ascending order (float64)
+ *          8*b   baseline count of each bin (int64)
+ *
+ * Bin i holds the values x with edge[i-1] <= x < edge[i]; the first and last bins are
+ * unbounded. The edges are baseline quantiles, so the bins hold similar counts.
+ */
+
+// Size of the baseline header.
+#define DRIFT_HEADER_SIZE (12 + STDDEV_ACCUMULATOR_SERIALIZED_SIZE)
+// The magic bytes at the start of a baseline.
+#define DRIFT_MAGIC "DRB1"
+// The default number of histogram bins of drift_baseline().
+#define DRIFT_DEFAULT_BINS 10
+// The largest supported number of histogram bins.
+#define DRIFT_MAX_BINS 1000
+// Proportion substituted for empty bins in the PSI, which is undefined for them.
+#define DRIFT_PSI_FLOOR 1e-4
+
+// Comparison methods of drift_score().
+#define DRIFT_VAR_RATIO 0  // Frame sample variance divided by the baseline sample variance.
+#define DRIFT_MEAN_SHIFT 1 // Frame mean minus baseline mean, in baseline standard deviations.
+#define DRIFT_PSI 2        // Population stability index over the baseline bins.
+#define DRIFT_KS_APPROX 3  // Largest CDF distance at the bin edges (binned Kolmogorov-Smirnov).
+
+/**
+ * @struct DriftBaselineContext
+ * @brief Aggregate context of `drift_baseline()`.
+ */
+typedef struct {
+    WindowStatsData data; // Buffered values (appended only, so values[0..count) is contiguous).
+    int bins;             // Requested number of bins.
+    int ingest_mode;      // Ingestion mode captured at the first step.
+} DriftBaselineContext;
+
+/**
+ * @brief The "step" function of `drift_baseline(x [, bins])`.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (1 or 2).
+ * @param argv The argument values.
+ */
+static void drift_baseline_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    DriftBaselineContext *ctx = (DriftBaselineContext *)sqlite3_aggregate_context(context, sizeof(DriftBaselineContext));
+    if (!ctx) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    // Initialize context on the first call.
+    if (ctx->data.values == NULL) {
+        sqlite3_int64 bins = argc > 1 ? sqlite3_value_int64(argv[1]) : DRIFT_DEFAULT_BINS;
+        if (argc > 1 && (sqlite3_value_numeric_type(argv[1]) != SQLITE_INTEGER || bins < 2 || bins > DRIFT_MAX_BINS)) {
+            sqlite3_result_error(context, "drift_baseline requires 2 <= bins <= 1000.", -1);
+            return;
+        }
+        if (init_window_stats_data(context, &ctx->data) != SQLITE_OK)
+            return;
+        ctx->bins = (int)bins;
+        ctx->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+    }
+
+    double value;
+    int status = read_numeric_value(argv[0], ctx->ingest_mode, &value);
+    if (status == VALUE_INVALID) {
+        sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+        return;
+    }
+    if (status != VALUE_NUMERIC && status != VALUE_COERCED)
+        return;
+    if (ctx->data.count >= ctx->data.capacity) {
+        if (grow_stats_buffer(context, &ctx->data) != SQLITE_OK)
+            return;
+    }
+    add_to_circular_buffer(&ctx->data, value);
+}
+
+/**
+ * @brief Finds the histogram bin of a value.
+ * @param edges The inner bin edges in ascending order.
+ * @param edge_count The number of edges (bins - 1).
+ * @param x The value.
+ * @return The number of edges <= x, the index of the bin.
+ */
+static int drift_bin(const double *edges, int edge_count, double x) {
+    int lo = 0, hi = edge_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (edges[mid] <= x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * @brief The "final" function of `drift_baseline()`: the baseline BLOB, or NULL for no values.
+ *
+ * The edges are the quantiles at i / bins of the sorted values. Repeated quantiles (from
+ * ties) are merged, so a baseline can have fewer bins than requested.
+ * @param context The SQLite function context.
+ */
+static void drift_baseline_final(sqlite3_context *context) {
+    DriftBaselineContext *ctx = (DriftBaselineContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || !ctx->data.values || ctx->data.count == 0) {
+        sqlite3_result_null(context);
+        if (ctx)
+            free(ctx->data.values);
+        return;
+    }
+
+    double *values = ctx->data.values;
+    int n = ctx->data.count;
+    qsort(values, n, sizeof(double), compare_doubles);
+    MomentsState moments = {0, 0.0, 0.0};
+    stddev_accumulator_add_batch(&moments, values, n);
+
+    double *edges = (double *)malloc(ctx->bins * sizeof(double));
+    unsigned char *blob = edges ? (unsigned char *)sqlite3_malloc64(DRIFT_HEADER_SIZE + 16 * (size_t)ctx->bins) : NULL;
+    if (!blob) {
+        sqlite3_result_error_nomem(context);
+        free(edges);
+        free(values);
+        return;
+    }
+    int edge_count = 0;
+    for (int i = 1; i < ctx->bins; i++) {
+        double edge = values[(sqlite3_int64)i * n / ctx->bins];
+        if (edge > values[0] && (edge_count == 0 || edge > edges[edge_count - 1]))
+            edges[edge_count++] = edge;
+    }
+    int bins = edge_count + 1;
+
+    memcpy(blob, DRIFT_MAGIC, 4);
+    put_le64(blob + 4, (sqlite3_uint64)bins);
+    stddev_accumulator_serialize(&moments, blob + 12);
+    unsigned char *out = blob + DRIFT_HEADER_SIZE;
+    for (int i = 0; i < edge_count; i++, out += 8)
+        put_le_double(out, edges[i]);
+    // The values are sorted, so each bin is a contiguous run.
+    int start = 0;
+    for (int b = 0; b < bins; b++, out += 8) {
+        int end = start;
+        while (end < n && drift_bin(edges, edge_count, values[end]) == b)
+            end++;
+        put_le64(out, (sqlite3_uint64)(end - start));
+        start = end;
+    }
+    sqlite3_result_blob64(context, blob, DRIFT_HEADER_SIZE + 8 * (size_t)(edge_count + bins), sqlite3_free);
+    free(edges);
+    free(values);
+}
+
+/**
+ * @struct DriftContext
+ * @brief Aggregate/window context of `drift_score()`.
+ *
+ * The baseline is decoded once, at the first step; the frame keeps its moments and a
+ * histogram over the baseline bins, both updated in O(log bins) amortized per row. The
+ * frame's values are kept so that its moments can be recomputed after removals.
+ */
+typedef struct {
+    int initialized;              // Whether the baseline and method have been read.
+    int ingest_mode;              // Ingestion mode captured at the first step.
+    int method;                   // One of the DRIFT_* methods.
+    int bins;                     // Number of histogram bins.
+    MomentsState baseline;        // Moments of the baseline values.
+    MomentsState frame;           // Moments of the values in the frame.
+    WindowStatsData values;       // The values in the frame, oldest first.
+    int removals;                 // Values removed since the frame moments were last recomputed.
+    double *edges;                // Inner bin edges (bins - 1); owns the single allocation.
+    sqlite3_int64 *baseline_hist; // Baseline count of each bin.
+    sqlite3_int64 *frame_hist;    // Frame count of each bin.
+} DriftContext;
+
+/**
+ * @brief Decodes the baseline and method arguments into a drift context.
+ * @param context The SQLite function context, which receives any error.
+ * @param ctx The drift context.
+ * @param baseline The baseline BLOB.
+ * @param method The method name.
+ * @return SQLITE_OK on success, or an error code (with the error result set).
+ */
+static int drift_init(sqlite3_context *context, DriftContext *ctx, sqlite3_value *baseline, sqlite3_value *method) {
+    static const char *const method_names[] = {"var_ratio", "mean_shift", "psi", "ks_approx"};
+    const char *name = (const char *)sqlite3_value_text(method);
+    ctx->method = -1;
+    for (int i = 0; name && i < (int)(sizeof(method_names) / sizeof(method_names[0])); i++)
+        if (sqlite3_stricmp(name, method_names[i]) == 0)
+            ctx->method = i;
+    if (ctx->method < 0) {
+        sqlite3_result_error(context, "drift_score method must be 'var_ratio', 'mean_shift', 'psi' or 'ks_approx'.", -1);
+        return SQLITE_ERROR;
+    }
+
+    const unsigned char *blob = (const unsigned char *)sqlite3_value_blob(baseline);
+    size_t size = sqlite3_value_type(baseline) == SQLITE_BLOB ? (size_t)sqlite3_value_bytes(baseline) : 0;
+    sqlite3_int64 bins = size >= DRIFT_HEADER_SIZE && memcmp(blob, DRIFT_MAGIC, 4) == 0 ? (sqlite3_int64)get_le64(blob + 4) : 0;
+    if (bins < 1 || bins > DRIFT_MAX_BINS || size != DRIFT_HEADER_SIZE + 8 * (size_t)(2 * bins - 1) ||
+        stddev_accumulator_deserialize(&ctx->baseline, blob + 12, STDDEV_ACCUMULATOR_SERIALIZED_SIZE) != 0) {
+        sqlite3_result_error(context, "Invalid drift baseline.", -1);
+        return SQLITE_ERROR;
+    }
+    ctx->edges = (double *)malloc((size_t)(3 * bins - 1) * 8);
+    if (!ctx->edges) {
+        sqlite3_result_error_nomem(context);
+        return SQLITE_NOMEM;
+    }
+    ctx->bins = (int)bins;
+    ctx->baseline_hist = (sqlite3_int64 *)(ctx->edges + bins - 1);
+    ctx->frame_hist = ctx->baseline_hist + bins;
+    const unsigned char *in = blob + DRIFT_HEADER_SIZE;
+    for (int i = 0; i < ctx->bins - 1; i++, in += 8)
+        ctx->edges[i] = get_le_double(in);
+    for (int i = 0; i < ctx->bins; i++, in += 8) {
+        ctx->baseline_hist[i] = (sqlite3_int64)get_le64(in);
+        ctx->frame_hist[i] = 0;
+    }
+    return SQLITE_OK;
+}
+
+/**
+ * @brief The "step" function of `drift_score(x, baseline, method)`.
+ *
+ * The baseline (from `drift_baseline()`) and the method are read from the first row.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (3).
+ * @param argv The argument values.
+ */
+static void drift_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    DriftContext *ctx = (DriftContext *)sqlite3_aggregate_context(context, sizeof(DriftContext));
+    if (!ctx) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    if (!ctx->initialized) {
+        if (drift_init(context, ctx, argv[1], argv[2]) != SQLITE_OK)
+            return;
+        if (init_window_stats_data(context, &ctx->values) != SQLITE_OK) {
+            free(ctx->edges);
+            ctx->edges = NULL;
+            return;
+        }
+        ctx->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+        ctx->initialized = 1;
+    }
+
+    double value;
+    int status = read_numeric_value(argv[0], ctx->ingest_mode, &value);
+    if (status == VALUE_INVALID) {
+        sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+        return;
+    }
+    if (status != VALUE_NUMERIC && status != VALUE_COERCED)
+        return;
+    if (ctx->values.count >= ctx->values.capacity && grow_stats_buffer(context, &ctx->values) != SQLITE_OK)
+        return;
+    add_to_circular_buffer(&ctx->values, value);
+    stddev_accumulator_add(&ctx->frame, value);
+    ctx->frame_hist[drift_bin(ctx->edges, ctx->bins - 1, value)]++;
+}
+
+/**
+ * @brief The "inverse" function of `drift_score()`: removes the value of the leaving row.
+ *
+ * The frame moments are recomputed from the frame once per frame's worth of removals,
+ * and right after a removal that cancelled nearly all of M2, so that rounding error
+ * cannot build up.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (3).
+ * @param argv The argument values of the row leaving the window.
+ */
+static void drift_inverse(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    DriftContext *ctx = (DriftContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || !ctx->initialized || ctx->frame.n == 0)
+        return;
+    double value;
+    int status = read_numeric_value(argv[0], ctx->ingest_mode, &value);
+    if (status != VALUE_NUMERIC && status != VALUE_COERCED)
+        return;
+    value = remove_from_circular_buffer(&ctx->values);
+    double m2 = ctx->frame.m2;
+    stddev_accumulator_remove(&ctx->frame, value);
+    ctx->frame_hist[drift_bin(ctx->edges, ctx->bins - 1, value)]--;
+    if (++ctx->removals >= ctx->values.count || ctx->frame.m2 < m2 * REMOVAL_CANCELLATION_LIMIT) {
+        stddev_accumulator_init(&ctx->frame);
+        for (int i = 0; i < ctx->values.count; i++)
+            stddev_accumulator_add(&ctx->frame, get_circular_value(&ctx->values, i));
+        ctx->removals = 0;
+    }
+}
+
+/**
+ * @brief The "value" function of `drift_score()`: compares the frame with the baseline.
+ *
+ * Returns NULL when the score is undefined: an empty frame, fewer than two values for
+ * 'var_ratio', or a baseline without spread for 'var_ratio' and 'mean_shift'.
+ * @param context The SQLite function context.
+ */
+static void drift_value(sqlite3_context *context) {
+    DriftContext *ctx = (DriftContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || !ctx->initialized || ctx->frame.n == 0) {
+        sqlite3_result_null(context);
+        return;
+    }
+    stddev_accumulator_result frame, baseline;
+    stddev_accumulator_finalize(&ctx->frame, &frame);
+    stddev_accumulator_finalize(&ctx->baseline, &baseline);
+
+    double score = NAN;
+    switch (ctx->method) {
+    case DRIFT_VAR_RATIO:
+        score = baseline.variance_sample > 0.0 ? frame.variance_sample / baseline.variance_sample : NAN;
+        break;
+    case DRIFT_MEAN_SHIFT:
+        score = baseline.stddev_sample > 0.0 ? (frame.mean - baseline.mean) / baseline.stddev_sample : NAN;
+        break;
+    case DRIFT_PSI:
+        score = 0.0;
+        for (int i = 0; i < ctx->bins; i++) {
+            double p = (double)ctx->frame_hist[i] / ctx->frame.n;
+            double q = (double)ctx->baseline_hist[i] / ctx->baseline.n;
+            p = p > DRIFT_PSI_FLOOR ? p : DRIFT_PSI_FLOOR;
+            q = q > DRIFT_PSI_FLOOR ? q : DRIFT_PSI_FLOOR;
+            score += (p - q) * log(p / q);
+        }
+        break;
+    case DRIFT_KS_APPROX: {
+        sqlite3_int64 frame_cumulative = 0, baseline_cumulative = 0;
+        score = 0.0;
+        for (int i = 0; i < ctx->bins - 1; i++) {
+            frame_cumulative += ctx->frame_hist[i];
+            baseline_cumulative += ctx->baseline_hist[i];
+            double distance = fabs((double)frame_cumulative / ctx->frame.n - (double)baseline_cumulative / ctx->baseline.n);
+            score = distance > score ? distance : score;
+        }
+        break;
+    }
+    }
+    set_result(context, score);
+}
+
+/**
+ * @brief The "final" function of `drift_score()`.
+ * @param context The SQLite function context.
+ */
+static void drift_final(sqlite3_context *context) {
+    drift_value(context);
+    DriftContext *ctx = (DriftContext *)sqlite3_aggregate_context(context, 0);
+    if (ctx) {
+        free(ctx->edges);
+        ctx->edges = NULL;
+        free(ctx->values.values);
+        ctx->values.values = NULL;
+    }
+}
+
+// --- Parallel Partitioned Window Statistics ---
+
+// Columns of the parallel_window_stats table-valued function.
+#define PARALLEL_COLUMN_PART 0
+#define PARALLEL_COLUMN_ORD 1
+#define PARALLEL_COLUMN_VALUE 2
+#define PARALLEL_COLUMN_N 3
+#define PARALLEL_COLUMN_MEAN 4
+#define PARALLEL_COLUMN_VARIANCE 5
+#define PARALLEL_COLUMN_STDDEV 6
+#define PARALLEL_COLUMN_TABLE 7
+// Number of hidden argument columns, starting at PARALLEL_COLUMN_TABLE.
+#define PARALLEL_ARGUMENT_COUNT 6
+// All arguments but threads must be given.
+#define PARALLEL_REQUIRED_ARGUMENTS 0x1F
+// The largest number of worker threads.
+#define PARALLEL_MAX_THREADS 64
+// Number of result rows handed from a worker to the cursor at a time.
+#define PARALLEL_BATCH_ROWS 1024
+// Number of batches a worker may run ahead of the cursor.
+#define PARALLEL_QUEUE_DEPTH 4
+
+/**
+ * @struct ParallelRow
+ * @brief A result row of `parallel_window_stats()`.
+ */
+typedef struct {
+    int key_index;        // Index of the row's partition in the cursor's key list.
+    StatsKey ord;         // The order value; TEXT/BLOB bytes live in the batch arena.
+    size_t ord_offset;    // Offset of the TEXT/BLOB bytes of `ord` in the batch arena.
+    double value;         // The value, NaN when NULL.
+    MomentsState moments; // Moments of the non-NULL values of the frame ending at this row.
+} ParallelRow;
+
+/**
+ * @struct ParallelBatch
+ * @brief A block of consecutive result rows of one worker.
+ */
+typedef struct ParallelBatch {
+    struct ParallelBatch *next;       // Next batch in the worker's queue.
+    int count;                        // Number of rows.
+    unsigned char *arena;             // TEXT/BLOB bytes of the order values.
+    size_t arena_size;                // Used bytes of the arena.
+    size_t arena_capacity;            // Allocated bytes of the arena.
+    ParallelRow rows[PARALLEL_BATCH_ROWS]; // The rows.
+} ParallelBatch;
+
+/**
+ * @struct ParallelWorker
+ * @brief Computes the rolling statistics of a subset of the partitions.
+ *
+ * A threaded worker reads through its own connection and hands batches to the cursor
+ * through a bounded queue; the fields below `signal` are shared and only accessed while
+ * holding it. Without threads a single worker runs on the cursor's connection, on demand.
+ */
+typedef struct {
+    const char *filename;     // Database file of a threaded worker, or NULL to use `db`.
+    const char *vfs;          // VFS of the caller's connection, used by a threaded worker.
+    sqlite3 *db;              // Connection read by the worker.
+    const char *sql;          // Per-partition query (or the single ordered scan), owned by the cursor.
+    int single_scan;          // Whether `sql` reads all partitions in one scan ordered by (part, ord).
+    const StatsKey *keys;     // The cursor's partition keys.
+    int *key_indexes;         // Indexes of the worker's partitions in ascending order.
+    int key_count;            // Number of partitions of the worker.
+    int next_key;             // Next entry of `key_indexes` to scan.
+    int current_key;          // Index of the partition being scanned.
+    int frame_rows;           // Number of rows per frame.
+    int ingest_mode;          // Ingestion mode captured at the start of the scan.
+    sqlite3_stmt *stmt;       // The per-partition query.
+    int scanning;             // Whether `stmt` is positioned inside a partition.
+    WindowStatsData ring;     // Values of the frame (NaN for NULL).
+    MomentsState moments;     // Moments of the non-NULL values of the frame.
+    int removals;             // Values removed since the moments were last recomputed.
+    int threaded;             // Whether the worker runs on its own thread.
+    StatsThread thread;       // The worker thread.
+    StatsSignal signal;       // Protects the fields below.
+    ParallelBatch *queue;     // Completed batches, oldest first.
+    ParallelBatch *queue_tail; // Last completed batch.
+    int queued;               // Number of completed batches.
+    int finished;             // Whether the worker has produced its last batch.
+    int stop_requested;       // Set by the cursor to end the thread early.
+    int rc;                   // Error code of a failed scan.
+    char *error;              // Error message of a failed scan (sqlite3_malloc'ed).
+} ParallelWorker;
+
+/**
+ * @struct ParallelWindowTable
+ * @brief The eponymous `parallel_window_stats` virtual table.
+ */
+typedef struct {
+    sqlite3_vtab base;   // Base class.
+    sqlite3 *db;         // The connection.
+    StatsConfig *config; // The connection's configuration (ingestion mode).
+} ParallelWindowTable;
+
+/**
+ * @struct ParallelWindowCursor
+ * @brief A scan of `parallel_window_stats()`: merges the worker streams in partition order.
+ */
+typedef struct {
+    sqlite3_vtab_cursor base;                          // Base class.
+    GroupMap partitions;                               // The distinct partition keys, in sort order.
+    StatsKey *keys;                                    // The partition keys by index.
+    int key_count;                                     // Number of partitions.
+    char *sql;                                         // Per-partition query shared by the workers.
+    ParallelWorker *workers;                           // The workers.
+    int worker_count;                                  // Number of workers.
+    ParallelBatch **heads;                             // Current batch of each worker, NULL when done.
+    int *positions;                                    // Current row in each worker's batch.
+    int current;                                       // Worker of the current row.
+    int eof;                                           // Whether the scan is past the last row.
+    sqlite3_int64 rowid;                               // Row counter.
+    sqlite3_value *arguments[PARALLEL_ARGUMENT_COUNT]; // Argument values of the scan, for the hidden columns.
+} ParallelWindowCursor;
+
+/**
+ * @brief Reads the next batch of result rows of a worker on the calling thread.
+ *
+ * Partitions are scanned one after the other with the per-partition query, which
+ * streams the rows of a partition in order through an index on (part_col, order_col).
+ * Without such an index, a single worker reads all partitions in one ordered scan whose
+ * third column flags the first row of each partition. The frame is a ring of the last
+ * `frame_rows` values, so each row costs O(1) amortized: the moments are recomputed from
+ * the ring once per `frame_rows` removals to bound rounding drift.
+ * @param w The worker.
+ * @param batch The batch to fill; it is empty when the worker has no more rows.
+ * @return SQLITE_OK on success, or an error code with `w->error` set.
+ */
+static int parallel_fill_batch(ParallelWorker *w, ParallelBatch *batch) {
+    while (batch->count < PARALLEL_BATCH_ROWS) {
+        if (!w->scanning) {
+            if (w->next_key == w->key_count)
+                break;
+            sqlite3_reset(w->stmt);
+            if (w->single_scan) {
+                w->next_key = w->key_count;
+                w->current_key = -1;
+            } else {
+                w->current_key = w->key_indexes[w->next_key++];
+                int rc = bind_stats_key(w->stmt, 1, &w->keys[w->current_key]);
+                if (rc != SQLITE_OK) {
+                    w->error = sqlite3_mprintf("parallel_window_stats: %s", sqlite3_errmsg(w->db));
+                    return rc;
+                }
+                w->ring.count = w->ring.head = w->ring.tail = 0;
+                stddev_accumulator_init(&w->moments);
+                w->removals = 0;
+            }
+            w->scanning = 1;
+        }
+
+        int rc = sqlite3_step(w->stmt);
+        if (rc == SQLITE_DONE) {
+            w->scanning = 0;
+            continue;
+        }
+        if (rc != SQLITE_ROW) {
+            w->error = sqlite3_mprintf("parallel_window_stats: %s", sqlite3_errmsg(w->db));
+            return rc;
+        }
+        if (w->single_scan && (w->current_key < 0 || sqlite3_column_int(w->stmt, 2))) {
+            // The partitions come in the order of the cursor's key list.
+            if (++w->current_key >= w->key_count) {
+                w->error = sqlite3_mprintf("parallel_window_stats: the table changed during the scan");
+                return SQLITE_ABORT;
+            }
+            w->ring.count = w->ring.head = w->ring.tail = 0;
+            stddev_accumulator_init(&w->moments);
+            w->removals = 0;
+        }
+        double value;
+        int status = read_numeric_value(sqlite3_column_value(w->stmt, 1), w->ingest_mode, &value);
+        if (status == VALUE_INVALID) {
+            w->error = sqlite3_mprintf("Invalid data type, expected numeric value.");
+            return SQLITE_MISMATCH;
+        }
+        if (status != VALUE_NUMERIC && status != VALUE_COERCED)
+            value = NAN;
+
+        int stale = 0;
+        if (w->ring.count == w->frame_rows) {
+            double leaving = remove_from_circular_buffer(&w->ring);
+            if (!isnan(leaving)) {
+                double m2 = w->moments.m2;
+                stddev_accumulator_remove(&w->moments, leaving);
+                stale = ++w->removals >= w->frame_rows || w->moments.m2 < m2 * REMOVAL_CANCELLATION_LIMIT;
+            }
+        }
+        add_to_circular_buffer(&w->ring, value);
+        if (!isnan(value))
+            stddev_accumulator_add(&w->moments, value);
+        if (stale) {
+            // Removals accumulate rounding drift; recompute once per frame's worth of them.
+            stddev_accumulator_init(&w->moments);
+            for (int i = 0; i < w->ring.count; i++) {
+                double v = get_circular_value(&w->ring, i);
+                if (!isnan(v))
+                    stddev_accumulator_add(&w->moments, v);
+            }
+            w->removals = 0;
+        }
+
+        ParallelRow *row = &batch->rows[batch->count];
+        stats_key_from_value(sqlite3_column_value(w->stmt, 0), &row->ord);
+        if (row->ord.type == SQLITE_TEXT || row->ord.type == SQLITE_BLOB) {
+            if (batch->arena_size + row->ord.n > batch->arena_capacity) {
+                size_t capacity = batch->arena_capacity ? batch->arena_capacity : 4096;
+                while (capacity < batch->arena_size + row->ord.n)
+                    capacity *= CAPACITY_GROWTH_FACTOR;
+                unsigned char *arena = (unsigned char *)realloc(batch->arena, capacity);
+                if (!arena) {
+                    w->error = sqlite3_mprintf("out of memory");
+                    return SQLITE_NOMEM;
+                }
+                batch->arena = arena;
+                batch->arena_capacity = capacity;
+            }
+            if (row->ord.n > 0)
+                memcpy(batch->arena + batch->arena_size, row->ord.z, row->ord.n);
+            row->ord_offset = batch->arena_size;
+            row->ord.z = NULL;
+            batch->arena_size += row->ord.n;
+        }
+        row->key_index = w->current_key;
+        row->value = value;
+        row->moments = w->moments;
+        batch->count++;
+    }
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Frees a batch.
+ * @param batch The batch, or NULL.
+ */
+static void free_parallel_batch(ParallelBatch *batch) {
+    if (batch) {
+        free(batch->arena);
+        free(batch);
+    }
+}
+
+/**
+ * @brief Body of a worker thread: produces batches until its partitions are done.
+ * @param arg The ParallelWorker.
+ */
+static void parallel_worker_main(void *arg) {
+    ParallelWorker *w = (ParallelWorker *)arg;
+    int rc = sqlite3_open_v2(w->filename, &w->db, SQLITE_OPEN_READONLY, w->vfs);
+    if (rc == SQLITE_OK) {
+        sqlite3_busy_timeout(w->db, WORKER_BUSY_TIMEOUT_MS);
+        // One read transaction gives the worker a consistent snapshot across its partitions.
+        rc = sqlite3_exec(w->db, "BEGIN", NULL, NULL, NULL);
+    }
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(w->db, w->sql, -1, &w->stmt, NULL);
+    if (rc != SQLITE_OK)
+        w->error = sqlite3_mprintf("parallel_window_stats: %s", w->db ? sqlite3_errmsg(w->db) : "out of memory");
+
+    while (rc == SQLITE_OK) {
+        ParallelBatch *batch = (ParallelBatch *)calloc(1, sizeof(ParallelBatch));
+        if (!batch) {
+            rc = SQLITE_NOMEM;
+            w->error = sqlite3_mprintf("out of memory");
+            break;
+        }
+        rc = parallel_fill_batch(w, batch);
+        if (rc != SQLITE_OK || batch->count == 0) {
+            free_parallel_batch(batch);
+            break;
+        }
+
+        // Wait for room in the queue, so a slow reader bounds the memory in use.
+        stats_signal_lock(&w->signal);
+        while (w->queued >= PARALLEL_QUEUE_DEPTH && !w->stop_requested)
+            stats_signal_wait(&w->signal);
+        int stop = w->stop_requested;
+        if (!stop) {
+            if (w->queue_tail)
+                w->queue_tail->next = batch;
+            else
+                w->queue = batch;
+            w->queue_tail = batch;
+            w->queued++;
+            stats_signal_broadcast(&w->signal);
+        }
+        stats_signal_unlock(&w->signal);
+        if (stop) {
+            free_parallel_batch(batch);
+            break;
+        }
+    }
+
+    sqlite3_finalize(w->stmt);
+    w->stmt = NULL;
+    sqlite3_close(w->db);
+    w->db = NULL;
+    stats_signal_lock(&w->signal);
+    w->rc = rc;
+    w->finished = 1;
+    stats_signal_broadcast(&w->signal);
+    stats_signal_unlock(&w->signal);
+}
+
+/**
+ * @brief Takes the next batch of a worker, waiting for a threaded worker to produce it.
+ * @param c The cursor, whose table receives any error message.
+ * @param w The worker.
+ * @param batch Receives the batch, or NULL when the worker is done.
+ * @return SQLITE_OK on success, or the worker's error code.
+ */
+static int parallel_next_batch(ParallelWindowCursor *c, ParallelWorker *w, ParallelBatch **batch) {
+    *batch = NULL;
+    int rc = SQLITE_OK;
+    if (!w->threaded) {
+        ParallelBatch *b = (ParallelBatch *)calloc(1, sizeof(ParallelBatch));
+        if (!b)
+            return SQLITE_NOMEM;
+        rc = parallel_fill_batch(w, b);
+        if (rc == SQLITE_OK && b->count > 0)
+            *batch = b;
+        else
+            free_parallel_batch(b);
+    } else {
+        stats_signal_lock(&w->signal);
+        while (!w->queue && !w->finished)
+            stats_signal_wait(&w->signal);
+        if (w->queue) {
+            *batch = w->queue;
+            w->queue = w->queue->next;
+            if (!w->queue)
+                w->queue_tail = NULL;
+            w->queued--;
+            stats_signal_broadcast(&w->signal);
+        } else {
+            rc = w->rc;
+        }
+        stats_signal_unlock(&w->signal);
+    }
+    if (rc != SQLITE_OK) {
+        c->base.pVtab->zErrMsg = sqlite3_mprintf("%s", w->error ? w->error : "parallel_window_stats failed");
+        return rc;
+    }
+    if (*batch)
+        (*batch)->next = NULL;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Connects the eponymous `parallel_window_stats` virtual table.
+ * @param db The database connection.
+ * @param aux The StatsConfig of the connection.
+ * @param argc The number of module arguments.
+ * @param argv The module arguments.
+ * @param vtab Receives the virtual table.
+ * @param error_message Receives an error message.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int parallel_window_connect(sqlite3 *db, void *aux, int argc, const char *const *argv, sqlite3_vtab **vtab, char **error_message) {
+    int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(part, ord, value REAL, n INTEGER, mean REAL, variance REAL, stddev REAL, "
+                                      "\"table\" HIDDEN, part_col HIDDEN, order_col HIDDEN, value_col HIDDEN, frame_rows HIDDEN, threads HIDDEN)");
+    if (rc != SQLITE_OK)
+        return rc;
+    ParallelWindowTable *table = (ParallelWindowTable *)sqlite3_malloc(sizeof(ParallelWindowTable));
+    if (!table)
+        return SQLITE_NOMEM;
+    memset(table, 0, sizeof(*table));
+    table->db = db;
+    table->config = (StatsConfig *)aux;
+    *vtab = &table->base;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Disconnects the `parallel_window_stats` virtual table.
+ * @param vtab The virtual table.
+ * @return SQLITE_OK.
+ */
+static int parallel_window_disconnect(sqlite3_vtab *vtab) {
+    sqlite3_free(vtab);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Plans a `parallel_window_stats` scan.
+ * @param vtab The virtual table.
+ * @param info The index information.
+ * @return SQLITE_OK, SQLITE_CONSTRAINT for an unusable plan, or SQLITE_ERROR if an argument is missing.
+ */
+static int parallel_window_best_index(sqlite3_vtab *vtab, sqlite3_index_info *info) {
+    return plan_table_function(vtab, info, PARALLEL_COLUMN_TABLE, PARALLEL_ARGUMENT_COUNT, PARALLEL_REQUIRED_ARGUMENTS,
+                               "parallel_window_stats requires table, part_col, order_col, value_col and frame_rows arguments", 1e6);
+}
+
+/**
+ * @brief Opens a `parallel_window_stats` cursor.
+ * @param vtab The virtual table.
+ * @param cursor Receives the cursor.
+ * @return SQLITE_OK on success, or SQLITE_NOMEM.
+ */
+static int parallel_window_open(sqlite3_vtab *vtab, sqlite3_vtab_cursor **cursor) {
+    ParallelWindowCursor *c = (ParallelWindowCursor *)calloc(1, sizeof(ParallelWindowCursor));
+    if (!c)
+        return SQLITE_NOMEM;
+    group_map_init(&c->partitions, 0);
+    c->eof = 1;
+    *cursor = &c->base;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Stops the workers of a cursor and releases everything the scan allocated.
+ * @param c The cursor.
+ */
+static void reset_parallel_cursor(ParallelWindowCursor *c) {
+    for (int i = 0; i < c->worker_count; i++) {
+        ParallelWorker *w = &c->workers[i];
+        if (w->threaded) {
+            stats_signal_lock(&w->signal);
+            w->stop_requested = 1;
+            stats_signal_broadcast(&w->signal);
+            stats_signal_unlock(&w->signal);
+            stats_thread_join(w->thread);
+            stats_signal_destroy(&w->signal);
+        } else {
+            sqlite3_finalize(w->stmt);
+        }
+        while (w->queue) {
+            ParallelBatch *next = w->queue->next;
+            free_parallel_batch(w->queue);
+            w->queue = next;
+        }
+        free_parallel_batch(c->heads[i]);
+        free(w->key_indexes);
+        free(w->ring.values);
+        sqlite3_free(w->error);
+    }
+    free(c->workers);
+    free(c->heads);
+    free(c->positions);
+    c->workers = NULL;
+    c->heads = NULL;
+    c->positions = NULL;
+    c->worker_count = 0;
+    free(c->keys);
+    c->keys = NULL;
+    c->key_count = 0;
+    group_map_free(&c->partitions);
+    group_map_init(&c->partitions, 0);
+    sqlite3_free(c->sql);
+    c->sql = NULL;
+    free_table_function_arguments(c->arguments, PARALLEL_ARGUMENT_COUNT);
+    c->eof = 1;
+    c->rowid = 0;
+}
+
+/**
+ * @brief Closes a `parallel_window_stats` cursor.
+ * @param cursor The cursor.
+ * @return SQLITE_OK.
+ */
+static int parallel_window_close(sqlite3_vtab_cursor *cursor) {
+    ParallelWindowCursor *c = (ParallelWindowCursor *)cursor;
+    reset_parallel_cursor(c);
+    group_map_free(&c->partitions);
+    free(c);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Makes the row with the smallest partition index among the worker heads current.
+ *
+ * Each worker emits its partitions in ascending order and a partition belongs to a
+ * single worker, so this k-way merge yields the rows in (partition, order) order. The
+ * worker of the current row stays selected while its partition continues.
+ * @param c The cursor.
+ * @param previous_key The partition index of the previous row, or -1.
+ */
+static void parallel_select_row(ParallelWindowCursor *c, int previous_key) {
+    if (c->current >= 0 && c->heads[c->current] && c->heads[c->current]->rows[c->positions[c->current]].key_index == previous_key)
+        return;
+    c->current = -1;
+    for (int i = 0; i < c->worker_count; i++) {
+        if (!c->heads[i])
+            continue;
+        if (c->current < 0 || c->heads[i]->rows[c->positions[i]].key_index < c->heads[c->current]->rows[c->positions[c->current]].key_index)
+            c->current = i;
+    }
+    c->eof = c->current < 0;
+}
+
+/**
+ * @brief Reports whether a table has an index that streams a partition in order.
+ *
+ * The per-partition queries need an index whose first two columns are part_col and
+ * order_col; without it each of them would scan the whole table.
+ * @param db The database connection.
+ * @param source The table name.
+ * @param part_col The partition column.
+ * @param order_col The order column.
+ * @return 1 if there is a usable index, 0 otherwise (including when the check fails).
+ */
+static int parallel_has_order_index(sqlite3 *db, const char *source, const char *part_col, const char *order_col) {
+    sqlite3_stmt *stmt = NULL;
+    int found = 0;
+    if (sqlite3_prepare_v2(db,
+                           "SELECT 1 FROM pragma_index_list(?1) AS l WHERE NOT l.partial"
+                           " AND (SELECT name FROM pragma_index_info(l.name) WHERE seqno = 0) = ?2 COLLATE NOCASE"
+                           " AND (SELECT name FROM pragma_index_info(l.name) WHERE seqno = 1) = ?3 COLLATE NOCASE",
+                           -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, source, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, part_col, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, order_col, -1, SQLITE_STATIC);
+        found = sqlite3_step(stmt) == SQLITE_ROW;
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+/**
+ * @brief Reports whether a table name resolves to a table of the main database.
+ *
+ * Unqualified names are looked up in the temp schema first, then in main, then in the
+ * attached databases; only a table found in main is visible to a threaded worker.
+ * @param db The database connection.
+ * @param source The table name.
+ * @return 1 if the name refers to a table of main, 0 otherwise (including when the check fails).
+ */
+static int parallel_table_in_main(sqlite3 *db, const char *source) {
+    sqlite3_stmt *stmt = NULL;
+    int in_main = 0;
+    if (sqlite3_prepare_v2(db,
+                           "SELECT NOT EXISTS (SELECT 1 FROM temp.sqlite_master WHERE type IN ('table', 'view') AND name = ?1 COLLATE NOCASE)"
+                           " AND EXISTS (SELECT 1 FROM main.sqlite_master WHERE type IN ('table', 'view') AND name = ?1 COLLATE NOCASE)",
+                           -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, source, -1, SQLITE_STATIC);
+        in_main = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return in_main;
+}
+
+/**
+ * @brief Starts a `parallel_window_stats` scan.
+ *
+ * Reads the distinct partition keys in sort order, assigns each to a worker by the
+ * hash of the key and starts the workers. Threaded workers open their own read-only
+ * connections to the database file, with the same VFS. An in-memory database, a table
+ * outside the main schema (or threads = 1) is read by a single worker on this connection
+ * instead, and so is a table without an index on (part_col, order_col), with one ordered
+ * scan.
+ * @param cursor The cursor.
+ * @param idx_num Bitmask of the arguments passed in argv.
+ * @param idx_str Unused.
+ * @param argc The number of arguments.
+ * @param argv The arguments, in column order.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int parallel_window_filter(sqlite3_vtab_cursor *cursor, int idx_num, const char *idx_str, int argc, sqlite3_value **argv) {
+    ParallelWindowCursor *c = (ParallelWindowCursor *)cursor;
+    ParallelWindowTable *table = (ParallelWindowTable *)cursor->pVtab;
+    reset_parallel_cursor(c);
+    if (copy_table_function_arguments(c->arguments, PARALLEL_ARGUMENT_COUNT, idx_num, argv) != SQLITE_OK)
+        return SQLITE_NOMEM;
+
+    const char *source = (const char *)sqlite3_value_text(c->arguments[0]);
+    const char *part_col = (const char *)sqlite3_value_text(c->arguments[1]);
+    const char *order_col = (const char *)sqlite3_value_text(c->arguments[2]);
+    const char *value_col = (const char *)sqlite3_value_text(c->arguments[3]);
+    sqlite3_int64 frame_rows = sqlite3_value_int64(c->arguments[4]);
+    sqlite3_int64 threads = c->arguments[5] && sqlite3_value_type(c->arguments[5]) != SQLITE_NULL ? sqlite3_value_int64(c->arguments[5]) : 1;
+    if (!source || !part_col || !order_col || !value_col || sqlite3_value_numeric_type(c->arguments[4]) != SQLITE_INTEGER || frame_rows < 1 ||
+        frame_rows > 0x7FFFFFFF || threads < 1 || threads > PARALLEL_MAX_THREADS) {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("parallel_window_stats requires table, part_col, order_col and value_col names, frame_rows >= 1 "
+                                                 "and 1 <= threads <= 64");
+        return SQLITE_ERROR;
+    }
+
+    // The distinct partition keys, in the order of the result.
+    sqlite3_stmt *stmt = NULL;
+    char *sql = sqlite3_mprintf("SELECT DISTINCT \"%w\" FROM \"%w\" ORDER BY 1", part_col, source);
+    int rc = sql ? sqlite3_prepare_v2(table->db, sql, -1, &stmt, NULL) : SQLITE_NOMEM;
+    sqlite3_free(sql);
+    while (rc == SQLITE_OK && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        StatsKey key;
+        stats_key_from_value(sqlite3_column_value(stmt, 0), &key);
+        rc = group_map_lookup(&c->partitions, &key, 1) ? SQLITE_OK : SQLITE_NOMEM;
+    }
+    if (rc == SQLITE_DONE)
+        rc = SQLITE_OK;
+    if (rc != SQLITE_OK && rc != SQLITE_NOMEM)
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("parallel_window_stats: %s", sqlite3_errmsg(table->db));
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_OK)
+        return rc;
+    c->key_count = c->partitions.count;
+    c->keys = (StatsKey *)malloc((c->key_count ? c->key_count : 1) * sizeof(StatsKey));
+    if (!c->keys)
+        return SQLITE_NOMEM;
+    int index = 0;
+    for (GroupMapEntry *e = c->partitions.first; e; e = e->next_added)
+        c->keys[index++] = e->key;
+
+    int single_scan = !parallel_has_order_index(table->db, source, part_col, order_col);
+    if (single_scan)
+        c->sql = sqlite3_mprintf("SELECT \"%w\", \"%w\", \"%w\" IS NOT lag(\"%w\") OVER (ORDER BY \"%w\", \"%w\") FROM \"%w\" ORDER BY \"%w\", \"%w\"",
+                                 order_col, value_col, part_col, part_col, part_col, order_col, source, part_col, order_col);
+    else
+        c->sql = sqlite3_mprintf("SELECT \"%w\", \"%w\" FROM \"%w\" WHERE \"%w\" IS ?1 ORDER BY 1", order_col, value_col, source, part_col);
+    if (!c->sql)
+        return SQLITE_NOMEM;
+    const char *filename = sqlite3_db_filename(table->db, "main");
+    int threaded = !single_scan && threads > 1 && filename && filename[0] && sqlite3_threadsafe() && parallel_table_in_main(table->db, source);
+    if (threaded && !sqlite3_get_autocommit(table->db)) {
+        cursor->pVtab->zErrMsg = sqlite3_mprintf("parallel_window_stats: threads > 1 cannot be used inside a transaction, as the workers "
+                                                 "would not see its changes");
+        return SQLITE_ERROR;
+    }
+    sqlite3_vfs *vfs = NULL;
+    if (threaded && sqlite3_file_control(table->db, "main", SQLITE_FCNTL_VFS_POINTER, &vfs) != SQLITE_OK)
+        vfs = NULL;
+    c->worker_count = threaded ? (int)threads : 1;
+    c->workers = (ParallelWorker *)calloc(c->worker_count, sizeof(ParallelWorker));
+    c->heads = (ParallelBatch **)calloc(c->worker_count, sizeof(ParallelBatch *));
+    c->positions = (int *)calloc(c->worker_count, sizeof(int));
+    if (!c->workers || !c->heads || !c->positions) {
+        c->worker_count = 0;
+        return SQLITE_NOMEM;
+    }
+    for (int i = 0; i < c->worker_count; i++) {
+        ParallelWorker *w = &c->workers[i];
+        w->filename = threaded ? filename : NULL;
+        w->vfs = vfs ? vfs->zName : NULL;
+        w->db = threaded ? NULL : table->db;
+        w->sql = c->sql;
+        w->single_scan = single_scan;
+        w->keys = c->keys;
+        w->frame_rows = (int)frame_rows;
+        w->ingest_mode = table->config->ingest_mode;
+        w->key_indexes = (int *)malloc((c->key_count ? c->key_count : 1) * sizeof(int));
+        w->ring.capacity = (int)frame_rows;
+        w->ring.values = (double *)malloc((size_t)frame_rows * sizeof(double));
+        if (!w->key_indexes || !w->ring.values)
+            return SQLITE_NOMEM;
+    }
+    for (int k = 0; k < c->key_count; k++) {
+        ParallelWorker *w = &c->workers[stats_key_hash(&c->keys[k]) % (unsigned int)c->worker_count];
+        w->key_indexes[w->key_count++] = k;
+    }
+
+    for (int i = 0; i < c->worker_count; i++) {
+        ParallelWorker *w = &c->workers[i];
+        if (!threaded) {
+            rc = sqlite3_prepare_v2(table->db, c->sql, -1, &w->stmt, NULL);
+            if (rc != SQLITE_OK) {
+                cursor->pVtab->zErrMsg = sqlite3_mprintf("parallel_window_stats: %s", sqlite3_errmsg(table->db));
+                return rc;
+            }
+            continue;
+        }
+        if (stats_signal_init(&w->signal) != SQLITE_OK) {
+            cursor->pVtab->zErrMsg = sqlite3_mprintf("parallel_window_stats: cannot create a worker");
+            return SQLITE_ERROR;
+        }
+        if (stats_thread_start(&w->thread, parallel_worker_main, w) != SQLITE_OK) {
+            stats_signal_destroy(&w->signal);
+            cursor->pVtab->zErrMsg = sqlite3_mprintf("parallel_window_stats: cannot start a worker thread");
+            return SQLITE_ERROR;
+        }
+        w->threaded = 1;
+    }
+
+    for (int i = 0; i < c->worker_count; i++) {
+        rc = parallel_next_batch(c, &c->workers[i], &c->heads[i]);
+        if (rc != SQLITE_OK)
+            return rc;
+    }
+    c->current = -1;
+    parallel_select_row(c, -1);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Advances a `parallel_window_stats` cursor to the next row.
+ * @param cursor The cursor.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int parallel_window_next(sqlite3_vtab_cursor *cursor) {
+    ParallelWindowCursor *c = (ParallelWindowCursor *)cursor;
+    int i = c->current;
+    int previous_key = c->heads[i]->rows[c->positions[i]].key_index;
+    c->rowid++;
+    if (++c->positions[i] == c->heads[i]->count) {
+        free_parallel_batch(c->heads[i]);
+        c->heads[i] = NULL;
+        c->positions[i] = 0;
+        int rc = parallel_next_batch(c, &c->workers[i], &c->heads[i]);
+        if (rc != SQLITE_OK)
+            return rc;
+    }
+    parallel_select_row(c, previous_key);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Reports whether a `parallel_window_stats` cursor is past the last row.
+ * @param cursor The cursor.
+ * @return Non-zero at the end of the scan.
+ */
+static int parallel_window_eof(sqlite3_vtab_cursor *cursor) { return ((ParallelWindowCursor *)cursor)->eof; }
+
+/**
+ * @brief Returns a column of the current `parallel_window_stats` row.
+ * @param cursor The cursor.
+ * @param context The result context.
+ * @param column The column index.
+ * @return SQLITE_OK.
+ */
+static int parallel_window_column(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int column) {
+    ParallelWindowCursor *c = (ParallelWindowCursor *)cursor;
+    const ParallelBatch *batch = c->heads[c->current];
+    const ParallelRow *row = &batch->rows[c->positions[c->current]];
+    const MomentsState *m = &row->moments;
+    switch (column) {
+    case PARALLEL_COLUMN_PART:
+        result_stats_key(context, &c->keys[row->key_index]);
+        break;
+    case PARALLEL_COLUMN_ORD: {
+        StatsKey ord = row->ord;
+        if (ord.type == SQLITE_TEXT || ord.type == SQLITE_BLOB)
+            ord.z = batch->arena ? batch->arena + row->ord_offset : (const unsigned char *)"";
+        result_stats_key(context, &ord);
+        break;
+    }
+    case PARALLEL_COLUMN_VALUE:
+        set_result(context, row->value);
+        break;
+    case PARALLEL_COLUMN_N:
+        sqlite3_result_int64(context, m->n);
+        break;
+    case PARALLEL_COLUMN_MEAN:
+        set_result(context, m->n > 0 ? m->mean : NAN);
+        break;
+    case PARALLEL_COLUMN_VARIANCE:
+        set_result(context, calculate_variance_sample(m));
+        break;
+    case PARALLEL_COLUMN_STDDEV:
+        set_result(context, calculate_stddev_sample(m));
+        break;
+    default:
+        if (c->arguments[column - PARALLEL_COLUMN_TABLE])
+            sqlite3_result_value(context, c->arguments[column - PARALLEL_COLUMN_TABLE]);
+    }
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Returns the rowid of the current `parallel_window_stats` row.
+ * @param cursor The cursor.
+ * @param rowid Receives the rowid.
+ * @return SQLITE_OK.
+ */
+static int parallel_window_rowid(sqlite3_vtab_cursor *cursor, sqlite3_int64 *rowid) {
+    *rowid = ((ParallelWindowCursor *)cursor)->rowid;
+    return SQLITE_OK;
+}
+
+// The eponymous-only `parallel_window_stats` table-valued function.
+static const sqlite3_module parallel_window_module = {
+    0,                          // iVersion
+    NULL,                       // xCreate (eponymous only)
+    parallel_window_connect,    // xConnect
+    parallel_window_best_index, // xBestIndex
+    parallel_window_disconnect, // xDisconnect
+    NULL,                       // xDestroy
+    parallel_window_open,       // xOpen
+    parallel_window_close,      // xClose
+    parallel_window_filter,     // xFilter
+    parallel_window_next,       // xNext
+    parallel_window_eof,        // xEof
+    parallel_window_column,     // xColumn
+    parallel_window_rowid,      // xRowid
+};
+
+// --- Multiple Frame Sizes in One Pass ---
+
+// Largest number of frame sizes of `multi_window_stats()`.
+#define MULTI_WINDOW_MAX_SIZES 32
+// Largest supported frame size in rows.
+#define MULTI_WINDOW_MAX_ROWS 10000000
+
+/**
+ * @struct MultiWindowContext
+ * @brief Aggregate context of `multi_window_stats()`.
+ *
+ * All frames end at the current row, so the ring of the largest frame holds every value
+ * a smaller frame can still need; each size only keeps its own moments. The moments are
+ * recomputed from the ring each time it wraps, so removals cannot accumulate drift.
+ */
+typedef struct {
+    int sizes[MULTI_WINDOW_MAX_SIZES];             // Frame sizes in rows, ascending.
+    MomentsState moments[MULTI_WINDOW_MAX_SIZES];  // Moments of the non-NULL values of each frame.
+    int size_count;                                // Number of frame sizes (0 before the first step).
+    double *ring;                                  // The last sizes[size_count - 1] values (NaN for NULL).
+    int next;                                      // Ring slot written by the next row.
+    sqlite3_int64 rows;                            // Number of rows seen.
+    int ingest_mode;                               // Ingestion mode captured at the first step.
+} MultiWindowContext;
+
+/**
+ * @brief Compares two ints for qsort().
+ * @param a Pointer to the first int.
+ * @param b Pointer to the second int.
+ * @return Negative, zero or positive as for qsort().
+ */
+static int compare_ints(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Parses a comma-separated list of frame sizes into ascending distinct sizes.
+ * @param text The list, e.g. "10,60,1440".
+ * @param sizes Receives the sizes.
+ * @return The number of sizes, or 0 if the list is invalid.
+ */
+static int parse_window_sizes(const char *text, int *sizes) {
+    int count = 0;
+    const char *p = text;
+    while (p && *p) {
+        char *end;
+        while (*p == ' ')
+            p++;
+        long size = strtol(p, &end, 10);
+        if (end == p || size < 1 || size > MULTI_WINDOW_MAX_ROWS || count == MULTI_WINDOW_MAX_SIZES)
+            return 0;
+        sizes[count++] = (int)size;
+        p = end;
+        while (*p == ' ')
+            p++;
+        if (*p == ',')
+            p++;
+        else if (*p)
+            return 0;
+    }
+    qsort(sizes, count, sizeof(int), compare_ints);
+    int distinct = 0;
+    for (int i = 0; i < count; i++) {
+        if (distinct == 0 || sizes[i] != sizes[distinct - 1])
+            sizes[distinct++] = sizes[i];
+    }
+    return distinct;
+}
+
+/**
+ * @brief Recomputes the moments of one frame size from the ring.
+ * @param ctx The aggregate context, with the current row already in the ring.
+ * @param i The index of the frame size.
+ */
+static void multi_window_recompute(MultiWindowContext *ctx, int i) {
+    int capacity = ctx->sizes[ctx->size_count - 1];
+    int count = ctx->rows < ctx->sizes[i] ? (int)ctx->rows : ctx->sizes[i];
+    int slot = ctx->next - count;
+    if (slot < 0)
+        slot += capacity;
+    stddev_accumulator_init(&ctx->moments[i]);
+    for (int k = 0; k < count; k++) {
+        if (!isnan(ctx->ring[slot]))
+            stddev_accumulator_add(&ctx->moments[i], ctx->ring[slot]);
+        if (++slot == capacity)
+            slot = 0;
+    }
+}
+
+/**
+ * @brief The "step" function of `multi_window_stats(x, sizes)`.
+ *
+ * Before the row enters, the value that falls out of each frame of k rows is the k-th
+ * most recent value of the shared ring; it is removed from that frame's moments, then
+ * the new value is added to all of them. Each row costs O(number of sizes) amortized:
+ * every time the ring wraps, all moments are recomputed from it, and a frame whose M2
+ * a removal cancelled almost entirely is recomputed at once.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (2).
+ * @param argv The argument values.
+ */
+static void multi_window_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    MultiWindowContext *ctx = (MultiWindowContext *)sqlite3_aggregate_context(context, sizeof(MultiWindowContext));
+    if (!ctx) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    // Initialize context on the first call.
+    if (ctx->size_count == 0) {
+        int count = parse_window_sizes((const char *)sqlite3_value_text(argv[1]), ctx->sizes);
+        if (count == 0) {
+            sqlite3_result_error(context, "multi_window_stats requires a list of 1 to 32 frame sizes such as '10,60,1440', "
+                                          "each between 1 and 10000000.", -1);
+            return;
+        }
+        ctx->ring = (double *)malloc((size_t)ctx->sizes[count - 1] * sizeof(double));
+        if (!ctx->ring) {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        for (int i = 0; i < count; i++)
+            stddev_accumulator_init(&ctx->moments[i]);
+        ctx->size_count = count;
+        ctx->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+    }
+
+    double value;
+    int status = read_numeric_value(argv[0], ctx->ingest_mode, &value);
+    if (status == VALUE_INVALID) {
+        sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+        return;
+    }
+    if (status != VALUE_NUMERIC && status != VALUE_COERCED)
+        value = NAN;
+
+    int capacity = ctx->sizes[ctx->size_count - 1];
+    unsigned int stale = 0; // Bit i: the moments of size i lost their precision.
+    for (int i = 0; i < ctx->size_count && ctx->rows >= ctx->sizes[i]; i++) {
+        int slot = ctx->next - ctx->sizes[i];
+        double leaving = ctx->ring[slot < 0 ? slot + capacity : slot];
+        if (!isnan(leaving)) {
+            double m2 = ctx->moments[i].m2;
+            stddev_accumulator_remove(&ctx->moments[i], leaving);
+            if (ctx->moments[i].m2 < m2 * REMOVAL_CANCELLATION_LIMIT)
+                stale |= 1u << i;
+        }
+    }
+    if (!isnan(value)) {
+        for (int i = 0; i < ctx->size_count; i++)
+            stddev_accumulator_add(&ctx->moments[i], value);
+    }
+    ctx->ring[ctx->next] = value;
+    if (++ctx->next == capacity) {
+        ctx->next = 0;
+        stale = ~0u;
+    }
+    ctx->rows++;
+    for (int i = 0; i < ctx->size_count; i++) {
+        if (stale & (1u << i))
+            multi_window_recompute(ctx, i);
+    }
+}
+
+/**
+ * @brief The "inverse" function of `multi_window_stats()`.
+ *
+ * The function keeps its own frames, so frames that drop rows are rejected.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments.
+ * @param argv The argument values of the row leaving the window.
+ */
+static void multi_window_inverse(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    sqlite3_result_error(context, "multi_window_stats requires a frame starting at UNBOUNDED PRECEDING.", -1);
+}
+
+/**
+ * @brief The "value" function of `multi_window_stats()`.
+ *
+ * Returns a JSON object keyed by frame size, e.g. `{"10":{"n":..,"mean":..,
+ * "variance":..,"stddev":..},"60":{...}}`, with the sample statistics of the non-NULL
+ * values among the last k rows (fewer at the start of the series).
+ * @param context The SQLite function context.
+ */
+static void multi_window_value(sqlite3_context *context) {
+    MultiWindowContext *ctx = (MultiWindowContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || ctx->size_count == 0) {
+        sqlite3_result_null(context);
+        return;
+    }
+    sqlite3_str *json = sqlite3_str_new(sqlite3_context_db_handle(context));
+    sqlite3_str_appendchar(json, 1, '{');
+    for (int i = 0; i < ctx->size_count; i++) {
+        const MomentsState *m = &ctx->moments[i];
+        json_append_separator(json);
+        sqlite3_str_appendf(json, "\"%d\":{", ctx->sizes[i]);
+        json_append_int(json, "n", m->n);
+        json_append_double(json, "mean", m->n > 0 ? m->mean : NAN);
+        json_append_double(json, "variance", calculate_variance_sample(m));
+        json_append_double(json, "stddev", calculate_stddev_sample(m));
+        sqlite3_str_appendchar(json, 1, '}');
+    }
+    sqlite3_str_appendchar(json, 1, '}');
+    json_result(context, json);
+}
+
+/**
+ * @brief The "final" function of `multi_window_stats()`.
+ *
+ * As an aggregate, returns the statistics of the frames ending at the last row.
+ * @param context The SQLite function context.
+ */
+static void multi_window_final(sqlite3_context *context) {
+    multi_window_value(context);
+    MultiWindowContext *ctx = (MultiWindowContext *)sqlite3_aggregate_context(context, 0);
+    if (ctx && ctx->size_count > 0) {
+        free(ctx->ring);
+        ctx->size_count = 0;
+    }
+}
+
+// --- Counter Rate Statistics ---
+
+/**
+ * @struct RateSample
+ * @brief The rate a counter sample contributes: the rate from the previous sample.
+ */
+typedef struct {
+    double rate; // Increase per time unit since the previous sample, NaN if there is none.
+    int reset;   // Whether the counter was reset since the previous sample.
+} RateSample;
+
+/**
+ * @struct RateStatsContext
+ * @brief Aggregate context of `rate_stats()`.
+ *
+ * The frame's samples (rows with a non-NULL counter and timestamp) are kept as a ring of
+ * the rates they contribute. The rate of a sample depends on the sample before it, so
+ * when the oldest sample leaves the frame, the rate of the new oldest sample is removed
+ * from the moments. The moments are recomputed from the ring once per frame's worth of
+ * removed rates, so the rounding error of removals does not build up.
+ */
+typedef struct {
+    RateSample *samples;  // Ring of the frame's samples, oldest first.
+    int capacity;         // Allocated ring slots.
+    int head;             // Ring slot of the oldest sample.
+    int count;            // Number of samples in the frame.
+    double last_counter;  // Counter of the newest sample.
+    double last_ts;       // Timestamp of the newest sample.
+    MomentsState moments; // Moments of the rates in the frame.
+    sqlite3_int64 resets; // Number of resets among the rates in the frame.
+    int removals;         // Rates removed since the moments were last recomputed.
+    int stale;            // Whether a removal cancelled nearly all of M2.
+    int initialized;      // Whether the ingestion mode has been captured.
+    int ingest_mode;      // Ingestion mode captured at the first step.
+} RateStatsContext;
+
+/**
+ * @brief Reads the counter and timestamp arguments of `rate_stats()`.
+ * @param context The SQLite function context, for errors.
+ * @param ctx The aggregate context.
+ * @param argv The argument values.
+ * @param counter Receives the counter.
+ * @param ts Receives the timestamp.
+ * @return 1 for a sample, 0 if the row has a NULL (or skipped) argument, -1 after an error.
+ */
+static int read_rate_sample(sqlite3_context *context, RateStatsContext *ctx, sqlite3_value **argv, double *counter, double *ts) {
+    int status_counter = read_numeric_value(argv[0], ctx->ingest_mode, counter);
+    int status_ts = read_numeric_value(argv[1], ctx->ingest_mode, ts);
+    if (status_counter == VALUE_INVALID || status_ts == VALUE_INVALID) {
+        sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+        return -1;
+    }
+    return (status_counter == VALUE_NUMERIC || status_counter == VALUE_COERCED) && (status_ts == VALUE_NUMERIC || status_ts == VALUE_COERCED);
+}
+
+/**
+ * @brief The "step" function of `rate_stats(counter, ts)`.
+ *
+ * Computes the rate from the previous sample of the frame: the counter increase divided
+ * by the elapsed time. A counter that went down was reset, and as in Prometheus the
+ * increase is then the new counter value itself. Samples with a timestamp that does not
+ * advance contribute no rate.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (2).
+ * @param argv The argument values.
+ */
+static void rate_stats_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    RateStatsContext *ctx = (RateStatsContext *)sqlite3_aggregate_context(context, sizeof(RateStatsContext));
+    if (!ctx) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    // Initialize context on the first call.
+    if (!ctx->initialized) {
+        ctx->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+        stddev_accumulator_init(&ctx->moments);
+        ctx->initialized = 1;
+    }
+
+    double counter, ts;
+    if (read_rate_sample(context, ctx, argv, &counter, &ts) <= 0)
+        return;
+    if (ctx->count == ctx->capacity) {
+        int capacity = ctx->capacity ? ctx->capacity * CAPACITY_GROWTH_FACTOR : INITIAL_CAPACITY;
+        RateSample *samples = (RateSample *)malloc(capacity * sizeof(RateSample));
+        if (!samples) {
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        for (int i = 0; i < ctx->count; i++)
+            samples[i] = ctx->samples[(ctx->head + i) % ctx->capacity];
+        free(ctx->samples);
+        ctx->samples = samples;
+        ctx->capacity = capacity;
+        ctx->head = 0;
+    }
+
+    RateSample sample = {NAN, 0};
+    if (ctx->count > 0 && ts > ctx->last_ts) {
+        sample.reset = counter < ctx->last_counter;
+        sample.rate = (sample.reset ? counter : counter - ctx->last_counter) / (ts - ctx->last_ts);
+        if (isnan(sample.rate) || isinf(sample.rate)) {
+            sample.rate = NAN;
+            sample.reset = 0;
+        } else {
+            stddev_accumulator_add(&ctx->moments, sample.rate);
+            ctx->resets += sample.reset;
+        }
+    }
+    ctx->samples[(ctx->head + ctx->count) % ctx->capacity] = sample;
+    ctx->count++;
+    ctx->last_counter = counter;
+    ctx->last_ts = ts;
+}
+
+/**
+ * @brief Removes the rate of a sample from the moments and marks it as removed.
+ * @param ctx The aggregate context.
+ * @param sample The sample.
+ */
+static void rate_stats_drop(RateStatsContext *ctx, RateSample *sample) {
+    if (!isnan(sample->rate)) {
+        double m2 = ctx->moments.m2;
+        stddev_accumulator_remove(&ctx->moments, sample->rate);
+        ctx->resets -= sample->reset;
+        ctx->removals++;
+        ctx->stale |= ctx->moments.m2 < m2 * REMOVAL_CANCELLATION_LIMIT;
+    }
+    sample->rate = NAN;
+    sample->reset = 0;
+}
+
+/**
+ * @brief The "inverse" function of `rate_stats()`.
+ *
+ * The oldest sample leaves the frame. Its own rate left with the sample before it; the
+ * rate of the next sample was measured from it and leaves now.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (2).
+ * @param argv The argument values of the row leaving the window.
+ */
+static void rate_stats_inverse(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    RateStatsContext *ctx = (RateStatsContext *)sqlite3_aggregate_context(context, 0);
+    double counter, ts;
+    if (!ctx || !ctx->initialized || ctx->count == 0 || read_rate_sample(context, ctx, argv, &counter, &ts) <= 0)
+        return;
+    rate_stats_drop(ctx, &ctx->samples[ctx->head]);
+    ctx->head = (ctx->head + 1) % ctx->capacity;
+    ctx->count--;
+    if (ctx->count > 0)
+        rate_stats_drop(ctx, &ctx->samples[ctx->head]);
+
+    // Recompute the moments from the ring once per frame's worth of removed rates, and
+    // right after a removal that cancelled nearly all of M2; this is O(1) amortized.
+    if (ctx->stale || ctx->removals >= ctx->count) {
+        stddev_accumulator_init(&ctx->moments);
+        for (int i = 0; i < ctx->count; i++) {
+            double rate = ctx->samples[(ctx->head + i) % ctx->capacity].rate;
+            if (!isnan(rate))
+                stddev_accumulator_add(&ctx->moments, rate);
+        }
+        ctx->removals = 0;
+        ctx->stale = 0;
+    }
+}
+
+/**
+ * @brief The "value" function of `rate_stats()`.
+ *
+ * Returns a JSON object with the number of rates `n`, their `mean`, sample `variance`
+ * and `stddev`, and the number of counter `resets` among them, or NULL without samples.
+ * @param context The SQLite function context.
+ */
+static void rate_stats_value(sqlite3_context *context) {
+    RateStatsContext *ctx = (RateStatsContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || ctx->count == 0) {
+        sqlite3_result_null(context);
+        return;
+    }
+    const MomentsState *m = &ctx->moments;
+    sqlite3_str *json = sqlite3_str_new(sqlite3_context_db_handle(context));
+    sqlite3_str_appendchar(json, 1, '{');
+    json_append_int(json, "n", m->n);
+    json_append_double(json, "mean", m->n > 0 ? m->mean : NAN);
+    json_append_double(json, "variance", calculate_variance_sample(m));
+    json_append_double(json, "stddev", calculate_stddev_sample(m));
+    json_append_int(json, "resets", ctx->resets);
+    sqlite3_str_appendchar(json, 1, '}');
+    json_result(context, json);
+}
+
+/**
+ * @brief The "final" function of `rate_stats()`.
+ * @param context The SQLite function context.
+ */
+static void rate_stats_final(sqlite3_context *context) {
+    rate_stats_value(context);
+    RateStatsContext *ctx = (RateStatsContext *)sqlite3_aggregate_context(context, 0);
+    if (ctx) {
+        free(ctx->samples);
+        ctx->samples = NULL;
+        ctx->count = ctx->capacity = 0;
+    }
+}
+
+// --- Survey Replicate-Weight Variance ---
+
+// Largest number of replicate weights per row.
+#define REPLICATE_MAX_WEIGHTS 10000
+
+// Replicate variance methods.
+#define REPLICATE_JK1 1
+#define REPLICATE_BRR 2
+#define REPLICATE_FAY 3
+
+/**
+ * @struct ReplicateContext
+ * @brief Aggregate context of `replicate_variance()`.
+ *
+ * Keeps the weighted sums of the full sample and of every replicate. Values are shifted
+ * by the first value so the weighted sums stay small.
+ */
+typedef struct {
+    int replicates;      // Number of replicate weights R (0 before the first row).
+    int method;          // REPLICATE_JK1, REPLICATE_BRR or REPLICATE_FAY.
+    double rho;          // Fay's perturbation factor.
+    double *sums;        // Per replicate weight sums [0, R), weighted sums [R, 2R), row weights [2R, 3R).
+    double sum_w;        // Sum of the full-sample weights.
+    double sum_wx;       // Sum of full-sample weight * shifted value.
+    double shift;        // First value.
+    sqlite3_int64 n;     // Number of rows used.
+    int ingest_mode;     // Ingestion mode captured at the first step.
+} ReplicateContext;
+
+// Longest JSON number accepted as a replicate weight.
+#define REPLICATE_MAX_NUMBER_LENGTH 500
+
+/**
+ * @brief Parses a JSON number at the start of a string.
+ *
+ * Only the JSON grammar is accepted (no leading '+' or '.', no hex, `nan` or `inf`).
+ * Short numbers are converted exactly by parse_numeric_text(). Longer ones go to
+ * strtod() with the decimal point removed and the exponent adjusted, so that the
+ * locale's decimal separator cannot change the result.
+ * @param p The string.
+ * @param end Receives the position after the number.
+ * @param out Receives the number.
+ * @return 1 on success, or 0 if no finite number starts at `p`.
+ */
+static int parse_json_number(const char *p, const char **end, double *out) {
+    const char *q = p;
+    q += *q == '-';
+    if (*q == '0')
+        q++;
+    else if (*q >= '1' && *q <= '9')
+        while (*q >= '0' && *q <= '9')
+            q++;
+    else
+        return 0;
+    if (*q == '.') {
+        if (!(*++q >= '0' && *q <= '9'))
+            return 0;
+        while (*q >= '0' && *q <= '9')
+            q++;
+    }
+    if (*q == 'e' || *q == 'E') {
+        q += q[1] == '+' || q[1] == '-';
+        if (!(*++q >= '0' && *q <= '9'))
+            return 0;
+        while (*q >= '0' && *q <= '9')
+            q++;
+    }
+    int length = (int)(q - p);
+    if (length > REPLICATE_MAX_NUMBER_LENGTH)
+        return 0;
+    *end = q;
+    if (parse_numeric_text((const unsigned char *)p, length, out) == NUMERIC_TEXT_EXACT)
+        return 1;
+
+    // Rewrite "-12.345e6" as "-12345e3" for strtod().
+    char buffer[REPLICATE_MAX_NUMBER_LENGTH + 16];
+    int used = 0, fraction_digits = 0, exponent = 0, exponent_negative = 0;
+    const char *s = p;
+    if (*s == '-')
+        buffer[used++] = *s++;
+    for (; *s >= '0' && *s <= '9'; s++)
+        buffer[used++] = *s;
+    if (*s == '.')
+        for (s++; *s >= '0' && *s <= '9'; s++, fraction_digits++)
+            buffer[used++] = *s;
+    if (*s == 'e' || *s == 'E') {
+        s++;
+        if (*s == '+' || *s == '-')
+            exponent_negative = *s++ == '-';
+        for (; *s >= '0' && *s <= '9'; s++)
+            if (exponent < 100000)
+                exponent = exponent * 10 + (*s - '0');
+    }
+    snprintf(buffer + used, sizeof(buffer) - used, "e%d", (exponent_negative ? -exponent : exponent) - fraction_digits);
+    *out = strtod(buffer, NULL);
+    return isfinite(*out);
+}
+
+/**
+ * @brief Decodes the replicate weights of a row.
+ *
+ * Accepts a BLOB of little-endian float64 values or a JSON array of numbers such as the
+ * text of `json_array(rw1, rw2, ...)`. Every weight must be finite.
+ * @param arg The argument.
+ * @param out Receives up to `max` weights.
+ * @param max The largest number of weights.
+ * @return The number of weights, or -1 if the argument is not a valid weight list.
+ */
+static int read_replicate_weights(sqlite3_value *arg, double *out, int max) {
+    if (sqlite3_value_type(arg) == SQLITE_BLOB) {
+        int bytes = sqlite3_value_bytes(arg);
+        if (bytes == 0 || bytes % 8 != 0 || bytes / 8 > max)
+            return -1;
+        const unsigned char *in = (const unsigned char *)sqlite3_value_blob(arg);
+        for (int r = 0; r < bytes / 8; r++)
+            if (!isfinite(out[r] = get_le_double(in + 8 * (size_t)r)))
+                return -1;
+        return bytes / 8;
+    }
+    const char *p = (const char *)sqlite3_value_text(arg);
+    if (sqlite3_value_type(arg) != SQLITE_TEXT || !p)
+        return -1;
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        p++;
+    if (*p++ != '[')
+        return -1;
+    int count = 0;
+    for (;;) {
+        const char *end;
+        if (count == max)
+            return -1;
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+            p++;
+        if (!parse_json_number(p, &end, &out[count]))
+            return -1;
+        count++;
+        p = end;
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+            p++;
+        if (*p == ']')
+            break;
+        if (*p++ != ',')
+            return -1;
+    }
+    return count;
+}
+
+/**
+ * @brief The "step" function of `replicate_variance(x, full_weight, rep_weights, method[, rho])`.
+ *
+ * Adds the row to the full-sample sums and, in one pass over the decoded weights, to
+ * the sums of all R replicates. Rows with a NULL value or full-sample weight are ignored.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (4 or 5).
+ * @param argv The argument values.
+ */
+static void replicate_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    ReplicateContext *ctx = (ReplicateContext *)sqlite3_aggregate_context(context, sizeof(ReplicateContext));
+    if (!ctx) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    if (!ctx->method) {
+        const char *method = (const char *)sqlite3_value_text(argv[3]);
+        if (method && sqlite3_stricmp(method, "jk1") == 0)
+            ctx->method = REPLICATE_JK1;
+        else if (method && sqlite3_stricmp(method, "brr") == 0)
+            ctx->method = REPLICATE_BRR;
+        else if (method && sqlite3_stricmp(method, "fay") == 0)
+            ctx->method = REPLICATE_FAY;
+        else {
+            sqlite3_result_error(context, "replicate_variance method must be 'jk1', 'brr' or 'fay'.", -1);
+            return;
+        }
+        ctx->rho = argc > 4 ? sqlite3_value_double(argv[4]) : 0.0;
+        if (ctx->method == REPLICATE_FAY && (argc < 5 || !(ctx->rho >= 0.0 && ctx->rho < 1.0))) {
+            ctx->method = 0;
+            sqlite3_result_error(context, "replicate_variance 'fay' requires 0 <= rho < 1.", -1);
+            return;
+        }
+        ctx->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+    }
+
+    double x, w;
+    int status_x = read_numeric_value(argv[0], ctx->ingest_mode, &x);
+    int status_w = read_numeric_value(argv[1], ctx->ingest_mode, &w);
+    if (status_x == VALUE_INVALID || status_w == VALUE_INVALID) {
+        sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+        return;
+    }
+    if ((status_x != VALUE_NUMERIC && status_x != VALUE_COERCED) || (status_w != VALUE_NUMERIC && status_w != VALUE_COERCED))
+        return;
+
+    const char *usage = "replicate_variance expects the same number (at most 10000) of finite replicate weights for every row, "
+                        "as a float64 BLOB or a JSON array.";
+    if (!ctx->replicates) {
+        // Decode the first row into a buffer of the largest size, then shrink it to 3 R.
+        double *sums = (double *)malloc((size_t)REPLICATE_MAX_WEIGHTS * sizeof(double));
+        int count = sums ? read_replicate_weights(argv[2], sums, REPLICATE_MAX_WEIGHTS) : 0;
+        if (count <= 0) {
+            free(sums);
+            if (sums)
+                sqlite3_result_error(context, usage, -1);
+            else
+                sqlite3_result_error_nomem(context);
+            return;
+        }
+        double *packed = (double *)realloc(sums, 3 * (size_t)count * sizeof(double));
+        if (!packed) {
+            free(sums);
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        memmove(packed + 2 * (size_t)count, packed, (size_t)count * sizeof(double));
+        memset(packed, 0, 2 * (size_t)count * sizeof(double));
+        ctx->sums = packed;
+        ctx->replicates = count;
+        ctx->shift = x;
+    } else if (read_replicate_weights(argv[2], ctx->sums + 2 * (size_t)ctx->replicates, ctx->replicates) != ctx->replicates) {
+        sqlite3_result_error(context, usage, -1);
+        return;
+    }
+
+    int count = ctx->replicates;
+    const double *restrict rep_w = ctx->sums + 2 * (size_t)count;
+    double d = x - ctx->shift;
+    ctx->n++;
+    ctx->sum_w += w;
+    ctx->sum_wx += w * d;
+    double *restrict rep_sum_w = ctx->sums;
+    double *restrict rep_sum_wx = ctx->sums + count;
+    for (int r = 0; r < count; r++) {
+        rep_sum_w[r] += rep_w[r];
+        rep_sum_wx[r] += rep_w[r] * d;
+    }
+}
+
+/**
+ * @brief The "final" function of `replicate_variance()`.
+ *
+ * The estimate is the weighted mean; the weighted total is reported as well. Each
+ * replicate's estimates use its own weights, and their squared deviations from the
+ * full-sample estimate are scaled by (R - 1) / R for 'jk1', 1 / R for 'brr' and
+ * 1 / (R (1 - rho)^2) for 'fay'. Returns a JSON object with n, replicates, estimate,
+ * variance, se, total, total_variance and total_se, or NULL without rows.
+ * @param context The SQLite function context.
+ */
+static void replicate_final(sqlite3_context *context) {
+    ReplicateContext *ctx = (ReplicateContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || ctx->n == 0) {
+        sqlite3_result_null(context);
+        if (ctx)
+            free(ctx->sums);
+        return;
+    }
+    int count = ctx->replicates;
+    double scale;
+    if (ctx->method == REPLICATE_JK1)
+        scale = count > 1 ? (double)(count - 1) / count : NAN;
+    else if (ctx->method == REPLICATE_BRR)
+        scale = 1.0 / count;
+    else
+        scale = 1.0 / (count * (1.0 - ctx->rho) * (1.0 - ctx->rho));
+
+    double mean = ctx->sum_wx / ctx->sum_w;
+    double mean_ss = 0.0, total_ss = 0.0;
+    for (int r = 0; r < count; r++) {
+        double rep_sum_w = ctx->sums[r], rep_sum_wx = ctx->sums[count + r];
+        double mean_diff = rep_sum_wx / rep_sum_w - mean;
+        double total_diff = (rep_sum_wx - ctx->sum_wx) + ctx->shift * (rep_sum_w - ctx->sum_w);
+        mean_ss += mean_diff * mean_diff;
+        total_ss += total_diff * total_diff;
+    }
+    sqlite3_str *json = sqlite3_str_new(sqlite3_context_db_handle(context));
+    sqlite3_str_appendchar(json, 1, '{');
+    json_append_int(json, "n", ctx->n);
+    json_append_int(json, "replicates", count);
+    json_append_double(json, "estimate", ctx->shift + mean);
+    json_append_double(json, "variance", scale * mean_ss);
+    json_append_double(json, "se", sqrt(scale * mean_ss));
+    json_append_double(json, "total", ctx->sum_wx + ctx->shift * ctx->sum_w);
+    json_append_double(json, "total_variance", scale * total_ss);
+    json_append_double(json, "total_se", sqrt(scale * total_ss));
+    sqlite3_str_appendchar(json, 1, '}');
+    json_result(context, json);
+    free(ctx->sums);
+    ctx->sums = NULL;
+}
+
+// --- Bulk Per-Group Standardization ---
+
+// MAD scale factor that makes the robust scale consistent with the standard deviation of normal data.
+#define MAD_NORMAL_SCALE 1.482602218505602
+
+/**
+ * @struct StandardizeGroup
+ * @brief Per-group payload of `stats_standardize()`.
+ */
+typedef struct {
+    MomentsState moments; // Moments of the group's values ('zscore').
+    double *values;       // The group's values ('robust').
+    sqlite3_int64 count;  // Number of entries in `values`.
+    sqlite3_int64 capacity; // Allocated entries of `values`.
+    double center;        // Mean or median.
+    double scale;         // Sample standard deviation or scaled MAD; NaN if undefined.
+} StandardizeGroup;
+
+/**
+ * @brief Builds the group key of a row from its group columns.
+ *
+ * A single column is used as is. Several columns are packed into a BLOB key of
+ * (type, value) records, so rows group as with SQL `GROUP BY` (binary collation).
+ * @param stmt The statement positioned on the row.
+ * @param first The index of the first group column.
+ * @param count The number of group columns.
+ * @param buffer Scratch storage for packed keys.
+ * @param key Receives the key.
+ * @return SQLITE_OK on success, or SQLITE_NOMEM.
+ */
+static int standardize_group_key(sqlite3_stmt *stmt, int first, int count, sqlite3_str *buffer, StatsKey *key) {
+    if (count == 0) {
+        memset(key, 0, sizeof(*key));
+        key->type = SQLITE_NULL;
+        return SQLITE_OK;
+    }
+    if (count == 1) {
+        stats_key_from_value(sqlite3_column_value(stmt, first), key);
+        return SQLITE_OK;
+    }
+    sqlite3_str_reset(buffer);
+    for (int i = 0; i < count; i++) {
+        StatsKey part;
+        unsigned char bytes[8];
+        stats_key_from_value(sqlite3_column_value(stmt, first + i), &part);
+        sqlite3_str_appendchar(buffer, 1, (char)part.type);
+        if (part.type == SQLITE_INTEGER) {
+            put_le64(bytes, (sqlite3_uint64)part.i);
+            sqlite3_str_append(buffer, (const char *)bytes, 8);
+        } else if (part.type == SQLITE_FLOAT) {
+            put_le_double(bytes, part.r);
+            sqlite3_str_append(buffer, (const char *)bytes, 8);
+        } else if (part.type == SQLITE_TEXT || part.type == SQLITE_BLOB) {
+            put_le64(bytes, (sqlite3_uint64)part.n);
+            sqlite3_str_append(buffer, (const char *)bytes, 8);
+            sqlite3_str_append(buffer, (const char *)part.z, part.n);
+        }
+    }
+    if (sqlite3_str_errcode(buffer) != SQLITE_OK)
+        return SQLITE_NOMEM;
+    memset(key, 0, sizeof(*key));
+    key->type = SQLITE_BLOB;
+    key->z = (const unsigned char *)sqlite3_str_value(buffer);
+    key->n = sqlite3_str_length(buffer);
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Computes the center and scale of every group.
+ * @param groups Map from group key to StandardizeGroup.
+ * @param robust Whether to use the median and MAD instead of the mean and standard deviation.
+ */
+static void standardize_group_scales(GroupMap *groups, int robust) {
+    for (GroupMapEntry *entry = groups->first; entry; entry = entry->next_added) {
+        StandardizeGroup *g = (StandardizeGroup *)group_map_payload(entry);
+        if (!robust) {
+            g->center = g->moments.mean;
+            g->scale = calculate_stddev_sample(&g->moments);
+            continue;
+        }
+        sqlite3_int64 n = g->count, mid = n / 2;
+        qsort(g->values, n, sizeof(double), compare_doubles);
+        g->center = n % 2 ? g->values[mid] : 0.5 * (g->values[mid - 1] + g->values[mid]);
+        for (sqlite3_int64 i = 0; i < n; i++)
+            g->values[i] = fabs(g->values[i] - g->center);
+        qsort(g->values, n, sizeof(double), compare_doubles);
+        g->scale = MAD_NORMAL_SCALE * (n % 2 ? g->values[mid] : 0.5 * (g->values[mid - 1] + g->values[mid]));
+    }
+}
+
+/**
+ * @brief Implements `stats_standardize(table, value_col, group_cols, target_col [, method])`.
+ *
+ * Writes `(value - center) / scale` of each row's group into `target_col`: the mean and
+ * sample standard deviation for 'zscore' (the default), or the median and the MAD scaled
+ * by 1.4826 for 'robust'. `group_cols` is a comma-separated list of column names; NULL
+ * or an empty string standardizes over the whole table. The first pass builds the
+ * per-group statistics in a hash map, the second streams the rows in rowid order through
+ * one prepared UPDATE. Rows without a value, or whose group has no scale (fewer than
+ * two values, or zero spread), get NULL. Both passes run inside one savepoint. Returns
+ * the number of rows updated.
+ *
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (4 or 5).
+ * @param argv The argument values.
+ */
+static void stats_standardize_func(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    sqlite3 *db = sqlite3_context_db_handle(context);
+    StatsConfig *config = (StatsConfig *)sqlite3_user_data(context);
+    const char *table = (const char *)sqlite3_value_text(argv[0]);
+    const char *value = (const char *)sqlite3_value_text(argv[1]);
+    const char *group_list = (const char *)sqlite3_value_text(argv[2]);
+    const char *target = (const char *)sqlite3_value_text(argv[3]);
+    const char *method = argc > 4 ? (const char *)sqlite3_value_text(argv[4]) : "zscore";
+    if (!table || !value || !target) {
+        sqlite3_result_error(context, "stats_standardize requires table, value_col and target_col names.", -1);
+        return;
+    }
+    int robust;
+    if (method && sqlite3_stricmp(method, "zscore") == 0)
+        robust = 0;
+    else if (method && sqlite3_stricmp(method, "robust") == 0)
+        robust = 1;
+    else {
+        sqlite3_result_error(context, "stats_standardize method must be 'zscore' or 'robust'.", -1);
+        return;
+    }
+
+    // Quote the group columns as a select list.
+    sqlite3_str *select = sqlite3_str_new(db);
+    sqlite3_str_appendf(select, "SELECT rowid, \"%w\"", value);
+    int group_count = 0;
+    for (const char *p = group_list; p && *p;) {
+        while (*p == ' ')
+            p++;
+        const char *end = strchr(p, ',');
+        int length = end ? (int)(end - p) : (int)strlen(p);
+        while (length > 0 && p[length - 1] == ' ')
+            length--;
+        if (length > 0) {
+            sqlite3_str_appendf(select, ", \"%.*w\"", length, p);
+            group_count++;
+        }
+        p = end ? end + 1 : p + strlen(p);
+    }
+    sqlite3_str_appendf(select, " FROM \"%w\" ORDER BY rowid", table);
+    char *select_sql = sqlite3_str_finish(select);
+    char *update_sql = sqlite3_mprintf("UPDATE \"%w\" SET \"%w\" = ?1 WHERE rowid = ?2", table, target);
+    if (!select_sql || !update_sql) {
+        sqlite3_free(select_sql);
+        sqlite3_free(update_sql);
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    sqlite3_stmt *stmt = NULL, *update_stmt = NULL;
+    sqlite3_str *key_buffer = sqlite3_str_new(db);
+    char *error_message = NULL;
+    sqlite3_int64 updated = 0;
+    GroupMap groups;
+    group_map_init(&groups, sizeof(StandardizeGroup));
+
+    int rc = sqlite3_exec(db, "SAVEPOINT stats_standardize", NULL, NULL, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db, select_sql, -1, &stmt, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db, update_sql, -1, &update_stmt, NULL);
+
+    // Pass 1: per-group statistics.
+    while (rc == SQLITE_OK && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        double number;
+        int status = read_numeric_value(sqlite3_column_value(stmt, 1), config->ingest_mode, &number);
+        rc = SQLITE_OK;
+        if (status == VALUE_INVALID) {
+            error_message = sqlite3_mprintf("Invalid data type, expected numeric value.");
+            rc = SQLITE_MISMATCH;
+        } else if (status == VALUE_NUMERIC || status == VALUE_COERCED) {
+            StatsKey key;
+            StandardizeGroup *g = NULL;
+            rc = standardize_group_key(stmt, 2, group_count, key_buffer, &key);
+            if (rc == SQLITE_OK && !(g = (StandardizeGroup *)group_map_lookup(&groups, &key, 1)))
+                rc = SQLITE_NOMEM;
+            if (rc == SQLITE_OK && !robust) {
+                stddev_accumulator_add(&g->moments, number);
+            } else if (rc == SQLITE_OK) {
+                if (g->count == g->capacity) {
+                    sqlite3_int64 capacity = g->capacity ? g->capacity * CAPACITY_GROWTH_FACTOR : 16;
+                    double *values = (double *)realloc(g->values, (size_t)capacity * sizeof(double));
+                    if (!values) {
+                        rc = SQLITE_NOMEM;
+                        break;
+                    }
+                    g->values = values;
+                    g->capacity = capacity;
+                }
+                g->values[g->count++] = number;
+            }
+        }
+    }
+    if (rc == SQLITE_DONE) {
+        standardize_group_scales(&groups, robust);
+        rc = SQLITE_OK;
+    }
+
+    // Pass 2: stream the rows again and write the standardized values.
+    if (rc == SQLITE_OK)
+        rc = sqlite3_reset(stmt);
+    while (rc == SQLITE_OK && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        double number;
+        int status = read_numeric_value(sqlite3_column_value(stmt, 1), config->ingest_mode, &number);
+        StatsKey key;
+        const StandardizeGroup *g = NULL;
+        rc = SQLITE_OK;
+        if (status == VALUE_NUMERIC || status == VALUE_COERCED) {
+            rc = standardize_group_key(stmt, 2, group_count, key_buffer, &key);
+            if (rc == SQLITE_OK)
+                g = (const StandardizeGroup *)group_map_lookup(&groups, &key, 0);
+        }
+        if (rc != SQLITE_OK)
+            break;
+        double z = g && g->scale > 0.0 ? (number - g->center) / g->scale : NAN;
+        if (isnan(z) || isinf(z))
+            sqlite3_bind_null(update_stmt, 1);
+        else
+            sqlite3_bind_double(update_stmt, 1, z);
+        sqlite3_bind_int64(update_stmt, 2, sqlite3_column_int64(stmt, 0));
+        rc = sqlite3_step(update_stmt) == SQLITE_DONE ? SQLITE_OK : sqlite3_errcode(db);
+        sqlite3_reset(update_stmt);
+        updated += sqlite3_changes(db);
+    }
+    if (rc == SQLITE_DONE)
+        rc = SQLITE_OK;
+
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(update_stmt);
+    sqlite3_free(select_sql);
+    sqlite3_free(update_sql);
+    sqlite3_free(sqlite3_str_finish(key_buffer));
+    for (GroupMapEntry *entry = groups.first; entry; entry = entry->next_added)
+        free(((StandardizeGroup *)group_map_payload(entry))->values);
+    group_map_free(&groups);
+
+    if (rc != SQLITE_OK) {
+        if (!error_message)
+            error_message = sqlite3_mprintf("%s", rc == SQLITE_NOMEM ? "out of memory" : sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK TO stats_standardize; RELEASE stats_standardize", NULL, NULL, NULL);
+        sqlite3_result_error(context, error_message, -1);
+    } else if (sqlite3_exec(db, "RELEASE stats_standardize", NULL, NULL, NULL) != SQLITE_OK) {
+        sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+    } else {
+        sqlite3_result_int64(context, updated);
+    }
+    sqlite3_free(error_message);
+}
+
+// --- Distribution Fitting ---
+
+// Number of shape values k at which the Weibull power sums are kept.
+#define FIT_GRID_SIZE 32
+// Smallest grid shape; consecutive shapes differ by the factor FIT_GRID_RATIO.
+#define FIT_GRID_MIN_SHAPE 0.05
+#define FIT_GRID_RATIO 1.25
+// Size of a fit_distribution_state() BLOB: magic, two accumulators, non-positive count,
+// log reference and four numbers per grid point.
+#define FIT_STATE_SIZE (4 + 2 * STDDEV_ACCUMULATOR_SERIALIZED_SIZE + 16 + 32 * FIT_GRID_SIZE)
+// Iteration limits of the parameter solvers.
+#define FIT_NEWTON_MAX_ITERATIONS 100
+#define FIT_BISECTION_ITERATIONS 100
+
+// Distributions of fit_distribution().
+#define FIT_NORMAL 1
+#define FIT_LOGNORMAL 2
+#define FIT_GAMMA 3
+#define FIT_WEIBULL 4
+
+/**
+ * @struct FitPowerSum
+ * @brief The power sums of one Weibull grid shape k, scaled to avoid overflow.
+ *
+ * With y = log(x) - ref, holds sum(exp(k y - max)), sum(y exp(k y - max)) and
+ * sum(y^2 exp(k y - max)): the power sum sum(x^k) up to a factor and its first two
+ * derivatives in k.
+ */
+typedef struct {
+    double max;  // Scale exponent: the largest k y seen.
+    double sum0; // Scaled sum of exp(k y); 0 for no values.
+    double sum1; // Scaled sum of y exp(k y).
+    double sum2; // Scaled sum of y^2 exp(k y).
+} FitPowerSum;
+
+/**
+ * @struct FitState
+ * @brief Sufficient statistics of `fit_distribution()`.
+ *
+ * Besides the moments of x and of log(x), the Weibull likelihood needs the power sums
+ * sum(x^k), which have no fixed-size sufficient statistic. They are kept with their
+ * first two derivatives on a geometric grid of shapes k and interpolated between grid
+ * points. All parts merge exactly.
+ */
+typedef struct {
+    MomentsState x;                 // Moments of the values.
+    MomentsState log_x;             // Moments of the logarithms of the positive values.
+    sqlite3_int64 nonpositive;      // Number of values <= 0.
+    double ref;                     // Reference logarithm (the first positive value's).
+    FitPowerSum grid[FIT_GRID_SIZE]; // Power sums at the grid shapes.
+    int has_grid;                   // Whether `grid` is maintained.
+    int distribution;               // FIT_* of the aggregate form, 0 for states.
+    int initialized;                // Whether the state has been set up.
+    int ingest_mode;                // Ingestion mode captured at the first step.
+} FitState;
+
+/**
+ * @brief Adds scaled sums to the power sums of a grid shape.
+ * @param p The power sums.
+ * @param max The scale exponent of the sums to add.
+ * @param sum0 The scaled sum of exp(k y) to add.
+ * @param sum1 The scaled sum of y exp(k y) to add.
+ * @param sum2 The scaled sum of y^2 exp(k y) to add.
+ */
+static void fit_power_sum_add(FitPowerSum *p, double max, double sum0, double sum1, double sum2) {
+    if (sum0 == 0.0)
+        return;
+    if (p->sum0 == 0.0) {
+        p->max = max;
+        p->sum0 = sum0;
+        p->sum1 = sum1;
+        p->sum2 = sum2;
+    } else if (max <= p->max) {
+        double w = exp(max - p->max);
+        p->sum0 += w * sum0;
+        p->sum1 += w * sum1;
+        p->sum2 += w * sum2;
+    } else {
+        // Rescale the existing sums to the larger exponent.
+        double w = exp(p->max - max);
+        p->max = max;
+        p->sum0 = w * p->sum0 + sum0;
+        p->sum1 = w * p->sum1 + sum1;
+        p->sum2 = w * p->sum2 + sum2;
+    }
+}
+
+/**
+ * @brief Initializes an empty fit state.
+ * @param s The state.
+ * @param has_grid Whether to maintain the Weibull grid.
+ */
+static void fit_state_init(FitState *s, int has_grid) {
+    stddev_accumulator_init(&s->x);
+    stddev_accumulator_init(&s->log_x);
+    s->nonpositive = 0;
+    s->ref = 0.0;
+    memset(s->grid, 0, sizeof(s->grid));
+    s->has_grid = has_grid;
+    s->initialized = 1;
+}
+
+/**
+ * @brief Adds a value to a fit state.
+ * @param s The state.
+ * @param x The value.
+ */
+static void fit_state_add(FitState *s, double x) {
+    stddev_accumulator_add(&s->x, x);
+    if (!(x > 0.0)) {
+        s->nonpositive++;
+        return;
+    }
+    double log_value = log(x);
+    if (s->log_x.n == 0)
+        s->ref = log_value;
+    stddev_accumulator_add(&s->log_x, log_value);
+    if (s->has_grid) {
+        double y = log_value - s->ref, k = FIT_GRID_MIN_SHAPE;
+        for (int j = 0; j < FIT_GRID_SIZE; j++, k *= FIT_GRID_RATIO)
+            fit_power_sum_add(&s->grid[j], k * y, 1.0, y, y * y);
+    }
+}
+
+/**
+ * @brief Merges a fit state into another.
+ * @param into The state to update.
+ * @param other The state to merge in.
+ */
+static void fit_state_merge(FitState *into, const FitState *other) {
+    if (other->log_x.n > 0 && into->has_grid) {
+        if (into->log_x.n == 0)
+            into->ref = other->ref;
+        // Re-express the other sums relative to this state's reference: y = y_other + d.
+        double d = other->ref - into->ref, k = FIT_GRID_MIN_SHAPE;
+        for (int j = 0; j < FIT_GRID_SIZE; j++, k *= FIT_GRID_RATIO) {
+            const FitPowerSum *p = &other->grid[j];
+            fit_power_sum_add(&into->grid[j], p->max + k * d, p->sum0, p->sum1 + d * p->sum0, p->sum2 + 2.0 * d * p->sum1 + d * d * p->sum0);
+        }
+    }
+    stddev_accumulator_merge(&into->x, &other->x);
+    stddev_accumulator_merge(&into->log_x, &other->log_x);
+    into->nonpositive += other->nonpositive;
+}
+
+/**
+ * @brief Sets a fit state as a BLOB result.
+ *
+ * Format (little-endian): "FIT1", the serialized accumulators of x and of log(x),
+ * the non-positive count (int64), the reference logarithm and, per grid shape, the
+ * scale exponent and the three scaled sums (float64).
+ * @param context The SQLite function context.
+ * @param s The state (with grid).
+ */
+static void fit_state_result(sqlite3_context *context, const FitState *s) {
+    unsigned char blob[FIT_STATE_SIZE], *out = blob + 4;
+    memcpy(blob, "FIT1", 4);
+    out += stddev_accumulator_serialize(&s->x, out);
+    out += stddev_accumulator_serialize(&s->log_x, out);
+    put_le64(out, (sqlite3_uint64)s->nonpositive);
+    put_le_double(out + 8, s->ref);
+    out += 16;
+    for (int j = 0; j < FIT_GRID_SIZE; j++, out += 32) {
+        put_le_double(out, s->grid[j].max);
+        put_le_double(out + 8, s->grid[j].sum0);
+        put_le_double(out + 16, s->grid[j].sum1);
+        put_le_double(out + 24, s->grid[j].sum2);
+    }
+    sqlite3_result_blob(context, blob, sizeof(blob), SQLITE_TRANSIENT);
+}
+
+/**
+ * @brief Reads a fit state BLOB.
+ * @param context The SQLite function context, which receives any error.
+ * @param value The state BLOB.
+ * @param s Receives the state.
+ * @return SQLITE_OK on success, or SQLITE_ERROR (with the error result set).
+ */
+static int fit_state_read(sqlite3_context *context, sqlite3_value *value, FitState *s) {
+    const unsigned char *in = (const unsigned char *)sqlite3_value_blob(value);
+    if (sqlite3_value_type(value) != SQLITE_BLOB || sqlite3_value_bytes(value) != FIT_STATE_SIZE || memcmp(in, "FIT1", 4) != 0 ||
+        stddev_accumulator_deserialize(&s->x, in + 4, STDDEV_ACCUMULATOR_SERIALIZED_SIZE) != 0 ||
+        stddev_accumulator_deserialize(&s->log_x, in + 4 + STDDEV_ACCUMULATOR_SERIALIZED_SIZE, STDDEV_ACCUMULATOR_SERIALIZED_SIZE) != 0) {
+        sqlite3_result_error(context, "Invalid fit_distribution state.", -1);
+        return SQLITE_ERROR;
+    }
+    in += 4 + 2 * STDDEV_ACCUMULATOR_SERIALIZED_SIZE;
+    s->nonpositive = (sqlite3_int64)get_le64(in);
+    s->ref = get_le_double(in + 8);
+    in += 16;
+    for (int j = 0; j < FIT_GRID_SIZE; j++, in += 32) {
+        s->grid[j].max = get_le_double(in);
+        s->grid[j].sum0 = get_le_double(in + 8);
+        s->grid[j].sum1 = get_le_double(in + 16);
+        s->grid[j].sum2 = get_le_double(in + 24);
+    }
+    s->has_grid = 1;
+    s->initialized = 1;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Parses a distribution name.
+ * @param name The name.
+ * @return FIT_NORMAL, FIT_LOGNORMAL, FIT_GAMMA or FIT_WEIBULL, or 0 for an unknown name.
+ */
+static int fit_distribution_code(const char *name) {
+    if (!name)
+        return 0;
+    if (sqlite3_stricmp(name, "normal") == 0)
+        return FIT_NORMAL;
+    if (sqlite3_stricmp(name, "lognormal") == 0)
+        return FIT_LOGNORMAL;
+    if (sqlite3_stricmp(name, "gamma") == 0)
+        return FIT_GAMMA;
+    if (sqlite3_stricmp(name, "weibull") == 0)
+        return FIT_WEIBULL;
+    return 0;
+}
+
+/**
+ * @brief Fits the gamma shape by maximum likelihood.
+ *
+ * Solves log(k) - psi(k) = log(mean) - mean(log x) with Newton's method, starting from
+ * the Minka/Choi-Wette approximation.
+ * @param s The sufficient statistic log(mean) - mean(log x) (> 0).
+ * @return The shape k.
+ */
+static double fit_gamma_shape(double s) {
+    double k = (3.0 - s + sqrt((s - 3.0) * (s - 3.0) + 24.0 * s)) / (12.0 * s);
+    for (int i = 0; i < FIT_NEWTON_MAX_ITERATIONS; i++) {
+        double f = log(k) - digamma(k) - s;
+        double next = k - f / (1.0 / k - trigamma(k));
+        if (!(next > 0.0))
+            next = k / 2.0;
+        if (fabs(next - k) <= 1e-14 * k) {
+            k = next;
+            break;
+        }
+        k = next;
+    }
+    return k;
+}
+
+/**
+ * @brief Evaluates the interpolated Weibull log power sum.
+ *
+ * With u = log(k), interpolates F(k) = log(mean(exp(k y))) between the two enclosing
+ * grid points by the quintic Hermite polynomial matching F and its first two
+ * derivatives in u at both.
+ * @param f F at the grid points.
+ * @param d1 dF/du at the grid points.
+ * @param d2 d2F/du2 at the grid points.
+ * @param k The shape, within the grid.
+ * @param derivative Receives dF/dk.
+ * @return F(k).
+ */
+static double fit_weibull_interpolate(const double *f, const double *d1, const double *d2, double k, double *derivative) {
+    double h = log(FIT_GRID_RATIO);
+    double u = log(k / FIT_GRID_MIN_SHAPE) / h;
+    int j = (int)u;
+    if (j >= FIT_GRID_SIZE - 1)
+        j = FIT_GRID_SIZE - 2;
+    double t = u - j, t2 = t * t, t3 = t2 * t, t4 = t3 * t, t5 = t4 * t;
+    double value = (1.0 - 10.0 * t3 + 15.0 * t4 - 6.0 * t5) * f[j] + (t - 6.0 * t3 + 8.0 * t4 - 3.0 * t5) * h * d1[j] +
+                   (0.5 * t2 - 1.5 * t3 + 1.5 * t4 - 0.5 * t5) * h * h * d2[j] + (0.5 * t3 - t4 + 0.5 * t5) * h * h * d2[j + 1] +
+                   (-4.0 * t3 + 7.0 * t4 - 3.0 * t5) * h * d1[j + 1] + (10.0 * t3 - 15.0 * t4 + 6.0 * t5) * f[j + 1];
+    double slope = (-30.0 * t2 + 60.0 * t3 - 30.0 * t4) * f[j] + (1.0 - 18.0 * t2 + 32.0 * t3 - 15.0 * t4) * h * d1[j] +
+                   (t - 4.5 * t2 + 6.0 * t3 - 2.5 * t4) * h * h * d2[j] + (1.5 * t2 - 4.0 * t3 + 2.5 * t4) * h * h * d2[j + 1] +
+                   (-12.0 * t2 + 28.0 * t3 - 15.0 * t4) * h * d1[j + 1] + (30.0 * t2 - 60.0 * t3 + 30.0 * t4) * f[j + 1];
+    *derivative = slope / (h * k);
+    return value;
+}
+
+/**
+ * @brief Fits a Weibull distribution by maximum likelihood.
+ *
+ * With the scale profiled out, the shape k solves 1/k + mean(y) = F'(k), where F is the
+ * interpolated log mean power sum; the left side decreases and the right side increases
+ * in k, so the root is found by bisection on the grid.
+ * @param s The state (log moments and grid, at least two distinct positive values).
+ * @param shape Receives k.
+ * @param scale Receives lambda.
+ * @return 1 on success, 0 if the shape falls outside the grid.
+ */
+static int fit_weibull(const FitState *s, double *shape, double *scale) {
+    double f[FIT_GRID_SIZE], d1[FIT_GRID_SIZE], d2[FIT_GRID_SIZE], k = FIT_GRID_MIN_SHAPE;
+    double log_n = log((double)s->log_x.n);
+    for (int j = 0; j < FIT_GRID_SIZE; j++, k *= FIT_GRID_RATIO) {
+        const FitPowerSum *p = &s->grid[j];
+        double mean_y = p->sum1 / p->sum0, var_y = p->sum2 / p->sum0 - mean_y * mean_y;
+        // Derivatives in u = log(k): dF/du = k F'(k), d2F/du2 = k F'(k) + k^2 F''(k).
+        f[j] = p->max + log(p->sum0) - log_n;
+        d1[j] = k * mean_y;
+        d2[j] = k * mean_y + k * k * var_y;
+    }
+
+    double mean_y = s->log_x.mean - s->ref, derivative;
+    double lo = FIT_GRID_MIN_SHAPE, hi = k / FIT_GRID_RATIO;
+    fit_weibull_interpolate(f, d1, d2, lo, &derivative);
+    if (1.0 / lo + mean_y - derivative < 0.0)
+        return 0;
+    fit_weibull_interpolate(f, d1, d2, hi, &derivative);
+    if (1.0 / hi + mean_y - derivative > 0.0)
+        return 0;
+    for (int i = 0; i < FIT_BISECTION_ITERATIONS; i++) {
+        double mid = sqrt(lo * hi);
+        fit_weibull_interpolate(f, d1, d2, mid, &derivative);
+        if (1.0 / mid + mean_y - derivative > 0.0)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    k = sqrt(lo * hi);
+    *shape = k;
+    *scale = exp(s->ref + fit_weibull_interpolate(f, d1, d2, k, &derivative) / k);
+    return 1;
+}
+
+/**
+ * @brief Fits a distribution to a state and sets the JSON result.
+ *
+ * The parameters are maximum-likelihood estimates: for 'normal' the mean and the
+ * population standard deviation, for 'lognormal' those of log(x), for 'gamma' the shape
+ * (Newton's method on the digamma equation) and scale, for 'weibull' the shape and
+ * scale. Returns a JSON object with the distribution, n, the parameters, loglik and
+ * aic, or NULL if the distribution cannot be fitted (fewer than two distinct values,
+ * values <= 0 for the positive distributions, or a Weibull shape outside [0.05, 50]).
+ * @param context The SQLite function context.
+ * @param s The state.
+ * @param distribution FIT_*.
+ */
+static void fit_json_result(sqlite3_context *context, const FitState *s, int distribution) {
+    static const char *const names[] = {NULL, "normal", "lognormal", "gamma", "weibull"};
+    double n = (double)s->x.n, p1 = NAN, p2 = NAN, loglik = NAN;
+    const char *p1_name = "shape", *p2_name = "scale";
+    int positive = s->nonpositive == 0 && s->log_x.n >= 2 && s->log_x.m2 > 0.0;
+
+    if (distribution == FIT_NORMAL && s->x.n >= 2 && s->x.m2 > 0.0) {
+        p1_name = "mean";
+        p2_name = "stddev";
+        p1 = s->x.mean;
+        p2 = sqrt(s->x.m2 / n);
+        loglik = -0.5 * n * (log(2.0 * M_PI * p2 * p2) + 1.0);
+    } else if (distribution == FIT_LOGNORMAL && positive) {
+        p1_name = "mu";
+        p2_name = "sigma";
+        p1 = s->log_x.mean;
+        p2 = sqrt(s->log_x.m2 / n);
+        loglik = -0.5 * n * (log(2.0 * M_PI * p2 * p2) + 1.0) - n * p1;
+    } else if (distribution == FIT_GAMMA && positive) {
+        double stat = log(s->x.mean) - s->log_x.mean;
+        if (stat > 0.0) {
+            p1 = fit_gamma_shape(stat);
+            p2 = s->x.mean / p1;
+            loglik = n * ((p1 - 1.0) * s->log_x.mean - p1 - p1 * log(p2) - lgamma(p1));
+        }
+    } else if (distribution == FIT_WEIBULL && positive && s->has_grid) {
+        if (fit_weibull(s, &p1, &p2))
+            loglik = n * (log(p1) - p1 * log(p2) + (p1 - 1.0) * s->log_x.mean - 1.0);
+    }
+    if (isnan(loglik) || isinf(loglik)) {
+        sqlite3_result_null(context);
+        return;
+    }
+
+    sqlite3_str *json = sqlite3_str_new(sqlite3_context_db_handle(context));
+    sqlite3_str_appendf(json, "{\"distribution\":\"%s\"", names[distribution]);
+    json_append_int(json, "n", s->x.n);
+    json_append_double(json, p1_name, p1);
+    json_append_double(json, p2_name, p2);
+    json_append_double(json, "loglik", loglik);
+    json_append_double(json, "aic", 4.0 - 2.0 * loglik);
+    sqlite3_str_appendchar(json, 1, '}');
+    json_result(context, json);
+}
+
+/**
+ * @brief The "step" function of `fit_distribution(x, distribution)` and `fit_distribution_state(x)`.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (2, or 1 for the state).
+ * @param argv The argument values.
+ */
+static void fit_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    FitState *s = (FitState *)sqlite3_aggregate_context(context, sizeof(FitState));
+    if (!s) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    if (!s->initialized) {
+        int distribution = argc > 1 ? fit_distribution_code((const char *)sqlite3_value_text(argv[1])) : 0;
+        if (argc > 1 && !distribution) {
+            sqlite3_result_error(context, "fit_distribution distribution must be 'normal', 'lognormal', 'gamma' or 'weibull'.", -1);
+            return;
+        }
+        // Only Weibull fits and states need the power-sum grid.
+        fit_state_init(s, argc == 1 || distribution == FIT_WEIBULL);
+        s->distribution = distribution;
+        s->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+    }
+    double value;
+    int status = read_numeric_value(argv[0], s->ingest_mode, &value);
+    if (status == VALUE_INVALID) {
+        sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+        return;
+    }
+    if ((status == VALUE_NUMERIC || status == VALUE_COERCED) && isfinite(value))
+        fit_state_add(s, value);
+}
+
+/**
+ * @brief The "final" function of `fit_distribution()`: the fitted parameters as JSON (see fit_json_result()).
+ * @param context The SQLite function context.
+ */
+static void fit_final(sqlite3_context *context) {
+    FitState *s = (FitState *)sqlite3_aggregate_context(context, 0);
+    if (!s || !s->initialized)
+        sqlite3_result_null(context);
+    else
+        fit_json_result(context, s, s->distribution);
+}
+
+/**
+ * @brief The "final" function of `fit_distribution_state()` and `fit_distribution_merge()`:
+ * the sufficient statistics as a mergeable state BLOB.
+ * @param context The SQLite function context.
+ */
+static void fit_state_final(sqlite3_context *context) {
+    FitState *s = (FitState *)sqlite3_aggregate_context(context, 0);
+    FitState empty;
+    if (!s || !s->initialized) {
+        fit_state_init(&empty, 1);
+        s = &empty;
+    }
+    fit_state_result(context, s);
+}
+
+/**
+ * @brief The "step" function of `fit_distribution_merge(state)`: merges state BLOBs, for
+ * example one per shard. NULL states are ignored.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (1).
+ * @param argv The argument values.
+ */
+static void fit_merge_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    FitState *merged = (FitState *)sqlite3_aggregate_context(context, sizeof(FitState));
+    if (!merged) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    if (!merged->initialized)
+        fit_state_init(merged, 1);
+    FitState state;
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL || fit_state_read(context, argv[0], &state) != SQLITE_OK)
+        return;
+    fit_state_merge(merged, &state);
+}
+
+/**
+ * @brief `fit_distribution_result(state, distribution)`: fits a distribution to a state BLOB.
+ *
+ * The same state can be fitted with each distribution, for example to compare their AIC.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (2).
+ * @param argv The argument values.
+ */
+static void fit_result_func(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    int distribution = fit_distribution_code((const char *)sqlite3_value_text(argv[1]));
+    if (!distribution) {
+        sqlite3_result_error(context, "fit_distribution distribution must be 'normal', 'lognormal', 'gamma' or 'weibull'.", -1);
+        return;
+    }
+    FitState s;
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        sqlite3_result_null(context);
+        return;
+    }
+    if (fit_state_read(context, argv[0], &s) == SQLITE_OK)
+        fit_json_result(context, &s, distribution);
+}
+
+// --- Normality Tests ---
+
+// Largest sample size of the Shapiro-Wilk approximation.
+#define SHAPIRO_WILK_MAX_N 5000
+
+/**
+ * @struct HigherMomentsContext
+ * @brief Aggregate context of `jarque_bera()`: count, mean and central sums M2, M3, M4.
+ *
+ * The values of the frame are kept so that the sums can be recomputed after removals,
+ * whose rounding error would otherwise persist.
+ */
+typedef struct {
+    sqlite3_int64 n;      // Number of values.
+    double mean;          // Mean of the values.
+    double m2;            // Sum of squared deviations from the mean.
+    double m3;            // Sum of cubed deviations from the mean.
+    double m4;            // Sum of fourth-power deviations from the mean.
+    WindowStatsData data; // The values in the frame, oldest first.
+    int removals;         // Values removed since the sums were last recomputed.
+    int initialized;      // Whether the ingestion mode has been captured.
+    int ingest_mode;      // Ingestion mode captured at the first step.
+} HigherMomentsContext;
+
+/**
+ * @brief Reads the value argument of `jarque_bera()`.
+ * @param context The SQLite function context, for errors.
+ * @param ctx The aggregate context.
+ * @param arg The argument.
+ * @param value Receives the value.
+ * @return 1 for a value, 0 for NULL (or skipped), -1 after an error.
+ */
+static int read_higher_moments_value(sqlite3_context *context, HigherMomentsContext *ctx, sqlite3_value *arg, double *value) {
+    if (!ctx->initialized) {
+        ctx->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+        ctx->initialized = 1;
+    }
+    int status = read_numeric_value(arg, ctx->ingest_mode, value);
+    if (status == VALUE_INVALID) {
+        sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+        return -1;
+    }
+    return status == VALUE_NUMERIC || status == VALUE_COERCED;
+}
+
+/**
+ * @brief Adds a value to the central sums with the one-pass updates of Terriberry.
+ * @param ctx The aggregate context.
+ * @param x The value.
+ */
+static void higher_moments_add(HigherMomentsContext *ctx, double x) {
+    double n = (double)++ctx->n;
+    double delta = x - ctx->mean, dn = delta / n, dn2 = dn * dn, term = delta * dn * (n - 1.0);
+    ctx->mean += dn;
+    ctx->m4 += term * dn2 * (n * n - 3.0 * n + 3.0) + 6.0 * dn2 * ctx->m2 - 4.0 * dn * ctx->m3;
+    ctx->m3 += term * dn * (n - 2.0) - 3.0 * dn * ctx->m2;
+    ctx->m2 += term;
+}
+
+/**
+ * @brief The "step" function of `jarque_bera(x)`: adds a value to the frame and to the
+ * central sums.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (1).
+ * @param argv The argument values.
+ */
+static void jarque_bera_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    HigherMomentsContext *ctx = (HigherMomentsContext *)sqlite3_aggregate_context(context, sizeof(HigherMomentsContext));
+    double x;
+    if (!ctx) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    if (read_higher_moments_value(context, ctx, argv[0], &x) <= 0)
+        return;
+    if (ctx->data.values == NULL && init_window_stats_data(context, &ctx->data) != SQLITE_OK)
+        return;
+    if (ctx->data.count >= ctx->data.capacity && grow_stats_buffer(context, &ctx->data) != SQLITE_OK)
+        return;
+    add_to_circular_buffer(&ctx->data, x);
+    higher_moments_add(ctx, x);
+}
+
+/**
+ * @brief The "inverse" function of `jarque_bera()`: removes the oldest value by running
+ * the update of higher_moments_add() backwards.
+ *
+ * The sums are recomputed from the frame once per frame's worth of removals, and right
+ * after a removal that cancelled nearly all of M2, so rounding error cannot build up.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (1).
+ * @param argv The argument values of the row leaving the window.
+ */
+static void jarque_bera_inverse(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    HigherMomentsContext *ctx = (HigherMomentsContext *)sqlite3_aggregate_context(context, sizeof(HigherMomentsContext));
+    double x;
+    if (!ctx || ctx->n == 0 || !ctx->data.values || read_higher_moments_value(context, ctx, argv[0], &x) <= 0)
+        return;
+    x = remove_from_circular_buffer(&ctx->data);
+    double m2 = ctx->m2;
+    if (ctx->n == 1) {
+        ctx->n = 0;
+        ctx->mean = ctx->m2 = ctx->m3 = ctx->m4 = 0.0;
+        ctx->removals = 0;
+        return;
+    }
+    double n = (double)ctx->n--;
+    double mean = (ctx->mean * n - x) / (n - 1.0);
+    double delta = x - mean, dn = delta / n, dn2 = dn * dn, term = delta * dn * (n - 1.0);
+    ctx->mean = mean;
+    ctx->m2 -= term;
+    ctx->m3 -= term * dn * (n - 2.0) - 3.0 * dn * ctx->m2;
+    ctx->m4 -= term * dn2 * (n * n - 3.0 * n + 3.0) + 6.0 * dn2 * ctx->m2 - 4.0 * dn * ctx->m3;
+    if (ctx->m2 < 0.0)
+        ctx->m2 = 0.0; // Guard against rounding below zero.
+
+    if (++ctx->removals >= ctx->data.count || ctx->m2 < m2 * REMOVAL_CANCELLATION_LIMIT) {
+        ctx->n = 0;
+        ctx->mean = ctx->m2 = ctx->m3 = ctx->m4 = 0.0;
+        for (int i = 0; i < ctx->data.count; i++)
+            higher_moments_add(ctx, get_circular_value(&ctx->data, i));
+        ctx->removals = 0;
+    }
+}
+
+/**
+ * @brief The "value" function of `jarque_bera()`.
+ *
+ * JB = n / 6 * (S^2 + (K - 3)^2 / 4) with the sample skewness S and kurtosis K of the
+ * population moments; under normality JB is asymptotically chi-squared with two degrees
+ * of freedom, so p = exp(-JB / 2). Returns a JSON object with n, skewness,
+ * excess_kurtosis, statistic and p_value, or NULL for fewer than two distinct values.
+ * @param context The SQLite function context.
+ */
+static void jarque_bera_value(sqlite3_context *context) {
+    HigherMomentsContext *ctx = (HigherMomentsContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || ctx->n < 2 || !(ctx->m2 > 0.0)) {
+        sqlite3_result_null(context);
+        return;
+    }
+    double n = (double)ctx->n;
+    double skewness = sqrt(n) * ctx->m3 / pow(ctx->m2, 1.5);
+    double excess_kurtosis = n * ctx->m4 / (ctx->m2 * ctx->m2) - 3.0;
+    double statistic = n / 6.0 * (skewness * skewness + 0.25 * excess_kurtosis * excess_kurtosis);
+
+    sqlite3_str *json = sqlite3_str_new(sqlite3_context_db_handle(context));
+    sqlite3_str_appendchar(json, 1, '{');
+    json_append_int(json, "n", ctx->n);
+    json_append_double(json, "skewness", skewness);
+    json_append_double(json, "excess_kurtosis", excess_kurtosis);
+    json_append_double(json, "statistic", statistic);
+    json_append_double(json, "p_value", exp(-0.5 * statistic));
+    sqlite3_str_appendchar(json, 1, '}');
+    json_result(context, json);
+}
+
+/**
+ * @brief The "final" function of `jarque_bera()`: the value function, then the frame is freed.
+ * @param context The SQLite function context.
+ */
+static void jarque_bera_final(sqlite3_context *context) {
+    jarque_bera_value(context);
+    HigherMomentsContext *ctx = (HigherMomentsContext *)sqlite3_aggregate_context(context, 0);
+    if (ctx && ctx->data.values) {
+        free(ctx->data.values);
+        ctx->data.values = NULL;
+    }
+}
+
+/**
+ * @struct NormalityContext
+ * @brief Aggregate context of `anderson_darling_normal()` and `shapiro_wilk()`.
+ */
+typedef struct {
+    WindowStatsData data; // Buffered values (appended only, so values[0..count) is contiguous).
+    int ingest_mode;      // Ingestion mode captured at the first step.
+} NormalityContext;
+
+/**
+ * @brief The "step" function of `anderson_darling_normal(x)` and `shapiro_wilk(x)`: buffers the value.
+ * @param context The SQLite function context.
+ * @param argc The number of arguments (1).
+ * @param argv The argument values.
+ */
+static void normality_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    NormalityContext *ctx = (NormalityContext *)sqlite3_aggregate_context(context, sizeof(NormalityContext));
+    if (!ctx) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    // Initialize context on the first call.
+    if (ctx->data.values == NULL) {
+        if (init_window_stats_data(context, &ctx->data) != SQLITE_OK)
+            return;
+        ctx->ingest_mode = ((StatsConfig *)sqlite3_user_data(context))->ingest_mode;
+    }
+
+    double value;
+    int status = read_numeric_value(argv[0], ctx->ingest_mode, &value);
+    if (status == VALUE_INVALID) {
+        sqlite3_result_error(context, "Invalid data type, expected numeric value.", -1);
+        return;
+    }
+    if (status != VALUE_NUMERIC && status != VALUE_COERCED)
+        return;
+    if (ctx->data.count >= ctx->data.capacity) {
+        if (grow_stats_buffer(context, &ctx->data) != SQLITE_OK)
+            return;
+    }
+    add_to_circular_buffer(&ctx->data, value);
+}
+
+/**
+ * @brief Sets the JSON result of a normality test.
+ * @param context The SQLite function context.
+ * @param n The sample size.
+ * @param statistic The test statistic.
+ * @param p_value The p-value.
+ */
+static void normality_result(sqlite3_context *context, sqlite3_int64 n, double statistic, double p_value) {
+    sqlite3_str *json = sqlite3_str_new(sqlite3_context_db_handle(context));
+    sqlite3_str_appendchar(json, 1, '{');
+    json_append_int(json, "n", n);
+    json_append_double(json, "statistic", statistic);
+    json_append_double(json, "p_value", p_value);
+    sqlite3_str_appendchar(json, 1, '}');
+    json_result(context, json);
+}
+
+/**
+ * @brief The "final" function of `anderson_darling_normal(x)`.
+ *
+ * Sorts the buffered values in place and computes the Anderson-Darling statistic A^2
+ * against a normal distribution with the sample mean and standard deviation, adjusted
+ * to A*^2 = A^2 (1 + 0.75/n + 2.25/n^2) for the estimated parameters. The p-value
+ * follows D'Agostino and Stephens (1986). Returns a JSON object with n, statistic
+ * (A*^2) and p_value, or NULL for fewer than three values or no spread.
+ * @param context The SQLite function context.
+ */
+static void anderson_darling_final(sqlite3_context *context) {
+    NormalityContext *ctx = (NormalityContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || !ctx->data.values) {
+        sqlite3_result_null(context);
+        return;
+    }
+    double *values = ctx->data.values;
+    int n = ctx->data.count;
+    MomentsState m;
+    range_moments(values, 0, n, &m);
+    double sd = calculate_stddev_sample(&m);
+    if (n < 3 || !(sd > 0.0) || isinf(sd)) {
+        sqlite3_result_null(context);
+        free(values);
+        ctx->data.values = NULL;
+        return;
+    }
+    qsort(values, n, sizeof(double), compare_doubles);
+
+    // Pair the i-th smallest with the i-th largest value.
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        double low = (values[i] - m.mean) / sd, high = (values[n - 1 - i] - m.mean) / sd;
+        sum += (2.0 * i + 1.0) * (log(normal_cdf(low)) + log(normal_cdf(-high)));
+    }
+    double a2 = -n - sum / n;
+    double a = a2 * (1.0 + 0.75 / n + 2.25 / ((double)n * n));
+    double p;
+    if (a >= 0.6) {
+        double c = a < 153.467 ? a : 153.467; // The quadratic turns upwards past its minimum.
+        p = exp(1.2937 - 5.709 * c + 0.0186 * c * c);
+    } else if (a >= 0.34) {
+        p = exp(0.9177 - 4.279 * a - 1.38 * a * a);
+    } else if (a >= 0.2) {
+        p = 1.0 - exp(-8.318 + 42.796 * a - 59.938 * a * a);
+    } else {
+        p = 1.0 - exp(-13.436 + 101.14 * a - 223.73 * a * a);
+    }
+    normality_result(context, n, a, p < 1.0 ? p : 1.0);
+    free(values);
+    ctx->data.values = NULL;
+}
+
+/**
+ * @brief Computes the Shapiro-Wilk W statistic and p-value of sorted values.
+ *
+ * Royston's approximation (algorithm AS R94): the coefficients come from the expected
+ * normal order statistics with polynomial corrections of the two outermost ones, and
+ * the p-value from a normalizing transformation of W.
+ * @param x The values, sorted ascending (3 <= n <= 5000).
+ * @param n The number of values.
+ * @param mean The mean of the values.
+ * @param p_value Receives the p-value.
+ * @return W.
+ */
+static double shapiro_wilk_w(const double *x, int n, double mean, double *p_value) {
+    int half = n / 2;
+    double numerator = 0.0, ssq = 0.0;
+    for (int i = 0; i < n; i++)
+        ssq += (x[i] - mean) * (x[i] - mean);
+
+    if (n == 3) {
+        numerator = sqrt(0.5) * (x[2] - x[0]);
+    } else {
+        double *m = (double *)malloc((size_t)half * sizeof(double));
+        if (!m)
+            return NAN;
+        double sum_m2 = 0.0;
+        for (int i = 0; i < half; i++) {
+            m[i] = normal_quantile((i + 1 - 0.375) / (n + 0.25));
+            sum_m2 += m[i] * m[i];
+        }
+        sum_m2 *= 2.0;
+        double norm = sqrt(sum_m2), u = 1.0 / sqrt((double)n);
+        double a1 = -m[0] / norm + u * (0.221157 + u * (-0.147981 + u * (-2.071190 + u * (4.434685 - 2.706056 * u))));
+        double a2 = 0.0, scale;
+        int first;
+        if (n > 5) {
+            a2 = -m[1] / norm + u * (0.042981 + u * (-0.293762 + u * (-1.752461 + u * (5.682633 - 3.582633 * u))));
+            scale = sqrt((sum_m2 - 2.0 * m[0] * m[0] - 2.0 * m[1] * m[1]) / (1.0 - 2.0 * a1 * a1 - 2.0 * a2 * a2));
+            first = 2;
+        } else {
+            scale = sqrt((sum_m2 - 2.0 * m[0] * m[0]) / (1.0 - 2.0 * a1 * a1));
+            first = 1;
+        }
+        // Coefficients are antisymmetric, so each pairs the i-th smallest and largest values.
+        numerator = a1 * (x[n - 1] - x[0]);
+        if (first == 2)
+            numerator += a2 * (x[n - 2] - x[1]);
+        for (int i = first; i < half; i++)
+            numerator += -m[i] / scale * (x[n - 1 - i] - x[i]);
+        free(m);
+    }
+    double w = numerator * numerator / ssq;
+    if (w > 1.0)
+        w = 1.0;
+
+    if (n == 3) {
+        double p = 6.0 / 3.14159265358979323846 * (asin(sqrt(w)) - asin(sqrt(0.75)));
+        *p_value = p > 0.0 ? p : 0.0;
+        return w;
+    }
+    double y = log(1.0 - w), mu, sigma;
+    if (n <= 11) {
+        double gamma = -2.273 + 0.459 * n;
+        if (y >= gamma) {
+            *p_value = 1e-99; // Beyond the range of the transformation: W is extremely small.
+            return w;
+        }
+        y = -log(gamma - y);
+        mu = 0.5440 + n * (-0.39978 + n * (0.025054 - 6.714e-4 * n));
+        sigma = exp(1.3822 + n * (-0.77857 + n * (0.062767 - 0.0020322 * n)));
+    } else {
+        double ln = log((double)n);
+        mu = -1.5861 + ln * (-0.31082 + ln * (-0.083751 + 0.0038915 * ln));
+        sigma = exp(-0.4803 + ln * (-0.082676 + 0.0030302 * ln));
+    }
+    *p_value = normal_cdf(-(y - mu) / sigma);
+    return w;
+}
+
+/**
+ * @brief The "final" function of `shapiro_wilk(x)`.
+ *
+ * Sorts the buffered values in place and computes W and its p-value (see
+ * shapiro_wilk_w()). Returns a JSON object with n, statistic (W) and p_value, or NULL
+ * outside 3 <= n <= 5000 or for values without spread.
+ * @param context The SQLite function context.
+ */
+static void shapiro_wilk_final(sqlite3_context *context) {
+    NormalityContext *ctx = (NormalityContext *)sqlite3_aggregate_context(context, 0);
+    if (!ctx || !ctx->data.values) {
+        sqlite3_result_null(context);
+        return;
+    }
+    double *values = ctx->data.values;
+    int n = ctx->data.count;
+    MomentsState m;
+    range_moments(values, 0, n, &m);
+    if (n < 3 || n > SHAPIRO_WILK_MAX_N || !(m.m2 > 0.0) || isinf(m.m2)) {
+        sqlite3_result_null(context);
+    } else {
+        qsort(values, n, sizeof(double), compare_doubles);
+        double p_value;
+        double w = shapiro_wilk_w(values, n, m.mean, &p_value);
+        if (isnan(w))
+            sqlite3_result_error_nomem(context);
+        else
+            normality_result(context, n, w, p_value);
+    }
+    free(values);
+    ctx->data.values = NULL;
+}
+
+// --- Extension Initialization ---
+
+/**
+ * @struct StatsFunctionGroup
+ * @brief Defines a group of related statistical functions to be registered.
+ * This structure helps to reduce code duplication during function registration.
+ */
+typedef struct {
+    const char **names;                // Array of function names/aliases.
+    int name_count;                    // Number of names in the array.
+    void (*xValue)(sqlite3_context *); // Pointer to the xValue function.
+    void (*xFinal)(sqlite3_context *); // Pointer to the xFinal function.
+} StatsFunctionGroup;
+
+/**
+ * @struct StatsFunctionDef
+ * @brief Describes a scalar, aggregate or window function to be registered.
+ *
+ * Exactly one of `xFunc` (scalar) or `xStep`/`xFinal` (aggregate) is set; aggregates
+ * that also set `xValue` and `xInverse` are registered as window functions.
+ */
+typedef struct {
+    const char *name;                                               // Function name.
+    int n_arg;                                                      // Number of arguments, -1 for any.
+    int flags;                                                      // Flags combined with SQLITE_UTF8.
+    void (*xFunc)(sqlite3_context *, int, sqlite3_value **);        // Scalar implementation.
+    void (*xStep)(sqlite3_context *, int, sqlite3_value **);        // Aggregate step.
+    void (*xFinal)(sqlite3_context *);                              // Aggregate final.
+    void (*xValue)(sqlite3_context *);                              // Window value.
+    void (*xInverse)(sqlite3_context *, int, sqlite3_value **);     // Window inverse.
+} StatsFunctionDef;
+
+/**
+ * @brief Registers a function described by a StatsFunctionDef.
+ * @param db The database connection.
+ * @param config The connection's StatsConfig, shared as user data.
+ * @param def The function definition.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int register_function_def(sqlite3 *db, StatsConfig *config, const StatsFunctionDef *def) {
+    int flags = SQLITE_UTF8 | def->flags;
+    config->ref_count++;
+    if (def->xValue)
+        return sqlite3_create_window_function(db, def->name, def->n_arg, flags, config, def->xStep, def->xFinal, def->xValue, def->xInverse,
+                                              release_stats_config);
+    return sqlite3_create_function_v2(db, def->name, def->n_arg, flags, config, def->xFunc, def->xStep, def->xFinal, release_stats_config);
+}
+
+// Functions registered in addition to the stddev/variance families.
+static const StatsFunctionDef additional_functions[] = {
+    {"stats_config", 1, SQLITE_DIRECTONLY, stats_config_func, NULL, NULL, NULL, NULL},
+    {"stats_config", 2, SQLITE_DIRECTONLY, stats_config_func, NULL, NULL, NULL, NULL},
+    {"stats_ingest_counts", 0, 0, stats_ingest_counts_func, NULL, NULL, NULL, NULL},
+    {"stats_ingest_counts", 1, 0, stats_ingest_counts_func, NULL, NULL, NULL, NULL},
+    {"stats_apply_changeset", 4, SQLITE_DIRECTONLY, stats_apply_changeset_func, NULL, NULL, NULL, NULL},
+    {"stats_apply_changeset", 5, SQLITE_DIRECTONLY, stats_apply_changeset_func, NULL, NULL, NULL, NULL},
+    {"stats_deferred_create", 3, SQLITE_DIRECTONLY, stats_deferred_create_func, NULL, NULL, NULL, NULL},
+    {"stats_deferred_create", 4, SQLITE_DIRECTONLY, stats_deferred_create_func, NULL, NULL, NULL, NULL},
+    {"stats_deferred_flush", 1, SQLITE_DIRECTONLY, stats_deferred_flush_func, NULL, NULL, NULL, NULL},
+    {"stats_deferred_flush", 2, SQLITE_DIRECTONLY, stats_deferred_flush_func, NULL, NULL, NULL, NULL},
+    {"stats_standardize", 4, SQLITE_DIRECTONLY, stats_standardize_func, NULL, NULL, NULL, NULL},
+    {"stats_standardize", 5, SQLITE_DIRECTONLY, stats_standardize_func, NULL, NULL, NULL, NULL},
+    {"stats_deferred_start", 1, SQLITE_DIRECTONLY, stats_deferred_start_func, NULL, NULL, NULL, NULL},
+    {"stats_deferred_start", 2, SQLITE_DIRECTONLY, stats_deferred_start_func, NULL, NULL, NULL, NULL},
+    {"stats_deferred_start", 3, SQLITE_DIRECTONLY, stats_deferred_start_func, NULL, NULL, NULL, NULL},
+    {"stats_deferred_stop", 1, SQLITE_DIRECTONLY, stats_deferred_stop_func, NULL, NULL, NULL, NULL},
+    {"stats_deferred_value", 3, 0, stats_deferred_value_func, NULL, NULL, NULL, NULL},
+    {"stddev_state", 1, SQLITE_DETERMINISTIC, NULL, stats_step, stddev_state_final, NULL, NULL},
+    {"stddev_merge", 1, SQLITE_DETERMINISTIC, NULL, stddev_merge_step, stddev_merge_final, NULL, NULL},
+    {"stddev_result", 1, SQLITE_DETERMINISTIC, stddev_result_func, NULL, NULL, NULL, NULL},
+    {"variance_components", 3, SQLITE_DETERMINISTIC, NULL, variance_components_step, variance_components_final, NULL, NULL},
+    {"welch_ttest", 2, SQLITE_DETERMINISTIC, NULL, welch_ttest_step, welch_ttest_final, NULL, NULL},
+    {"cuped_stats", 3, SQLITE_DETERMINISTIC, NULL, cuped_stats_step, cuped_stats_final, NULL, NULL},
+    {"ratio_metric_stats", 2, SQLITE_DETERMINISTIC, NULL, ratio_metric_step, ratio_metric_final, ratio_metric_value, ratio_metric_inverse},
+    {"sigma_clipped_stats", 3, SQLITE_DETERMINISTIC, NULL, sigma_clip_step, sigma_clip_final, NULL, NULL},
+    {"series_pack", 2, SQLITE_DETERMINISTIC, NULL, series_pack_step, series_pack_final, NULL, NULL},
+    {"chunk_stats", 1, SQLITE_DETERMINISTIC, chunk_stats_func, NULL, NULL, NULL, NULL},
+    {"chunk_range_stats", 3, SQLITE_DETERMINISTIC, chunk_range_stats_func, NULL, NULL, NULL, NULL},
+    {"chunk_merge_stats", 1, SQLITE_DETERMINISTIC, NULL, chunk_merge_step, chunk_merge_final, NULL, NULL},
+    {"semivariogram", 5, SQLITE_DETERMINISTIC, NULL, semivariogram_step, semivariogram_final, NULL, NULL},
+    {"semivariogram", 6, SQLITE_DETERMINISTIC, NULL, semivariogram_step, semivariogram_final, NULL, NULL},
+    {"kernel_rolling_variance", 3, SQLITE_DETERMINISTIC, NULL, kernel_variance_step, kernel_variance_final, kernel_variance_value,
+     kernel_variance_inverse},
+    {"incremental_pca", 2, SQLITE_DETERMINISTIC, NULL, pca_step, pca_final, NULL, NULL},
+    {"incremental_pca_state", 2, SQLITE_DETERMINISTIC, NULL, pca_step, pca_state_final, NULL, NULL},
+    {"incremental_pca_merge", 1, SQLITE_DETERMINISTIC, NULL, pca_merge_step, pca_state_final, NULL, NULL},
+    {"incremental_pca_result", 1, SQLITE_DETERMINISTIC, pca_result_func, NULL, NULL, NULL, NULL},
+    {"drift_baseline", 1, SQLITE_DETERMINISTIC, NULL, drift_baseline_step, drift_baseline_final, NULL, NULL},
+    {"drift_baseline", 2, SQLITE_DETERMINISTIC, NULL, drift_baseline_step, drift_baseline_final, NULL, NULL},
+    {"drift_score", 3, SQLITE_DETERMINISTIC, NULL, drift_step, drift_final, drift_value, drift_inverse},
+    {"multi_window_stats", 2, SQLITE_DETERMINISTIC, NULL, multi_window_step, multi_window_final, multi_window_value, multi_window_inverse},
+    {"rate_stats", 2, SQLITE_DETERMINISTIC, NULL, rate_stats_step, rate_stats_final, rate_stats_value, rate_stats_inverse},
+    {"replicate_variance", 4, SQLITE_DETERMINISTIC, NULL, replicate_step, replicate_final, NULL, NULL},
+    {"replicate_variance", 5, SQLITE_DETERMINISTIC, NULL, replicate_step, replicate_final, NULL, NULL},
+    {"fit_distribution", 2, SQLITE_DETERMINISTIC, NULL, fit_step, fit_final, NULL, NULL},
+    {"fit_distribution_state", 1, SQLITE_DETERMINISTIC, NULL, fit_step, fit_state_final, NULL, NULL},
+    {"fit_distribution_merge", 1, SQLITE_DETERMINISTIC, NULL, fit_merge_step, fit_state_final, NULL, NULL},
+    {"fit_distribution_result", 2, SQLITE_DETERMINISTIC, fit_result_func, NULL, NULL, NULL, NULL},
+    {"jarque_bera", 1, SQLITE_DETERMINISTIC, NULL, jarque_bera_step, jarque_bera_final, jarque_bera_value, jarque_bera_inverse},
+    {"anderson_darling_normal", 1, SQLITE_DETERMINISTIC, NULL, normality_step, anderson_darling_final, NULL, NULL},
+    {"shapiro_wilk", 1, SQLITE_DETERMINISTIC, NULL, normality_step, shapiro_wilk_final, NULL, NULL},
+    {"variance_changepoint", 3, SQLITE_DETERMINISTIC, NULL, changepoint_step, changepoint_final, changepoint_value, changepoint_inverse},
+};
+
+/**
+ * @struct StatsModuleDef
+ * @brief Describes a virtual table module (table-valued function) to be registered.
+ */
+typedef struct {
+    const char *name;             // Module name.
+    const sqlite3_module *module; // Module implementation.
+} StatsModuleDef;
+
+// Virtual table modules, terminated by an entry with a NULL name.
+static const StatsModuleDef stats_modules[] = {
+    {"ring_series", &ring_series_module},
+    {"session_stats", &session_stats_module},
+    {"parallel_window_stats", &parallel_window_module},
+#ifndef _WIN32
+    {"stream_stats", &stream_stats_module},
+#endif
+    {NULL, NULL},
+};
+
+/**
+ * @brief Helper function to register a unified statistical function (lowercase and uppercase).
+ * @param db The database connection.
+ * @param config The connection's StatsConfig, shared as user data.
+ * @param name The name of the function to register.
+ * @param xFinal The final function for aggregate mode.
+ * @param xValue The value function for window mode.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int register_unified_stats_function(sqlite3 *db, StatsConfig *config, const char *name, void (*xFinal)(sqlite3_context *),
+                                           void (*xValue)(sqlite3_context *)) {
+    int rc;
+    // Register the lowercase version.
+    config->ref_count++;
+    rc = sqlite3_create_window_function(db, name, 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, config, stats_step, xFinal, xValue, stats_inverse,
+                                        release_stats_config);
+    if (rc != SQLITE_OK)
+        return rc;
+
+    // Create and register the uppercase version.
+    char *upper_name = malloc(strlen(name) + 1);
+    if (!upper_name)
+        return SQLITE_NOMEM;
+    strcpy(upper_name, name);
+    for (int i = 0; upper_name[i]; i++) {
+        if (upper_name[i] >= 'a' && upper_name[i] <= 'z') {
+            upper_name[i] = upper_name[i] - 'a' + 'A';
+        }
+    }
+
+    config->ref_count++;
+    rc = sqlite3_create_window_function(db, upper_name, 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS, config, stats_step, xFinal, xValue,
+                                        stats_inverse, release_stats_config);
+    free(upper_name);
+    return rc;
+}
+
+/**
+ * @brief The main entry point for the SQLite extension.
+ *
+ * This function registers all the custom statistical functions and their aliases.
+ * It has a unique name so that it can be linked statically next to other extensions
+ * and registered with `sqlite3_auto_extension()`. SQLite also finds it automatically
+ * when the library file is named `stddev.so` / `stddev.dll`.
+ *
+ * @param db The database connection.
+ * @param pzErrMsg A pointer to an error message string.
+ * @param pApi A pointer to the SQLite API routines.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+STDDEV_API int sqlite3_stddev_init(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi) {
+    int rc = SQLITE_OK;
+    SQLITE_EXTENSION_INIT2(pApi);
+
+    // The configuration is shared by all registrations; this function holds one reference
+    // to it until registration is complete.
+    StatsConfig *config = (StatsConfig *)calloc(1, sizeof(StatsConfig));
+    if (!config)
+        return SQLITE_NOMEM;
+    config->ingest_mode = DEFAULT_INGEST_MODE;
+    config->ref_count = 1;
+
+    // Define the names and aliases for each statistical function.
+    const char *stddev_samp_names[] = {"stddev_samp", "stddev_sample", "stdev_samp", "stdev_sample", "stddev", "stdev", "std_dev", "standard_deviation"};
+    const char *stddev_pop_names[] = {"stddev_pop", "stddev_population", "stdev_pop", "stdev_population"};
+    const char *variance_samp_names[] = {"variance_samp", "variance_sample", "var_samp", "var_sample", "variance", "var"};
+    const char *variance_pop_names[] = {"variance_pop", "variance_population", "var_pop", "var_population"};
+
+    // Define the groups of functions to be registered.
+    StatsFunctionGroup functions_to_register[] = {
+        {stddev_samp_names, sizeof(stddev_samp_names) / sizeof(stddev_samp_names[0]), stddev_samp_value, stddev_samp_final},
+        {stddev_pop_names, sizeof(stddev_pop_names) / sizeof(stddev_pop_names[0]), stddev_pop_value, stddev_pop_final},
+        {variance_samp_names, sizeof(variance_samp_names) / sizeof(variance_samp_names[0]), variance_samp_value, variance_samp_final},
+        {variance_pop_names, sizeof(variance_pop_names) / sizeof(variance_pop_names[0]), variance_pop_value, variance_pop_final}};
+
+    // Iterate through the groups and register each function and its aliases.
+    int num_groups = sizeof(functions_to_register) / sizeof(functions_to_register[0]);
+    for (int i = 0; i < num_groups; i++) {
+        StatsFunctionGroup *group = &functions_to_register[i];
+        for (int j = 0; j < group->name_count; j++) {
+            rc = register_unified_stats_function(db, config, group->names[j], group->xFinal, group->xValue);
+            if (rc != SQLITE_OK)
+                goto done;
+        }
+    }
+
+    // Register the remaining functions.
+    for (size_t i = 0; i < sizeof(additional_functions) / sizeof(additional_functions[0]); i++) {
+        rc = register_function_def(db, config, &additional_functions[i]);
+        if (rc != SQLITE_OK)
+            goto done;
+    }
+
+    // Register the virtual table modules, which also receive the configuration.
+    for (const StatsModuleDef *def = stats_modules; def->name; def++) {
+        config->ref_count++;
+        rc = sqlite3_create_module_v2(db, def->name, def->module, config, release_stats_config);
+        if (rc != SQLITE_OK)
+            goto done;
+    }
+
+done:
+    release_stats_config(config);
+    return rc;
+}
+
+#ifndef SQLITE_CORE
+/**
+ * @brief The generic entry point used by `.load` when no entry point name is given.
+ *
+ * Only built for the loadable extension; a statically linked build (compiled with
+ * `SQLITE_CORE`) exposes just `sqlite3_stddev_init` to avoid symbol clashes.
+ *
+ * @param db The database connection.
+ * @param pzErrMsg A pointer to an error message string.
+ * @param pApi A pointer to the SQLite API routines.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+STDDEV_API int sqlite3_extension_init(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi) {
+    return sqlite3_stddev_init(db, pzErrMsg, pApi);
 }
+#endif
@@ -0,0 +1,165 @@
+/**
+ * @file stddev-accumulator.c
+ * @brief Implementation of the embeddable mean/variance accumulator (see stddev-accumulator.h).
+ */
+#include "stddev-accumulator.h"
+
+#include <math.h>
+#include <string.h>
+
+// The magic bytes at the start of a serialized accumulator.
+#define ACCUMULATOR_MAGIC "SDA1"
+
+/**
+ * @brief Writes a 64-bit word in little-endian byte order.
+ * @param out The destination (8 bytes).
+ * @param bits The word.
+ */
+static void write_le64(unsigned char *out, uint64_t bits) {
+    for (int i = 0; i < 8; i++)
+        out[i] = (unsigned char)(bits >> (8 * i));
+}
+
+/**
+ * @brief Reads a 64-bit word in little-endian byte order.
+ * @param in The source (8 bytes).
+ * @return The word.
+ */
+static uint64_t read_le64(const unsigned char *in) {
+    uint64_t bits = 0;
+    for (int i = 7; i >= 0; i--)
+        bits = (bits << 8) | in[i];
+    return bits;
+}
+
+void stddev_accumulator_init(stddev_accumulator *acc) {
+    acc->n = 0;
+    acc->mean = 0.0;
+    acc->m2 = 0.0;
+}
+
+void stddev_accumulator_add(stddev_accumulator *acc, double x) {
+    acc->n++;
+    double delta = x - acc->mean;
+    acc->mean += delta / acc->n;
+    acc->m2 += delta * (x - acc->mean);
+}
+
+void stddev_accumulator_remove(stddev_accumulator *acc, double x) {
+    if (acc->n <= 1) {
+        stddev_accumulator_init(acc);
+        return;
+    }
+    double old_mean = acc->mean;
+    acc->n--;
+    acc->mean = (old_mean * (acc->n + 1) - x) / acc->n;
+    acc->m2 -= (x - old_mean) * (x - acc->mean);
+    if (acc->m2 < 0.0)
+        acc->m2 = 0.0; // Guard against rounding below zero.
+}
+
+void stddev_accumulator_add_batch(stddev_accumulator *acc, const double *values, size_t count) {
+    if (count == 0)
+        return;
+
+    // Four independent partial sums keep several additions in flight without
+    // reassociating a single floating-point sum.
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        s0 += values[i];
+        s1 += values[i + 1];
+        s2 += values[i + 2];
+        s3 += values[i + 3];
+    }
+    for (; i < count; i++)
+        s0 += values[i];
+    double mean = ((s0 + s1) + (s2 + s3)) / count;
+
+    // Corrected two-pass M2: the sum of the deviations removes the rounding error of the mean.
+    double q0 = 0.0, q1 = 0.0, q2 = 0.0, q3 = 0.0, deviation = 0.0;
+    for (i = 0; i + 4 <= count; i += 4) {
+        double d0 = values[i] - mean, d1 = values[i + 1] - mean, d2 = values[i + 2] - mean, d3 = values[i + 3] - mean;
+        q0 += d0 * d0;
+        q1 += d1 * d1;
+        q2 += d2 * d2;
+        q3 += d3 * d3;
+        deviation += (d0 + d1) + (d2 + d3);
+    }
+    for (; i < count; i++) {
+        double d = values[i] - mean;
+        q0 += d * d;
+        deviation += d;
+    }
+    double m2 = ((q0 + q1) + (q2 + q3)) - deviation * deviation / count;
+
+    stddev_accumulator batch = {(int64_t)count, mean, m2 > 0.0 ? m2 : 0.0};
+    stddev_accumulator_merge(acc, &batch);
+}
+
+void stddev_accumulator_merge(stddev_accumulator *into, const stddev_accumulator *other) {
+    stddev_accumulator part = *other; // `other` may alias `into`.
+    if (part.n == 0)
+        return;
+    if (into->n == 0) {
+        *into = part;
+        return;
+    }
+    int64_t n = into->n + part.n;
+    double delta = part.mean - into->mean;
+    into->mean += delta * part.n / n;
+    into->m2 += part.m2 + delta * delta * ((double)into->n * part.n / n);
+    into->n = n;
+}
+
+void stddev_accumulator_subtract(stddev_accumulator *from, const stddev_accumulator *part) {
+    if (part->n == 0)
+        return;
+    int64_t n = from->n - part->n;
+    if (n <= 0) {
+        stddev_accumulator_init(from);
+        return;
+    }
+    double mean = (from->mean * from->n - part->mean * part->n) / n;
+    double delta = part->mean - mean;
+    double m2 = from->m2 - part->m2 - delta * delta * ((double)n * part->n / from->n);
+    from->n = n;
+    from->mean = mean;
+    from->m2 = m2 > 0.0 ? m2 : 0.0; // Guard against rounding below zero.
+}
+
+size_t stddev_accumulator_serialize(const stddev_accumulator *acc, unsigned char *out) {
+    uint64_t bits;
+    memcpy(out, ACCUMULATOR_MAGIC, 4);
+    write_le64(out + 4, (uint64_t)acc->n);
+    memcpy(&bits, &acc->mean, sizeof(bits));
+    write_le64(out + 12, bits);
+    memcpy(&bits, &acc->m2, sizeof(bits));
+    write_le64(out + 20, bits);
+    return STDDEV_ACCUMULATOR_SERIALIZED_SIZE;
+}
+
+int stddev_accumulator_deserialize(stddev_accumulator *acc, const unsigned char *in, size_t size) {
+    if (!in || size != STDDEV_ACCUMULATOR_SERIALIZED_SIZE || memcmp(in, ACCUMULATOR_MAGIC, 4) != 0)
+        return -1;
+    stddev_accumulator value;
+    uint64_t bits;
+    value.n = (int64_t)read_le64(in + 4);
+    bits = read_le64(in + 12);
+    memcpy(&value.mean, &bits, sizeof(bits));
+    bits = read_le64(in + 20);
+    memcpy(&value.m2, &bits, sizeof(bits));
+    if (value.n < 0)
+        return -1;
+    *acc = value;
+    return 0;
+}
+
+void stddev_accumulator_finalize(const stddev_accumulator *acc, stddev_accumulator_result *out) {
+    out->n = acc->n;
+    out->mean = acc->n >= 1 ? acc->mean : NAN;
+    out->variance_population = acc->n >= 1 ? acc->m2 / acc->n : NAN;
+    out->variance_sample = acc->n >= 2 ? acc->m2 / (acc->n - 1) : NAN;
+    out->stddev_population = sqrt(out->variance_population);
+    out->stddev_sample = sqrt(out->variance_sample);
+}
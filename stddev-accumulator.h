@@ -0,0 +1,146 @@
+/**
+ * @file stddev-accumulator.h
+ * @brief Embeddable, allocation-free accumulator for mean, variance and standard deviation.
+ *
+ * This is the accumulation code behind the SQL functions of the extension. Host
+ * applications can link it directly (it is part of `libsqlite-stddev.a`) to compute
+ * statistics in-process that are bit-for-bit identical to what the SQL functions return
+ * for the same values in the same order.
+ *
+ * The accumulator keeps the count, mean and sum of squared deviations (M2) of the
+ * values, updated with Welford's algorithm. Accumulators can be merged (Chan et al.),
+ * which makes them suitable for per-thread or per-shard partial results, and serialized
+ * into a fixed-size little-endian record that the SQL functions `stddev_merge()` and
+ * `stddev_result()` accept.
+ *
+ * ABI: the layout of stddev_accumulator and the serialized format are stable. Changes
+ * that break either will come with a new STDDEV_ACCUMULATOR_ABI_VERSION.
+ */
+#ifndef STDDEV_ACCUMULATOR_H
+#define STDDEV_ACCUMULATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Version of the accumulator layout and of the serialized format.
+#define STDDEV_ACCUMULATOR_ABI_VERSION 1
+// Size of a serialized accumulator in bytes.
+#define STDDEV_ACCUMULATOR_SERIALIZED_SIZE 28
+
+/**
+ * @struct stddev_accumulator
+ * @brief Count, mean and sum of squared deviations of a set of values.
+ *
+ * The storage belongs to the caller (on the stack, inside another structure, ...); no
+ * function of this API allocates memory.
+ */
+typedef struct stddev_accumulator {
+    int64_t n;   // Number of values.
+    double mean; // Mean of the values.
+    double m2;   // Sum of squared deviations from the mean.
+} stddev_accumulator;
+
+/**
+ * @struct stddev_accumulator_result
+ * @brief The statistics of an accumulator. Undefined statistics are NaN.
+ */
+typedef struct stddev_accumulator_result {
+    int64_t n;                  // Number of values.
+    double mean;                // Mean (NaN without values).
+    double variance_sample;     // Sample variance, n - 1 in the denominator (NaN for n < 2).
+    double variance_population; // Population variance, n in the denominator (NaN for n < 1).
+    double stddev_sample;       // Square root of the sample variance.
+    double stddev_population;   // Square root of the population variance.
+} stddev_accumulator_result;
+
+/**
+ * @brief Resets an accumulator to the empty state.
+ * @param acc The accumulator.
+ */
+void stddev_accumulator_init(stddev_accumulator *acc);
+
+/**
+ * @brief Adds a value.
+ * @param acc The accumulator.
+ * @param x The value.
+ */
+void stddev_accumulator_add(stddev_accumulator *acc, double x);
+
+/**
+ * @brief Removes a value that was added before (the inverse of stddev_accumulator_add()).
+ *
+ * Removing the last value resets the accumulator.
+ *
+ * Removal is not exact: each call leaves rounding error in the mean and M2, and later
+ * additions do not wash it out. After a value much larger than the others has been
+ * removed, the variance can be wrong by orders of magnitude. A caller that slides a
+ * window must keep the window's values and recompute the accumulator from them
+ * periodically, e.g. after as many removals as the window holds (O(1) amortized).
+ * @param acc The accumulator.
+ * @param x The value to remove.
+ */
+void stddev_accumulator_remove(stddev_accumulator *acc, double x);
+
+/**
+ * @brief Adds a batch of values.
+ *
+ * The batch is reduced with a two-pass mean and M2 and then merged, which is both more
+ * accurate and faster than adding the values one by one. The result can therefore
+ * differ in the last bits from adding the same values individually.
+ * @param acc The accumulator.
+ * @param values The values.
+ * @param count The number of values.
+ */
+void stddev_accumulator_add_batch(stddev_accumulator *acc, const double *values, size_t count);
+
+/**
+ * @brief Merges the values of another accumulator into an accumulator.
+ * @param into The accumulator to update.
+ * @param other The accumulator to merge in (may be the same as `into`).
+ */
+void stddev_accumulator_merge(stddev_accumulator *into, const stddev_accumulator *other);
+
+/**
+ * @brief Removes the values of a merged accumulator (the inverse of stddev_accumulator_merge()).
+ *
+ * Removing everything resets the accumulator.
+ * @param from The accumulator to update.
+ * @param part The accumulator of the values to remove.
+ */
+void stddev_accumulator_subtract(stddev_accumulator *from, const stddev_accumulator *part);
+
+/**
+ * @brief Writes an accumulator in the portable serialized format.
+ *
+ * Format (little-endian): the magic bytes "SDA1", n (int64), mean (float64), M2 (float64).
+ * @param acc The accumulator.
+ * @param out Receives STDDEV_ACCUMULATOR_SERIALIZED_SIZE bytes.
+ * @return STDDEV_ACCUMULATOR_SERIALIZED_SIZE.
+ */
+size_t stddev_accumulator_serialize(const stddev_accumulator *acc, unsigned char *out);
+
+/**
+ * @brief Reads an accumulator written by stddev_accumulator_serialize().
+ * @param acc Receives the accumulator.
+ * @param in The serialized bytes.
+ * @param size The number of bytes.
+ * @return 0 on success, -1 if the bytes are not a valid serialized accumulator.
+ */
+int stddev_accumulator_deserialize(stddev_accumulator *acc, const unsigned char *in, size_t size);
+
+/**
+ * @brief Computes the statistics of an accumulator.
+ * @param acc The accumulator.
+ * @param out Receives the statistics.
+ */
+void stddev_accumulator_finalize(const stddev_accumulator *acc, stddev_accumulator_result *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STDDEV_ACCUMULATOR_H
@@ -0,0 +1 @@
+SELECT snapshot, key, n, mean, variance FROM stream_stats('/tmp/h/f.fifo', '<key:u32,value:f64', 'key', 'value', 1000);
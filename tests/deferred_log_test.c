@@ -0,0 +1,110 @@
+/**
+ * @file deferred_log_test.c
+ * @brief Regression test for deferred delta-log maintenance.
+ *
+ * Drains a summary table to empty, leaves new changes pending in its delta log and runs
+ * `stats_deferred_create()` again. The pending rows must be applied as deltas once,
+ * not counted a second time by seeding from the source table.
+ *
+ * Usage: deferred_log_test
+ *
+ * Exits with status 0 when every check passes and 1 otherwise.
+ */
+#include <math.h>
+#include <sqlite3.h>
+#include <stdio.h>
+
+// Entry point of the statically linked extension.
+int sqlite3_stddev_init(sqlite3 *db, char **pzErrMsg, const struct sqlite3_api_routines *pApi);
+
+/**
+ * @brief Runs SQL statements, reporting any error.
+ * @param db The database connection.
+ * @param sql The statements.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int exec_sql(sqlite3 *db, const char *sql) {
+    char *err = NULL;
+    int rc = sqlite3_exec(db, sql, NULL, NULL, &err);
+    if (rc != SQLITE_OK)
+        fprintf(stderr, "%s\n  failed: %s\n", sql, err ? err : sqlite3_errmsg(db));
+    sqlite3_free(err);
+    return rc;
+}
+
+/**
+ * @brief Runs a query that returns a single number.
+ * @param db The database connection.
+ * @param sql The query.
+ * @param value Receives the number (NaN for NULL).
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int query_double(sqlite3 *db, const char *sql, double *value) {
+    sqlite3_stmt *stmt = NULL;
+    int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if (rc == SQLITE_OK && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        *value = sqlite3_column_type(stmt, 0) == SQLITE_NULL ? NAN : sqlite3_column_double(stmt, 0);
+        rc = SQLITE_OK;
+    } else if (rc == SQLITE_DONE) {
+        rc = SQLITE_ERROR;
+    }
+    if (rc != SQLITE_OK)
+        fprintf(stderr, "%s\n  failed: %s\n", sql, sqlite3_errmsg(db));
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+/**
+ * @brief Checks that a query returns the expected number.
+ * @param db The database connection.
+ * @param sql The query.
+ * @param expected The expected number.
+ * @return 1 if the check passes, 0 otherwise.
+ */
+static int expect_double(sqlite3 *db, const char *sql, double expected) {
+    double value;
+    if (query_double(db, sql, &value) != SQLITE_OK)
+        return 0;
+    if (!(fabs(value - expected) <= 1e-9 * (1.0 + fabs(expected)))) {
+        fprintf(stderr, "%s\n  returned %.17g, expected %.17g\n", sql, value, expected);
+        return 0;
+    }
+    return 1;
+}
+
+int main(void) {
+    sqlite3_auto_extension((void (*)(void))sqlite3_stddev_init);
+    sqlite3 *db;
+    if (sqlite3_open(":memory:", &db) != SQLITE_OK) {
+        fprintf(stderr, "cannot open database: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    int ok = exec_sql(db, "CREATE TABLE prices(sym, price);"
+                          "SELECT stats_deferred_create('price_summary', 'prices', 'price', 'sym');"
+                          "INSERT INTO prices VALUES ('a', 1), ('a', 3);"
+                          "SELECT stats_deferred_flush('price_summary');"
+                          "DELETE FROM prices;"
+                          "SELECT stats_deferred_flush('price_summary');") == SQLITE_OK;
+    ok = ok && expect_double(db, "SELECT count(*) FROM price_summary", 0);
+
+    // New changes are pending when the summary is set up again.
+    ok = ok && exec_sql(db, "INSERT INTO prices VALUES ('a', 10), ('a', 20);") == SQLITE_OK;
+    ok = ok && expect_double(db, "SELECT stats_deferred_create('price_summary', 'prices', 'price', 'sym')", 0);
+    ok = ok && expect_double(db, "SELECT count(*) FROM price_summary_log", 0);
+    ok = ok && expect_double(db, "SELECT n FROM price_summary WHERE group_key = 'a'", 2);
+    ok = ok && expect_double(db, "SELECT mean FROM price_summary WHERE group_key = 'a'", 15);
+    ok = ok && expect_double(db, "SELECT m2 FROM price_summary WHERE group_key = 'a'", 50);
+
+    // Later changes still go through the log exactly once.
+    ok = ok && exec_sql(db, "INSERT INTO prices VALUES ('a', 30);") == SQLITE_OK;
+    ok = ok && expect_double(db, "SELECT stats_deferred_value('price_summary', 'a', 'n')", 3);
+    ok = ok && expect_double(db, "SELECT stats_deferred_flush('price_summary')", 1);
+    ok = ok && expect_double(db, "SELECT n FROM price_summary WHERE group_key = 'a'", 3);
+    ok = ok && expect_double(db, "SELECT stddev_samp(price) FROM prices", 10);
+    ok = ok && expect_double(db, "SELECT stats_deferred_value('price_summary', 'a', 'stddev_samp')", 10);
+
+    sqlite3_close(db);
+    printf("deferred_log_test: %s\n", ok ? "passed" : "FAILED");
+    return ok ? 0 : 1;
+}
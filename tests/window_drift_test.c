@@ -0,0 +1,120 @@
+/**
+ * @file window_drift_test.c
+ * @brief Regression test for rounding drift in sliding window frames.
+ *
+ * Slides small frames over a series of small values with a few huge spikes. Every
+ * window result must match the same function run as a plain aggregate over the rows
+ * of the frame, also right after a spike has left the frame.
+ *
+ * Usage: window_drift_test
+ *
+ * Exits with status 0 when every check passes and 1 otherwise.
+ */
+#include <math.h>
+#include <sqlite3.h>
+#include <stdio.h>
+
+// Entry point of the statically linked extension.
+int sqlite3_stddev_init(sqlite3 *db, char **pzErrMsg, const struct sqlite3_api_routines *pApi);
+
+// Largest accepted relative difference between a window result and its aggregate.
+#define MAX_RELATIVE_ERROR 1e-8
+
+/**
+ * @brief Runs SQL statements, reporting any error.
+ * @param db The database connection.
+ * @param sql The statements.
+ * @return SQLITE_OK on success, or an error code on failure.
+ */
+static int exec_sql(sqlite3 *db, const char *sql) {
+    char *err = NULL;
+    int rc = sqlite3_exec(db, sql, NULL, NULL, &err);
+    if (rc != SQLITE_OK)
+        fprintf(stderr, "%s\n  failed: %s\n", sql, err ? err : sqlite3_errmsg(db));
+    sqlite3_free(err);
+    return rc;
+}
+
+/**
+ * @brief Checks that the two columns of a query agree on every row.
+ *
+ * Rows where both columns are NULL agree; a NULL on one side only does not.
+ * @param db The database connection.
+ * @param sql A query returning the window result and the reference result of each row.
+ * @return 1 if the check passes, 0 otherwise.
+ */
+static int expect_same_columns(sqlite3 *db, const char *sql) {
+    sqlite3_stmt *stmt = NULL;
+    int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    int ok = rc == SQLITE_OK, rows = 0;
+    while (ok && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        rows++;
+        int null_a = sqlite3_column_type(stmt, 0) == SQLITE_NULL, null_b = sqlite3_column_type(stmt, 1) == SQLITE_NULL;
+        double a = sqlite3_column_double(stmt, 0), b = sqlite3_column_double(stmt, 1);
+        if (null_a != null_b || (!null_a && !(fabs(a - b) <= MAX_RELATIVE_ERROR * fabs(b) + 1e-300))) {
+            fprintf(stderr, "%s\n  row %d: window %.17g, aggregate %.17g\n", sql, rows, a, b);
+            ok = 0;
+        }
+    }
+    if (ok && rc != SQLITE_DONE) {
+        fprintf(stderr, "%s\n  failed: %s\n", sql, sqlite3_errmsg(db));
+        ok = 0;
+    }
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+int main(void) {
+    sqlite3_auto_extension((void (*)(void))sqlite3_stddev_init);
+    sqlite3 *db;
+    if (sqlite3_open(":memory:", &db) != SQLITE_OK) {
+        fprintf(stderr, "cannot open database: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    // Small values cycling through 0..6 thousandths, with spikes at rows 10 and 1500.
+    int ok = exec_sql(db, "CREATE TABLE t(i INTEGER PRIMARY KEY, v REAL);"
+                          "WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM s WHERE i < 3000) "
+                          "INSERT INTO t SELECT i, CASE i WHEN 10 THEN 1e9 WHEN 1500 THEN -3e12 ELSE (i % 7) * 0.001 END FROM s;") ==
+             SQLITE_OK;
+
+    ok = expect_same_columns(db, "SELECT stddev(v) OVER (ORDER BY i ROWS 4 PRECEDING), "
+                                 "(SELECT stddev(v) FROM t AS f WHERE f.i BETWEEN t.i - 4 AND t.i) FROM t") &&
+         ok;
+    ok = expect_same_columns(db, "SELECT variance_pop(v) OVER (ORDER BY i ROWS BETWEEN 3 PRECEDING AND 5 FOLLOWING), "
+                                 "(SELECT variance_pop(v) FROM t AS f WHERE f.i BETWEEN t.i - 3 AND t.i + 5) FROM t") &&
+         ok;
+    ok = expect_same_columns(db, "SELECT json_extract(jarque_bera(v) OVER (ORDER BY i ROWS 19 PRECEDING), '$.statistic'), "
+                                 "(SELECT json_extract(jarque_bera(v), '$.statistic') FROM t AS f WHERE f.i BETWEEN t.i - 19 AND t.i) "
+                                 "FROM t") &&
+         ok;
+    ok = exec_sql(db, "CREATE TABLE baseline AS SELECT drift_baseline(v) AS state FROM t WHERE i > 2000;") == SQLITE_OK && ok;
+    ok = expect_same_columns(db, "SELECT drift_score(v, (SELECT state FROM baseline), 'var_ratio') OVER (ORDER BY i ROWS 9 PRECEDING), "
+                                 "(SELECT drift_score(v, (SELECT state FROM baseline), 'var_ratio') FROM t AS f "
+                                 "WHERE f.i BETWEEN t.i - 9 AND t.i) FROM t") &&
+         ok;
+    ok = expect_same_columns(db, "SELECT json_extract(multi_window_stats(v, '10,25') OVER (ORDER BY i), '$.\"10\".variance'), "
+                                 "(SELECT variance(v) FROM t AS f WHERE f.i BETWEEN t.i - 9 AND t.i) FROM t") &&
+         ok;
+    ok = expect_same_columns(db, "SELECT json_extract(multi_window_stats(v, '10,25') OVER (ORDER BY i), '$.\"25\".variance'), "
+                                 "(SELECT variance(v) FROM t AS f WHERE f.i BETWEEN t.i - 24 AND t.i) FROM t") &&
+         ok;
+    ok = exec_sql(db, "CREATE TABLE parts AS SELECT i % 2 AS part, i, v FROM t;") == SQLITE_OK && ok;
+    ok = expect_same_columns(db, "SELECT variance, (SELECT variance(v) FROM parts AS f WHERE f.part = p.part AND f.i BETWEEN p.ord - 18 AND p.ord) "
+                                 "FROM parallel_window_stats('parts', 'part', 'i', 'v', 10) AS p") &&
+         ok;
+
+    // A counter rising by 1, 2 and 3 per row, with one jump of 1e12 early on.
+    ok = exec_sql(db, "CREATE TABLE counters AS SELECT i AS ts, (i / 3) * 6 + (i % 3) * ((i % 3) + 1) / 2 + (i >= 40) * 1e12 AS c "
+                      "FROM t;") == SQLITE_OK &&
+         ok;
+    ok = expect_same_columns(db, "SELECT json_extract(rate_stats(c, ts) OVER (ORDER BY ts ROWS 9 PRECEDING), '$.variance'), "
+                                 "(SELECT json_extract(rate_stats(c, ts), '$.variance') FROM "
+                                 "(SELECT c, ts FROM counters AS f WHERE f.ts BETWEEN counters.ts - 9 AND counters.ts ORDER BY ts)) "
+                                 "FROM counters") &&
+         ok;
+
+    sqlite3_close(db);
+    printf("window_drift_test: %s\n", ok ? "passed" : "FAILED");
+    return ok ? 0 : 1;
+}